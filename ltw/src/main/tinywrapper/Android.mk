@@ -7,6 +7,10 @@ LOCAL_SRC_FILES := glsl_optimizer/src/code/ir_print_glsl_visitor.cpp \
    glsl_optimizer/src/code/c_wrapper.cpp \
    glsl_optimizer/src/code/GlslConvert.cpp \
    glsl_optimizer/src/code/ir_print_ir_visitor.cpp \
+   glsl_optimizer/src/code/precision_demotion.cpp \
+   glsl_optimizer/src/code/varying_pruning.cpp \
+   glsl_optimizer/src/code/uniform_specialization.cpp \
+   glsl_optimizer/src/code/preprocessor_cache.cpp \
    glsl_optimizer/src/util/compat_layer.cpp \
    glsl_optimizer/src/util/u_qsort.cpp \
    glsl_optimizer/src/util/u_debug_stack_android.cpp \
@@ -379,9 +383,11 @@ LOCAL_CFLAGS += -D__STDC_CONSTANT_MACROS
 LOCAL_CFLAGS += -DUTIL_ARCH_LITTLE_ENDIAN
 LOCAL_CFLAGS += -DUNIX
 LOCAL_CFLAGS += -DANDROID -DHAVE_STRUCT_TIMESPEC -DDETECT_OS_ANDROID
+LOCAL_CFLAGS += -DHAVE_DL_ITERATE_PHDR
 LOCAL_CFLAGS += -DHAVE_OPENGL
 LOCAL_CFLAGS += -DHAVE_OPENGL_ES_1
 LOCAL_CFLAGS += -DHAVE_OPENGL_ES_2
+LOCAL_CFLAGS += -DHAVE_COMPRESSION -DHAVE_ZLIB
 LOCAL_CFLAGS += -fvisibility=hidden
 LOCAL_LDFLAGS := -ffunction-sections -fdata-sections
 include $(BUILD_STATIC_LIBRARY)
@@ -395,22 +401,35 @@ LOCAL_SRC_FILES := \
     glformats.c \
     basevertex.c \
     shader_wrapper.c \
+    shader_disk_cache.c \
+    shader_translation.c \
+    shader_cache.c \
+    shader_normalize.c \
+    shader_stats.c \
+    program_state.c \
+    program_specialization.c \
     string_utils.c \
     framebuffer.c \
     of_buffer_copier.c \
     stubs.c \
     multidraw.c \
+    stream_ring.c \
+    scratch.c \
+    state_shadow.c \
     vertexattrib.c \
     swizzle.c \
     license_notice.c \
     env.c \
     mempool.c \
     vgpu_shaderconv/shaderconv.c \
+    vgpu_shaderconv/shadertokens.c \
     unordered_map/unordered_map.c \
     unordered_map/int_hash.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/glsl_optimizer/include
+LOCAL_CFLAGS := -DHAVE_DL_ITERATE_PHDR -DHAVE_COMPRESSION
 LOCAL_STATIC_LIBRARIES := glsl_optimizer
 LOCAL_LDFLAGS := -ffunction-sections -fdata-sections -Wl,--version-script=$(LOCAL_PATH)/version.script
 # Comment for debugging
 LOCAL_LDFLAGS += -flto -Wl,--gc-sections
-LOCAL_LDLIBS := -llog -lEGL
+LOCAL_LDLIBS := -llog -lEGL -lz
 include $(BUILD_SHARED_LIBRARY)
@@ -7,16 +7,11 @@
 #include "proc.h"
 #include "egl.h"
 #include "main.h"
+#include "state_shadow.h"
+#include "basevertex.h"
+#include "env.h"
 #include "debug.h"
 
-typedef struct {
-    GLuint count;
-    GLuint instanceCount;
-    GLuint firstIndex;
-    GLint baseVertex;
-    GLuint reservedMustBeZero;
-} indirect_pass_t;
-
 void basevertex_init(context_t* context) {
     basevertex_renderer_t *renderer = &context->basevertex;
     if(context->drawelementsbasevertex != NULL) {
@@ -27,9 +22,12 @@ void basevertex_init(context_t* context) {
         LTW_ERROR_PRINTF("LTW: BaseVertex render calls not available: requires OpenGL ES 3.1");
         return;
     }
-    es3_functions.glGenBuffers(1, &renderer->indirectRenderBuffer);
+    // 每次绘制的命令从环形缓冲区里分配，不再每次 glBufferData 重新分配整个缓冲区
+    bool persistent = context->buffer_storage && env_istrue_d("LTW_PERSISTENT_STREAMING", true);
+    bool created = stream_ring_init(&renderer->command_ring, BASEVERTEX_RING_SIZE, BASEVERTEX_RING_MAX_SIZE, persistent);
+    es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
     GLenum error = es3_functions.glGetError();
-    if(error != GL_NO_ERROR) {
+    if(!created || error != GL_NO_ERROR) {
         LTW_ERROR_PRINTF("LTW: Failed to initialize indirect buffers: %x", error);
         return;
     }
@@ -46,6 +44,7 @@ GLint type_bytes(GLenum type) {
 }
 
 static void restore_state(GLuint element_buffer) {
+    es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, current_context->bound_buffers[get_buffer_index(GL_COPY_WRITE_BUFFER)]);
     es3_functions.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, current_context->bound_buffers[get_buffer_index(GL_DRAW_INDIRECT_BUFFER)]);
 }
 
@@ -57,8 +56,7 @@ void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const voi
     }
     basevertex_renderer_t *renderer = &current_context->basevertex;
     if(!renderer->ready) return;
-    GLint elementbuffer;
-    es3_functions.glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementbuffer);
+    GLuint elementbuffer = shadow_get_element_buffer();
     if(elementbuffer == 0) {
         // I am not bothered enough to implement this.
         LTW_ERROR_PRINTF("LTW: Base vertex draws without element buffer are not supported");
@@ -80,9 +78,15 @@ void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const voi
     indirect_pass.baseVertex = basevertex;
     indirect_pass.instanceCount = 1;
     indirect_pass.reservedMustBeZero = 0;
-    es3_functions.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirectRenderBuffer);
-    es3_functions.glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(indirect_pass_t), &indirect_pass, GL_STREAM_DRAW);
-    es3_functions.glDrawElementsIndirect(mode, type, 0);
+    stream_ring_t* ring = &renderer->command_ring;
+    GLintptr command_offset = stream_ring_alloc(ring, sizeof(indirect_pass_t), sizeof(GLuint));
+    if(command_offset < 0) {
+        restore_state(elementbuffer);
+        return;
+    }
+    stream_ring_write(ring, command_offset, &indirect_pass, sizeof(indirect_pass_t));
+    es3_functions.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer);
+    es3_functions.glDrawElementsIndirect(mode, type, (const void*)command_offset);
     restore_state(elementbuffer);
 }
 
@@ -108,8 +112,7 @@ void glMultiDrawElementsBaseVertex(GLenum mode,
     }
     basevertex_renderer_t *renderer = &current_context->basevertex;
     if(!renderer->ready) return;
-    GLint elementbuffer;
-    es3_functions.glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementbuffer);
+    GLuint elementbuffer = shadow_get_element_buffer();
     if(elementbuffer == 0) {
         // I am not bothered enough to implement this.
         LTW_ERROR_PRINTF("LTW: Base vertex draws without element buffer are not supported");
@@ -120,8 +123,7 @@ void glMultiDrawElementsBaseVertex(GLenum mode,
         LTW_ERROR_PRINTF("LTW: unsupported type for multi base vertex draw");
         return;
     }
-    // 检查 drawcount 大小，防止栈溢出和负数
-    if(drawcount <= 0 || drawcount > 10000) {
+    if(drawcount <= 0) {
         LTW_ERROR_PRINTF("LTW: invalid drawcount: %d", drawcount);
         return;
     }
@@ -130,39 +132,48 @@ void glMultiDrawElementsBaseVertex(GLenum mode,
         LTW_ERROR_PRINTF("LTW: drawcount overflow: %d", drawcount);
         return;
     }
-    size_t alloc_size = sizeof(indirect_pass_t) * drawcount;
-    indirect_pass_t* indirect_passes = malloc(alloc_size);
-    if(!indirect_passes) {
-        LTW_ERROR_PRINTF("LTW: Failed to allocate memory for indirect passes");
-        return;
-    }
+    // 先检查所有子绘制，出错时还没有占用环形缓冲区
     for(GLsizei i = 0; i < drawcount; i++) {
         // 添加对单个 indices 数组的检查
         if(!indices[i]) {
             LTW_ERROR_PRINTF("LTW: NULL indices pointer at draw %i", i);
-            free(indirect_passes);
             return;
         }
-        uintptr_t indicesPointer = (uintptr_t)indices[i];
-        if(indicesPointer % typeBytes != 0) {
+        if((uintptr_t)indices[i] % typeBytes != 0) {
             LTW_ERROR_PRINTF("LTW: misaligned base vertex draw not supported (draw %i)", i);
-            free(indirect_passes);
             return;
         }
-        indirect_pass_t* pass = &indirect_passes[i];
+    }
+    // 命令在栈上攒成一批再写入环形缓冲区，各绘制用其中的偏移
+    stream_ring_t* ring = &renderer->command_ring;
+    GLintptr command_offset = stream_ring_alloc(ring, (GLsizeiptr)drawcount * sizeof(indirect_pass_t), sizeof(GLuint));
+    if(command_offset < 0) {
+        restore_state(elementbuffer);
+        return;
+    }
+    indirect_pass_t batch[MULTIDRAW_COMMAND_BATCH];
+    GLsizei batched = 0, written = 0;
+    for(GLsizei i = 0; i < drawcount; i++) {
+        indirect_pass_t* pass = &batch[batched++];
         pass->count = count[i];
-        pass->firstIndex = indicesPointer / typeBytes;
+        pass->firstIndex = (uintptr_t)indices[i] / typeBytes;
         pass->baseVertex = basevertex[i];
         pass->instanceCount = 1;
         pass->reservedMustBeZero = 0;
+        if(batched == MULTIDRAW_COMMAND_BATCH) {
+            stream_ring_write(ring, command_offset + written * sizeof(indirect_pass_t), batch, sizeof(batch));
+            written += batched;
+            batched = 0;
+        }
+    }
+    if(batched > 0) {
+        stream_ring_write(ring, command_offset + written * sizeof(indirect_pass_t), batch, batched * sizeof(indirect_pass_t));
     }
-    es3_functions.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->indirectRenderBuffer);
-    es3_functions.glBufferData(GL_DRAW_INDIRECT_BUFFER, alloc_size, indirect_passes, GL_STREAM_DRAW);
+    es3_functions.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer);
     if(current_context->multidraw_indirect) {
-        es3_functions.glMultiDrawElementsIndirectEXT(mode, type, 0, drawcount, 0);
+        es3_functions.glMultiDrawElementsIndirectEXT(mode, type, (const void*)command_offset, drawcount, 0);
     } else for(GLsizei i = 0; i < drawcount; i++) {
-        es3_functions.glDrawElementsIndirect(mode, type, (void*)(sizeof(indirect_pass_t) * i));
+        es3_functions.glDrawElementsIndirect(mode, type, (const void*)(command_offset + sizeof(indirect_pass_t) * i));
     }
-    free(indirect_passes);
     restore_state(elementbuffer);
 }
\ No newline at end of file
@@ -7,6 +7,25 @@
 #ifndef GL4ES_WRAPPER_BASEVERTEX_H
 #define GL4ES_WRAPPER_BASEVERTEX_H
 
+// 间接绘制命令的内存布局（DrawElementsIndirectCommand / DrawArraysIndirectCommand），ES 要求 base instance 为 0
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint reservedMustBeZero;
+} indirect_pass_t;
+
+typedef struct {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint reservedMustBeZero;
+} indirect_array_pass_t;
+
+// 间接绘制命令先攒在栈上，每批写一次环形缓冲区（非持久映射时就是一次 glBufferSubData）
+#define MULTIDRAW_COMMAND_BATCH 128
+
 GLint type_bytes(GLenum type);
 
 #endif //GL4ES_WRAPPER_BASEVERTEX_H
@@ -9,6 +9,9 @@
 #include "env.h"
 #include "mempool.h"
 #include "debug.h"
+#include "shader_stats.h"
+#include "program_specialization.h"
+#include "main.h"
 #include <string.h>
 #include <pthread.h>
 
@@ -27,6 +30,7 @@ static pthread_mutex_t egl_state_mutex = PTHREAD_MUTEX_INITIALIZER;
 EGLContext (*host_eglCreateContext)(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list);
 EGLBoolean (*host_eglDestroyContext)(EGLDisplay dpy, EGLContext ctx);
 EGLBoolean (*host_eglMakeCurrent) (EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx);
+EGLBoolean (*host_eglSwapBuffers) (EGLDisplay dpy, EGLSurface surface);
 
 void init_egl() {
     context_map = alloc_intmap();
@@ -36,6 +40,7 @@ void init_egl() {
             "eglDestroyContext");
     host_eglMakeCurrent = (EGLBoolean (*)(EGLDisplay, EGLSurface, EGLSurface,
                                           EGLContext)) host_eglGetProcAddress("eglMakeCurrent");
+    host_eglSwapBuffers = (EGLBoolean (*)(EGLDisplay, EGLSurface)) host_eglGetProcAddress("eglSwapBuffers");
 }
 
 static bool init_context(context_t* tw_context) {
@@ -47,6 +52,8 @@ static bool init_context(context_t* tw_context) {
     if(!tw_context->program_map) goto fail_dealloc;
     tw_context->texture_swztrack_map = alloc_intmap_safe();
     if(!tw_context->texture_swztrack_map) goto fail_dealloc;
+    tw_context->vao_element_buffers = alloc_intmap_safe();
+    if(!tw_context->vao_element_buffers) goto fail_dealloc;
     for(int i = 0; i < MAX_BOUND_BASEBUFFERS; i++) {
         unordered_map *map = alloc_intmap_safe();
         if(!map) goto fail_dealloc;
@@ -63,6 +70,8 @@ static bool init_context(context_t* tw_context) {
     tw_context->swizzle_track_pool = mempool_create(sizeof(texture_swizzle_track_t), 128);
     if(!tw_context->swizzle_track_pool) goto fail_dealloc;
 
+    scratch_init(&tw_context->scratch, SCRATCH_INITIAL_CAPACITY);
+
     return true;
 
     fail_dealloc:
@@ -78,6 +87,8 @@ static bool init_context(context_t* tw_context) {
         unordered_map_free(tw_context->program_map);
     if(tw_context->texture_swztrack_map)
         unordered_map_free(tw_context->texture_swztrack_map);
+    if(tw_context->vao_element_buffers)
+        unordered_map_free(tw_context->vao_element_buffers);
     
     // 清理内存池
     if(tw_context->shader_info_pool) mempool_destroy(tw_context->shader_info_pool);
@@ -89,11 +100,58 @@ static bool init_context(context_t* tw_context) {
     return false;
 }
 
+static share_group_t* share_group_create(void) {
+    share_group_t* share_group = calloc(1, sizeof(share_group_t));
+    if(share_group == NULL) return NULL;
+    share_group->buffer_sizes = alloc_intmap_safe();
+    if(share_group->buffer_sizes == NULL) {
+        free(share_group);
+        return NULL;
+    }
+    pthread_mutex_init(&share_group->lock, NULL);
+    share_group->refcount = 1;
+    return share_group;
+}
+
+static void share_group_release(share_group_t* share_group) {
+    if(share_group == NULL) return;
+    pthread_mutex_lock(&egl_state_mutex);
+    bool last = --share_group->refcount == 0;
+    pthread_mutex_unlock(&egl_state_mutex);
+    if(!last) return;
+    unordered_map_free(share_group->buffer_sizes);
+    pthread_mutex_destroy(&share_group->lock);
+    free(share_group);
+}
+
+// 流式环形缓冲区和 fence 属于共享组，共享时驱动不会随上下文释放它们。
+// 只有当前线程上有同一共享组的上下文（包括被销毁的这个，它在解除绑定前仍然有效）时才能删除
+static void free_incontext(context_t* tw_context) {
+    if(!tw_context->context_rdy) return;
+    if(current_context == NULL || current_context->share_group != tw_context->share_group) {
+        if(tw_context->share_group != NULL && tw_context->share_group->refcount > 1) {
+            LTW_DEBUG_PRINTF("LTW: no context of the share group is current, streaming buffers are left to the driver");
+        }
+        return;
+    }
+    stream_ring_destroy(&tw_context->multidraw_ring);
+    stream_ring_destroy(&tw_context->basevertex.command_ring);
+    tw_context->basevertex.ready = false;
+    if(current_context != tw_context) {
+        es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, current_context->bound_buffers[get_buffer_index(GL_COPY_WRITE_BUFFER)]);
+    }
+}
+
 static void free_context(context_t* tw_context) {
+    // 上下文已销毁，驱动会随之释放着色器对象
+    free_patched_frag_cache(tw_context, false);
+    free_shader_objects(tw_context);
     unordered_map_free(tw_context->shader_map);
     unordered_map_free(tw_context->program_map);
     unordered_map_free(tw_context->framebuffer_map);
     unordered_map_free(tw_context->texture_swztrack_map);
+    unordered_map_free(tw_context->vao_element_buffers);
+    share_group_release(tw_context->share_group);
     if(tw_context->extensions_string != NULL) free(tw_context->extensions_string);
     if(tw_context->nextras != 0 && tw_context->extra_extensions_array != NULL) {
         for(int i = 0; i < tw_context->nextras; i++) {
@@ -107,6 +165,9 @@ static void free_context(context_t* tw_context) {
     if(tw_context->program_info_pool) mempool_destroy(tw_context->program_info_pool);
     if(tw_context->framebuffer_pool) mempool_destroy(tw_context->framebuffer_pool);
     if(tw_context->swizzle_track_pool) mempool_destroy(tw_context->swizzle_track_pool);
+
+    scratch_report(&tw_context->scratch);
+    scratch_destroy(&tw_context->scratch);
 }
 
 void init_extra_extensions(context_t* context, int* length) {
@@ -266,8 +327,6 @@ static void init_incontext(context_t* tw_context) {
 
     basevertex_init(tw_context);
     buffer_copier_init(tw_context);
-    es3_functions.glGenBuffers(1, &tw_context->multidraw_element_buffer);
-
     // 初始化格式缓存
     memset(tw_context->format_cache, 0, sizeof(tw_context->format_cache));
     tw_context->format_cache_index = 0;
@@ -275,19 +334,23 @@ static void init_incontext(context_t* tw_context) {
     // 自适应预分配 multidraw 缓冲区大小
     // 根据设备内存动态调整：高配设备 512KB，低配设备 256KB
     size_t device_memory_mb = detect_device_memory_mb();
+    GLsizeiptr multidraw_buffer_size;
     if(device_memory_mb >= 6144) {  // >= 6GB
-        tw_context->multidraw_buffer_size = 512 * 1024;  // 512KB
+        multidraw_buffer_size = 512 * 1024;  // 512KB
         LTW_ERROR_PRINTF("LTW: Using large multidraw buffer (512KB) for high-memory device");
     } else if(device_memory_mb >= 4096) {  // >= 4GB
-        tw_context->multidraw_buffer_size = 384 * 1024;  // 384KB
+        multidraw_buffer_size = 384 * 1024;  // 384KB
         LTW_ERROR_PRINTF("LTW: Using medium multidraw buffer (384KB) for mid-range device");
     } else {  // < 4GB
-        tw_context->multidraw_buffer_size = 256 * 1024;  // 256KB
+        multidraw_buffer_size = 256 * 1024;  // 256KB
         LTW_ERROR_PRINTF("LTW: Using small multidraw buffer (256KB) for low-memory device");
     }
 
-    es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, tw_context->multidraw_element_buffer);
-    es3_functions.glBufferData(GL_COPY_WRITE_BUFFER, tw_context->multidraw_buffer_size, NULL, GL_STREAM_DRAW);
+    // 有 EXT_buffer_storage 时持久映射，客户端索引直接写进映射
+    bool persistent_streaming = tw_context->buffer_storage && env_istrue_d("LTW_PERSISTENT_STREAMING", true);
+    if(!stream_ring_init(&tw_context->multidraw_ring, multidraw_buffer_size, MULTIDRAW_RING_MAX_SIZE, persistent_streaming)) {
+        LTW_ERROR_PRINTF("LTW: Failed to create the multidraw streaming buffer");
+    }
     es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
     // 初始化 swizzle 批量更新相关字段
@@ -309,11 +372,6 @@ static void init_incontext(context_t* tw_context) {
     tw_context->fast_gl.glMapBufferRange = es3_functions.glMapBufferRange;
     tw_context->fast_gl.glUnmapBuffer = es3_functions.glUnmapBuffer;
     tw_context->fast_gl.glFlushMappedBufferRange = es3_functions.glFlushMappedBufferRange;
-
-    // 初始化环形缓冲区字段
-    tw_context->multidraw_ring_head = 0;
-    tw_context->multidraw_ring_tail = 0;
-    tw_context->multidraw_ring_wrapped = false;
 }
 
 EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context, const EGLint *attrib_list) {
@@ -325,6 +383,21 @@ EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_c
         host_eglDestroyContext(dpy, phys_context);
         return EGL_NO_CONTEXT;
     }
+    // 与共享上下文使用同一个共享组
+    pthread_mutex_lock(&egl_state_mutex);
+    context_t* shared = share_context != EGL_NO_CONTEXT ? unordered_map_get(context_map, share_context) : NULL;
+    if(shared != NULL) {
+        tw_context->share_group = shared->share_group;
+        tw_context->share_group->refcount++;
+    }
+    pthread_mutex_unlock(&egl_state_mutex);
+    if(tw_context->share_group == NULL) tw_context->share_group = share_group_create();
+    if(tw_context->share_group == NULL) {
+        free_context(tw_context);
+        free(tw_context);
+        host_eglDestroyContext(dpy, phys_context);
+        return EGL_NO_CONTEXT;
+    }
     unordered_map_put(context_map, phys_context, tw_context);
     return phys_context;
 }
@@ -333,9 +406,12 @@ EGLBoolean eglDestroyContext (EGLDisplay dpy, EGLContext ctx) {
     if(!host_eglDestroyContext(dpy, ctx)) return EGL_FALSE;
     context_t* old_ctx = unordered_map_remove(context_map, ctx);
     if(old_ctx) {
+        free_incontext(old_ctx);
         free_context(old_ctx);
         free(old_ctx);
     }
+    shader_stats_dump();
+    program_specialization_dump_stats();
 
     // 使用互斥锁保护全局 EGL 状态
     pthread_mutex_lock(&egl_state_mutex);
@@ -427,4 +503,9 @@ EGLBoolean eglMakeCurrent (EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGL
     pthread_mutex_unlock(&egl_state_mutex);
 
     return EGL_TRUE;
-}
\ No newline at end of file
+}
+EGLBoolean eglSwapBuffers (EGLDisplay dpy, EGLSurface surface) {
+    // 帧边界：当前上下文的临时分配全部作废，并按本帧峰值调整缓冲区
+    if(current_context != NULL) scratch_reset(&current_context->scratch);
+    return host_eglSwapBuffers(dpy, surface);
+}
@@ -8,20 +8,27 @@
 #define POJAVLAUNCHER_EGL_H
 
 #include <stdbool.h>
+#include <pthread.h>
 #include <EGL/egl.h>
 #include "proc.h"
 #include "unordered_map/unordered_map.h"
+#include "shader_disk_cache.h"
+#include "stream_ring.h"
+#include "scratch.h"
 
 #define MAX_BOUND_BUFFERS 9
 #define MAX_BOUND_BASEBUFFERS 4
 #define MAX_DRAWBUFFERS 8
 #define MAX_FBTARGETS 8
-#define MAX_TMUS 8
+#define MAX_TMUS 32
 #define MAX_TEXTARGETS 8
+#define MULTIDRAW_RING_MAX_SIZE (16 * 1024 * 1024)
+#define BASEVERTEX_RING_SIZE (64 * 1024)
+#define BASEVERTEX_RING_MAX_SIZE (4 * 1024 * 1024)
 
 typedef struct {
     bool ready;
-    GLuint indirectRenderBuffer;
+    stream_ring_t command_ring;     // 间接绘制命令的流式环形缓冲区，按区段 fence 回收
 } basevertex_renderer_t;
 
 typedef struct {
@@ -69,20 +76,52 @@ typedef struct {
 
 #define FORMAT_CACHE_SIZE 64
 
+// 已按颜色绑定打补丁并编译的片段着色器，重复链接时复用，避免每次链接都额外编译一次
+typedef struct {
+    uint64_t source_hash;
+    GLchar* source;         // 共享的翻译结果（持有引用），用于完整比对
+    GLchar* colorbindings[MAX_DRAWBUFFERS];
+    GLuint shader;
+} patched_frag_entry_t;
+
+#define PATCHED_FRAG_CACHE_SIZE 32
+
 // 前向声明内存池
 typedef struct mempool mempool_t;
 
 // 前向声明 shader 和 program 信息结构体（在 shader_wrapper.c 中定义）
 typedef struct {
     GLenum shader_type;
-    GLchar* source;
+    GLchar* source;         // 共享的翻译结果，用 shader_source_release 释放
+    bool compile_pending;   // glCompileShader 被推迟，程序二进制缓存命中时可完全跳过编译
+    bool has_source_key;
+    uint8_t source_key[SHADER_DISK_CACHE_KEY_SIZE]; // 翻译前规范化源码（含类型和 GLSL 版本）的 SHA-1，见 shader_normalize.h
+    struct shader_translation* pending_translation; // 工作线程上尚未取回的翻译任务
+    GLchar* original_source; // 原始源码，source 是第 0 级翻译或启用了跨阶段优化时保留，供后台优化
+    bool tier0;             // source 是第 0 级（未优化）翻译
+    bool delete_pending;    // 已调用 glDeleteShader，但还附加在程序上，驱动尚未删除
 } shader_info_t;
 
+#define MAX_ATTACHED_SHADERS 6
+#define MAX_BOUND_ATTRIBS 16
+
 typedef struct {
     GLuint frag_shader;
+    GLuint shaders[MAX_ATTACHED_SHADERS];   // 已附加的着色器，用于计算程序二进制缓存键
     GLchar* colorbindings[MAX_DRAWBUFFERS];
+    GLchar* attribbindings[MAX_BOUND_ATTRIBS];
+    bool binary_uncacheable;    // 使用了缓存键无法覆盖的链接状态（如 transform feedback）
+    struct program_upgrade* upgrade;    // 分级编译/跨阶段优化：后台优化完成后在 glUseProgram 时换入
+    struct program_specialization* specialization; // uniform 特化的跟踪状态（LTW_SPECIALIZE_UNIFORMS）
 } program_info_t;
 
+// 共享组：eglCreateContext 指定了共享上下文时，缓冲区等对象在组内共享，它们的状态也放在这里
+typedef struct {
+    pthread_mutex_t lock;       //组内的上下文可能同时在不同线程上使用
+    int refcount;               //组内上下文的数量（由 egl.c 的 egl_state_mutex 保护）
+    unordered_map* buffer_sizes;        //缓冲区 -> 大小 + 1
+} share_group_t;
+
 typedef struct {
     EGLContext phys_context;    //实际的EGL上下文句柄
     bool context_rdy;   //标记上下文是否已准备就绪
@@ -90,7 +129,7 @@ typedef struct {
     PFNGLDRAWELEMENTSBASEVERTEXPROC drawelementsbasevertex; //函数指针，指向绘制元素基顶点的函数
     GLint shader_version;   //着色器版本
     basevertex_renderer_t basevertex;   //基顶点渲染器
-    GLuint multidraw_element_buffer;    //多重绘制元素缓冲区对象
+    stream_ring_t multidraw_ring;   //多重绘制拼接索引用的流式环形缓冲区
     framebuffer_copier_t framebuffer_copier;    //帧缓冲复制器
     unordered_map* shader_map;  //着色器映射表
     unordered_map* program_map; //程序映射表
@@ -100,7 +139,15 @@ typedef struct {
     int proxy_width, proxy_height, proxy_intformat, maxTextureSize; //代理纹理参数和最大纹理尺寸
     GLint max_drawbuffers;  //最大绘制缓冲区数
     GLuint bound_buffers[MAX_BOUND_BUFFERS];       //绑定的缓冲区对象数组
+    // 绑定状态的影子副本，内部查询不调用 glGet（见 state_shadow.h）
+    GLuint active_texture;      //当前纹理单元（从 GL_TEXTURE0 起的下标）
+    GLuint bound_textures[MAX_TMUS][MAX_TEXTARGETS];   //每个纹理单元各目标上绑定的纹理
+    GLuint vertex_array;        //当前 VAO
+    GLuint element_buffer;      //当前 VAO 的元素缓冲区
+    unordered_map* vao_element_buffers; //VAO -> 元素缓冲区
+    share_group_t* share_group;         //所属的共享组
     GLuint program;     //当前使用的程序对象
+    struct program_specialization* current_specialization; //当前程序的 uniform 特化状态，未启用时为 NULL
     GLuint draw_framebuffer;    //绘制帧缓冲对象
     GLuint read_framebuffer;    //读取帧缓冲对象
     framebuffer_t* cached_draw_framebuffer;   //缓存的绘制帧缓冲对象
@@ -112,7 +159,10 @@ typedef struct {
     char** extra_extensions_array;      //额外扩展字符串数组
     format_cache_entry_t format_cache[FORMAT_CACHE_SIZE];   //纹理格式缓存
     int format_cache_index;    //格式缓存索引
-    GLsizei multidraw_buffer_size;  //多重绘制缓冲区大小
+    patched_frag_entry_t patched_frag_cache[PATCHED_FRAG_CACHE_SIZE];  //打补丁片段着色器缓存
+    int patched_frag_cache_index;  //下一个被替换的缓存槽位
+    int pending_program_upgrades;  //等待换入优化版本的程序数量
+    GLenum deferred_error;         //包装器内部取走的应用错误，由下一次 glGetError 返回
     mempool_t* shader_info_pool;    //shader_info_t 内存池
     // Swizzle 批量更新相关
     GLuint pending_swizzle_textures[64];  // 待更新的纹理ID列表
@@ -134,17 +184,18 @@ typedef struct {
         unsigned char (*glUnmapBuffer)(GLenum);
         void (*glFlushMappedBufferRange)(GLenum, GLintptr, GLsizeiptr);
     } fast_gl;
-    // MultiDraw 环形缓冲区相关
-    size_t multidraw_ring_head;  // 环形缓冲区头部位置
-    size_t multidraw_ring_tail;  // 环形缓冲区尾部位置
-    bool multidraw_ring_wrapped; // 是否已环绕
     mempool_t* program_info_pool;   //program_info_t 内存池
     mempool_t* framebuffer_pool;    //framebuffer_t 内存池
     mempool_t* swizzle_track_pool;  //texture_swizzle_track_t 内存池
+    scratch_arena_t scratch;        //单次调用内的临时分配，eglSwapBuffers 时重置
 } context_t;        //表示OpenGL ES的上下文状态信息
 
 extern thread_local context_t *current_context;
 extern void init_egl();
 extern GLenum get_textarget_query_param(GLenum target);
+extern void free_patched_frag_cache(context_t* context, bool delete_shaders);
+extern void free_shader_objects(context_t* context);
+extern void program_upgrade_if_ready(GLuint program);
+extern void program_specialization_bind(GLuint program);
 
 #endif //POJAVLAUNCHER_EGL_H
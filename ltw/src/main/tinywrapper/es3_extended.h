@@ -18,4 +18,38 @@ GLESFUNC(glTexBuffer, PFNGLTEXBUFFERPROC);
 GLESFUNC(glTexBufferRange, PFNGLTEXBUFFERRANGEPROC);
 GLESFUNC(glTexBufferEXT, PFNGLTEXBUFFEREXTPROC)
 GLESFUNC(glTexBufferRangeEXT, PFNGLTEXBUFFERRANGEEXTPROC)
-GLESFUNC(glMultiDrawElementsIndirectEXT, PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC)
\ No newline at end of file
+GLESFUNC(glMultiDrawElementsIndirectEXT, PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC)
+GLESFUNC(glMultiDrawArraysIndirectEXT, PFNGLMULTIDRAWARRAYSINDIRECTEXTPROC)
+GLESFUNC(glProgramUniform1f, PFNGLPROGRAMUNIFORM1FPROC)
+GLESFUNC(glProgramUniform1fv, PFNGLPROGRAMUNIFORM1FVPROC)
+GLESFUNC(glProgramUniform1i, PFNGLPROGRAMUNIFORM1IPROC)
+GLESFUNC(glProgramUniform1iv, PFNGLPROGRAMUNIFORM1IVPROC)
+GLESFUNC(glProgramUniform1ui, PFNGLPROGRAMUNIFORM1UIPROC)
+GLESFUNC(glProgramUniform1uiv, PFNGLPROGRAMUNIFORM1UIVPROC)
+GLESFUNC(glProgramUniform2f, PFNGLPROGRAMUNIFORM2FPROC)
+GLESFUNC(glProgramUniform2fv, PFNGLPROGRAMUNIFORM2FVPROC)
+GLESFUNC(glProgramUniform2i, PFNGLPROGRAMUNIFORM2IPROC)
+GLESFUNC(glProgramUniform2iv, PFNGLPROGRAMUNIFORM2IVPROC)
+GLESFUNC(glProgramUniform2ui, PFNGLPROGRAMUNIFORM2UIPROC)
+GLESFUNC(glProgramUniform2uiv, PFNGLPROGRAMUNIFORM2UIVPROC)
+GLESFUNC(glProgramUniform3f, PFNGLPROGRAMUNIFORM3FPROC)
+GLESFUNC(glProgramUniform3fv, PFNGLPROGRAMUNIFORM3FVPROC)
+GLESFUNC(glProgramUniform3i, PFNGLPROGRAMUNIFORM3IPROC)
+GLESFUNC(glProgramUniform3iv, PFNGLPROGRAMUNIFORM3IVPROC)
+GLESFUNC(glProgramUniform3ui, PFNGLPROGRAMUNIFORM3UIPROC)
+GLESFUNC(glProgramUniform3uiv, PFNGLPROGRAMUNIFORM3UIVPROC)
+GLESFUNC(glProgramUniform4f, PFNGLPROGRAMUNIFORM4FPROC)
+GLESFUNC(glProgramUniform4fv, PFNGLPROGRAMUNIFORM4FVPROC)
+GLESFUNC(glProgramUniform4i, PFNGLPROGRAMUNIFORM4IPROC)
+GLESFUNC(glProgramUniform4iv, PFNGLPROGRAMUNIFORM4IVPROC)
+GLESFUNC(glProgramUniform4ui, PFNGLPROGRAMUNIFORM4UIPROC)
+GLESFUNC(glProgramUniform4uiv, PFNGLPROGRAMUNIFORM4UIVPROC)
+GLESFUNC(glProgramUniformMatrix2fv, PFNGLPROGRAMUNIFORMMATRIX2FVPROC)
+GLESFUNC(glProgramUniformMatrix3fv, PFNGLPROGRAMUNIFORMMATRIX3FVPROC)
+GLESFUNC(glProgramUniformMatrix4fv, PFNGLPROGRAMUNIFORMMATRIX4FVPROC)
+GLESFUNC(glProgramUniformMatrix2x3fv, PFNGLPROGRAMUNIFORMMATRIX2X3FVPROC)
+GLESFUNC(glProgramUniformMatrix3x2fv, PFNGLPROGRAMUNIFORMMATRIX3X2FVPROC)
+GLESFUNC(glProgramUniformMatrix2x4fv, PFNGLPROGRAMUNIFORMMATRIX2X4FVPROC)
+GLESFUNC(glProgramUniformMatrix4x2fv, PFNGLPROGRAMUNIFORMMATRIX4X2FVPROC)
+GLESFUNC(glProgramUniformMatrix3x4fv, PFNGLPROGRAMUNIFORMMATRIX3X4FVPROC)
+GLESFUNC(glProgramUniformMatrix4x3fv, PFNGLPROGRAMUNIFORMMATRIX4X3FVPROC)
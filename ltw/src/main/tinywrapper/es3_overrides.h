@@ -45,6 +45,11 @@ GLESOVERRIDE(glDeleteProgram)
 GLESOVERRIDE(glLinkProgram)
 GLESOVERRIDE(glAttachShader)
 GLESOVERRIDE(glGetShaderiv)
+GLESOVERRIDE(glGetShaderInfoLog)
+GLESOVERRIDE(glCompileShader)
+GLESOVERRIDE(glDetachShader)
+GLESOVERRIDE(glBindAttribLocation)
+GLESOVERRIDE(glTransformFeedbackVaryings)
 GLESOVERRIDE(glShaderSource)
 GLESOVERRIDE(glTexImage2D)
 GLESOVERRIDE(glDebugMessageControl)
@@ -57,7 +62,81 @@ GLESOVERRIDE(glDrawElementsBaseVertex)
 GLESOVERRIDE(glBindBufferBase)
 GLESOVERRIDE(glBindBufferRange)
 GLESOVERRIDE(glBindBuffer)
+GLESOVERRIDE(glBufferData)
+GLESOVERRIDE(glDeleteBuffers)
+GLESOVERRIDE(glBindVertexArray)
+GLESOVERRIDE(glDeleteVertexArrays)
+GLESOVERRIDE(glActiveTexture)
+GLESOVERRIDE(glBindTexture)
+GLESOVERRIDE(glDeleteTextures)
 GLESOVERRIDE(glUseProgram)
+GLESOVERRIDE(glGetUniformLocation)
+GLESOVERRIDE(glUniform1f)
+GLESOVERRIDE(glUniform2f)
+GLESOVERRIDE(glUniform3f)
+GLESOVERRIDE(glUniform4f)
+GLESOVERRIDE(glUniform1i)
+GLESOVERRIDE(glUniform2i)
+GLESOVERRIDE(glUniform3i)
+GLESOVERRIDE(glUniform4i)
+GLESOVERRIDE(glUniform1ui)
+GLESOVERRIDE(glUniform2ui)
+GLESOVERRIDE(glUniform3ui)
+GLESOVERRIDE(glUniform4ui)
+GLESOVERRIDE(glUniform1fv)
+GLESOVERRIDE(glUniform2fv)
+GLESOVERRIDE(glUniform3fv)
+GLESOVERRIDE(glUniform4fv)
+GLESOVERRIDE(glUniform1iv)
+GLESOVERRIDE(glUniform2iv)
+GLESOVERRIDE(glUniform3iv)
+GLESOVERRIDE(glUniform4iv)
+GLESOVERRIDE(glUniform1uiv)
+GLESOVERRIDE(glUniform2uiv)
+GLESOVERRIDE(glUniform3uiv)
+GLESOVERRIDE(glUniform4uiv)
+GLESOVERRIDE(glUniformMatrix2fv)
+GLESOVERRIDE(glUniformMatrix3fv)
+GLESOVERRIDE(glUniformMatrix4fv)
+GLESOVERRIDE(glUniformMatrix2x3fv)
+GLESOVERRIDE(glUniformMatrix2x4fv)
+GLESOVERRIDE(glUniformMatrix3x2fv)
+GLESOVERRIDE(glUniformMatrix3x4fv)
+GLESOVERRIDE(glUniformMatrix4x2fv)
+GLESOVERRIDE(glUniformMatrix4x3fv)
+GLESOVERRIDE(glProgramUniform1f)
+GLESOVERRIDE(glProgramUniform1fv)
+GLESOVERRIDE(glProgramUniform1i)
+GLESOVERRIDE(glProgramUniform1iv)
+GLESOVERRIDE(glProgramUniform1ui)
+GLESOVERRIDE(glProgramUniform1uiv)
+GLESOVERRIDE(glProgramUniform2f)
+GLESOVERRIDE(glProgramUniform2fv)
+GLESOVERRIDE(glProgramUniform2i)
+GLESOVERRIDE(glProgramUniform2iv)
+GLESOVERRIDE(glProgramUniform2ui)
+GLESOVERRIDE(glProgramUniform2uiv)
+GLESOVERRIDE(glProgramUniform3f)
+GLESOVERRIDE(glProgramUniform3fv)
+GLESOVERRIDE(glProgramUniform3i)
+GLESOVERRIDE(glProgramUniform3iv)
+GLESOVERRIDE(glProgramUniform3ui)
+GLESOVERRIDE(glProgramUniform3uiv)
+GLESOVERRIDE(glProgramUniform4f)
+GLESOVERRIDE(glProgramUniform4fv)
+GLESOVERRIDE(glProgramUniform4i)
+GLESOVERRIDE(glProgramUniform4iv)
+GLESOVERRIDE(glProgramUniform4ui)
+GLESOVERRIDE(glProgramUniform4uiv)
+GLESOVERRIDE(glProgramUniformMatrix2fv)
+GLESOVERRIDE(glProgramUniformMatrix3fv)
+GLESOVERRIDE(glProgramUniformMatrix4fv)
+GLESOVERRIDE(glProgramUniformMatrix2x3fv)
+GLESOVERRIDE(glProgramUniformMatrix3x2fv)
+GLESOVERRIDE(glProgramUniformMatrix2x4fv)
+GLESOVERRIDE(glProgramUniformMatrix4x2fv)
+GLESOVERRIDE(glProgramUniformMatrix3x4fv)
+GLESOVERRIDE(glProgramUniformMatrix4x3fv)
 GLESOVERRIDE(glGetIntegerv)
 GLESOVERRIDE(glBindFramebuffer)
 GLESOVERRIDE(glGenFramebuffers)
@@ -0,0 +1,580 @@
+/*
+ * Shader translator benchmark.
+ *
+ * Feeds a corpus of desktop GLSL through optimize_shader() (the same entry
+ * point the wrapper uses) and reports per-shader latency, output size, heap
+ * allocations and the time split between translator phases, plus overall
+ * throughput and peak memory. Used to compare translator changes on a Linux
+ * host.
+ *
+ * Usage: shader_bench [options] [files or directories...]
+ *   -n N         timed iterations per shader (default 20)
+ *   -w N         warm-up iterations per shader (default 2)
+ *   -s VERSION   source GLSL version passed to the translator (default 460)
+ *   -t VERSION   target GLSL ES version (default 320)
+ *   --csv FILE   also write the per-shader results as CSV
+ *   --no-synthetic  skip the generated large shaders
+ *   --fast       tier-0 translation (OPTIMIZE_SHADER_FAST), no optimization passes
+ *   --mediump    demote safe float values to mediump (OPTIMIZE_SHADER_MEDIUMP), after
+ *                checking that values computed from a highp uniform stay highp
+ *   --no-pp-cache  disable the preprocessor checkpoint cache (LTW_PREPROCESSOR_CACHE=0)
+ *
+ * Without file arguments the bundled corpus (bench/corpus) is used. Stages
+ * are taken from the file extension: .vsh/.vert, .fsh/.frag, .gsh/.geom.
+ */
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "c_wrapper.h"
+
+namespace fs = std::filesystem;
+
+#ifdef __GLIBC__
+// Count every malloc-family call (ralloc, std::string and operator new all end
+// up here) by interposing glibc's allocator in the executable.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static uint64_t g_allocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+	g_allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	g_allocations++;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	g_allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+#define BENCH_COUNTS_ALLOCATIONS 1
+#else
+static uint64_t g_allocations = 0;
+#define BENCH_COUNTS_ALLOCATIONS 0
+#endif
+
+namespace
+{
+	struct Shader
+	{
+		std::string name;
+		GLenum type;
+		std::string source;
+	};
+
+	struct Sample
+	{
+		uint64_t total = 0;
+		optimize_shader_timings phases = {};
+	};
+
+	struct ShaderResult
+	{
+		std::string name;
+		GLenum type = 0;
+		size_t inputSize = 0;
+		size_t outputSize = 0;
+		bool failed = false;
+		uint64_t minNs = 0;
+		uint64_t medianNs = 0;
+		uint64_t meanNs = 0;
+		optimize_shader_timings meanPhases = {};
+		optimize_shader_precision precision = {};
+		uint64_t allocations = 0;	// malloc/calloc/realloc calls per translation
+	};
+
+	struct Options
+	{
+		int iterations = 20;
+		int warmup = 2;
+		int sourceVersion = 460;
+		int targetVersion = 320;
+		bool synthetic = true;
+		int flags = 0;
+		std::string csvPath;
+		std::vector<std::string> inputs;
+	};
+
+	bool StageFromExtension(const std::string& ext, GLenum* type)
+	{
+		if (ext == ".vsh" || ext == ".vert") *type = GL_VERTEX_SHADER;
+		else if (ext == ".fsh" || ext == ".frag") *type = GL_FRAGMENT_SHADER;
+		else if (ext == ".gsh" || ext == ".geom") *type = GL_GEOMETRY_SHADER;
+		else return false;
+		return true;
+	}
+
+	const char* StageName(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_VERTEX_SHADER: return "vert";
+		case GL_FRAGMENT_SHADER: return "frag";
+		case GL_GEOMETRY_SHADER: return "geom";
+		default: return "?";
+		}
+	}
+
+	void LoadFile(const fs::path& path, const fs::path& root, std::vector<Shader>& shaders)
+	{
+		GLenum type;
+		if (!StageFromExtension(path.extension().string(), &type)) return;
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			fprintf(stderr, "cannot read %s\n", path.c_str());
+			return;
+		}
+		std::stringstream contents;
+		contents << file.rdbuf();
+		std::string name = root.empty() ? path.filename().string() : fs::relative(path, root).string();
+		shaders.push_back({ name, type, contents.str() });
+	}
+
+	void LoadInput(const std::string& input, std::vector<Shader>& shaders)
+	{
+		const fs::path path(input);
+		if (fs::is_directory(path))
+		{
+			std::vector<fs::path> files;
+			for (const auto& entry : fs::recursive_directory_iterator(path))
+			{
+				if (entry.is_regular_file()) files.push_back(entry.path());
+			}
+			std::sort(files.begin(), files.end());
+			for (const auto& file : files) LoadFile(file, path, shaders);
+		}
+		else
+		{
+			LoadFile(path, fs::path(), shaders);
+		}
+	}
+
+	// Large shaders in the shape shaderpacks produce after macro expansion:
+	// many helper functions, uniforms and loops that all feed the output.
+	std::string GenerateLargeFragment(int functions)
+	{
+		std::string src = "#version 120\n";
+		for (int i = 0; i < functions; i++)
+		{
+			src += "uniform vec4 u_param" + std::to_string(i) + ";\n";
+		}
+		src += "uniform sampler2D u_tex;\nvarying vec2 v_uv;\n";
+		for (int i = 0; i < functions; i++)
+		{
+			const std::string n = std::to_string(i);
+			src += "vec4 layer" + n + "(vec2 uv, vec4 acc) {\n"
+				"    vec4 c = texture2D(u_tex, uv * u_param" + n + ".xy + u_param" + n + ".zw);\n"
+				"    for (int j = 0; j < 4; j++) {\n"
+				"        c.rgb = mix(c.rgb, acc.rgb, 0.25 * float(j));\n"
+				"        uv += vec2(0.01, -0.02) * float(j + " + n + ");\n"
+				"    }\n"
+				"    if (c.a < 0.1) c = vec4(pow(max(acc.rgb, vec3(0.0)), vec3(2.2)), acc.a);\n"
+				"    return acc * 0.5 + c * 0.5 + vec4(dot(c.rgb, vec3(0.299, 0.587, 0.114)));\n"
+				"}\n";
+		}
+		src += "void main() {\n    vec4 acc = vec4(0.0);\n";
+		for (int i = 0; i < functions; i++)
+		{
+			src += "    acc = layer" + std::to_string(i) + "(v_uv, acc);\n";
+		}
+		src += "    gl_FragColor = acc;\n}\n";
+		return src;
+	}
+
+	std::string GenerateLargeVertex(int varyings)
+	{
+		std::string src = "#version 150 core\nin vec3 Position;\nin vec2 UV0;\nuniform mat4 ModelViewMat;\nuniform mat4 ProjMat;\n";
+		for (int i = 0; i < varyings; i++)
+		{
+			src += "uniform mat4 u_bone" + std::to_string(i) + ";\n";
+			src += "out vec4 v_data" + std::to_string(i) + ";\n";
+		}
+		src += "void main() {\n    vec4 pos = vec4(Position, 1.0);\n";
+		for (int i = 0; i < varyings; i++)
+		{
+			const std::string n = std::to_string(i);
+			src += "    v_data" + n + " = u_bone" + n + " * pos + vec4(UV0, float(" + n + "), 1.0);\n";
+		}
+		src += "    gl_Position = ProjMat * ModelViewMat * pos;\n}\n";
+		return src;
+	}
+
+	// Many #define/#if blocks, like an option-heavy shaderpack program.
+	std::string GenerateMacroHeavy(int options)
+	{
+		std::string src = "#version 120\n";
+		for (int i = 0; i < options; i++)
+		{
+			src += "#define OPTION_" + std::to_string(i) + " " + std::to_string(i % 3) + "\n";
+		}
+		src += "varying vec2 texcoord;\nuniform sampler2D gcolor;\nvoid main() {\n    vec3 color = texture2D(gcolor, texcoord).rgb;\n";
+		for (int i = 0; i < options; i++)
+		{
+			const std::string n = std::to_string(i);
+			src += "#if OPTION_" + n + " == 1\n    color *= 1.0" + n + ";\n"
+				"#elif OPTION_" + n + " == 2\n    color += vec3(0.00" + n + ");\n#endif\n";
+		}
+		src += "    gl_FragData[0] = vec4(color, 1.0);\n}\n";
+		return src;
+	}
+
+	// Programs of one shaderpack: the same settings block and library
+	// (#included by every program) followed by a body of their own.
+	std::string GenerateSharedHeader(int options, int variant)
+	{
+		std::string src = "#version 120\n";
+		for (int i = 0; i < options; i++)
+		{
+			const std::string n = std::to_string(i);
+			src += "#define SETTING_" + n + " " + std::to_string(i % 4) + " // [0 1 2 3]\n";
+		}
+		for (int i = 0; i < options / 4; i++)
+		{
+			const std::string n = std::to_string(i);
+			src += "/* Helper " + n + " of the shared library. */\n"
+				"#if SETTING_" + n + " >= 2\n"
+				"vec3 lib" + n + "(vec3 c) { return c * float(SETTING_" + n + ") + vec3(0.0" + n + "); }\n"
+				"#else\n"
+				"vec3 lib" + n + "(vec3 c) { return mix(c, vec3(dot(c, vec3(0.33))), 0.5); }\n"
+				"#endif\n";
+		}
+		src += "varying vec2 texcoord;\nuniform sampler2D gcolor;\nvoid main() {\n    vec3 color = texture2D(gcolor, texcoord).rgb;\n";
+		for (int i = variant; i < options / 4; i += 3)
+		{
+			src += "    color = lib" + std::to_string(i) + "(color);\n";
+		}
+		src += "    gl_FragData[0] = vec4(color, 1.0);\n}\n";
+		return src;
+	}
+
+	// A time uniform reaches thousands of seconds, where fp16 only has a step
+	// of 2.0: nothing computed from it may be demoted to mediump.
+	const char* const kUniformTimeShader =
+		"#version 120\n"
+		"uniform float frameTimeCounter;\nuniform float waveSpeed;\n"
+		"uniform sampler2D gcolor;\nvarying vec2 texcoord;\n"
+		"void main() {\n"
+		"    vec3 color = texture2D(gcolor, texcoord).rgb;\n"
+		"    float t = frameTimeCounter * waveSpeed;\n"
+		"    vec2 wave = vec2(sin(t), cos(t * 1.3)) * 0.5 + 0.5;\n"
+		"    color = mix(color, color * wave.x, wave.y);\n"
+		"    gl_FragData[0] = vec4(color, 1.0);\n"
+		"}\n";
+
+	std::vector<std::string> Identifiers(const std::string& text)
+	{
+		std::vector<std::string> names;
+		for (size_t i = 0; i < text.size();)
+		{
+			if (!isalpha((unsigned char)text[i]) && text[i] != '_')
+			{
+				i++;
+				continue;
+			}
+			size_t end = i;
+			while (end < text.size() && (isalnum((unsigned char)text[end]) || text[end] == '_')) end++;
+			names.push_back(text.substr(i, end - i));
+			i = end;
+		}
+		return names;
+	}
+
+	// Translates kUniformTimeShader with mediump demotion and follows the
+	// assignments of the output: every variable written from the uniform, or
+	// from something written from it, must not be declared mediump.
+	bool CheckUniformOperands(const Options& options)
+	{
+		std::vector<char> input(kUniformTimeShader, kUniformTimeShader + strlen(kUniformTimeShader) + 1);
+		char* output = optimize_shader_ex(input.data(), GL_FRAGMENT_SHADER, options.sourceVersion,
+			options.targetVersion, options.flags | OPTIMIZE_SHADER_MEDIUMP, nullptr, nullptr, nullptr);
+		if (output == nullptr) return false;
+		std::istringstream lines(output);
+		free(output);
+		std::vector<std::string> mediump;
+		std::vector<std::string> derived = { "frameTimeCounter" };
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			const size_t assign = line.find(" = ");
+			// Declaration, or the variable part of an assignment without swizzle or index
+			std::string target = line.substr(0, std::min(assign, line.find_first_of(".[;")));
+			const std::vector<std::string> names = Identifiers(target);
+			if (names.empty()) continue;
+			if (target.find("mediump ") != std::string::npos) mediump.push_back(names.back());
+			if (assign == std::string::npos) continue;
+			for (const std::string& name : Identifiers(line.substr(assign)))
+			{
+				if (std::find(derived.begin(), derived.end(), name) != derived.end())
+				{
+					derived.push_back(names.back());
+					break;
+				}
+			}
+		}
+		for (const std::string& name : derived)
+		{
+			if (std::find(mediump.begin(), mediump.end(), name) != mediump.end())
+			{
+				fprintf(stderr, "%s is computed from a highp uniform but was demoted to mediump\n", name.c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void AddSynthetic(std::vector<Shader>& shaders)
+	{
+		shaders.push_back({ "synthetic/large_fragment_64.fsh", GL_FRAGMENT_SHADER, GenerateLargeFragment(64) });
+		shaders.push_back({ "synthetic/large_fragment_256.fsh", GL_FRAGMENT_SHADER, GenerateLargeFragment(256) });
+		shaders.push_back({ "synthetic/many_varyings_32.vsh", GL_VERTEX_SHADER, GenerateLargeVertex(32) });
+		shaders.push_back({ "synthetic/macro_heavy_512.fsh", GL_FRAGMENT_SHADER, GenerateMacroHeavy(512) });
+		shaders.push_back({ "synthetic/shared_header_a.fsh", GL_FRAGMENT_SHADER, GenerateSharedHeader(256, 0) });
+		shaders.push_back({ "synthetic/shared_header_b.fsh", GL_FRAGMENT_SHADER, GenerateSharedHeader(256, 1) });
+		shaders.push_back({ "synthetic/uniform_time.fsh", GL_FRAGMENT_SHADER, kUniformTimeShader });
+	}
+
+	uint64_t PhaseSum(const optimize_shader_timings& t)
+	{
+		return t.preprocess + t.parse + t.ast_to_hir + t.link + t.optimize + t.convert;
+	}
+
+	ShaderResult Run(const Shader& shader, const Options& options)
+	{
+		ShaderResult result;
+		result.name = shader.name;
+		result.type = shader.type;
+		result.inputSize = shader.source.size();
+
+		std::vector<char> input(shader.source.begin(), shader.source.end());
+		input.push_back('\0');
+
+		for (int i = 0; i < options.warmup; i++)
+		{
+			free(optimize_shader_ex(input.data(), shader.type, options.sourceVersion, options.targetVersion,
+				options.flags, nullptr, nullptr, nullptr));
+		}
+
+		std::vector<Sample> samples;
+		for (int i = 0; i < options.iterations; i++)
+		{
+			Sample sample;
+			optimize_shader_output placement = {};
+			const uint64_t allocationsBefore = g_allocations;
+			const auto start = std::chrono::steady_clock::now();
+			char* output = optimize_shader_ex(input.data(), shader.type, options.sourceVersion,
+				options.targetVersion, options.flags, &sample.phases, &result.precision, &placement);
+			sample.total = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			result.allocations = g_allocations - allocationsBefore;
+			if (output == nullptr)
+			{
+				result.failed = true;
+				return result;
+			}
+			result.outputSize = placement.length;
+			free(output);
+			samples.push_back(sample);
+		}
+		if (samples.empty()) return result;
+
+		std::vector<uint64_t> totals;
+		optimize_shader_timings sum = {};
+		for (const Sample& s : samples)
+		{
+			totals.push_back(s.total);
+			sum.preprocess += s.phases.preprocess;
+			sum.parse += s.phases.parse;
+			sum.ast_to_hir += s.phases.ast_to_hir;
+			sum.link += s.phases.link;
+			sum.optimize += s.phases.optimize;
+			sum.convert += s.phases.convert;
+		}
+		std::sort(totals.begin(), totals.end());
+		const uint64_t n = samples.size();
+		uint64_t total = 0;
+		for (uint64_t t : totals) total += t;
+		result.minNs = totals.front();
+		result.medianNs = totals[totals.size() / 2];
+		result.meanNs = total / n;
+		result.meanPhases = { sum.preprocess / n, sum.parse / n, sum.ast_to_hir / n,
+			sum.link / n, sum.optimize / n, sum.convert / n };
+		return result;
+	}
+
+	double Percent(uint64_t part, uint64_t whole)
+	{
+		return whole == 0 ? 0.0 : 100.0 * (double)part / (double)whole;
+	}
+
+	void PrintUsage(const char* argv0)
+	{
+		fprintf(stderr, "usage: %s [-n iterations] [-w warmup] [-s source_version] [-t target_version]\n"
+			"       [--csv file] [--no-synthetic] [--fast] [--mediump] [--no-pp-cache] [files or directories...]\n", argv0);
+	}
+
+	bool ParseOptions(int argc, char** argv, Options* options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "-n" && hasValue) options->iterations = std::max(1, atoi(argv[++i]));
+			else if (arg == "-w" && hasValue) options->warmup = std::max(0, atoi(argv[++i]));
+			else if (arg == "-s" && hasValue) options->sourceVersion = atoi(argv[++i]);
+			else if (arg == "-t" && hasValue) options->targetVersion = atoi(argv[++i]);
+			else if (arg == "--csv" && hasValue) options->csvPath = argv[++i];
+			else if (arg == "--no-synthetic") options->synthetic = false;
+			else if (arg == "--fast") options->flags |= OPTIMIZE_SHADER_FAST;
+			else if (arg == "--mediump") options->flags |= OPTIMIZE_SHADER_MEDIUMP;
+			else if (arg == "--no-pp-cache") setenv("LTW_PREPROCESSOR_CACHE", "0", 1);
+			else if (!arg.empty() && arg[0] == '-') return false;
+			else options->inputs.push_back(arg);
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	std::vector<Shader> shaders;
+	if (options.inputs.empty()) options.inputs.push_back(BENCH_CORPUS_DIR);
+	for (const std::string& input : options.inputs) LoadInput(input, shaders);
+	if (options.synthetic) AddSynthetic(shaders);
+	if (shaders.empty())
+	{
+		fprintf(stderr, "no shaders found\n");
+		return 1;
+	}
+	if ((options.flags & OPTIMIZE_SHADER_MEDIUMP) && !CheckUniformOperands(options))
+	{
+		fprintf(stderr, "mediump demotion check failed\n");
+		return 1;
+	}
+
+	printf("%d shaders, %d iterations (+%d warm-up), GLSL %d -> ES %d\n\n",
+		(int)shaders.size(), options.iterations, options.warmup, options.sourceVersion, options.targetVersion);
+	printf("%-40s %4s %8s %8s %9s %9s %9s %7s  %5s %5s %5s %5s %5s %5s\n",
+		"shader", "type", "in(B)", "out(B)", "min(us)", "med(us)", "mean(us)", "allocs",
+		"pp%", "parse%", "hir%", "link%", "opt%", "glsl%");
+
+	const auto wallStart = std::chrono::steady_clock::now();
+	std::vector<ShaderResult> results;
+	optimize_shader_timings phaseTotals = {};
+	uint64_t meanTotal = 0;
+	size_t inputTotal = 0;
+	uint64_t allocationTotal = 0;
+	optimize_shader_precision precisionTotals = {};
+	int failures = 0;
+	for (const Shader& shader : shaders)
+	{
+		ShaderResult r = Run(shader, options);
+		results.push_back(r);
+		if (r.failed)
+		{
+			failures++;
+			printf("%-40s %4s %8zu   FAILED\n", r.name.c_str(), StageName(r.type), r.inputSize);
+			continue;
+		}
+		const optimize_shader_timings& p = r.meanPhases;
+		const uint64_t phases = PhaseSum(p);
+		printf("%-40s %4s %8zu %8zu %9.1f %9.1f %9.1f %7llu  %5.1f %5.1f %5.1f %5.1f %5.1f %5.1f\n",
+			r.name.c_str(), StageName(r.type), r.inputSize, r.outputSize,
+			r.minNs / 1000.0, r.medianNs / 1000.0, r.meanNs / 1000.0, (unsigned long long)r.allocations,
+			Percent(p.preprocess, phases), Percent(p.parse, phases), Percent(p.ast_to_hir, phases),
+			Percent(p.link, phases), Percent(p.optimize, phases), Percent(p.convert, phases));
+		phaseTotals.preprocess += p.preprocess;
+		phaseTotals.parse += p.parse;
+		phaseTotals.ast_to_hir += p.ast_to_hir;
+		phaseTotals.link += p.link;
+		phaseTotals.optimize += p.optimize;
+		phaseTotals.convert += p.convert;
+		meanTotal += r.meanNs;
+		inputTotal += r.inputSize;
+		allocationTotal += r.allocations;
+		precisionTotals.operations += r.precision.operations;
+		precisionTotals.demoted_operations += r.precision.demoted_operations;
+		precisionTotals.variables += r.precision.variables;
+		precisionTotals.demoted_variables += r.precision.demoted_variables;
+	}
+	const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	const uint64_t phases = PhaseSum(phaseTotals);
+	const int succeeded = (int)shaders.size() - failures;
+	printf("\nsummary: %d ok, %d failed, wall %.2fs\n", succeeded, failures, wallSeconds);
+	if (meanTotal > 0)
+	{
+		printf("  one pass over the corpus: %.2f ms, %.1f shaders/s, %.2f MB/s of input\n",
+			meanTotal / 1e6, succeeded / (meanTotal / 1e9), inputTotal / (meanTotal / 1e9) / (1024.0 * 1024.0));
+	}
+	printf("  phase split: preprocess %.1f%%, parse %.1f%%, ast_to_hir %.1f%%, link %.1f%%, optimize %.1f%%, glsl %.1f%%\n",
+		Percent(phaseTotals.preprocess, phases), Percent(phaseTotals.parse, phases),
+		Percent(phaseTotals.ast_to_hir, phases), Percent(phaseTotals.link, phases),
+		Percent(phaseTotals.optimize, phases), Percent(phaseTotals.convert, phases));
+	if (options.flags & OPTIMIZE_SHADER_MEDIUMP)
+	{
+		printf("  mediump: %u/%u float operations, %u/%u variables demoted\n",
+			precisionTotals.demoted_operations, precisionTotals.operations,
+			precisionTotals.demoted_variables, precisionTotals.variables);
+	}
+	if (BENCH_COUNTS_ALLOCATIONS)
+	{
+		printf("  heap allocations: %llu per pass over the corpus, %.0f per shader\n",
+			(unsigned long long)allocationTotal, succeeded > 0 ? (double)allocationTotal / succeeded : 0.0);
+	}
+	printf("  peak RSS: %.1f MB\n", usage.ru_maxrss / 1024.0);
+
+	if (!options.csvPath.empty())
+	{
+		FILE* csv = fopen(options.csvPath.c_str(), "w");
+		if (csv == nullptr)
+		{
+			fprintf(stderr, "cannot write %s\n", options.csvPath.c_str());
+			return 1;
+		}
+		fprintf(csv, "shader,type,input_bytes,output_bytes,failed,min_ns,median_ns,mean_ns,"
+			"preprocess_ns,parse_ns,ast_to_hir_ns,link_ns,optimize_ns,convert_ns,float_ops,mediump_ops,allocations\n");
+		for (const ShaderResult& r : results)
+		{
+			const optimize_shader_timings& p = r.meanPhases;
+			fprintf(csv, "%s,%s,%zu,%zu,%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u,%llu\n",
+				r.name.c_str(), StageName(r.type), r.inputSize, r.outputSize, r.failed ? 1 : 0,
+				(unsigned long long)r.minNs, (unsigned long long)r.medianNs, (unsigned long long)r.meanNs,
+				(unsigned long long)p.preprocess, (unsigned long long)p.parse, (unsigned long long)p.ast_to_hir,
+				(unsigned long long)p.link, (unsigned long long)p.optimize, (unsigned long long)p.convert,
+				r.precision.operations, r.precision.demoted_operations, (unsigned long long)r.allocations);
+		}
+		fclose(csv);
+	}
+	return failures == 0 ? 0 : 1;
+}
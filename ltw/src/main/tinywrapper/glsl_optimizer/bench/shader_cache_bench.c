@@ -0,0 +1,317 @@
+/*
+ * Shader cache reload benchmark.
+ *
+ * Replays a shaderpack being reloaded several times through the in-memory
+ * shader cache (shader_cache.c) and reports the hit rate with exact source
+ * keys and with normalized keys (shader_normalize.c). Every reload resubmits
+ * the corpus the way a shaderpack loader rebuilds it: unchanged, with a banner
+ * comment carrying the reload number, with #line directives from #include
+ * expansion renumbered and CRLF line endings, or re-indented. From the sixth
+ * load on a pack option is changed, which must miss with both keys once.
+ * Before that it checks that no normalized key outgrows its source buffer.
+ *
+ * Usage: shader_cache_bench [-r reloads] [files or directories...]
+ *
+ * Without file arguments the bundled corpus (bench/corpus) is used.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../../shader_cache.h"
+#include "../../shader_normalize.h"
+
+bool debug = false;
+
+typedef struct {
+    char * name;
+    char * source;
+    unsigned type;
+} Shader;
+
+typedef struct {
+    Shader * items;
+    int count;
+    int capacity;
+} ShaderList;
+
+static void LoadFile(ShaderList * list, const char * path) {
+    const char * ext = strrchr(path, '.');
+    if (ext == NULL) return;
+    unsigned type;
+    if (strcmp(ext, ".vsh") == 0 || strcmp(ext, ".vert") == 0) type = 0x8B31; // GL_VERTEX_SHADER
+    else if (strcmp(ext, ".fsh") == 0 || strcmp(ext, ".frag") == 0) type = 0x8B30; // GL_FRAGMENT_SHADER
+    else return;
+
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char * source = malloc(size + 1);
+    size_t read = fread(source, 1, size, file);
+    source[read] = '\0';
+    fclose(file);
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 32;
+        list->items = realloc(list->items, list->capacity * sizeof(Shader));
+    }
+    list->items[list->count++] = (Shader) { strdup(path), source, type };
+}
+
+static int ComparePaths(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void LoadInput(ShaderList * list, const char * path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        LoadFile(list, path);
+        return;
+    }
+    DIR * dir = opendir(path);
+    if (dir == NULL) return;
+    char ** entries = NULL;
+    int count = 0;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        entries = realloc(entries, (count + 1) * sizeof(char *));
+        entries[count] = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(entries[count], "%s/%s", path, entry->d_name);
+        ++count;
+    }
+    closedir(dir);
+    qsort(entries, count, sizeof(char *), ComparePaths);
+    for (int i = 0; i < count; ++i) {
+        LoadInput(list, entries[i]);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+typedef struct {
+    char * data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+static void Put(Text * text, const char * data, size_t length) {
+    if (text->length + length + 1 > text->capacity) {
+        text->capacity = (text->length + length + 1) * 2;
+        text->data = realloc(text->data, text->capacity);
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+static void PutString(Text * text, const char * data) {
+    Put(text, data, strlen(data));
+}
+
+/**
+ * Rebuild a shader the way the loader emits it on the given reload. Every
+ * fourth load is byte-identical to the first one, the others differ from it
+ * in one way that does not change the shader.
+ * @param optionChanged Whether the user changed a pack option before this reload
+ */
+static char * LoaderOutput(const char * source, int reload, int optionChanged) {
+    Text text = { 0 };
+    int variant = reload % 4;
+    const char * eol = variant == 2 ? "\r\n" : "\n";
+    int lineShift = variant == 2 ? reload : 0;
+    int line = 1;
+    for (const char * p = source; *p != '\0'; ++line) {
+        const char * end = strchr(p, '\n');
+        size_t length = end ? (size_t) (end - p) : strlen(p);
+        char banner[128];
+        if (line == 2) {
+            // Right after #version: banner and the #line of the first include
+            if (variant == 1) {
+                snprintf(banner, sizeof(banner), "// Generated by the shaderpack loader, reload %d%s", reload, eol);
+                PutString(&text, banner);
+            }
+            snprintf(banner, sizeof(banner), "#line 1 %d%s", 1 + lineShift % 4, eol);
+            PutString(&text, banner);
+        }
+        if (line > 2 && line % 16 == 0) {
+            snprintf(banner, sizeof(banner), "#line %d %d%s", line + lineShift, lineShift % 4, eol);
+            PutString(&text, banner);
+        }
+        const char * body = p;
+        if (variant == 3) {
+            // Re-indented with tabs
+            while (*body == ' ') ++body;
+            if (body != p) Put(&text, "\t", 1);
+        }
+        if (optionChanged && strncmp(body, "#define", 7) == 0 && memchr(body, '4', length - (body - p)) != NULL) {
+            char * copy = strndup(body, length - (body - p));
+            *strchr(copy, '4') = '6';
+            PutString(&text, copy);
+            free(copy);
+        } else {
+            Put(&text, body, length - (body - p));
+        }
+        PutString(&text, eol);
+        p = end ? end + 1 : p + length;
+    }
+    return text.data;
+}
+
+/**
+ * Normalized keys are written into buffers sized for the source, so the
+ * output must never be longer than the input. Runs the known edge cases and
+ * random fragments built from the characters the normalizer treats
+ * specially, and checks a guard area behind each output buffer.
+ * @return Number of inputs that overran
+ */
+static int CheckNormalizeBounds(void) {
+    static const char * cases[] = {
+        "__LINE__/*\n",
+        "__LINE__/*\n*//*\n*/",
+        "__LINE__\n/*\n*/#define A 1\n",
+        "__LINE__ a/ /*\n*/b",
+        "__FILE__ /*\n\n",
+        "#version 150\n#line 4\n/*\n",
+    };
+    static const char alphabet[] = "/*\n\\# \t+a1";
+    enum { GUARD = 16, RANDOM_INPUTS = 200000, MAX_RANDOM_LENGTH = 24 };
+    char input[MAX_RANDOM_LENGTH + 16];
+    int failures = 0;
+    unsigned seed = 1;
+    int total = (int) (sizeof(cases) / sizeof(cases[0])) + RANDOM_INPUTS;
+    for (int k = 0; k < total; ++k) {
+        const char * text = input;
+        if (k < (int) (sizeof(cases) / sizeof(cases[0]))) {
+            text = cases[k];
+        } else {
+            // Half of the inputs keep every line break, like a source using __LINE__
+            size_t length = 0;
+            if (k % 2 == 0) {
+                memcpy(input, "__LINE__", 8);
+                length = 8;
+            }
+            seed = seed * 1103515245u + 12345u;
+            size_t extra = (seed >> 16) % MAX_RANDOM_LENGTH;
+            for (size_t i = 0; i < extra; ++i) {
+                seed = seed * 1103515245u + 12345u;
+                input[length++] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+            }
+            input[length] = '\0';
+        }
+        size_t length = strlen(text);
+        char * out = malloc(length + 1 + GUARD);
+        memset(out, 0x5a, length + 1 + GUARD);
+        size_t outLength = shader_normalize_source_into(1, &text, &length, out, NULL);
+        bool overran = outLength > length;
+        for (int i = 0; i < GUARD; ++i) overran |= (unsigned char) out[length + 1 + i] != 0x5a;
+        if (overran) {
+            if (failures++ < 8) fprintf(stderr, "normalized key longer than its source: \"%s\"\n", text);
+        }
+        free(out);
+    }
+    return failures;
+}
+
+static double NowUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+int main(int argc, char ** argv) {
+    int reloads = 8;
+    ShaderList shaders = { 0 };
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reloads = atoi(argv[++i]);
+            if (reloads < 1) reloads = 1;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-r reloads] [files or directories...]\n", argv[0]);
+            return 2;
+        } else {
+            LoadInput(&shaders, argv[i]);
+        }
+    }
+    int overruns = CheckNormalizeBounds();
+    if (overruns != 0) {
+        fprintf(stderr, "%d inputs overran the normalization buffer\n", overruns);
+        return 1;
+    }
+    if (shaders.count == 0) LoadInput(&shaders, BENCH_CORPUS_DIR);
+    if (shaders.count == 0) {
+        fprintf(stderr, "no shaders found\n");
+        return 1;
+    }
+
+    // The two key kinds use different target versions so they never share entries
+    enum { EXACT, NORMALIZED, MODES };
+    const char * modeNames[MODES] = { "exact", "normalized" };
+    int hits[MODES] = { 0 }, lookups[MODES] = { 0 };
+    double normalizeUs = 0;
+    size_t normalizedBytes = 0, sourceBytes = 0;
+    int optionReload = reloads > 5 ? 5 : -1;
+
+    printf("%d shaders, %d loads (a pack option changes at load %d)\n\n", shaders.count, reloads, optionReload);
+    printf("%-8s %12s %12s\n", "reload", "exact hits", "norm hits");
+    for (int reload = 0; reload < reloads; ++reload) {
+        int reloadHits[MODES] = { 0 };
+        for (int i = 0; i < shaders.count; ++i) {
+            const Shader * shader = &shaders.items[i];
+            char * source = LoaderOutput(shader->source, reload, reload >= optionReload && optionReload >= 0);
+            size_t length = strlen(source);
+            for (int mode = 0; mode < MODES; ++mode) {
+                const char * key = source;
+                size_t keyLength = length;
+                char * normalized = NULL;
+                if (mode == NORMALIZED) {
+                    double start = NowUs();
+                    normalized = shader_normalize_source(1, (const char * const *) &key, &length, &keyLength);
+                    normalizeUs += NowUs() - start;
+                    normalizedBytes += keyLength;
+                    sourceBytes += length;
+                    key = normalized;
+                }
+                int targetVersion = 300 + mode;
+                ++lookups[mode];
+                char * cached = shader_cache_get(1, (const char * const *) &key, &keyLength, shader->type, 460, targetVersion);
+                if (cached != NULL) {
+                    ++hits[mode];
+                    ++reloadHits[mode];
+                    shader_source_release(cached);
+                } else {
+                    // Stands in for the translation, only the key matters here
+                    char * translated = shader_source_new(source, length);
+                    shader_cache_put(key, keyLength, shader->type, 460, targetVersion, translated);
+                    shader_source_release(translated);
+                }
+                free(normalized);
+            }
+            free(source);
+        }
+        printf("%-8d %12d %12d\n", reload, reloadHits[EXACT], reloadHits[NORMALIZED]);
+    }
+
+    printf("\n");
+    for (int mode = 0; mode < MODES; ++mode) {
+        printf("%-11s %4d/%4d hits (%.1f%%), %d translations\n", modeNames[mode], hits[mode], lookups[mode],
+               100.0 * hits[mode] / lookups[mode], lookups[mode] - hits[mode]);
+    }
+    printf("normalization: %.1f us per shader, keys are %.0f%% of the source size\n",
+           normalizeUs / lookups[NORMALIZED], 100.0 * normalizedBytes / sourceBytes);
+    return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * vgpu shader converter benchmark.
+ *
+ * Runs every shader of the corpus through ConvertShaderVgpu() and through the
+ * original sequence of text passes it replaced (one strstr/memmove pass per
+ * rename, see shaderconv_reference.c), and reports the time of both
+ * and whether their outputs match. Outputs that only differ in whitespace are
+ * counted separately.
+ *
+ * Usage: shaderconv_bench [options] [files or directories...]
+ *   -n N           timed iterations per shader (default 10)
+ *   --no-synthetic skip the generated large shaders
+ *   --show-diffs   print both outputs of the shaders that differ
+ *
+ * Without file arguments the bundled corpus (bench/corpus) is used.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../../vgpu_shaderconv/shaderconv.h"
+#include "shaderconv_reference.h"
+
+typedef struct {
+    char * name;
+    char * source;
+    int is_vertex;
+} Shader;
+
+typedef struct {
+    Shader * items;
+    int count;
+    int capacity;
+} ShaderList;
+
+static void AddShader(ShaderList * list, const char * name, char * source, int is_vertex) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 32;
+        list->items = realloc(list->items, list->capacity * sizeof(Shader));
+    }
+    list->items[list->count++] = (Shader) { strdup(name), source, is_vertex };
+}
+
+static void LoadFile(ShaderList * list, const char * path) {
+    const char * ext = strrchr(path, '.');
+    if (ext == NULL) return;
+    int is_vertex;
+    if (strcmp(ext, ".vsh") == 0 || strcmp(ext, ".vert") == 0) is_vertex = 1;
+    else if (strcmp(ext, ".fsh") == 0 || strcmp(ext, ".frag") == 0) is_vertex = 0;
+    else return;
+
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char * source = malloc(size + 1);
+    size_t read = fread(source, 1, size, file);
+    source[read] = '\0';
+    fclose(file);
+    AddShader(list, path, source, is_vertex);
+}
+
+static int ComparePaths(const void * a, const void * b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void LoadInput(ShaderList * list, const char * path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        LoadFile(list, path);
+        return;
+    }
+    DIR * dir = opendir(path);
+    if (dir == NULL) return;
+    char ** entries = NULL;
+    int count = 0;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        entries = realloc(entries, (count + 1) * sizeof(char *));
+        entries[count] = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(entries[count], "%s/%s", path, entry->d_name);
+        ++count;
+    }
+    closedir(dir);
+    qsort(entries, count, sizeof(char *), ComparePaths);
+    for (int i = 0; i < count; ++i) {
+        LoadInput(list, entries[i]);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+static void Append(char ** text, size_t * length, const char * format, int value) {
+    char line[512];
+    int n = snprintf(line, sizeof(line), format, value, value, value, value);
+    *text = realloc(*text, *length + n + 1);
+    memcpy(*text + *length, line, n + 1);
+    *length += n;
+}
+
+// A desktop GLSL 1.20 shader of the size shaderpacks reach after #include:
+// texture2D calls, int math, array indices and varyings everywhere.
+static char * GenerateLarge(int functions) {
+    char * text = NULL;
+    size_t length = 0;
+    Append(&text, &length, "#version 120\n", 0);
+    Append(&text, &length, "uniform sampler2D texture;\nvarying vec2 texcoord;\nuniform float weights[8];\n", 0);
+    for (int i = 0; i < functions; ++i) {
+        Append(&text, &length,
+               "vec4 layer%d(vec2 uv, vec4 acc) {\n"
+               "    int steps = %d + 4;\n"
+               "    vec4 c = texture2D(texture, uv * 0.5 + vec2(%d) * 0.01);\n"
+               "    for (int j = 0; j < steps; j++) {\n"
+               "        c.rgb = mix(c.rgb, acc.rgb, weights[j] * float(%d));\n"
+               "    }\n"
+               "    return acc * 0.5 + c * 0.5;\n"
+               "}\n", i);
+    }
+    Append(&text, &length, "void main() {\n    vec4 acc = vec4(0);\n", 0);
+    for (int i = 0; i < functions; ++i) Append(&text, &length, "    acc = layer%d(texcoord, acc);\n", i);
+    Append(&text, &length, "    gl_FragColor = acc;\n}\n", 0);
+    return text;
+}
+
+static double NowUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+// Both converters take ownership of a heap copy of the source
+static char * Run(const Shader * shader, int passes, double * bestUs, int iterations) {
+    char * output = NULL;
+    *bestUs = 0;
+    for (int i = 0; i < iterations; ++i) {
+        char * source = strdup(shader->source);
+        double start = NowUs();
+        char * result = passes ? ConvertShaderVgpuPasses(source, shader->is_vertex)
+                               : ConvertShaderVgpu(source, shader->is_vertex, 0);
+        double elapsed = NowUs() - start;
+        if (i == 0 || elapsed < *bestUs) *bestUs = elapsed;
+        free(output);
+        output = result;
+    }
+    return output;
+}
+
+static int EqualIgnoringWhitespace(const char * a, const char * b) {
+    for (;;) {
+        while (*a == ' ' || *a == '\t' || *a == '\n' || *a == '\r') ++a;
+        while (*b == ' ' || *b == '\t' || *b == '\n' || *b == '\r') ++b;
+        if (*a != *b) return 0;
+        if (*a == '\0') return 1;
+        ++a;
+        ++b;
+    }
+}
+
+int main(int argc, char ** argv) {
+    int iterations = 10;
+    int synthetic = 1;
+    int showDiffs = 0;
+    ShaderList shaders = { 0 };
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+            if (iterations < 1) iterations = 1;
+        } else if (strcmp(argv[i], "--no-synthetic") == 0) {
+            synthetic = 0;
+        } else if (strcmp(argv[i], "--show-diffs") == 0) {
+            showDiffs = 1;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: %s [-n iterations] [--no-synthetic] [--show-diffs] [files or directories...]\n", argv[0]);
+            return 2;
+        } else {
+            LoadInput(&shaders, argv[i]);
+        }
+    }
+    if (shaders.count == 0) LoadInput(&shaders, BENCH_CORPUS_DIR);
+    if (synthetic) {
+        AddShader(&shaders, "synthetic/large_64.fsh", GenerateLarge(64), 0);
+        AddShader(&shaders, "synthetic/large_256.fsh", GenerateLarge(256), 0);
+    }
+    if (shaders.count == 0) {
+        fprintf(stderr, "no shaders found\n");
+        return 1;
+    }
+
+    printf("%d shaders, best of %d iterations\n\n", shaders.count, iterations);
+    printf("%-60s %8s %11s %11s %8s  %s\n", "shader", "in(B)", "passes(us)", "tokens(us)", "speedup", "output");
+    double totalPasses = 0, totalTokens = 0;
+    int identical = 0, whitespace = 0, different = 0;
+    for (int i = 0; i < shaders.count; ++i) {
+        const Shader * shader = &shaders.items[i];
+        double passesUs, tokensUs;
+        char * before = Run(shader, 1, &passesUs, iterations);
+        char * after = Run(shader, 0, &tokensUs, iterations);
+        totalPasses += passesUs;
+        totalTokens += tokensUs;
+
+        const char * verdict;
+        if (strcmp(before, after) == 0) {
+            verdict = "identical";
+            ++identical;
+        } else if (EqualIgnoringWhitespace(before, after)) {
+            verdict = "whitespace only";
+            ++whitespace;
+        } else {
+            verdict = "DIFFERENT";
+            ++different;
+        }
+        const char * name = shader->name;
+        if (strncmp(name, BENCH_CORPUS_DIR "/", strlen(BENCH_CORPUS_DIR "/")) == 0) name += strlen(BENCH_CORPUS_DIR "/");
+        if (strlen(name) > 60) name += strlen(name) - 60;
+        printf("%-60s %8zu %11.1f %11.1f %7.1fx  %s\n", name, strlen(shader->source), passesUs, tokensUs,
+               tokensUs > 0 ? passesUs / tokensUs : 0.0, verdict);
+        if (showDiffs && strcmp(verdict, "identical") != 0) {
+            printf("---- passes\n%s\n---- tokens\n%s\n----\n", before, after);
+        }
+        free(before);
+        free(after);
+    }
+
+    printf("\nsummary: passes %.2f ms, tokens %.2f ms (%.1fx); %d identical, %d whitespace only, %d different\n",
+           totalPasses / 1000, totalTokens / 1000, totalTokens > 0 ? totalPasses / totalTokens : 0.0,
+           identical, whitespace, different);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Reference implementation of the vgpu shader converter.
+ *
+ * The text passes ConvertShaderVgpu() ran before the token rewriter, one
+ * strstr/memmove pass per rename. shaderconv_bench checks the converter
+ * against them; they are not part of the wrapper.
+ */
+
+#include <string.h>
+
+#include "shaderconv_reference.h"
+#include "../../vgpu_shaderconv/shaderconv.h"
+#include "../../vgpu_shaderconv/shadertokens.h"
+#include "../../string_utils.h"
+
+/**
+ * Replace a function definition and calls to the function to another name
+ * @param source The shader as a string
+ * @param sourceLength The shader length
+ * @param initialName The name be to changed
+ * @param finalName The name to use instead
+ * @return The shader as a string, maybe in a different memory location
+ */
+static char * ReplaceFunctionName(char * source, int * sourceLength, const char * initialName, const char * finalName){
+    TokenRewrite rewrite = { TOKEN_REWRITE_FUNCTION, initialName, finalName };
+    TokenRewriter rewriter = { .rewrites = &rewrite, .rewriteCount = 1 };
+    if (strstr(source, initialName) == NULL) return source;
+    return RewriteShaderTokens(source, sourceLength, &rewriter);
+}
+
+/**
+ * Replace a function and its calls by a wrapper version, only if needed
+ * @param source The shader code as a string
+ * @param functionName The function to be replaced
+ * @param wrapperFunctionName The replacing function name
+ * @param function The wrapper function itself
+ * @return The shader as a string, maybe in a different memory location
+ */
+static char * WrapFunction(char * source, int * sourceLength, const char * functionName, const char * wrapperFunctionName, const char * wrapperFunction){
+    int originalSize = strlen(source);
+    source = ReplaceFunctionName(source, sourceLength, functionName, wrapperFunctionName);
+    // If some calls got replaced, add the wrapper
+    if(originalSize != strlen(source)){
+        int insertPoint = FindPositionAfterDirectives(source);
+        source = InplaceInsertByIndex(source, sourceLength, insertPoint + 1, wrapperFunction);
+    }
+
+    return source;
+}
+
+static char * WrapIvecFunctions(char * source, int * sourceLength){
+    for (int i = 0; i < vgpuFunctionWrapperCount; ++i) {
+        const VgpuFunctionWrapper * wrapper = &vgpuFunctionWrappers[i];
+        source = WrapFunction(source, sourceLength, wrapper->functionName, wrapper->wrapperName, wrapper->wrapper);
+    }
+    return source;
+}
+
+/**
+ * Change all (u)ints to floats.
+ * This is a hack to avoid dealing with implicit conversions on common operators
+ * @param source The shader as a string
+ * @return The shader as a string, maybe in a new memory location
+ * @see ForceIntegerArrayAccess
+ */
+static char * CoerceIntToFloat(char * source, int * sourceLength){
+    // Let's go the "freestyle way"
+
+    // Step 1 is to translate keywords
+    // Attempt and loop unrolling -> worked well, time to fix my shit I guess
+    source = ReplaceVariableName(source, sourceLength, "int", "float");
+    source = WrapFunction(source, sourceLength, "int", "float", "\n ");
+    source = ReplaceVariableName(source, sourceLength, "uint", "float");
+    source = WrapFunction(source, sourceLength, "uint", "float", "\n ");
+
+    // TODO Yes I could just do the same as above but I'm lazy at times
+    const gl4es_replacement_t integerTypes[] = {
+        { "ivec", "vec" },
+        { "uvec", "vec" },
+        { "isampleBuffer", "sampleBuffer" },
+        { "usampleBuffer", "sampleBuffer" },
+        { "isampler", "sampler" },
+        { "usampler", "sampler" },
+    };
+    source = gl4es_replace_batch(source, sourceLength, integerTypes, sizeof(integerTypes) / sizeof(integerTypes[0]));
+
+
+    // Step 3 is slower.
+    // We need to parse hardcoded values like 1 and turn it into 1.(0)
+    // The allocated length goes past the terminator, only the text is scanned
+    for(int i=0; source[i] != '\0'; ++i){
+
+        // Avoid version/line directives
+        if(source[i] == '#' && (source[i + 1] == 'v' || source[i + 1] == 'l') ){
+            // Look for the next line
+            while (source[i] != '\n' && source[i] != '\0'){
+                i++;
+            }
+            if(source[i] == '\0') break;
+        }
+
+        if(!isDigit(source[i])){ continue; }
+        // So there is a few situations that we have to distinguish:
+        // functionName1 (      ----- meaning there is SOMETHING on its left side that is related to the number
+        // function(1,          ----- there is something, and it ISN'T related to the number
+        // float test=3;        ----- something on both sides, not related to the number.
+        // float test=X.2       ----- There is a dot, so it is part of a float already
+        // float test = 0.00000 ----- I have to backtrack to find the dot
+        // float test = 4u      ----- I delete the u, then branch back to normal int handling
+
+        if(source[i-1] == '.' || source[i+1] == '.') continue;// Number part of a float
+        if(isValidFunctionName(source[i - 1])) continue; // Char attached to something related
+        if(isDigit(source[i+1])) continue; // End of number not reached
+        if(isDigit(source[i-1])){
+            // Backtrack to check if the number is floating point
+            int shouldBeCoerced = 0;
+            for(int j=1; 1; ++j){
+                if(isDigit(source[i-j])) continue;
+                if(isValidFunctionName(source[i-j])) break; // Function or variable name, don't coerce
+                if(source[i-j] == '.' || ((source[i-j] == '+' || source[i-j] == '-') && (source[i-j-1] == 'e'|| source[i-j-1] == 'E') )) break; // No coercion, float or scientific notation already
+                // Nothing found, should be coerced then
+                shouldBeCoerced = 1;
+                break;
+            }
+
+            if(!shouldBeCoerced) continue;
+        }
+
+        // Check if we have the scientific notation
+        if(((source[i-1] == '+' || source[i-1] == '-') && (source[i-2] == 'e'|| source[i-2] == 'E'))) continue;
+
+
+        // Remove the potential uint literal marking
+        if(source[i+1] == 'u') source[i+1] = ' ';
+
+        // Now we know there is nothing related to the digit, turn it into a float
+        source = InplaceInsertByIndex(source, sourceLength, i+1, ".0");
+    }
+
+    // TODO Hacks for special built in values and typecasts ?
+    const gl4es_replacement_t builtins[] = {
+        { "gl_VertexID", "float(gl_VertexID)" },
+        { "gl_InstanceID", "float(gl_InstanceID)" },
+    };
+    source = gl4es_replace_batch(source, sourceLength, builtins, 2);
+
+    return source;
+}
+
+/** Force all array accesses to use integers by adding an explicit typecast
+ * @param source The shader as a string
+ * @return The shader as a string, maybe at a new memory location */
+static char * ForceIntegerArrayAccess(char* source, int * sourceLength){
+    char * markerStart = "$";
+    char * markerEnd = "`";
+
+    // Step 1, we need to mark all [] that are empty and must not be changed
+    int leftCharIndex = 0;
+    for(int i=0; source[i] != '\0'; ++i){
+        if(source[i] == '['){
+            leftCharIndex = i;
+            continue;
+        }
+        // If a start has been found
+        if(leftCharIndex){
+            if(source[i] == ' ' || source[i] == '\n'){
+                continue;
+            }
+            // We find the other side and mark both ends
+            if(source[i] == ']'){
+                source[leftCharIndex] = *markerStart;
+                source[i] = *markerEnd;
+            }
+        }
+        //Something else is there, abort the marking phase for this one
+        leftCharIndex = 0;
+    }
+
+    // Step 2, replace the array accesses with a forced typecast version and restore all marked empty []
+    const gl4es_replacement_t accesses[] = {
+        { "]", ")]" },
+        { "[", "[int(" },
+        { markerStart, "[" },
+        { markerEnd, "]" },
+    };
+    source = gl4es_replace_batch(source, sourceLength, accesses, 4);
+
+    return source;
+}
+
+
+/** The pass sequence ConvertShaderVgpu used before the token rewriter */
+char * ConvertShaderVgpuPasses(char * source, int is_vertex) {
+    int sourceLength = strlen(source) + 1;
+    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define texture2D texture\n", "");
+    source = ReplaceVariableName(source, &sourceLength, "sample", "vgpu_Sample");
+    source = ReplaceVariableName(source, &sourceLength, "texture", "vgpu_texture");
+    source = ReplaceFunctionName(source, &sourceLength, "texture2D", "texture");
+    source = ReplaceFunctionName(source, &sourceLength, "texture3D", "texture");
+    source = ReplaceFunctionName(source, &sourceLength, "texture2DLod", "textureLod");
+    source = gl4es_inplace_replace_simple(source, &sourceLength, "\"", "");
+    source = InsertExtensions(source, &sourceLength);
+    source = ReplaceModOperator(source, &sourceLength);
+    source = CoerceIntToFloat(source, &sourceLength);
+    source = ForceIntegerArrayAccess(source, &sourceLength);
+    source = WrapIvecFunctions(source, &sourceLength);
+    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define texture texture2D\n", "");
+    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define attribute in\n", "");
+    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define varying out\n", "");
+    if (is_vertex) {
+        source = ReplaceVariableName(source, &sourceLength, "attribute", "in");
+        source = ReplaceVariableName(source, &sourceLength, "varying", "out");
+    } else {
+        source = ReplaceVariableName(source, &sourceLength, "varying", "in");
+    }
+    if (!is_vertex && doesShaderVersionContainsES(source)) {
+        source = ReplaceGLFragData(source, &sourceLength);
+        source = ReplaceGLFragColor(source, &sourceLength);
+    }
+    source = ReplacePrecisionQualifiers(source, &sourceLength, is_vertex);
+    source = ProcessSwitchCases(source, &sourceLength);
+    source = FixSimpleSwitchCases(source, &sourceLength);
+    source = WrapSwitchStatements(source, &sourceLength);
+    source = RemoveUniformProperty(source);
+    source = ForceIntegerLayoutOutput(source, &sourceLength);
+    source = WrapBitShiftOperators(source, &sourceLength);
+    source = WrapBitwiseOrAnd(source, &sourceLength);
+    source = SimplifyRedundantParentheses(source, &sourceLength);
+    source = SimplifyRedundantIntTypecasts(source, &sourceLength);
+    source = SimplifyConstIntTypecasts(source, &sourceLength);
+    source = FixReturnTypes(source, &sourceLength);
+    return source;
+}
@@ -0,0 +1,11 @@
+/*
+ * Reference implementation of the vgpu shader converter, see shaderconv_reference.c.
+ */
+
+#ifndef SHADERCONV_REFERENCE_H
+#define SHADERCONV_REFERENCE_H
+
+/** The pass sequence ConvertShaderVgpu used before the token rewriter, takes ownership of source */
+char * ConvertShaderVgpuPasses(char * source, int is_vertex);
+
+#endif //SHADERCONV_REFERENCE_H
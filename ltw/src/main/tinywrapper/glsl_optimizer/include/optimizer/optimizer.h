@@ -35,7 +35,9 @@ public:
 	bool Failed()const noexcept;
 	std::string GetLog();
 private:
-	GlslConvert& instance;
+	const GlslConvert& instance;
+	bool failed = false;
+	std::string log;
 };
 
 
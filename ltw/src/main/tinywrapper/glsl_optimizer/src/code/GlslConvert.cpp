@@ -15,11 +15,14 @@
  */
 
 #include <optional>
+#include <chrono>
 
 #include "GlslConvert.h"
 
 #include <cstdio>
 #include <cstring>
+#include <map>
+#include <mutex>
 
 #include "../compiler/glsl/ast.h"
 #include "../compiler/glsl/ir_optimization.h"
@@ -34,6 +37,7 @@
 
  //#include "ir_print_ir_visitor.h"
 #include "ir_print_glsl_visitor.h"
+#include "preprocessor_cache.h"
 //#include "../compiler/glsl/ir_builder_print_visitor.h"
 
 #include "../compiler/glsl/string_to_uint_map.h"
@@ -45,7 +49,9 @@
 
 GlslConvert::GlslConvert()
 {
-
+	// Process-wide IR setting; set once here (Instance() construction is
+	// thread-safe) instead of on every Optimize() call.
+	ir_variable::temporaries_allocate_names = true;
 }
 
 GlslConvert::~GlslConvert()
@@ -59,7 +65,25 @@ GlslConvert::~GlslConvert()
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-char * GlslConvert::Optimize(
+namespace
+{
+	// Adds the time elapsed since the previous lap to vTarget.
+	class PhaseClock
+	{
+	public:
+		void Lap(uint64_t& vTarget)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			vTarget += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_Start).count();
+			m_Start = now;
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_Start = std::chrono::steady_clock::now();
+	};
+}
+
+GlslConvert::Result GlslConvert::Optimize(
 	const char * vShaderSource,
 	ShaderStage vShaderType,
 	ApiTarget vTarget,
@@ -67,10 +91,9 @@ char * GlslConvert::Optimize(
 	int vGLSLVersion,
     int vTargetGLSLVersion,
     bool isESShader,
-	OptimizationStruct vOptimizationStruct)
+	OptimizationStruct vOptimizationStruct) const
 {
-	this->failed = false;
-    char * optimized_shader = NULL;
+	Result result;
 
 	struct gl_shader* shader = rzalloc(NULL, struct gl_shader);
 	shader->Stage = (gl_shader_stage)vShaderType;
@@ -100,18 +123,15 @@ char * GlslConvert::Optimize(
 
 	vOptimizationStruct.stage = vShaderType;
 
-	struct gl_context local_ctx;
-	struct gl_context* ctx = &local_ctx;
-	InitContext(ctx, vTarget, vGLSLVersion);
+	// Shallow copy of the shared template: the compiler only reads ctx, but it
+	// takes a non-const pointer. Kept on the heap since gl_context is ~150KB.
+	struct gl_context* ctx = (struct gl_context*)malloc(sizeof(struct gl_context));
+	memcpy(ctx, GetContextTemplate(vTarget, vGLSLVersion), sizeof(struct gl_context));
 
 	gl_shader_compiler_options compileOptions =
 		ctx->Const.ShaderCompilerOptions[(int)shader->Stage];
 	FillCompilerOptions(&compileOptions, &vOptimizationStruct);
 
-    ctx->Const.AllowGLSLExtensionDirectiveMidShader = true;
-
-	ir_variable::temporaries_allocate_names = true;
-
 	struct _mesa_glsl_parse_state* state
 		= new(shader) _mesa_glsl_parse_state(ctx, shader->Stage, shader);
 
@@ -125,16 +145,23 @@ char * GlslConvert::Optimize(
 	shader->Source = vShaderSource;
 	const char* source = shader->Source;
 
-	if (!(vOptimizationStruct.controlFlags & ControlFlags::CONTROL_SKIP_PREPROCESSING))
+	PhaseClock clock;
+
+	// Sources without macros, conditionals or comments go to the parser directly
+	if (!(vOptimizationStruct.controlFlags & ControlFlags::CONTROL_SKIP_PREPROCESSING) && source_needs_preprocessing(source))
 	{
-        state->error = glcpp_preprocess(state, &source, &state->info_log, add_builtin_defines, state, ctx) != 0;
+		// Checkpoints depend on the builtin defines, which depend on the context and the stage
+		const uint64_t contextKey = ((uint64_t)vTarget << 48) | ((uint64_t)vGLSLVersion << 16) | (uint64_t)vShaderType;
+		state->error = preprocess_cached(state, &source, &state->info_log, state, ctx, contextKey) != 0;
 	}
+	clock.Lap(result.timings.preprocess);
 
 	if (!state->error)
 	{
 		_mesa_glsl_lexer_ctor(state, source);
 		_mesa_glsl_parse(state);
 		_mesa_glsl_lexer_dtor(state);
+		clock.Lap(result.timings.parse);
 
 		if (vLanguageTarget == LanguageTarget::LANGUAGE_TARGET_AST)
 		{
@@ -183,6 +210,7 @@ char * GlslConvert::Optimize(
 
 			if (!state->translation_unit.is_empty())
 				_mesa_ast_to_hir(ir, state);
+			clock.Lap(result.timings.ast_to_hir);
 
 			if (!state->error)
 			{
@@ -209,6 +237,7 @@ char * GlslConvert::Optimize(
 								program->Shaders,
 								program->NumShaders,
 								_allowMissingMain);
+						clock.Lap(result.timings.link);
 
 						if (program->_LinkedShaders[stage])
 						{
@@ -223,14 +252,33 @@ char * GlslConvert::Optimize(
 						{
 							linked = false;
 
-							log = program->data->InfoLog;
-							failed = true;
+							result.log = program->data->InfoLog;
+							result.failed = true;
 						}
 					}
 
-					// Do optimization post-link
-                    apply_optimizations(ir, linked, &compileOptions);
+					const bool fast = (vOptimizationStruct.controlFlags & ControlFlags::CONTROL_FAST_TRANSLATION) != 0;
+					const bool linkStages = linked && !fast && (vOptimizationStruct.controlFlags & ControlFlags::CONTROL_LINK_STAGES);
+					if (linkStages && vOptimizationStruct.nextStageInputs != nullptr)
+						result.prunedOutputs = prune_dead_outputs(ir, *vOptimizationStruct.nextStageInputs);
+					if (linked && !fast && vOptimizationStruct.specializedUniformCount != 0)
+						result.specializedUniforms = specialize_uniforms(ir, vOptimizationStruct.specializedUniforms,
+							vOptimizationStruct.specializedUniformCount);
 
+					// Do optimization post-link
+                    apply_optimizations(ir, linked, &compileOptions, fast);
+					if (result.specializedUniforms != 0)
+						fold_specialized_constants(ir);
+					if (linkStages)
+					{
+						// A single optimization pass leaves dead chains half removed,
+						// which would keep their inputs (and the previous stage's code) alive
+						while (do_dead_code(ir)) {}
+						collect_stage_inputs(ir, &result.inputs);
+					}
+                    if (!fast && (vOptimizationStruct.controlFlags & ControlFlags::CONTROL_DEMOTE_PRECISION))
+                        demote_precision(ir, shader->Stage, &result.precision);
+					clock.Lap(result.timings.optimize);
 
 					validate_ir_tree(ir);
 
@@ -272,7 +320,12 @@ char * GlslConvert::Optimize(
                     state->es_shader = isESShader;
                     state->language_version = vTargetGLSLVersion;
                     state->original_language_version = vGLSLVersion;
-					optimized_shader = IR_TO_GLSL::Convert(ir, state);
+					// The output is usually within twice the input plus the precision preamble,
+					// so a buffer of that size is written once and never reallocated.
+					const size_t capacity = strlen(vShaderSource) * 2 + 1024;
+					result.source = IR_TO_GLSL::Convert(ir, state, vOptimizationStruct.outputReserve, capacity,
+						&result.sourceLength);
+					clock.Lap(result.timings.convert);
 				}
 				/*else if (vLanguageTarget == LanguageTarget::LANGUAGE_TARGET_HLSL)
 				{
@@ -285,16 +338,16 @@ char * GlslConvert::Optimize(
 			}
 			else
 			{
-				log = state->info_log;
-				failed = true;
+				result.log = state->info_log;
+				result.failed = true;
 			}
 		}
 
 	}
 	else
 	{
-		log = state->info_log;
-		failed = true;
+		result.log = state->info_log;
+		result.failed = true;
 	}
 
 	// free
@@ -306,16 +359,23 @@ char * GlslConvert::Optimize(
 	ralloc_free(state);
 	ralloc_free(shader);
 
-	ClearContext(ctx);
+	free(ctx);
 
-	return optimized_shader;
+	return result;
 }
 
 void GlslConvert::apply_optimizations(
         struct  exec_list *vIr,
         bool linked,
-        gl_shader_compiler_options* vCompilerFlags
+        gl_shader_compiler_options* vCompilerFlags,
+        bool vFast
 ) {
+   if (vFast) {
+      // Tier-0 translation: skip the optimization loop, keep the lowering
+      // of constructs GLSL ES can't express.
+      lower_instructions(vIr, false, false);
+      return;
+   }
    unsigned int passes = 0;
 	while (passes < 1){
       passes ++;
@@ -610,6 +670,27 @@ void GlslConvert::ClearContext(struct gl_context* ctx)
 	_mesa_glsl_builtin_functions_decref();
 }
 
+const struct gl_context* GlslConvert::GetContextTemplate(ApiTarget api, int vGlslVersion)
+{
+	// One fully initialized context per (api, version), built on first use and
+	// kept for the lifetime of the process. Each template holds a reference on
+	// the builtin functions, so they are no longer rebuilt for every shader.
+	static std::mutex templates_lock;
+	static std::map<std::pair<int, int>, struct gl_context*> templates;
+
+	std::lock_guard<std::mutex> guard(templates_lock);
+	const std::pair<int, int> key((int)api, vGlslVersion);
+	auto it = templates.find(key);
+	if (it != templates.end())
+		return it->second;
+
+	struct gl_context* ctx = rzalloc(NULL, struct gl_context);
+	InitContext(ctx, api, vGlslVersion);
+	ctx->Const.AllowGLSLExtensionDirectiveMidShader = true;
+	templates[key] = ctx;
+	return ctx;
+}
+
 struct gl_shader_program* GlslConvert::GetProgramFromShader(struct gl_context* ctx, struct gl_shader* shader)
 {
 	struct gl_shader_program* whole_program = 0;
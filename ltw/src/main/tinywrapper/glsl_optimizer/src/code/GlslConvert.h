@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <map>
 #include <functional>
 #include "../compiler/shader_enums.h"
+#include "precision_demotion.h"
+#include "varying_pruning.h"
+#include "uniform_specialization.h"
 
 struct exec_list;
 struct gl_context;
@@ -61,7 +65,10 @@ public:
 	enum ControlFlags 
 	{
 		CONTROL_SKIP_PREPROCESSING = (1 << 0), // Skip preprocessing shader source. Saves some time if you know you don't need it.
-		CONTROL_DO_PARTIAL_SHADER = (1 << 1) // Passed shader is not the full shader source. This makes some optimizations weaker.
+		CONTROL_DO_PARTIAL_SHADER = (1 << 1), // Passed shader is not the full shader source. This makes some optimizations weaker.
+		CONTROL_FAST_TRANSLATION = (1 << 2), // Only run the lowering passes the target needs. Output is correct but unoptimized.
+		CONTROL_DEMOTE_PRECISION = (1 << 3), // Qualify safe float values as mediump (see precision_demotion.h). Ignored with CONTROL_FAST_TRANSLATION.
+		CONTROL_LINK_STAGES = (1 << 4) // Shader is translated together with the other stage: report its live inputs and drop outputs missing from nextStageInputs (see varying_pruning.h).
 	};
 
 	enum CompilerFlags
@@ -164,6 +171,10 @@ public:
 		// dont save
 		int maxCountPasses = 1000;
 		ShaderStage stage = ShaderStage::MESA_SHADER_FRAGMENT;
+		const std::set<std::string>* nextStageInputs = nullptr; // with CONTROL_LINK_STAGES: inputs of the next stage, nullptr for the last one
+		const specialized_uniform* specializedUniforms = nullptr; // uniforms compiled in as constants (see uniform_specialization.h)
+		unsigned specializedUniformCount = 0;
+		size_t outputReserve = 0; // bytes left free in front of Result::source for the caller's header
 
 		// the rest is to save
 		CompilerFlags compilerFlags = (GlslConvert::CompilerFlags)0;
@@ -241,7 +252,33 @@ protected:
 	~GlslConvert(); // Prevent unwanted destruction
 
 public:
-	char * Optimize(
+	// Wall-clock time spent in each translator phase, in nanoseconds.
+	struct PhaseTimings
+	{
+		uint64_t preprocess = 0;	// glcpp_preprocess
+		uint64_t parse = 0;			// _mesa_glsl_parse
+		uint64_t ast_to_hir = 0;	// _mesa_ast_to_hir
+		uint64_t link = 0;			// link_intrastage_shaders
+		uint64_t optimize = 0;		// apply_optimizations
+		uint64_t convert = 0;		// IR_TO_GLSL::Convert
+	};
+
+	// Everything produced by a single Optimize() call. GlslConvert itself holds no
+	// per-call state, so any number of threads may translate at the same time.
+	struct Result
+	{
+		char* source = nullptr; // allocated with malloc, owned by the caller; the text starts outputReserve bytes in
+		size_t sourceLength = 0;
+		bool failed = false;
+		std::string log;
+		PhaseTimings timings;
+		precision_demotion_stats precision;	// all zero unless CONTROL_DEMOTE_PRECISION was set
+		std::set<std::string> inputs;		// with CONTROL_LINK_STAGES: stage inputs the shader still reads
+		unsigned prunedOutputs = 0;			// with CONTROL_LINK_STAGES: outputs the next stage does not read
+		unsigned specializedUniforms = 0;	// uniforms replaced by their value
+	};
+
+	Result Optimize(
 		const char * vShaderSource,
 		ShaderStage vShaderType,
 		ApiTarget vTarget, 
@@ -249,26 +286,17 @@ public:
 		int vGLSLVersion,
         int vTargetGLSLVersion,
         bool isESShader,
-		OptimizationStruct vOptimisationStruct);
-	std::string GetLog()noexcept
-	{
-		return std::move(log);
-	}
-	bool Failed()const noexcept
-	{
-		return failed;
-	}
+		OptimizationStruct vOptimisationStruct) const;
 
 
 public:
 	static void InitContext(struct gl_context *ctx, ApiTarget api, int vGlslVersion);
 	static void ClearContext(struct gl_context *ctx);
+	static const struct gl_context* GetContextTemplate(ApiTarget api, int vGlslVersion);
 	static struct gl_shader_program* GetProgramFromShader(struct gl_context *ctx, struct gl_shader *shader);
 
 private:
-	void FillCompilerOptions(gl_shader_compiler_options *vCompileOptions, OptimizationStruct *vOptimizationStruct);
-	std::string log;
-	bool failed = false;
+	static void FillCompilerOptions(gl_shader_compiler_options *vCompileOptions, OptimizationStruct *vOptimizationStruct);
 
-    void apply_optimizations(exec_list *vIr, bool linked, gl_shader_compiler_options *vCompilerFlags);
+    static void apply_optimizations(exec_list *vIr, bool linked, gl_shader_compiler_options *vCompilerFlags, bool vFast);
 };
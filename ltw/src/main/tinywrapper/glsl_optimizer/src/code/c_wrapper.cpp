@@ -3,6 +3,8 @@
 //
 
 #include <cstring>
+#include <cstdlib>
+#include <vector>
 #include "c_wrapper.h"
 #include "GlslConvert.h"
 
@@ -24,16 +26,31 @@ extern "C" {
 
 GlslConvert::OptimizationStruct optimizationStruct {}; // Default struct with everything enabled
 
+static GlslConvert::OptimizationStruct optionsForFlags(int flags) {
+    GlslConvert::OptimizationStruct options = optimizationStruct;
+    if(flags & OPTIMIZE_SHADER_FAST) {
+        options.controlFlags = (GlslConvert::ControlFlags)(options.controlFlags | GlslConvert::CONTROL_FAST_TRANSLATION);
+    }
+    if(flags & OPTIMIZE_SHADER_MEDIUMP) {
+        options.controlFlags = (GlslConvert::ControlFlags)(options.controlFlags | GlslConvert::CONTROL_DEMOTE_PRECISION);
+    }
+    return options;
+}
 
 
-__attribute((visibility("default"))) char *optimize_shader(char *source, GLenum type, int vGLSLVersion, int vTargetGLSLVersion) {
-    GlslConvert& converter = GlslConvert::Instance();
+__attribute((visibility("default"))) char *optimize_shader_ex(char *source, GLenum type, int vGLSLVersion, int vTargetGLSLVersion,
+                                                               int flags, struct optimize_shader_timings *timings,
+                                                               struct optimize_shader_precision *precision,
+                                                               struct optimize_shader_output *output) {
+    const GlslConvert& converter = GlslConvert::Instance();
     GlslConvert::ShaderStage stage = getStageForGlEnum(type);
     if(stage == GlslConvert::MESA_SHADER_NONE) {
         printf("Unknown shader type %x\n", type);
         return nullptr;
     }
-    char * optimized_shader = converter.Optimize(
+    GlslConvert::OptimizationStruct options = optionsForFlags(flags);
+    if(output != nullptr) options.outputReserve = output->offset;
+    GlslConvert::Result result = converter.Optimize(
             source,
             stage,
             GlslConvert::API_OPENGL_COMPAT,
@@ -41,13 +58,84 @@ __attribute((visibility("default"))) char *optimize_shader(char *source, GLenum
             vGLSLVersion,
             vTargetGLSLVersion,
             true,
-            optimizationStruct
+            options
             );
-    if(converter.Failed()) {
-        printf("Shader conversion failed!\n%s\n", converter.GetLog().c_str());
+    if(timings != nullptr) {
+        timings->preprocess = result.timings.preprocess;
+        timings->parse = result.timings.parse;
+        timings->ast_to_hir = result.timings.ast_to_hir;
+        timings->link = result.timings.link;
+        timings->optimize = result.timings.optimize;
+        timings->convert = result.timings.convert;
+    }
+    if(precision != nullptr) {
+        precision->variables = result.precision.variables;
+        precision->demoted_variables = result.precision.demoted_variables;
+        precision->operations = result.precision.operations;
+        precision->demoted_operations = result.precision.demoted_operations;
+    }
+    if(result.failed) {
+        printf("Shader conversion failed!\n%s\n", result.log.c_str());
+        free(result.source);
         return nullptr;
     }
-    return optimized_shader;
+    if(output != nullptr) output->length = result.sourceLength;
+    return result.source;
+}
+
+__attribute((visibility("default"))) char *optimize_shader(char *source, GLenum type, int vGLSLVersion, int vTargetGLSLVersion) {
+    return optimize_shader_ex(source, type, vGLSLVersion, vTargetGLSLVersion, 0, nullptr, nullptr, nullptr);
+}
+
+__attribute((visibility("default"))) int optimize_program(char *vertex_source, char *fragment_source,
+                                                          int vGLSLVersion, int vTargetGLSLVersion, int flags,
+                                                          const struct optimize_shader_constant *constants,
+                                                          int nconstants, char **vertex_output, char **fragment_output,
+                                                          struct optimize_shader_output *outputs,
+                                                          unsigned *pruned_varyings, unsigned *specialized) {
+    const GlslConvert& converter = GlslConvert::Instance();
+    *vertex_output = nullptr;
+    *fragment_output = nullptr;
+    std::vector<specialized_uniform> uniforms(nconstants);
+    for(int i = 0; i < nconstants; i++) {
+        uniforms[i].name = constants[i].name;
+        uniforms[i].gl_type = constants[i].type;
+        uniforms[i].value = constants[i].value;
+    }
+    // The fragment shader goes first: what it reads decides which vertex outputs stay
+    GlslConvert::OptimizationStruct options = optionsForFlags(flags & ~OPTIMIZE_SHADER_FAST);
+    options.controlFlags = (GlslConvert::ControlFlags)(options.controlFlags | GlslConvert::CONTROL_LINK_STAGES);
+    options.specializedUniforms = uniforms.data();
+    options.specializedUniformCount = (unsigned)uniforms.size();
+    if(outputs != nullptr) options.outputReserve = outputs[1].offset;
+    GlslConvert::Result fragment = converter.Optimize(fragment_source, GlslConvert::MESA_SHADER_FRAGMENT,
+                                                      GlslConvert::API_OPENGL_COMPAT, GlslConvert::LANGUAGE_TARGET_GLSL,
+                                                      vGLSLVersion, vTargetGLSLVersion, true, options);
+    if(fragment.failed) {
+        printf("Shader conversion failed!\n%s\n", fragment.log.c_str());
+        free(fragment.source);
+        return 0;
+    }
+    options.nextStageInputs = &fragment.inputs;
+    if(outputs != nullptr) options.outputReserve = outputs[0].offset;
+    GlslConvert::Result vertex = converter.Optimize(vertex_source, GlslConvert::MESA_SHADER_VERTEX,
+                                                    GlslConvert::API_OPENGL_COMPAT, GlslConvert::LANGUAGE_TARGET_GLSL,
+                                                    vGLSLVersion, vTargetGLSLVersion, true, options);
+    if(vertex.failed) {
+        printf("Shader conversion failed!\n%s\n", vertex.log.c_str());
+        free(vertex.source);
+        free(fragment.source);
+        return 0;
+    }
+    *vertex_output = vertex.source;
+    *fragment_output = fragment.source;
+    if(outputs != nullptr) {
+        outputs[0].length = vertex.sourceLength;
+        outputs[1].length = fragment.sourceLength;
+    }
+    if(pruned_varyings != nullptr) *pruned_varyings = vertex.prunedOutputs;
+    if(specialized != nullptr) *specialized = vertex.specializedUniforms + fragment.specializedUniforms;
+    return 1;
 }
 
 #ifdef __cplusplus
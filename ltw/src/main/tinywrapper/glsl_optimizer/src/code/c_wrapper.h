@@ -7,13 +7,75 @@
 #ifndef GL4ES_C_WRAPPER_H
 #define GL4ES_C_WRAPPER_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "GL/gl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Time spent in each translator phase, in nanoseconds
+struct optimize_shader_timings {
+    uint64_t preprocess;
+    uint64_t parse;
+    uint64_t ast_to_hir;
+    uint64_t link;
+    uint64_t optimize;
+    uint64_t convert;
+};
+
+// How many float values the mediump pass demoted (OPTIMIZE_SHADER_MEDIUMP)
+struct optimize_shader_precision {
+    uint32_t variables;
+    uint32_t demoted_variables;
+    uint32_t operations;
+    uint32_t demoted_operations;
+};
+
+// Skip the optimization passes (tier-0 translation, see shader_translation.h)
+#define OPTIMIZE_SHADER_FAST (1 << 0)
+// Qualify safe float temporaries, fragment inputs and texture results as mediump
+#define OPTIMIZE_SHADER_MEDIUMP (1 << 1)
+
+// Where the translated text goes in the returned allocation. The first `offset`
+// bytes are left for the caller (e.g. a refcount header, see shader_cache.h), so
+// the allocation can be kept as is instead of copied. The returned pointer is
+// still the start of the malloc'ed block; the text is at ret + offset and
+// `length` receives its strlen.
+struct optimize_shader_output {
+    size_t offset;
+    size_t length;
+};
+
 char *optimize_shader(char *source, GLenum type, int vGLSLVersion, int vTargetGLSLVersion );
+// Same as optimize_shader, with OPTIMIZE_SHADER_* flags; also reports the
+// per-phase split and the mediump demotion counts. timings, precision and
+// output may be NULL (no offset).
+char *optimize_shader_ex(char *source, GLenum type, int vGLSLVersion, int vTargetGLSLVersion,
+                         int flags, struct optimize_shader_timings *timings,
+                         struct optimize_shader_precision *precision, struct optimize_shader_output *output);
+
+// A uniform compiled into the shader as a constant (see optimize_program)
+struct optimize_shader_constant {
+    const char *name;
+    GLenum type;            // as reported by glGetActiveUniform
+    uint32_t value[16];     // one 32-bit word per component, column-major for matrices
+};
+
+// Translate a vertex/fragment pair together: vertex outputs the fragment
+// shader never reads are dropped along with the code computing them. On
+// success both outputs are malloc'ed and the number of removed varyings is
+// stored in pruned_varyings (may be NULL); returns 0 on failure.
+// Uniforms listed in constants are replaced by their value in both stages and
+// folded through the optimizer; the number of uniform declarations replaced
+// is stored in specialized (may be NULL).
+// outputs (may be NULL) places the vertex [0] and fragment [1] text as in
+// optimize_shader_ex.
+int optimize_program(char *vertex_source, char *fragment_source, int vGLSLVersion, int vTargetGLSLVersion,
+                     int flags, const struct optimize_shader_constant *constants, int nconstants,
+                     char **vertex_output, char **fragment_output, struct optimize_shader_output *outputs,
+                     unsigned *pruned_varyings, unsigned *specialized);
 
 #ifdef __cplusplus
 } /* extern C */
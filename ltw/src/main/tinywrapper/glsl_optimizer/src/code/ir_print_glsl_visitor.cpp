@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <atomic>
 #include "ir_print_glsl_visitor.h"
 #include "../compiler/glsl/ir_visitor.h"
 #include "../compiler/glsl_types.h"
@@ -28,11 +29,15 @@ IR_TO_GLSL::global_print_tracker::global_print_tracker()
 	var_counter = 0;
 	var_hash = _mesa_pointer_hash_table_create(NULL);
 	main_function_done = false;
+	printable_names = _mesa_pointer_hash_table_create(NULL);
+	symbols = _mesa_symbol_table_ctor();
 }
 
 IR_TO_GLSL::global_print_tracker::~global_print_tracker()
 {
 	_mesa_hash_table_destroy(var_hash, NULL);
+	_mesa_hash_table_destroy(printable_names, NULL);
+	_mesa_symbol_table_dtor(symbols);
 	ralloc_free(mem_ctx);
 }
 
@@ -191,10 +196,9 @@ void print_layout(sbuffer& str, struct _mesa_glsl_parse_state* state, ast_type_q
 }
 
 void nan_check_warn() {
-    static bool warned = false;
-    if(warned) return;
+    static std::atomic<bool> warned(false);
+    if(warned.exchange(true)) return;
     printf("LTW shader optimizer will emit NaN checks for fragment outputs. This may lead to loss of performance.\n");
-    warned = true;
 }
 
 void print_nan_check_funcs(sbuffer& str) {
@@ -213,9 +217,12 @@ void print_nan_check_funcs(sbuffer& str) {
 // DO NOT FORGET TO FREE IT
 char * IR_TO_GLSL::Convert(
 	exec_list* instructions,
-	struct _mesa_glsl_parse_state* state)
+	struct _mesa_glsl_parse_state* state,
+	size_t reserve,
+	size_t capacity,
+	size_t* length)
 {
-	sbuffer res;
+	sbuffer res(capacity ? capacity : 512, reserve);
     bool shader_nan_check = false;
 
 	if (state)
@@ -360,33 +367,27 @@ char * IR_TO_GLSL::Convert(
     global.enable_nan_check = shader_nan_check;
 	int uses_texlod_impl = 0;
 	int uses_texlodproj_impl = 0;
-	loop_state* ls = analyze_loop_variables(instructions);
-	if (ls)
+	// Loop analysis only feeds the canonical for-loop form, which is never
+	// emitted (see can_emit_canonical_for), so it is not run: it was the
+	// bulk of the allocations made while printing.
+	foreach_in_list(ir_instruction, ir, instructions)
 	{
-		foreach_in_list(ir_instruction, ir, instructions)
+		if (ir->ir_type == ir_type_variable)
 		{
-			if (ir->ir_type == ir_type_variable)
-			{
-				ir_variable* var = static_cast<ir_variable*>(ir);
-				if ((strstr(var->name, "gl_") == var->name)
-					&& !var->data.invariant)
-					continue;
-			}
-
-			ir_instruction* deconsted = const_cast<ir_instruction*>(ir);
-
-			IR_TO_GLSL v(res, &global, state);
-			v.loopstate = ls;
+			ir_variable* var = static_cast<ir_variable*>(ir);
+			if ((strstr(var->name, "gl_") == var->name)
+				&& !var->data.invariant)
+				continue;
+		}
 
-			ir->accept(&v);
-			if (ir->ir_type != ir_type_function && !v.skipped_this_ir)
-				res.append(";\n"); // uniforms
+		IR_TO_GLSL v(res, &global, state);
 
-			uses_texlod_impl |= v.uses_texlod_impl;
-			uses_texlodproj_impl |= v.uses_texlodproj_impl;
-		}
+		ir->accept(&v);
+		if (ir->ir_type != ir_type_function && !v.skipped_this_ir)
+			res.append(";\n"); // uniforms
 
-		delete ls;
+		uses_texlod_impl |= v.uses_texlod_impl;
+		uses_texlodproj_impl |= v.uses_texlodproj_impl;
 	}
 
 	print_texlod_workarounds(uses_texlod_impl, uses_texlodproj_impl, res);
@@ -396,6 +397,8 @@ char * IR_TO_GLSL::Convert(
 
     // DANGER, A NEW STRING IS ALLOCATED !
     // YOUR PROGRAM HAS TO FREE IT !
+	if (length)
+		*length = res.size();
 	return res.c_str_take_ownership();
 }
 
@@ -405,16 +408,27 @@ IR_TO_GLSL::IR_TO_GLSL(
 	const _mesa_glsl_parse_state* vState)
 	: generated_source(str), global(vGlobals), state(vState)
 {
-	printable_names = _mesa_pointer_hash_table_create(NULL);
-	symbols = _mesa_symbol_table_ctor();
-	mem_ctx = ralloc_context(NULL);
+	printable_names = global->printable_names;
+	symbols = global->symbols;
+	mem_ctx = global->mem_ctx;
 }
 
 IR_TO_GLSL::~IR_TO_GLSL()
 {
-	_mesa_hash_table_destroy(printable_names, NULL);
-	_mesa_symbol_table_dtor(symbols);
-	ralloc_free(mem_ctx);
+	if (instruction_scope_open)
+		_mesa_symbol_table_pop_scope(symbols);
+	if (printable_names->entries)
+		_mesa_hash_table_clear(printable_names, NULL);
+}
+
+// Most top-level instructions (uniforms, inputs) never declare a symbol, so the
+// scope that keeps this instruction's names apart is only opened on demand.
+void IR_TO_GLSL::open_instruction_scope()
+{
+	if (instruction_scope_open)
+		return;
+	_mesa_symbol_table_push_scope(symbols);
+	instruction_scope_open = true;
 }
 
 void
@@ -507,8 +521,7 @@ IR_TO_GLSL::unique_name(ir_variable* v)
 	 */
 	if (v->name == NULL)
 	{
-		static unsigned arg = 1;
-		return ralloc_asprintf(this->mem_ctx, "parameter@%u", arg++);
+		return ralloc_asprintf(this->mem_ctx, "parameter@%u", global->unnamed_param_counter++);
 	}
 
 	/* Do we already have a name for this variable? */
@@ -529,11 +542,11 @@ IR_TO_GLSL::unique_name(ir_variable* v)
 	}
 	else
 	{
-		static unsigned i = 1;
-		name = ralloc_asprintf(this->mem_ctx, "%s@%u", v->name, ++i);
+		name = ralloc_asprintf(this->mem_ctx, "%s@%u", v->name, ++global->renamed_var_counter);
 	}
 
 	_mesa_hash_table_insert(this->printable_names, v, (void*)name);
+	open_instruction_scope();
 	_mesa_symbol_table_add_symbol(this->symbols, name, v);
 
 	return name;
@@ -609,7 +622,7 @@ IR_TO_GLSL::visit(ir_variable* ir)
 	if (!inside_loop_body)
 	{
 		ir_loop* lo = ir->as_loop();
-		if (lo)
+		if (lo && loopstate)
 		{
 			loop_variable_state* inductor_state = loopstate->get(lo);
 			if (inductor_state && inductor_state->induction_variables.length() == 1 &&
@@ -702,6 +715,7 @@ IR_TO_GLSL::visit(ir_variable* ir)
 void
 IR_TO_GLSL::visit(ir_function_signature* ir)
 {
+	open_instruction_scope();
 	_mesa_symbol_table_push_scope(symbols);
 
 	print_type(generated_source, ir->return_type, true);
@@ -1730,7 +1744,7 @@ IR_TO_GLSL::visit(ir_assignment* ir)
 		if (/*!ir->condition &&*/ whole_var)
 		{
 			ir_loop* lo = whole_var->as_loop();
-			if (lo)
+			if (lo && loopstate)
 			{
 				loop_variable_state* inductor_state = loopstate->get(lo);
 				if (inductor_state && inductor_state->induction_variables.length() == 1 &&
@@ -2091,6 +2105,13 @@ IR_TO_GLSL::can_emit_canonical_for(loop_variable_state* ls)
 	if (ls == NULL)
 		return false;
 
+	// The for-loop form takes the induction variable's first assignment
+	// inside the body (its increment) as the initializer and redeclares the
+	// counter, so it is wrong for every loop. Loops used to always carry the
+	// extra discard-flow break and never got here; since constant folding
+	// can remove that break, print everything as while (true).
+	return false;
+
 	if (ls->induction_variables.is_empty())
 		return false;
 
@@ -2108,6 +2129,9 @@ IR_TO_GLSL::can_emit_canonical_for(loop_variable_state* ls)
 bool
 IR_TO_GLSL::emit_canonical_for(ir_loop* ir)
 {
+	if (this->loopstate == NULL)
+		return false;
+
 	loop_variable_state* const ls = this->loopstate->get(ir);
 
 	if (!can_emit_canonical_for(ls))
@@ -49,12 +49,26 @@ public:
 		void* mem_ctx;
 		bool	main_function_done;
         bool enable_nan_check;
+		// Name suffix counters, kept per conversion so output is deterministic
+		// and concurrent conversions don't race.
+		unsigned	unnamed_param_counter = 1;
+		unsigned	renamed_var_counter = 1;
+		// Scratch state of the per-instruction visitors. Created once per
+		// conversion; each visitor opens a fresh symbol scope and clears the
+		// names when it is done, so top-level instructions stay independent.
+		hash_table*	printable_names;
+		_mesa_symbol_table*	symbols;
 	};
 
 public:
+	// Returns a malloc'ed block holding `reserve` unused bytes followed by the
+	// shader text. `capacity` pre-sizes the buffer, `length` receives strlen(text).
 	static char * Convert(
 		exec_list *instructions,
-		struct _mesa_glsl_parse_state *state);
+		struct _mesa_glsl_parse_state *state,
+		size_t reserve = 0,
+		size_t capacity = 0,
+		size_t *length = nullptr);
 	static void print_type(sbuffer& str, const glsl_type *t, bool arraySize);
 	static void print_type_post(sbuffer& str, const glsl_type *t, bool arraySize);
 
@@ -71,6 +85,7 @@ public:
    void newline_indent();
    void newline_deindent();
    void print_var_name(ir_variable* v);
+   void open_instruction_scope();
    const char *unique_name(ir_variable *var);
    void emit_assignment_part(ir_dereference* lhs, ir_rvalue* rhs, unsigned write_mask, ir_rvalue* dstIndex);
    bool can_emit_canonical_for(loop_variable_state *ls);
@@ -114,6 +129,7 @@ public:
 	int indentation = 0;
 	bool inside_loop_body = false;
 	bool skipped_this_ir = false;
+	bool instruction_scope_open = false;
 	bool previous_skipped = false;
 	int uses_texlod_impl = 0; // 3 bits per tex_dimension, bit set for each precision if any texture sampler needs the GLES2 lod workaround.
 	int uses_texlodproj_impl = 0; // 3 bits per tex_dimension, bit set for each precision if any texture sampler needs the GLES2 lod workaround.
@@ -17,10 +17,10 @@ std::string Optimizer::Optimize(std::string vShaderSource, xShaderStage vShaderT
 
 bool Optimizer::Failed() const noexcept
 {
-	return instance.Failed();
+	return failed;
 }
 
 std::string Optimizer::GetLog()
 {
-	return instance.GetLog();
+	return std::move(log);
 }
@@ -0,0 +1,292 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include "precision_demotion.h"
+
+#include <cctype>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler/glsl/ir_hierarchical_visitor.h"
+#include "../compiler/glsl_types.h"
+
+namespace {
+
+// Substrings (case-insensitive) marking values that need highp on 16-bit ALUs
+const char* const kDeniedNames[] = { "depth", "pos", "shadow" };
+
+// Built-ins whose inputs must stay highp
+const char* const kHighpSinks[] = { "gl_Position", "gl_FragDepth", "gl_PointSize", "gl_ClipDistance", "gl_ClipVertex" };
+
+bool ContainsNoCase(const char* haystack, const char* needle)
+{
+	const size_t needleLength = strlen(needle);
+	for (const char* p = haystack; *p; p++)
+	{
+		size_t i = 0;
+		while (i < needleLength && p[i] && tolower((unsigned char)p[i]) == needle[i]) i++;
+		if (i == needleLength) return true;
+	}
+	return false;
+}
+
+bool IsDeniedName(const char* name)
+{
+	if (name == nullptr) return false;
+	for (const char* denied : kDeniedNames)
+	{
+		if (ContainsNoCase(name, denied)) return true;
+	}
+	return false;
+}
+
+bool IsBuiltin(const ir_variable* var)
+{
+	return var->name != nullptr && strncmp(var->name, "gl_", 3) == 0;
+}
+
+struct VariableInfo
+{
+	bool eligible = false;
+	bool sink = false;		// feeds highp math: everything it reads stays highp
+	bool derived = false;	// computed from highp data: everything it writes stays highp
+	unsigned writes = 0;
+};
+
+struct Assignment
+{
+	ir_variable* lhs;
+	std::vector<ir_variable*> rhs;
+	bool readsDepthTexture;
+};
+
+// Collects the variables an rvalue reads. Texture coordinates are not values
+// of the fetch result, so the walk stops at ir_texture and only looks at the
+// sampler.
+class RvalueCollector : public ir_hierarchical_visitor
+{
+public:
+	explicit RvalueCollector(std::vector<ir_variable*>* vars) : vars(vars) {}
+
+	ir_visitor_status visit(ir_dereference_variable* ir) override
+	{
+		vars->push_back(ir->var);
+		return visit_continue;
+	}
+
+	ir_visitor_status visit_enter(ir_texture* ir) override
+	{
+		const ir_variable* sampler = ir->sampler->variable_referenced();
+		if (ir->sampler->type->without_array()->sampler_shadow || ir->shadow_comparator != nullptr ||
+			(sampler != nullptr && IsDeniedName(sampler->name)))
+		{
+			readsDepthTexture = true;
+		}
+		return visit_continue_with_parent;
+	}
+
+	std::vector<ir_variable*>* vars;
+	bool readsDepthTexture = false;
+};
+
+class PrecisionAnalysis : public ir_hierarchical_visitor
+{
+public:
+	explicit PrecisionAnalysis(gl_shader_stage stage) : stage(stage) {}
+
+	VariableInfo& Info(ir_variable* var)
+	{
+		return variables[var];
+	}
+
+	ir_visitor_status visit(ir_variable* ir) override
+	{
+		VariableInfo& info = Info(ir);
+		if (IsBuiltin(ir))
+		{
+			for (const char* sink : kHighpSinks)
+			{
+				if (strcmp(ir->name, sink) == 0) info.sink = true;
+			}
+			if (strcmp(ir->name, "gl_FragCoord") == 0) info.derived = true;
+			if (IsHighpNumber(ir)) info.derived = true;
+			return visit_continue;
+		}
+		if (IsDeniedName(ir->name))
+		{
+			info.sink = true;
+			info.derived = true;
+		}
+		// Values handed to the next stage may end up as texture coordinates there
+		if (ir->data.mode == ir_var_shader_out && stage != MESA_SHADER_FRAGMENT) info.sink = true;
+		info.eligible = IsEligible(ir);
+		// Uniforms, attributes and other highp sources can hold values far outside
+		// the fp16 range or precision (frame time, world coordinates)
+		if (!info.eligible && IsHighpNumber(ir)) info.derived = true;
+		return visit_continue;
+	}
+
+	ir_visitor_status visit_enter(ir_assignment* ir) override
+	{
+		ir_variable* lhs = ir->lhs->variable_referenced();
+		if (lhs == nullptr) return visit_continue;
+		Info(lhs).writes++;
+		Assignment assignment = { lhs, {}, false };
+		RvalueCollector collector(&assignment.rhs);
+		ir->rhs->accept(&collector);
+		assignment.readsDepthTexture = collector.readsDepthTexture;
+		assignments.push_back(std::move(assignment));
+		// Keep walking so texture coordinates inside the rhs are seen
+		return visit_continue;
+	}
+
+	ir_visitor_status visit_enter(ir_texture* ir) override
+	{
+		std::vector<ir_variable*> coordinates;
+		RvalueCollector collector(&coordinates);
+		ir_rvalue* operands[] = { ir->coordinate, ir->projector, ir->shadow_comparator, ir->offset, ir->clamp,
+			nullptr, nullptr };
+		switch (ir->op)
+		{
+		case ir_txb: operands[5] = ir->lod_info.bias; break;
+		case ir_txl:
+		case ir_txf:
+		case ir_txs: operands[5] = ir->lod_info.lod; break;
+		case ir_txf_ms: operands[5] = ir->lod_info.sample_index; break;
+		case ir_txd:
+			operands[5] = ir->lod_info.grad.dPdx;
+			operands[6] = ir->lod_info.grad.dPdy;
+			break;
+		default: break;
+		}
+		for (ir_rvalue* operand : operands)
+		{
+			if (operand != nullptr) operand->accept(&collector);
+		}
+		for (ir_variable* var : coordinates) Info(var).sink = true;
+		return visit_continue;
+	}
+
+	// Functions that survived inlining: keep their arguments and results as they are
+	ir_visitor_status visit_enter(ir_call* ir) override
+	{
+		std::vector<ir_variable*> vars;
+		RvalueCollector collector(&vars);
+		foreach_in_list(ir_rvalue, param, &ir->actual_parameters) param->accept(&collector);
+		if (ir->return_deref != nullptr) ir->return_deref->accept(&collector);
+		for (ir_variable* var : vars) Pin(var);
+		return visit_continue_with_parent;
+	}
+
+	ir_visitor_status visit_enter(ir_return* ir) override
+	{
+		if (ir->value == nullptr) return visit_continue_with_parent;
+		std::vector<ir_variable*> vars;
+		RvalueCollector collector(&vars);
+		ir->value->accept(&collector);
+		for (ir_variable* var : vars) Pin(var);
+		return visit_continue_with_parent;
+	}
+
+	void Propagate()
+	{
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (const Assignment& assignment : assignments)
+			{
+				VariableInfo& lhs = Info(assignment.lhs);
+				bool derived = assignment.readsDepthTexture;
+				for (ir_variable* var : assignment.rhs)
+				{
+					VariableInfo& rhs = Info(var);
+					if (lhs.sink && !rhs.sink)
+					{
+						rhs.sink = true;
+						changed = true;
+					}
+					derived = derived || rhs.derived;
+				}
+				if (derived && !lhs.derived)
+				{
+					lhs.derived = true;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	std::unordered_map<ir_variable*, VariableInfo> variables;
+
+private:
+	bool IsEligible(const ir_variable* var) const
+	{
+		if (var->type->without_array()->base_type != GLSL_TYPE_FLOAT) return false;
+		if (var->data.invariant || var->data.precise) return false;
+		if (var->data.precision != GLSL_PRECISION_NONE && var->data.precision != GLSL_PRECISION_HIGH) return false;
+		switch (var->data.mode)
+		{
+		case ir_var_auto:
+		case ir_var_temporary:
+			return true;
+		case ir_var_shader_in:
+			// Vertex outputs stay highp: the fragment side may use them as
+			// texture coordinates, which this stage can't see.
+			return stage == MESA_SHADER_FRAGMENT;
+		default:
+			return false;
+		}
+	}
+
+	static bool IsHighpNumber(const ir_variable* var)
+	{
+		switch (var->type->without_array()->base_type)
+		{
+		case GLSL_TYPE_FLOAT:
+		case GLSL_TYPE_INT:
+		case GLSL_TYPE_UINT:
+			break;
+		default:
+			return false;
+		}
+		return var->data.precision == GLSL_PRECISION_NONE || var->data.precision == GLSL_PRECISION_HIGH;
+	}
+
+	void Pin(ir_variable* var)
+	{
+		VariableInfo& info = Info(var);
+		info.sink = true;
+		info.derived = true;
+	}
+
+	gl_shader_stage stage;
+	std::vector<Assignment> assignments;
+};
+
+} // namespace
+
+void demote_precision(exec_list* instructions, gl_shader_stage stage, precision_demotion_stats* stats)
+{
+	PrecisionAnalysis analysis(stage);
+	analysis.run(instructions);
+	analysis.Propagate();
+
+	precision_demotion_stats result;
+	for (auto& entry : analysis.variables)
+	{
+		const VariableInfo& info = entry.second;
+		if (!info.eligible) continue;
+		result.variables++;
+		result.operations += info.writes;
+		if (info.sink || info.derived) continue;
+		entry.first->data.precision = GLSL_PRECISION_MEDIUM;
+		result.demoted_variables++;
+		result.demoted_operations += info.writes;
+	}
+	if (stats != nullptr) *stats = result;
+}
@@ -0,0 +1,37 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef PRECISION_DEMOTION_H
+#define PRECISION_DEMOTION_H
+
+#include "../compiler/glsl/ir.h"
+#include "../compiler/shader_enums.h"
+
+struct precision_demotion_stats
+{
+	unsigned variables = 0;				// float variables the pass may requalify
+	unsigned demoted_variables = 0;
+	unsigned operations = 0;			// assignments writing those variables
+	unsigned demoted_operations = 0;
+};
+
+/**
+ * Qualify float temporaries, fragment inputs and the results of color texture
+ * fetches as mediump.
+ *
+ * Mesa's lower_precision() turns mediump operations into 16-bit IR types,
+ * which GLSL ES source cannot express, so this pass works on precision
+ * qualifiers instead and lets the driver pick the ALU width.
+ *
+ * A variable is left at highp when it feeds gl_Position, gl_FragDepth or a
+ * texture coordinate, or is derived from gl_FragCoord, a highp uniform or
+ * attribute, a shadow/depth texture or anything whose name mentions depth,
+ * position or shadow. What is left is computed from color texture fetches,
+ * fragment inputs and constants.
+ */
+void demote_precision(exec_list *instructions, gl_shader_stage stage, precision_demotion_stats *stats);
+
+#endif // PRECISION_DEMOTION_H
@@ -0,0 +1,354 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include "preprocessor_cache.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../compiler/glsl/glsl_parser_extras.h"
+#include "../util/ralloc.h"
+
+#define XXH_INLINE_ALL
+#include "../util/xxhash.h"
+
+namespace {
+
+// Smallest distance between two cut points; shorter sources are not cached
+const size_t kChunkSize = 4096;
+// Text, output and macro tables kept for the whole session
+const size_t kMaxCacheBytes = 16 * 1024 * 1024;
+
+bool IsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+bool IsIdentifierStart(char c)
+{
+	return isalpha((unsigned char)c) || c == '_';
+}
+
+bool IsIdentifierChar(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+// Does the directive after a '#' have this name
+bool DirectiveIs(const char* p, const char* name)
+{
+	while (IsBlank(*p)) p++;
+	const size_t length = strlen(name);
+	return strncmp(p, name, length) == 0 && !IsIdentifierChar(p[length]);
+}
+
+// Offsets the source can be split at without the halves preprocessing
+// differently: line ends outside comments, conditionals and parentheses, at
+// least kChunkSize apart, and none after a #line. glcpp_checkpoint_create()
+// rejects the ones this scan gets wrong.
+std::vector<size_t> FindCutPoints(const char* source, size_t length)
+{
+	std::vector<size_t> cuts;
+	size_t next = kChunkSize;
+	int conditionals = 0;
+	int parentheses = 0;
+	bool blockComment = false;
+	bool lineComment = false;
+	bool lineStart = true;
+	for (size_t i = 0; i < length; i++)
+	{
+		const char c = source[i];
+		if (c == '\\' && (source[i + 1] == '\n' || source[i + 1] == '\r'))
+		{
+			// Line continuation: the next line belongs to this one
+			i++;
+			if (source[i] == '\r' && source[i + 1] == '\n') i++;
+			continue;
+		}
+		if (c == '\n' || c == '\r')
+		{
+			const size_t end = (c == '\r' && source[i + 1] == '\n') ? i + 2 : i + 1;
+			if (!blockComment && conditionals == 0 && parentheses == 0 && end >= next && end < length &&
+				source[end] != '\r')
+			{
+				cuts.push_back(end);
+				next = end + kChunkSize;
+			}
+			lineComment = false;
+			lineStart = true;
+			i = end - 1;
+			continue;
+		}
+		if (blockComment)
+		{
+			if (c == '*' && source[i + 1] == '/')
+			{
+				blockComment = false;
+				i++;
+			}
+			continue;
+		}
+		if (lineComment || IsBlank(c)) continue;
+		if (c == '/' && (source[i + 1] == '*' || source[i + 1] == '/'))
+		{
+			blockComment = source[i + 1] == '*';
+			lineComment = !blockComment;
+			i++;
+			continue;
+		}
+		if (c == '#' && lineStart)
+		{
+			const char* directive = source + i + 1;
+			// A source number set by #line lives in the lexer and isn't carried over
+			if (DirectiveIs(directive, "line")) break;
+			if (DirectiveIs(directive, "if") || DirectiveIs(directive, "ifdef") || DirectiveIs(directive, "ifndef"))
+				conditionals++;
+			else if (DirectiveIs(directive, "endif") && conditionals > 0)
+				conditionals--;
+		}
+		lineStart = false;
+		if (c == '(') parentheses++;
+		else if (c == ')' && parentheses > 0) parentheses--;
+	}
+	return cuts;
+}
+
+// Preprocessor state after source[0, end). Each checkpoint preprocesses the
+// text since its parent and keeps the parent alive for the macros it shares.
+struct Checkpoint
+{
+	~Checkpoint() { glcpp_checkpoint_destroy(state); }
+
+	std::shared_ptr<const Checkpoint> parent;
+	glcpp_checkpoint* state = nullptr;	// nullptr: the source can't be cut here
+	size_t begin = 0;
+	size_t end = 0;
+	std::string chunk;					// source[begin, end), compared on lookup
+};
+
+class CheckpointCache
+{
+public:
+	std::shared_ptr<const Checkpoint> Find(uint64_t key)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto it = m_Entries.find(key);
+		if (it == m_Entries.end()) return nullptr;
+		m_Lru.splice(m_Lru.begin(), m_Lru, it->second.lru);
+		return it->second.checkpoint;
+	}
+
+	void Insert(uint64_t key, std::shared_ptr<const Checkpoint> checkpoint)
+	{
+		const size_t bytes = Bytes(*checkpoint);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Entries.count(key)) return;
+		m_Lru.push_front(key);
+		m_Entries[key] = { std::move(checkpoint), m_Lru.begin(), bytes };
+		m_Bytes += bytes;
+		while (m_Bytes > kMaxCacheBytes && m_Lru.size() > 1)
+		{
+			auto victim = m_Entries.find(m_Lru.back());
+			m_Bytes -= victim->second.bytes;
+			m_Entries.erase(victim);
+			m_Lru.pop_back();
+		}
+	}
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<const Checkpoint> checkpoint;
+		std::list<uint64_t>::iterator lru;
+		size_t bytes;
+	};
+
+	static size_t Bytes(const Checkpoint& checkpoint)
+	{
+		size_t output = 0;
+		if (checkpoint.state != nullptr) glcpp_checkpoint_output(checkpoint.state, &output);
+		return sizeof(Checkpoint) + checkpoint.chunk.size() + output;
+	}
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, Entry> m_Entries;
+	std::list<uint64_t> m_Lru;
+	size_t m_Bytes = 0;
+};
+
+CheckpointCache& Cache()
+{
+	static CheckpointCache cache;
+	return cache;
+}
+
+bool CacheEnabled()
+{
+	static const bool enabled = [] {
+		const char* env = getenv("LTW_PREPROCESSOR_CACHE");
+		return env == nullptr || *env != '0';
+	}();
+	return enabled;
+}
+
+// Whether the chain behind checkpoint covers exactly this source prefix
+bool Matches(const Checkpoint* checkpoint, const char* source)
+{
+	for (; checkpoint != nullptr; checkpoint = checkpoint->parent.get())
+	{
+		if (memcmp(source + checkpoint->begin, checkpoint->chunk.data(), checkpoint->chunk.size()) != 0) return false;
+	}
+	return true;
+}
+
+} // namespace
+
+bool source_needs_preprocessing(const char* source)
+{
+	bool lineStart = true;
+	for (const char* p = source; *p; p++)
+	{
+		const char c = *p;
+		if (c == '\n' || c == '\r')
+		{
+			lineStart = true;
+			continue;
+		}
+		if (IsBlank(c)) continue;
+		if (c == '#')
+		{
+			if (!lineStart || !(DirectiveIs(p + 1, "version") || DirectiveIs(p + 1, "extension"))) return true;
+			// The parser reads these itself; only the rest of the line matters
+			while (p[1] != '\0' && p[1] != '\n' && p[1] != '\r')
+			{
+				p++;
+				if (*p == '\\' || *p == '/') return true;
+			}
+			continue;
+		}
+		lineStart = false;
+		if (c == '\\') return true;
+		if (c == '/' && (p[1] == '/' || p[1] == '*')) return true;
+		if (IsIdentifierStart(c))
+		{
+			// Predefined macros and the names reserved for them
+			if ((c == '_' && p[1] == '_') || strncmp(p, "GL_", 3) == 0) return true;
+			while (IsIdentifierChar(p[1])) p++;
+		}
+	}
+	return false;
+}
+
+int preprocess_cached(void* ralloc_ctx, const char** shader, char** info_log,
+	_mesa_glsl_parse_state* state, gl_context* ctx, uint64_t context_key)
+{
+	const char* source = *shader;
+	const size_t length = strlen(source);
+	if (!CacheEnabled() || length < 2 * kChunkSize)
+		return glcpp_preprocess(ralloc_ctx, shader, info_log, add_builtin_defines, state, ctx);
+
+	const std::vector<size_t> cuts = FindCutPoints(source, length);
+	if (cuts.empty())
+		return glcpp_preprocess(ralloc_ctx, shader, info_log, add_builtin_defines, state, ctx);
+
+	// Key of every prefix ending at a cut point
+	std::vector<uint64_t> keys(cuts.size());
+	XXH64_state_t hash;
+	XXH64_reset(&hash, context_key);
+	size_t hashed = 0;
+	for (size_t i = 0; i < cuts.size(); i++)
+	{
+		XXH64_update(&hash, source + hashed, cuts[i] - hashed);
+		hashed = cuts[i];
+		keys[i] = XXH64_digest(&hash);
+	}
+
+	// Longest prefix already preprocessed
+	CheckpointCache& cache = Cache();
+	std::shared_ptr<const Checkpoint> last;
+	size_t first = 0;
+	for (size_t i = cuts.size(); i-- > 0;)
+	{
+		std::shared_ptr<const Checkpoint> checkpoint = cache.Find(keys[i]);
+		if (checkpoint == nullptr || checkpoint->state == nullptr || !Matches(checkpoint.get(), source)) continue;
+		last = std::move(checkpoint);
+		first = i + 1;
+		break;
+	}
+
+	// Preprocess the remaining chunks one by one so the next shader sharing
+	// part of them finds them, then the tail
+	for (size_t i = first; i < cuts.size(); i++)
+	{
+		std::shared_ptr<const Checkpoint> known = cache.Find(keys[i]);
+		if (known != nullptr && known->state == nullptr) continue;
+
+		auto checkpoint = std::make_shared<Checkpoint>();
+		checkpoint->begin = last != nullptr ? last->end : 0;
+		checkpoint->end = cuts[i];
+		checkpoint->chunk.assign(source + checkpoint->begin, checkpoint->end - checkpoint->begin);
+		checkpoint->state = glcpp_checkpoint_create(checkpoint->chunk.c_str(),
+			last != nullptr ? last->state : nullptr, add_builtin_defines, state, ctx);
+		if (checkpoint->state == nullptr)
+		{
+			// Remember that the source can't be cut here and keep the text in the next chunk
+			checkpoint->chunk.clear();
+			cache.Insert(keys[i], std::move(checkpoint));
+			continue;
+		}
+		checkpoint->parent = last;
+		last = checkpoint;
+		cache.Insert(keys[i], std::move(checkpoint));
+	}
+
+	if (last == nullptr)
+		return glcpp_preprocess(ralloc_ctx, shader, info_log, add_builtin_defines, state, ctx);
+
+	const char* tail = source + last->end;
+	const int errors = glcpp_preprocess_from(ralloc_ctx, &tail, info_log, last->state, add_builtin_defines,
+		state, ctx);
+
+	// Output and warnings of the chunks, in source order, then the tail's
+	std::vector<const Checkpoint*> chain;
+	for (const Checkpoint* checkpoint = last.get(); checkpoint != nullptr; checkpoint = checkpoint->parent.get())
+		chain.push_back(checkpoint);
+
+	size_t outputLength = strlen(tail);
+	for (const Checkpoint* checkpoint : chain)
+	{
+		size_t chunkLength = 0;
+		glcpp_checkpoint_output(checkpoint->state, &chunkLength);
+		outputLength += chunkLength;
+	}
+	char* output = (char*)ralloc_size(ralloc_ctx, outputLength + 1);
+	char* cursor = output;
+	std::string warnings;
+	for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+	{
+		size_t chunkLength = 0;
+		const char* chunkOutput = glcpp_checkpoint_output((*it)->state, &chunkLength);
+		memcpy(cursor, chunkOutput, chunkLength);
+		cursor += chunkLength;
+		warnings += glcpp_checkpoint_info_log((*it)->state);
+	}
+	strcpy(cursor, tail);
+	if (!warnings.empty())
+	{
+		// The tail's messages were appended already; the chunks' go in front
+		warnings += *info_log;
+		ralloc_free(*info_log);
+		*info_log = ralloc_strdup(ralloc_ctx, warnings.c_str());
+	}
+	*shader = output;
+	return errors;
+}
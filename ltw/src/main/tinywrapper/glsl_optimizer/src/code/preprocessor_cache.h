@@ -0,0 +1,37 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef PREPROCESSOR_CACHE_H
+#define PREPROCESSOR_CACHE_H
+
+#include <cstdint>
+
+struct gl_context;
+struct _mesa_glsl_parse_state;
+
+/**
+ * Whether the source needs glcpp at all. Plain GLSL (no directives besides
+ * #version and #extension, no comments, no line continuations and no
+ * identifier the preprocessor would replace, such as __LINE__ or GL_ES) is
+ * handed to the parser as is, see CONTROL_SKIP_PREPROCESSING.
+ */
+bool source_needs_preprocessing(const char *source);
+
+/**
+ * glcpp_preprocess() backed by a session-wide cache of preprocessed leading
+ * chunks. Shaderpacks start dozens of programs with the same settings block
+ * and library code; the macro state at the end of such a shared prefix is
+ * looked up by content hash and only the rest of the shader is tokenized.
+ *
+ * Sources are cut at line ends outside comments, conditionals and
+ * parentheses, roughly every few kilobytes. Checkpoints are only valid for
+ * the context they were made with, identified by context_key.
+ * LTW_PREPROCESSOR_CACHE=0 turns the cache off.
+ */
+int preprocess_cached(void *ralloc_ctx, const char **shader, char **info_log,
+	_mesa_glsl_parse_state *state, gl_context *ctx, uint64_t context_key);
+
+#endif // PREPROCESSOR_CACHE_H
@@ -2,6 +2,9 @@
 #define __ST_PRINTF__H__
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
 
 #include "../util/macros.h"
@@ -56,13 +59,22 @@ AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+// Growable output buffer for the GLSL/IR printers.
+//
+// The buffer is a single malloc'ed block. The first `reserve` bytes are left
+// untouched so the caller can put its own header in front of the text and keep
+// the block without copying it (see optimize_shader_output in c_wrapper.h).
+// append() formats straight into the free space and only formats a second time
+// when the block had to grow; literal strings are copied without vsnprintf.
 class sbuffer
 {
 public:
-	sbuffer()
+	explicit sbuffer(size_t capacity = 512, size_t reserve = 0)
 	{
-		m_Capacity = 512;
-		m_Ptr = (char*)malloc(m_Capacity);
+		m_Reserve = reserve;
+		m_Capacity = MAX2(capacity, (size_t)64);
+		m_Block = (char*)malloc(m_Reserve + m_Capacity);
+		m_Ptr = m_Block + m_Reserve;
 		m_Size = 0;
 		m_Ptr[0] = 0;
         m_Ownership_Lost = false;
@@ -71,31 +83,46 @@ public:
 	~sbuffer()
 	{
         if(!m_Ownership_Lost)
-		    free(m_Ptr);
+		    free(m_Block);
 	}
 
 	bool empty() const { return m_Size == 0; }
 
+	size_t size() const { return m_Size; }
+
 	const char* c_str() const { return m_Ptr; }
 
     /**
-     * Dangerous, get the string and declare the ownership lost.
+     * Dangerous, get the allocation and declare the ownership lost.
      * Meaning the lifecycle of the char * goes beyond what the class normally allows.
-     * @return A C style string
+     * @return The start of the malloc'ed block; the C style string begins `reserve` bytes in
      */
     char * c_str_take_ownership() {
         m_Ownership_Lost = true;
-		return m_Ptr;
+		return m_Block;
     }
 
 	void append(const char *fmt, ...) PRINTFLIKE(2, 3)
 	{
+		if (strchr(fmt, '%') == NULL)
+		{
+			append_literal(fmt, strlen(fmt));
+			return;
+		}
 		va_list args;
 		va_start(args, fmt);
 		vasprintf_append(fmt, args);
 		va_end(args);
 	}
 
+	void append_literal(const char *str, size_t length)
+	{
+		reserve_tail(length);
+		memcpy(m_Ptr + m_Size, str, length);
+		m_Size += length;
+		m_Ptr[m_Size] = 0;
+	}
+
 	void vasprintf_append(const char *fmt, va_list args)
 	{
 		assert(m_Ptr != NULL);
@@ -106,22 +133,42 @@ public:
 	{
 		assert(m_Ptr != NULL);
 
-		size_t new_length = vscprintf(fmt, args);
-		size_t needed_length = m_Size + new_length + 1;
-
-		if (m_Capacity < needed_length)
+		size_t available = m_Capacity - m_Size;
+		va_list copy;
+		va_copy(copy, args);
+		int new_length = vsnprintf(m_Ptr + m_Size, available, fmt, copy);
+		va_end(copy);
+		if (new_length < 0)
 		{
-			m_Capacity = MAX2(m_Capacity + m_Capacity / 2, needed_length);
-            m_Ptr = (char*)realloc(m_Ptr, m_Capacity);
+			m_Ptr[m_Size] = 0;
+			return;
 		}
 
-		vsnprintf(m_Ptr + m_Size, new_length + 1, fmt, args);
+		if ((size_t)new_length >= available)
+		{
+			reserve_tail(new_length);
+			vsnprintf(m_Ptr + m_Size, new_length + 1, fmt, args);
+		}
 		m_Size += new_length;
-		assert(m_Capacity >= m_Size);
+		assert(m_Capacity > m_Size);
 	}
 
 private:
+	// Make room for `length` more characters plus the terminator
+	void reserve_tail(size_t length)
+	{
+		size_t needed_length = m_Size + length + 1;
+		if (m_Capacity < needed_length)
+		{
+			m_Capacity = MAX2(m_Capacity + m_Capacity / 2, needed_length);
+			m_Block = (char*)realloc(m_Block, m_Reserve + m_Capacity);
+			m_Ptr = m_Block + m_Reserve;
+		}
+	}
+
+	char* m_Block;
 	char* m_Ptr;
+	size_t m_Reserve;
 	size_t m_Size;
 	size_t m_Capacity;
     bool m_Ownership_Lost;
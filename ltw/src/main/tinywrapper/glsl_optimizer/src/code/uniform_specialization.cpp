@@ -0,0 +1,192 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include "uniform_specialization.h"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "../compiler/glsl/ir_optimization.h"
+#include "../compiler/glsl/ir_rvalue_visitor.h"
+#include "../compiler/glsl_types.h"
+#include "../util/ralloc.h"
+
+namespace {
+
+ir_constant* MakeConstant(void* memCtx, const glsl_type* type, const uint32_t* value)
+{
+	ir_constant_data data;
+	memset(&data, 0, sizeof(data));
+	for (unsigned i = 0; i < type->components(); i++)
+	{
+		switch (type->base_type)
+		{
+		case GLSL_TYPE_FLOAT: memcpy(&data.f[i], &value[i], sizeof(float)); break;
+		case GLSL_TYPE_INT: data.i[i] = (int)value[i]; break;
+		case GLSL_TYPE_UINT: data.u[i] = value[i]; break;
+		case GLSL_TYPE_BOOL: data.b[i] = value[i] != 0; break;
+		default: return nullptr;
+		}
+	}
+	return new(memCtx) ir_constant(type, &data);
+}
+
+bool IsInParameter(const ir_variable* formal)
+{
+	return formal->data.mode == ir_var_function_in || formal->data.mode == ir_var_const_in;
+}
+
+// Replaces reads of the mapped variables with their constant and folds the
+// expressions that become constant on the way up
+class ConstantReplacer : public ir_rvalue_visitor
+{
+public:
+	void handle_rvalue(ir_rvalue** rvalue) override
+	{
+		if (*rvalue == nullptr || in_assignee) return;
+		ir_dereference_variable* deref = (*rvalue)->as_dereference_variable();
+		if (deref != nullptr)
+		{
+			auto it = constants.find(deref->var);
+			if (it == constants.end()) return;
+			*rvalue = it->second->clone(ralloc_parent(deref), nullptr);
+			replaced++;
+			return;
+		}
+		if ((*rvalue)->as_expression() == nullptr && (*rvalue)->as_swizzle() == nullptr) return;
+		ir_constant* folded = (*rvalue)->constant_expression_value(ralloc_parent(*rvalue));
+		if (folded != nullptr) *rvalue = folded;
+	}
+
+	// Out and inout arguments are lvalues, only rewrite what the callee reads
+	ir_visitor_status visit_enter(ir_call* ir) override
+	{
+		const exec_node* formalNode = ir->callee->parameters.get_head_raw();
+		foreach_in_list_safe(ir_rvalue, param, &ir->actual_parameters)
+		{
+			const ir_variable* formal = (const ir_variable*)formalNode;
+			formalNode = formalNode->next;
+			if (!IsInParameter(formal)) continue;
+			param->accept(this);
+			ir_rvalue* newParam = param;
+			handle_rvalue(&newParam);
+			if (newParam != param) param->replace_with(newParam);
+		}
+		return visit_continue_with_parent;
+	}
+
+	std::unordered_map<ir_variable*, ir_constant*> constants;
+	unsigned replaced = 0;
+};
+
+struct AssignmentInfo
+{
+	unsigned count = 0;
+	ir_assignment* assignment = nullptr;
+	bool pinned = false;
+};
+
+class AssignmentCounter : public ir_hierarchical_visitor
+{
+public:
+	ir_visitor_status visit_enter(ir_assignment* ir) override
+	{
+		ir_variable* var = ir->lhs->variable_referenced();
+		if (var == nullptr) return visit_continue;
+		AssignmentInfo& info = variables[var];
+		info.count++;
+		info.assignment = ir;
+		return visit_continue;
+	}
+
+	ir_visitor_status visit(ir_dereference_variable* ir) override
+	{
+		if (inOutArgument) variables[ir->var].pinned = true;
+		return visit_continue;
+	}
+
+	// Variables passed as out or inout arguments are written by the callee
+	ir_visitor_status visit_enter(ir_call* ir) override
+	{
+		const exec_node* formalNode = ir->callee->parameters.get_head_raw();
+		foreach_in_list(ir_rvalue, param, &ir->actual_parameters)
+		{
+			const ir_variable* formal = (const ir_variable*)formalNode;
+			formalNode = formalNode->next;
+			inOutArgument = !IsInParameter(formal);
+			param->accept(this);
+		}
+		inOutArgument = false;
+		if (ir->return_deref != nullptr)
+		{
+			AssignmentInfo& info = variables[ir->return_deref->var];
+			info.count++;
+			info.pinned = true;
+		}
+		return visit_continue_with_parent;
+	}
+
+	std::unordered_map<ir_variable*, AssignmentInfo> variables;
+	bool inOutArgument = false;
+};
+
+// One round of constant propagation for single-assignment temporaries
+bool PropagateConstants(exec_list* instructions)
+{
+	AssignmentCounter counter;
+	counter.run(instructions);
+
+	ConstantReplacer replacer;
+	for (auto& entry : counter.variables)
+	{
+		ir_variable* var = entry.first;
+		const AssignmentInfo& info = entry.second;
+		if (info.count != 1 || info.pinned) continue;
+		if (var->data.mode != ir_var_auto && var->data.mode != ir_var_temporary) continue;
+		if (!var->type->is_scalar() && !var->type->is_vector() && !var->type->is_matrix()) continue;
+		ir_assignment* assignment = info.assignment;
+		if (assignment->lhs->as_dereference_variable() == nullptr) continue;
+		if (!var->type->is_matrix() && assignment->write_mask != (1u << var->type->vector_elements) - 1) continue;
+		ir_constant* value = assignment->rhs->constant_expression_value(ralloc_parent(assignment));
+		if (value != nullptr) replacer.constants[var] = value;
+	}
+	if (replacer.constants.empty()) return false;
+	replacer.run(instructions);
+	return replacer.replaced != 0;
+}
+
+} // namespace
+
+unsigned specialize_uniforms(exec_list* instructions, const specialized_uniform* uniforms, unsigned count)
+{
+	std::unordered_map<std::string, const specialized_uniform*> byName;
+	for (unsigned i = 0; i < count; i++) byName[uniforms[i].name] = &uniforms[i];
+
+	ConstantReplacer replacer;
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_variable* var = node->as_variable();
+		if (var == nullptr || var->data.mode != ir_var_uniform) continue;
+		auto it = byName.find(var->name);
+		if (it == byName.end() || var->type->gl_type != it->second->gl_type) continue;
+		ir_constant* value = MakeConstant(ralloc_parent(var), var->type, it->second->value);
+		if (value != nullptr) replacer.constants[var] = value;
+	}
+	if (!replacer.constants.empty()) replacer.run(instructions);
+	return (unsigned)replacer.constants.size();
+}
+
+void fold_specialized_constants(exec_list* instructions)
+{
+	bool progress = true;
+	while (progress)
+	{
+		progress = PropagateConstants(instructions);
+		progress = do_if_simplification(instructions) || progress;
+		progress = do_dead_code(instructions) || progress;
+	}
+}
@@ -0,0 +1,38 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef UNIFORM_SPECIALIZATION_H
+#define UNIFORM_SPECIALIZATION_H
+
+#include <cstdint>
+
+#include "../compiler/glsl/ir.h"
+
+struct specialized_uniform
+{
+	const char* name;
+	unsigned gl_type;			// GL_FLOAT_VEC3, GL_BOOL, ... must match the declaration
+	const uint32_t* value;		// one 32-bit word per component, column-major for matrices
+};
+
+/**
+ * Replace every read of the given uniforms with their value. Uniforms that
+ * aren't declared or whose type doesn't match are left alone.
+ *
+ * Returns the number of uniforms replaced.
+ */
+unsigned specialize_uniforms(exec_list *instructions, const specialized_uniform *uniforms, unsigned count);
+
+/**
+ * Fold what specialize_uniforms() made constant: temporaries assigned a
+ * constant expression once are replaced by its value, constant conditions
+ * pick their branch, and the dead code is dropped. The regular optimization
+ * loop has no constant propagation, so without this only branches testing a
+ * uniform directly would go away.
+ */
+void fold_specialized_constants(exec_list *instructions);
+
+#endif // UNIFORM_SPECIALIZATION_H
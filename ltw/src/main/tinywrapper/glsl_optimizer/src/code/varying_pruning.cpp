@@ -0,0 +1,75 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include "varying_pruning.h"
+
+#include <cstring>
+
+#include "../compiler/glsl/ir_variable_refcount.h"
+
+namespace {
+
+// Built-in outputs that reach the fragment shader under another name
+const struct { const char* output; const char* input; } kBuiltinVaryings[] = {
+	{ "gl_FrontColor", "gl_Color" },
+	{ "gl_BackColor", "gl_Color" },
+	{ "gl_FrontSecondaryColor", "gl_SecondaryColor" },
+	{ "gl_BackSecondaryColor", "gl_SecondaryColor" },
+	{ "gl_TexCoord", "gl_TexCoord" },
+	{ "gl_FogFragCoord", "gl_FogFragCoord" },
+};
+
+// Name the next stage reads the output under, or nullptr if it must be kept
+const char* InputNameFor(const ir_variable* var)
+{
+	if (strncmp(var->name, "gl_", 3) != 0)
+	{
+		if (var->get_interface_type() != nullptr || var->data.explicit_location) return nullptr;
+		return var->name;
+	}
+	// Built-ins sit in gl_PerVertex with fixed locations, match them by name
+	for (const auto& varying : kBuiltinVaryings)
+	{
+		if (strcmp(var->name, varying.output) == 0) return varying.input;
+	}
+	// gl_Position, gl_PointSize, gl_ClipDistance... are consumed by fixed function
+	return nullptr;
+}
+
+} // namespace
+
+void collect_stage_inputs(exec_list* instructions, std::set<std::string>* inputs)
+{
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_variable* var = node->as_variable();
+		if (var != nullptr && var->data.mode == ir_var_shader_in) inputs->insert(var->name);
+	}
+}
+
+unsigned prune_dead_outputs(exec_list* instructions, const std::set<std::string>& next_stage_inputs)
+{
+	ir_variable_refcount_visitor refs;
+	refs.run(instructions);
+
+	unsigned pruned = 0;
+	foreach_in_list(ir_instruction, node, instructions)
+	{
+		ir_variable* var = node->as_variable();
+		if (var == nullptr || var->data.mode != ir_var_shader_out) continue;
+		const char* input = InputNameFor(var);
+		if (input == nullptr || next_stage_inputs.count(input) != 0) continue;
+		// A built-in the shader reads back would survive as a global the
+		// GLSL ES printer can't declare
+		const ir_variable_refcount_entry* entry = refs.get_variable_entry(var);
+		if (strncmp(var->name, "gl_", 3) == 0 && entry->referenced_count > entry->assigned_count) continue;
+		var->data.mode = ir_var_auto;
+		var->data.invariant = false;
+		// Unwritten compatibility built-ins are declared in every shader, don't count them
+		if (entry->assigned_count != 0) pruned++;
+	}
+	return pruned;
+}
@@ -0,0 +1,33 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef VARYING_PRUNING_H
+#define VARYING_PRUNING_H
+
+#include <set>
+#include <string>
+
+#include "../compiler/glsl/ir.h"
+
+/**
+ * Collect the names of the stage inputs still declared in a linked and
+ * optimized shader. Dead code elimination has already dropped the inputs the
+ * shader never reads, so this is the set the previous stage has to provide.
+ */
+void collect_stage_inputs(exec_list *instructions, std::set<std::string> *inputs);
+
+/**
+ * Turn the outputs of a linked shader that the next stage does not read into
+ * plain globals, so the following dead code passes remove them together with
+ * the code computing them. Compatibility varyings are matched through their
+ * fragment-side names (gl_FrontColor -> gl_Color, ...); other built-ins,
+ * interface blocks and outputs with an explicit location are kept.
+ *
+ * Returns the number of outputs demoted.
+ */
+unsigned prune_dead_outputs(exec_list *instructions, const std::set<std::string> &next_stage_inputs);
+
+#endif // VARYING_PRUNING_H
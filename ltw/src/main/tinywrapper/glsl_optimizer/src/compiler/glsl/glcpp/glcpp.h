@@ -249,6 +249,39 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 		 glcpp_extension_iterator extensions, void *state,
 		 struct gl_context *g_ctx);
 
+/* Preprocessor state at the end of a leading chunk of a shader, so that the
+ * text after it can be preprocessed without going through the chunk again.
+ * Immutable once created. */
+struct glcpp_checkpoint;
+
+/* Preprocess `chunk`, continuing from `from` (NULL at the start of a shader).
+ * Returns NULL when the chunk has errors or does not end at the top level
+ * (inside a conditional or a macro invocation). The result may use macros
+ * owned by `from`, which has to outlive it. */
+struct glcpp_checkpoint *
+glcpp_checkpoint_create(const char *chunk, const struct glcpp_checkpoint *from,
+			glcpp_extension_iterator extensions, void *state,
+			struct gl_context *gl_ctx);
+
+void
+glcpp_checkpoint_destroy(struct glcpp_checkpoint *checkpoint);
+
+/* Output and warnings of the chunk that produced `checkpoint` */
+const char *
+glcpp_checkpoint_output(const struct glcpp_checkpoint *checkpoint,
+			size_t *length);
+
+const char *
+glcpp_checkpoint_info_log(const struct glcpp_checkpoint *checkpoint);
+
+/* glcpp_preprocess() for the text following the chunks behind `from`.
+ * *shader receives the output of that text only. */
+int
+glcpp_preprocess_from(void *ralloc_ctx, const char **shader, char **info_log,
+		      const struct glcpp_checkpoint *from,
+		      glcpp_extension_iterator extensions, void *state,
+		      struct gl_context *g_ctx);
+
 /* Functions for writing to the info log */
 
 void
@@ -271,6 +304,9 @@ glcpp_lex (YYSTYPE *lvalp, YYLTYPE *llocp, yyscan_t scanner);
 int
 glcpp_lex_destroy (yyscan_t scanner);
 
+int
+glcpp_get_lineno (yyscan_t scanner);
+
 /* Generated by glcpp-parse.y to glcpp-parse.c */
 
 int
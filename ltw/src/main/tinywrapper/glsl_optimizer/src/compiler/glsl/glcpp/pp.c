@@ -221,22 +221,135 @@ remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 	return sb->buf;
 }
 
-int
-glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
-                 glcpp_extension_iterator extensions, void *state,
-                 struct gl_context *gl_ctx)
+struct glcpp_checkpoint {
+	/* Parser of the chunk, kept for the memory it owns: the macros it
+	 * defined, its output and its info log. */
+	glcpp_parser_t *parser;
+	/* Every macro defined at the end of the chunk. Entries may point into
+	 * the parsers of earlier checkpoints. */
+	struct hash_table *defines;
+	unsigned version;
+	bool version_set;
+	bool is_gles;
+	int next_line;
+};
+
+/* Start a parser where `from` left off: same macros, same #version and the
+ * line numbering continues. */
+static glcpp_parser_t *
+glcpp_parser_create_from(const struct glcpp_checkpoint *from,
+                         glcpp_extension_iterator extensions, void *state,
+                         struct gl_context *gl_ctx)
 {
-	int errors;
 	glcpp_parser_t *parser =
 		glcpp_parser_create(gl_ctx, extensions, state);
 
+	if (from == NULL)
+		return parser;
+
+	hash_table_foreach(from->defines, entry)
+		_mesa_hash_table_insert(parser->defines, entry->key, entry->data);
+
+	parser->version = from->version;
+	parser->version_set = from->version_set;
+	parser->is_gles = from->is_gles;
+	parser->has_new_line_number = 1;
+	parser->new_line_number = from->next_line;
+	return parser;
+}
+
+static void
+glcpp_parse_source(glcpp_parser_t *parser, const char **shader,
+                   struct gl_context *gl_ctx)
+{
 	if (! gl_ctx->Const.DisableGLSLLineContinuations)
 		*shader = remove_line_continuations(parser, *shader);
 
 	glcpp_lex_set_source_string (parser, *shader);
 
 	glcpp_parser_parse (parser);
+}
+
+struct glcpp_checkpoint *
+glcpp_checkpoint_create(const char *chunk, const struct glcpp_checkpoint *from,
+                        glcpp_extension_iterator extensions, void *state,
+                        struct gl_context *gl_ctx)
+{
+	glcpp_parser_t *parser =
+		glcpp_parser_create_from(from, extensions, state, gl_ctx);
+
+	glcpp_parse_source(parser, &chunk, gl_ctx);
+
+	/* The chunk has to end where a continuous parse would be back at
+	 * the start of a line with nothing pending. */
+	if (parser->error || parser->skip_stack || parser->active ||
+	    parser->lex_from_list) {
+		glcpp_parser_destroy(parser);
+		return NULL;
+	}
+
+	struct glcpp_checkpoint *checkpoint =
+		ralloc(NULL, struct glcpp_checkpoint);
+	checkpoint->version = parser->version;
+	checkpoint->version_set = parser->version_set;
+	checkpoint->is_gles = parser->is_gles;
+	checkpoint->next_line = glcpp_get_lineno(parser->scanner);
+
+	/* Keep the parser's memory but not its lexer; the defines table
+	 * moves to the checkpoint. */
+	glcpp_lex_destroy(parser->scanner);
+	parser->scanner = NULL;
+	_mesa_string_buffer_crimp_to_fit(parser->output);
+	ralloc_steal(checkpoint, parser);
+	checkpoint->parser = parser;
+	checkpoint->defines = parser->defines;
+	parser->defines = NULL;
+	return checkpoint;
+}
+
+void
+glcpp_checkpoint_destroy(struct glcpp_checkpoint *checkpoint)
+{
+	if (checkpoint == NULL)
+		return;
+	_mesa_hash_table_destroy(checkpoint->defines, NULL);
+	ralloc_free(checkpoint);
+}
+
+const char *
+glcpp_checkpoint_output(const struct glcpp_checkpoint *checkpoint,
+                        size_t *length)
+{
+	*length = checkpoint->parser->output->length;
+	return checkpoint->parser->output->buf;
+}
+
+const char *
+glcpp_checkpoint_info_log(const struct glcpp_checkpoint *checkpoint)
+{
+	return checkpoint->parser->info_log->buf;
+}
+
+int
+glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
+                 glcpp_extension_iterator extensions, void *state,
+                 struct gl_context *gl_ctx)
+{
+	return glcpp_preprocess_from(ralloc_ctx, shader, info_log, NULL,
+	                             extensions, state, gl_ctx);
+}
+
+int
+glcpp_preprocess_from(void *ralloc_ctx, const char **shader, char **info_log,
+                      const struct glcpp_checkpoint *from,
+                      glcpp_extension_iterator extensions, void *state,
+                      struct gl_context *gl_ctx)
+{
+	int errors;
+	glcpp_parser_t *parser =
+		glcpp_parser_create_from(from, extensions, state, gl_ctx);
 
+	glcpp_parse_source(parser, shader, gl_ctx);
 	if (parser->skip_stack)
 		glcpp_error (&parser->skip_stack->loc, parser, "Unterminated #if\n");
 
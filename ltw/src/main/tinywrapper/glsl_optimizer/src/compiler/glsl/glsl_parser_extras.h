@@ -1081,6 +1081,28 @@ extern int glcpp_preprocess(void *ctx, const char **shader, char **info_log,
                             struct _mesa_glsl_parse_state *state,
                             struct gl_context *gl_ctx);
 
+/* See glcpp/glcpp.h */
+struct glcpp_checkpoint;
+
+extern struct glcpp_checkpoint *
+glcpp_checkpoint_create(const char *chunk, const struct glcpp_checkpoint *from,
+                        glcpp_extension_iterator extensions,
+                        struct _mesa_glsl_parse_state *state,
+                        struct gl_context *gl_ctx);
+
+extern void glcpp_checkpoint_destroy(struct glcpp_checkpoint *checkpoint);
+
+extern const char *glcpp_checkpoint_output(const struct glcpp_checkpoint *checkpoint,
+                                           size_t *length);
+
+extern const char *glcpp_checkpoint_info_log(const struct glcpp_checkpoint *checkpoint);
+
+extern int glcpp_preprocess_from(void *ctx, const char **shader, char **info_log,
+                                 const struct glcpp_checkpoint *from,
+                                 glcpp_extension_iterator extensions,
+                                 struct _mesa_glsl_parse_state *state,
+                                 struct gl_context *gl_ctx);
+
 extern void
 _mesa_glsl_copy_symbols_from_table(struct exec_list *shader_ir,
                                    struct glsl_symbol_table *src,
@@ -17,6 +17,7 @@
 #include "glformats.h"
 #include "main.h"
 #include "swizzle.h"
+#include "state_shadow.h"
 #include "libraryinternal.h"
 #include "env.h"
 #include "mempool.h"
@@ -65,8 +66,7 @@ void *glMapBuffer(GLenum target, GLenum access) {   //GLenum是unsigned int类
             break;
     }   //GL读写权限选择
 
-    es3_functions.glGetBufferParameteriv(target, GL_BUFFER_SIZE, &length);  //对应ltw\src\main\tinywrapper\es3_functions.h中的GLESFUNC(glGetBufferParameteriv,PFNGLGETBUFFERPARAMETERIVPROC)
-    //调用获取缓冲区参数iv函数查询数组缓冲区大小，参数为（版本号，GL宏，int类型的指针）
+    length = shadow_get_buffer_size(target);    //缓冲区大小取自绑定状态的影子，不再调用 glGetBufferParameteriv（见 state_shadow.h）
     return es3_functions.glMapBufferRange(target, 0, length, access_range); //对应ltw\src\main\tinywrapper\es3_functions.h中的GLESFUNC(glMapBufferRange,PFNGLMAPBUFFERRANGEPROC)
     //调用映射缓冲区范围函数，参数为（版本号，偏移量，长度，访问权限）
 }
@@ -107,7 +107,7 @@ INTERNAL GLenum get_textarget_query_param(GLenum target) {
         case GL_TEXTURE_CUBE_MAP_ARRAY:
             return GL_TEXTURE_BINDING_CUBE_MAP_ARRAY;
         case GL_TEXTURE_BUFFER:
-            return GL_TEXTURE_BUFFER_BINDING;
+            return GL_TEXTURE_BINDING_BUFFER;
         default:
             return 0;
     }
@@ -288,6 +288,7 @@ void glBufferStorage(GLenum target,
         flags |= (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
     }
     es3_functions.glBufferStorageEXT(target, size, data, flags);
+    shadow_set_buffer_size(target, size);
 }
 
 void *glMapBufferRange( 	GLenum target,
@@ -376,6 +377,10 @@ INTERNAL GLenum get_base_buffer_enum(int buffer_index) {
 void glBindBuffer(GLenum buffer, GLuint name) {
     if(!current_context) return;
     es3_functions.glBindBuffer(buffer, name);
+    if(buffer == GL_ELEMENT_ARRAY_BUFFER) {
+        shadow_set_element_buffer(name);
+        return;
+    }
     int buffer_index = get_buffer_index(buffer);
     if(buffer_index == -1) return;
     current_context->bound_buffers[buffer_index] = name;
@@ -403,6 +408,9 @@ static basebuffer_binding_t* set_basebuffer(GLenum target, GLuint index, GLuint
 void glBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
     if(!current_context) return;
     es3_functions.glBindBufferBase(target, index, buffer);
+    // 同时绑定到通用绑定点
+    int buffer_index = get_buffer_index(target);
+    if(buffer_index != -1) current_context->bound_buffers[buffer_index] = buffer;
     basebuffer_binding_t * binding = set_basebuffer(target, index, buffer);
     if(!binding) return;
     binding->ranged = false;
@@ -411,6 +419,8 @@ void glBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
 void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
     if(!current_context) return;
     es3_functions.glBindBufferRange(target, index, buffer, offset, size);
+    int buffer_index = get_buffer_index(target);
+    if(buffer_index != -1) current_context->bound_buffers[buffer_index] = buffer;
     basebuffer_binding_t * binding = set_basebuffer(target, index, buffer);
     if(!binding) return;
     binding->ranged = true;
@@ -420,8 +430,11 @@ void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offs
 
 void glUseProgram(GLuint program) {
     if(!current_context) return;
+    // 分级编译：后台的优化翻译完成后，在下次绑定时换入
+    if(current_context->pending_program_upgrades > 0 && program != 0) program_upgrade_if_ready(program);
     es3_functions.glUseProgram(program);
     current_context->program = program;
+    program_specialization_bind(program);
 }
 
 void glGetIntegerv(GLenum pname, GLint* data) {
@@ -463,6 +476,7 @@ void glDeleteTextures(GLsizei n, const GLuint *textures) {
     if(!current_context) return;
     if(!textures) return;
     es3_functions.glDeleteTextures(n, textures);
+    shadow_delete_textures(n, textures);
     for(int i = 0; i < n; i++) {
         void* tracker = unordered_map_remove(current_context->texture_swztrack_map, (void*)textures[i]);
         if(tracker) mempool_free(current_context->swizzle_track_pool, tracker);
@@ -518,7 +532,12 @@ __attribute((constructor)) void init_noerror() {
 
 GLenum glGetError() {
     if(noerror) return 0;
-    else return es3_functions.glGetError();
+    if(current_context && current_context->deferred_error != GL_NO_ERROR) {
+        GLenum error = current_context->deferred_error;
+        current_context->deferred_error = GL_NO_ERROR;
+        return error;
+    }
+    return es3_functions.glGetError();
 }
 
 void glDebugMessageControl( 	GLenum source,
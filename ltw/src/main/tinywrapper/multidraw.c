@@ -6,8 +6,81 @@
 
 #include <proc.h>
 #include <egl.h>
+#include <limits.h>
 #include "basevertex.h"
+#include "main.h"
+#include "state_shadow.h"
 #include "debug.h"
+// 子绘制少于这个数时逐个 glDrawArrays 比上传命令更便宜
+#define MULTIDRAW_INDIRECT_MIN_DRAWS 4
+// 列表图元下，子绘制平均索引数少于这个值时拼成一次普通绘制（GPU 端只有一个绘制），否则用间接绘制免去复制
+#define MULTIDRAW_INDIRECT_MIN_INDICES 64
+
+// 只有各图元互相独立的模式才能把子绘制首尾相接成一次绘制，条带、扇形、环线拼起来会多出图元
+static inline bool is_list_mode(GLenum mode) {
+    switch(mode) {
+        case GL_POINTS:
+        case GL_LINES:
+        case GL_TRIANGLES:
+        case GL_LINES_ADJACENCY:
+        case GL_TRIANGLES_ADJACENCY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline void restore_copy_write(void) {
+    current_context->fast_gl.glBindBuffer(GL_COPY_WRITE_BUFFER, current_context->bound_buffers[get_buffer_index(GL_COPY_WRITE_BUFFER)]);
+}
+
+static inline void restore_draw_indirect(void) {
+    current_context->fast_gl.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, current_context->bound_buffers[get_buffer_index(GL_DRAW_INDIRECT_BUFFER)]);
+}
+
+// ES 3.1 的间接绘制在默认 VAO 上（及使用客户端数组时）报 GL_INVALID_OPERATION，什么也不画。
+// 旧版本游戏（1.16 及之前）在默认 VAO 上渲染，只有绑定了 VAO 时才走间接绘制；
+// 非默认 VAO 本身不允许客户端数组，绑定状态取自影子副本，不需要查询
+static inline bool can_draw_indirect(void) {
+    return current_context->multidraw_indirect && current_context->vertex_array != 0;
+}
+
+static bool multidraw_arrays_indirect(GLenum mode, const GLint *first, const GLsizei *count, GLsizei primcount, GLsizei valid_count) {
+    stream_ring_t* ring = &current_context->multidraw_ring;
+    GLintptr commands_offset = stream_ring_alloc(ring, (GLsizeiptr)valid_count * sizeof(indirect_array_pass_t), sizeof(GLuint));
+    if(commands_offset < 0) {
+        restore_copy_write();
+        return false;
+    }
+    indirect_array_pass_t batch[MULTIDRAW_COMMAND_BATCH];
+    GLsizei batched = 0, written = 0;
+    for(GLsizei i = 0; i < primcount; i++) {
+        // first 为负时原生调用只会报错，不画任何东西
+        if(count[i] <= 0 || first[i] < 0) continue;
+        indirect_array_pass_t* pass = &batch[batched++];
+        pass->count = count[i];
+        pass->instanceCount = 1;
+        pass->first = first[i];
+        pass->reservedMustBeZero = 0;
+        if(batched == MULTIDRAW_COMMAND_BATCH) {
+            stream_ring_write(ring, commands_offset + written * sizeof(indirect_array_pass_t), batch, sizeof(batch));
+            written += batched;
+            batched = 0;
+        }
+    }
+    if(batched > 0) {
+        stream_ring_write(ring, commands_offset + written * sizeof(indirect_array_pass_t), batch, batched * sizeof(indirect_array_pass_t));
+        written += batched;
+    }
+    restore_copy_write();
+    if(written > 0) {
+        current_context->fast_gl.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer);
+        es3_functions.glMultiDrawArraysIndirectEXT(mode, (const void*)commands_offset, written, 0);
+        restore_draw_indirect();
+    }
+    return true;
+}
+
 void glMultiDrawArrays( GLenum mode, GLint *first, GLsizei *count, GLsizei primcount )
 {
     // 优化：跳过空绘制调用
@@ -32,7 +105,13 @@ void glMultiDrawArrays( GLenum mode, GLint *first, GLsizei *count, GLsizei primc
         }
     }
 
-    // 多个绘制调用：逐个执行（保持原有逻辑）
+    // 子绘制较多时写一组间接绘制命令，一次 glMultiDrawArraysIndirectEXT 提交
+    if (can_draw_indirect() && valid_count >= MULTIDRAW_INDIRECT_MIN_DRAWS &&
+        multidraw_arrays_indirect(mode, first, count, primcount, valid_count)) {
+        return;
+    }
+
+    // 多个绘制调用：逐个执行
     for (int i = 0; i < primcount; i++) {
         if (count[i] > 0) {
             current_context->fast_gl.glDrawArrays(mode, first[i], count[i]);
@@ -40,108 +119,133 @@ void glMultiDrawArrays( GLenum mode, GLint *first, GLsizei *count, GLsizei primc
     }
 }
 
+// 索引已经在绑定的元素缓冲区里：每个子绘制写一条命令（firstIndex 即原偏移），不复制任何索引
+static bool multidraw_elements_indirect(GLenum mode, const GLsizei *count, GLenum type, GLsizei typebytes,
+                                        const void * const *indices, GLsizei primcount, GLsizei valid_count) {
+    // 偏移没有按索引大小对齐时换算不出 firstIndex，交给复制路径
+    for(GLsizei i = 0; i < primcount; i++) {
+        if(count[i] > 0 && (uintptr_t)indices[i] % typebytes != 0) return false;
+    }
+    stream_ring_t* ring = &current_context->multidraw_ring;
+    GLintptr commands_offset = stream_ring_alloc(ring, (GLsizeiptr)valid_count * sizeof(indirect_pass_t), sizeof(GLuint));
+    if(commands_offset < 0) {
+        restore_copy_write();
+        return false;
+    }
+    indirect_pass_t batch[MULTIDRAW_COMMAND_BATCH];
+    GLsizei batched = 0, written = 0;
+    for(GLsizei i = 0; i < primcount; i++) {
+        if(count[i] <= 0) continue;
+        indirect_pass_t* pass = &batch[batched++];
+        pass->count = count[i];
+        pass->instanceCount = 1;
+        pass->firstIndex = (uintptr_t)indices[i] / typebytes;
+        pass->baseVertex = 0;
+        pass->reservedMustBeZero = 0;
+        if(batched == MULTIDRAW_COMMAND_BATCH) {
+            stream_ring_write(ring, commands_offset + written * sizeof(indirect_pass_t), batch, sizeof(batch));
+            written += batched;
+            batched = 0;
+        }
+    }
+    if(batched > 0) {
+        stream_ring_write(ring, commands_offset + written * sizeof(indirect_pass_t), batch, batched * sizeof(indirect_pass_t));
+        written += batched;
+    }
+    restore_copy_write();
+    current_context->fast_gl.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring->buffer);
+    es3_functions.glMultiDrawElementsIndirectEXT(mode, type, (const void*)commands_offset, written, 0);
+    restore_draw_indirect();
+    return true;
+}
+
 void glMultiDrawElements( GLenum mode, GLsizei *count, GLenum type, const void * const *indices, GLsizei primcount )
 {
     if(!current_context) return;
     if(primcount <= 0) return;
 
-    GLint elementbuffer;
-    current_context->fast_gl.glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementbuffer);
-    current_context->fast_gl.glBindBuffer(GL_COPY_WRITE_BUFFER, current_context->multidraw_element_buffer);
-
-    GLsizei total = 0, typebytes = type_bytes(type);
+    GLsizei typebytes = type_bytes(type);
     if(typebytes <= 0) {
         LTW_ERROR_PRINTF("LTW: unsupported type for multidraw");
         return;
     }
 
     // 第一遍：计算总大小
+    GLsizei total = 0, valid_count = 0, last_valid = 0;
     for (GLsizei i = 0; i < primcount; i++) {
+        if(count[i] <= 0) continue;
+        // 检查整数溢出
+        if(count[i] > INT_MAX / typebytes - total) {
+            LTW_ERROR_PRINTF("LTW: multidraw size overflow");
+            return;
+        }
         total += count[i];
+        valid_count++;
+        last_valid = i;
     }
-    // 检查整数溢出
-    if(total > INT_MAX / typebytes) {
-        LTW_ERROR_PRINTF("LTW: multidraw size overflow");
-        return;
-    }
-    GLsizei needed_size = total * typebytes;
-
-    // 环形缓冲区逻辑：检查是否需要扩容
-    if(needed_size > current_context->multidraw_buffer_size) {
-        // 扩容到2倍或足够大小，但不超过 16MB
-        GLsizei new_size = needed_size * 2;
-        const GLsizei MAX_MULTIDRAW_BUFFER_SIZE = 16 * 1024 * 1024; // 16MB
-        if(new_size > MAX_MULTIDRAW_BUFFER_SIZE) {
-            new_size = needed_size;
-            if(new_size > MAX_MULTIDRAW_BUFFER_SIZE) {
-                LTW_ERROR_PRINTF("LTW: multidraw buffer size too large: %d", new_size);
-                return;
-            }
+    if(total == 0) return;
+
+    GLuint elementbuffer = shadow_get_element_buffer();
+
+    if(elementbuffer != 0) {
+        // 只有一个有效子绘制：直接画，不需要复制或间接命令
+        if(valid_count == 1) {
+            current_context->fast_gl.glDrawElements(mode, count[last_valid], type, indices[last_valid]);
+            return;
         }
-        current_context->fast_gl.glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, GL_STREAM_DRAW);
-        current_context->multidraw_buffer_size = new_size;
-        // 重置环形缓冲区
-        current_context->multidraw_ring_head = 0;
-        current_context->multidraw_ring_tail = 0;
-        current_context->multidraw_ring_wrapped = false;
-    } else {
-        // 检查环形缓冲区是否有足够空间
-        size_t available_space;
-        if(!current_context->multidraw_ring_wrapped) {
-            available_space = current_context->multidraw_buffer_size - current_context->multidraw_ring_head;
-        } else {
-            available_space = current_context->multidraw_ring_tail - current_context->multidraw_ring_head;
+        // 子绘制大或者模式不能拼接时走间接绘制；许多很小的列表子绘制拼成一次绘制更快
+        if(can_draw_indirect() &&
+           (!is_list_mode(mode) || total / valid_count >= MULTIDRAW_INDIRECT_MIN_INDICES) &&
+           multidraw_elements_indirect(mode, count, type, typebytes, indices, primcount, valid_count)) {
+            return;
         }
-
-        if(needed_size > available_space) {
-            // 空间不足，重置到缓冲区开头
-            current_context->multidraw_ring_head = 0;
-            current_context->multidraw_ring_wrapped = false;
+        // 非列表模式不能拼成一次绘制，索引已经在缓冲区里，逐段直接画，不需要复制
+        if(!is_list_mode(mode)) {
+            for (GLsizei i = 0; i < primcount; i++) {
+                if(count[i] <= 0) continue;
+                current_context->fast_gl.glDrawElements(mode, count[i], type, indices[i]);
+            }
+            return;
         }
     }
 
-    // 计算写入偏移量
-    size_t write_offset = current_context->multidraw_ring_head;
+    // 回退路径：把各段索引拼到流式环形缓冲区里（列表模式拼成一次绘制，客户端索引要先上传）
+    GLsizeiptr needed_size = (GLsizeiptr)total * typebytes;
+    stream_ring_t* ring = &current_context->multidraw_ring;
+    GLintptr write_offset = stream_ring_alloc(ring, needed_size, typebytes);
+    if(write_offset < 0) {
+        restore_copy_write();
+        return;
+    }
 
-    // 优化：根据数据源选择最佳填充策略
-    if(elementbuffer != 0) {
-        // 使用 glCopyBufferSubData 进行批量复制（GPU间传输，更快）
-        GLsizei offset = 0;
-        for (GLsizei i = 0; i < primcount; i++) {
-            GLsizei icount = count[i];
-            if(icount == 0) continue;
-            icount *= typebytes;
-            current_context->fast_gl.glCopyBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)indices[i], write_offset + offset, icount);
-            offset += icount;
+    GLintptr offset = write_offset;
+    for (GLsizei i = 0; i < primcount; i++) {
+        if(count[i] <= 0) continue;
+        GLsizeiptr icount = (GLsizeiptr)count[i] * typebytes;
+        if(elementbuffer != 0) {
+            // 索引在缓冲区里：GPU 端复制
+            current_context->fast_gl.glCopyBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)indices[i], offset, icount);
+        } else {
+            // 客户端索引：持久映射时直接 memcpy，否则 glBufferSubData
+            stream_ring_write(ring, offset, indices[i], icount);
         }
+        offset += icount;
+    }
+    restore_copy_write();
+
+    // 绑定并绘制：列表图元一次画完，其它模式（只有客户端索引会到这里）按原来的分段逐个画
+    current_context->fast_gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ring->buffer);
+    if(is_list_mode(mode)) {
+        current_context->fast_gl.glDrawElements(mode, total, type, (const void*)write_offset);
     } else {
-        // CPU数据：使用 glBufferSubData（一次性分配后批量填充）
-        GLsizei offset = 0;
+        offset = write_offset;
         for (GLsizei i = 0; i < primcount; i++) {
-            GLsizei icount = count[i];
-            if(icount == 0) continue;
-            icount *= typebytes;
-            current_context->fast_gl.glBufferSubData(GL_COPY_WRITE_BUFFER, write_offset + offset, icount, indices[i]);
-            offset += icount;
+            if(count[i] <= 0) continue;
+            current_context->fast_gl.glDrawElements(mode, count[i], type, (const void*)offset);
+            offset += (GLsizeiptr)count[i] * typebytes;
         }
     }
 
-    // 更新环形缓冲区头部
-    current_context->multidraw_ring_head += needed_size;
-    if(current_context->multidraw_ring_head >= current_context->multidraw_buffer_size) {
-        current_context->multidraw_ring_head = 0;
-        current_context->multidraw_ring_wrapped = true;
-    }
-    if(!current_context->multidraw_ring_wrapped) {
-        current_context->multidraw_ring_tail = current_context->multidraw_ring_head;
-    }
-
-    // 绑定并绘制
-    current_context->fast_gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, current_context->multidraw_element_buffer);
-    current_context->fast_gl.glDrawElements(mode, total, type, (const void*)write_offset);
-
-    // 恢复原始绑定
-    if(elementbuffer != 0) {
-        current_context->fast_gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-    }
-}
\ No newline at end of file
+    // 恢复原始绑定（元素缓冲区绑定属于 VAO，为 0 时也要恢复）
+    current_context->fast_gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+}
@@ -7,6 +7,7 @@
 #include "egl.h"
 #include <stdbool.h>
 #include "swizzle.h"
+#include "state_shadow.h"
 #include "debug.h"
 void buffer_copier_init(context_t* context) {
     framebuffer_copier_t* copier = &context->framebuffer_copier;
@@ -19,6 +20,8 @@ void buffer_copier_init(context_t* context) {
     es3_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     es3_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     es3_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // 新上下文上原本没有绑定纹理
+    es3_functions.glBindTexture(GL_TEXTURE_2D, 0);
     GLenum error = es3_functions.glGetError();
     if(error != 0) {
         LTW_ERROR_PRINTF("LTW: error while initializing buffer-copier: %x", error);
@@ -30,8 +33,7 @@ void buffer_copier_init(context_t* context) {
 static void buffer_copier_store(GLint x, GLint y, GLsizei w, GLsizei h) {
     framebuffer_copier_t* copier = &current_context->framebuffer_copier;
     if(!copier->ready) return;
-    GLint current_texbind;
-    es3_functions.glGetIntegerv(GL_TEXTURE_BINDING_2D, &current_texbind);
+    GLuint current_texbind = shadow_get_texture(GL_TEXTURE_2D);
     es3_functions.glBindTexture(GL_TEXTURE_2D, copier->temp_texture);
     es3_functions.glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, w, h, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     es3_functions.glBindTexture(GL_TEXTURE_2D, current_texbind);
@@ -44,10 +46,8 @@ static void buffer_copier_store(GLint x, GLint y, GLsizei w, GLsizei h) {
 static void buffer_copier_release(GLenum target, GLint level, GLint x, GLint y, GLsizei w, GLsizei h) {
     framebuffer_copier_t* copier = &current_context->framebuffer_copier;
     if(!copier->ready) return;
-    GLint current_texbind;
-    GLenum target_query = get_textarget_query_param(target);
-    if(target_query == GL_NONE) return;
-    es3_functions.glGetIntegerv(target_query, &current_texbind);
+    if(get_textarget_query_param(target) == GL_NONE) return;
+    GLuint current_texbind = shadow_get_texture(target);
     es3_functions.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copier->destfb);
     es3_functions.glBindFramebuffer(GL_READ_FRAMEBUFFER, copier->tempfb);
     es3_functions.glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target, current_texbind, level);
@@ -65,8 +65,7 @@ void glGetTexImage( 	GLenum target,
     if(!current_context->es31) goto unsupported_esver;
     if(format != GL_RGBA && format != GL_RGBA_INTEGER && type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_INT && type != GL_INT && type != GL_FLOAT) goto unsupported;
     framebuffer_copier_t* copier = &current_context->framebuffer_copier;
-    GLint texture;
-    es3_functions.glGetIntegerv(get_textarget_query_param(target), &texture);
+    GLuint texture = shadow_get_texture(target);
     es3_functions.glBindFramebuffer(GL_READ_FRAMEBUFFER, copier->tempfb);
     es3_functions.glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, level);
     GLint w, h;
@@ -145,8 +144,7 @@ void texture_blit_framebuffer(GLenum target,
         fb_blit_bit = GL_COLOR_BUFFER_BIT;
     }
 
-    GLint texture;
-    es3_functions.glGetIntegerv(get_textarget_query_param(target), &texture);
+    GLuint texture = shadow_get_texture(target);
     es3_functions.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copier->destfb);
     es3_functions.glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, fb_attachment, target, texture, level);
     es3_functions.glBlitFramebuffer(x, y, width+x, height+y, xoffset, yoffset, width+xoffset, height+yoffset, fb_blit_bit, GL_NEAREST);
@@ -0,0 +1,494 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "program_specialization.h"
+#include "shader_cache.h"
+#include "egl.h"
+#include "proc.h"
+#include "env.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+// 候选 uniform 连续这么多次 glUseProgram 没有改变后才生成特化版本
+#define SPECIALIZE_STABLE_USES 64
+// 改变超过这么多次的 uniform 不再参与特化（链接后的第一次赋值也算一次）
+#define SPECIALIZE_MAX_CHANGES 2
+// 位置表按位置直接索引，位置更大的 uniform 不跟踪
+#define SPECIALIZE_MAX_LOCATION 4096
+
+typedef enum {
+    KIND_FLOAT,
+    KIND_INT,
+    KIND_UINT,
+    KIND_BOOL
+} uniform_kind_t;
+
+typedef struct {
+    GLenum type;
+    uniform_kind_t kind;
+    GLint columns;      // 矩阵的列数，其余类型为 1
+    GLint rows;         // 每列的分量数
+} uniform_type_t;
+
+static const uniform_type_t uniform_types[] = {
+    { GL_FLOAT, KIND_FLOAT, 1, 1 },
+    { GL_FLOAT_VEC2, KIND_FLOAT, 1, 2 },
+    { GL_FLOAT_VEC3, KIND_FLOAT, 1, 3 },
+    { GL_FLOAT_VEC4, KIND_FLOAT, 1, 4 },
+    { GL_FLOAT_MAT2, KIND_FLOAT, 2, 2 },
+    { GL_FLOAT_MAT3, KIND_FLOAT, 3, 3 },
+    { GL_FLOAT_MAT4, KIND_FLOAT, 4, 4 },
+    { GL_FLOAT_MAT2x3, KIND_FLOAT, 2, 3 },
+    { GL_FLOAT_MAT2x4, KIND_FLOAT, 2, 4 },
+    { GL_FLOAT_MAT3x2, KIND_FLOAT, 3, 2 },
+    { GL_FLOAT_MAT3x4, KIND_FLOAT, 3, 4 },
+    { GL_FLOAT_MAT4x2, KIND_FLOAT, 4, 2 },
+    { GL_FLOAT_MAT4x3, KIND_FLOAT, 4, 3 },
+    { GL_INT, KIND_INT, 1, 1 },
+    { GL_INT_VEC2, KIND_INT, 1, 2 },
+    { GL_INT_VEC3, KIND_INT, 1, 3 },
+    { GL_INT_VEC4, KIND_INT, 1, 4 },
+    { GL_UNSIGNED_INT, KIND_UINT, 1, 1 },
+    { GL_UNSIGNED_INT_VEC2, KIND_UINT, 1, 2 },
+    { GL_UNSIGNED_INT_VEC3, KIND_UINT, 1, 3 },
+    { GL_UNSIGNED_INT_VEC4, KIND_UINT, 1, 4 },
+    { GL_BOOL, KIND_BOOL, 1, 1 },
+    { GL_BOOL_VEC2, KIND_BOOL, 1, 2 },
+    { GL_BOOL_VEC3, KIND_BOOL, 1, 3 },
+    { GL_BOOL_VEC4, KIND_BOOL, 1, 4 },
+};
+
+typedef struct {
+    GLchar* name;
+    const uniform_type_t* type;
+    GLint location;         // 通用版本中的位置，也是应用使用的位置
+    GLuint value[16];       // 最近写入的值，矩阵按列主序，bool 为 0/1
+    unsigned changes;
+    bool requested;         // 在正在进行或已换入的特化翻译中作为常量
+    bool constant;          // 特化版本把它编译成了常量，值改变时要换回通用版本
+    bool absent;            // 当前链接的特化版本中没有这个 uniform，值只由包装层保存
+} tracked_uniform_t;
+
+struct program_specialization {
+    GLuint program;
+    tracked_uniform_t* uniforms;
+    int nuniforms;
+    int* slots;             // 位置 -> uniforms 下标，-1 表示不跟踪
+    GLint nslots;
+    unsigned stable_uses;   // 候选 uniform 上次改变后的使用次数
+    int variants;
+    bool pending;           // 特化翻译进行中
+    bool active;            // 当前链接的是特化版本
+    bool exhausted;         // 特化不会再带来变化，或已达到版本上限
+    program_state_t* layout;
+    program_generic_t generic;
+};
+
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static bool enabled = false;
+static int max_variants = 4;
+
+static atomic_uint stat_programs;
+static atomic_uint stat_variants;
+static atomic_uint stat_fallbacks;
+static atomic_uint stat_folded;
+
+static void config_init(void) {
+    enabled = env_istrue("LTW_SPECIALIZE_UNIFORMS");
+    const char* variants = getenv("LTW_SPECIALIZE_VARIANTS");
+    if(variants != NULL) {
+        char* end = NULL;
+        long parsed = strtol(variants, &end, 10);
+        if(end != variants && parsed >= 0) max_variants = parsed > 64 ? 64 : (int)parsed;
+    }
+}
+
+INTERNAL bool program_specialization_enabled(void) {
+    pthread_once(&config_once, config_init);
+    return enabled;
+}
+
+static const uniform_type_t* find_type(GLenum type) {
+    for(size_t i = 0; i < sizeof(uniform_types) / sizeof(uniform_types[0]); i++) {
+        if(uniform_types[i].type == type) return &uniform_types[i];
+    }
+    return NULL;
+}
+
+static bool is_candidate(const tracked_uniform_t* uniform) {
+    return uniform->changes <= SPECIALIZE_MAX_CHANGES;
+}
+
+static void read_uniform(GLuint program, tracked_uniform_t* uniform) {
+    switch(uniform->type->kind) {
+        case KIND_FLOAT: es3_functions.glGetUniformfv(program, uniform->location, (GLfloat*)uniform->value); return;
+        case KIND_UINT: es3_functions.glGetUniformuiv(program, uniform->location, uniform->value); return;
+        // bool 按整数读出 0/1
+        default: es3_functions.glGetUniformiv(program, uniform->location, (GLint*)uniform->value); return;
+    }
+}
+
+// 把包装层保存的值写入当前程序
+static void write_uniform(const tracked_uniform_t* uniform) {
+    const uniform_type_t* type = uniform->type;
+    const GLfloat* f = (const GLfloat*)uniform->value;
+    const GLint* i = (const GLint*)uniform->value;
+    GLint location = uniform->location;
+    if(type->kind == KIND_UINT) {
+        switch(type->rows) {
+            case 1: es3_functions.glUniform1uiv(location, 1, uniform->value); return;
+            case 2: es3_functions.glUniform2uiv(location, 1, uniform->value); return;
+            case 3: es3_functions.glUniform3uiv(location, 1, uniform->value); return;
+            default: es3_functions.glUniform4uiv(location, 1, uniform->value); return;
+        }
+    }
+    if(type->kind != KIND_FLOAT) {
+        switch(type->rows) {
+            case 1: es3_functions.glUniform1iv(location, 1, i); return;
+            case 2: es3_functions.glUniform2iv(location, 1, i); return;
+            case 3: es3_functions.glUniform3iv(location, 1, i); return;
+            default: es3_functions.glUniform4iv(location, 1, i); return;
+        }
+    }
+    switch(type->type) {
+        case GL_FLOAT: es3_functions.glUniform1fv(location, 1, f); return;
+        case GL_FLOAT_VEC2: es3_functions.glUniform2fv(location, 1, f); return;
+        case GL_FLOAT_VEC3: es3_functions.glUniform3fv(location, 1, f); return;
+        case GL_FLOAT_VEC4: es3_functions.glUniform4fv(location, 1, f); return;
+        case GL_FLOAT_MAT2: es3_functions.glUniformMatrix2fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3: es3_functions.glUniformMatrix3fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT4: es3_functions.glUniformMatrix4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT2x3: es3_functions.glUniformMatrix2x3fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT2x4: es3_functions.glUniformMatrix2x4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3x2: es3_functions.glUniformMatrix3x2fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3x4: es3_functions.glUniformMatrix3x4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT4x2: es3_functions.glUniformMatrix4x2fv(location, 1, GL_FALSE, f); return;
+        default: es3_functions.glUniformMatrix4x3fv(location, 1, GL_FALSE, f); return;
+    }
+}
+
+// 返回记录下来的最大位置
+static GLint collect_uniforms(GLuint program, program_specialization_t* specialization, GLint count, GLint max_length) {
+    GLint max_location = -1;
+    GLchar name[max_length + 1];
+    for(GLint i = 0; i < count; i++) {
+        GLint size = 0;
+        GLenum type = 0;
+        name[0] = 0;
+        es3_functions.glGetActiveUniform(program, i, max_length + 1, NULL, &size, &type, name);
+        const uniform_type_t* uniform_type = find_type(type);
+        // 数组、结构体成员和内建 uniform 在翻译器里不是单独的变量；采样器没有值可以折叠
+        if(uniform_type == NULL || size != 1 || strchr(name, '[') != NULL || strchr(name, '.') != NULL ||
+           strncmp(name, "gl_", 3) == 0) {
+            continue;
+        }
+        GLint location = es3_functions.glGetUniformLocation(program, name);
+        if(location < 0 || location >= SPECIALIZE_MAX_LOCATION) continue;
+        tracked_uniform_t* uniform = &specialization->uniforms[specialization->nuniforms];
+        uniform->name = strdup(name);
+        if(uniform->name == NULL) continue;
+        uniform->type = uniform_type;
+        uniform->location = location;
+        read_uniform(program, uniform);
+        specialization->nuniforms++;
+        if(location > max_location) max_location = location;
+    }
+    return max_location;
+}
+
+INTERNAL program_specialization_t* program_specialization_create(GLuint program) {
+    if(!program_specialization_enabled() || max_variants == 0) return NULL;
+    GLint count = 0, max_length = 0;
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    if(count <= 0) return NULL;
+
+    program_specialization_t* specialization = calloc(1, sizeof(program_specialization_t));
+    if(specialization == NULL) return NULL;
+    specialization->program = program;
+    specialization->uniforms = calloc(count, sizeof(tracked_uniform_t));
+    if(specialization->uniforms == NULL) goto fail;
+    GLint max_location = collect_uniforms(program, specialization, count, max_length);
+    if(specialization->nuniforms == 0) goto fail;
+
+    specialization->nslots = max_location + 1;
+    specialization->slots = malloc(specialization->nslots * sizeof(int));
+    if(specialization->slots == NULL) goto fail;
+    for(GLint i = 0; i < specialization->nslots; i++) specialization->slots[i] = -1;
+    for(int i = 0; i < specialization->nuniforms; i++) specialization->slots[specialization->uniforms[i].location] = i;
+    specialization->layout = program_state_capture(program, false);
+    if(specialization->layout == NULL) goto fail;
+    atomic_fetch_add_explicit(&stat_programs, 1, memory_order_relaxed);
+    return specialization;
+
+    fail:
+    program_specialization_free(specialization);
+    return NULL;
+}
+
+INTERNAL void program_specialization_free(program_specialization_t* specialization) {
+    if(specialization == NULL) return;
+    for(int i = 0; i < specialization->nuniforms; i++) free(specialization->uniforms[i].name);
+    free(specialization->uniforms);
+    free(specialization->slots);
+    program_state_free(specialization->layout);
+    for(int i = 0; i < specialization->generic.nstages; i++) shader_source_release(specialization->generic.sources[i]);
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) free(specialization->generic.colorbindings[i]);
+    free(specialization);
+}
+
+INTERNAL program_generic_t* program_specialization_generic(program_specialization_t* specialization) {
+    return &specialization->generic;
+}
+
+INTERNAL bool program_specialization_note_use(program_specialization_t* specialization) {
+    if(specialization->pending || specialization->active || specialization->exhausted) return false;
+    if(++specialization->stable_uses < SPECIALIZE_STABLE_USES) return false;
+    bool has_candidate = false;
+    for(int i = 0; i < specialization->nuniforms && !has_candidate; i++) {
+        has_candidate = is_candidate(&specialization->uniforms[i]);
+    }
+    if(!has_candidate || specialization->variants >= max_variants) {
+        specialization->exhausted = true;
+        return false;
+    }
+    specialization->variants++;
+    specialization->pending = true;
+    specialization->stable_uses = 0;
+    return true;
+}
+
+INTERNAL int program_specialization_constants(program_specialization_t* specialization,
+                                              struct optimize_shader_constant** constants) {
+    *constants = malloc(specialization->nuniforms * sizeof(struct optimize_shader_constant));
+    if(*constants == NULL) return 0;
+    int nconstants = 0;
+    for(int i = 0; i < specialization->nuniforms; i++) {
+        tracked_uniform_t* uniform = &specialization->uniforms[i];
+        uniform->requested = is_candidate(uniform);
+        if(!uniform->requested) continue;
+        struct optimize_shader_constant* constant = &(*constants)[nconstants++];
+        memset(constant, 0, sizeof(struct optimize_shader_constant));
+        constant->name = uniform->name;
+        constant->type = uniform->type->type;
+        memcpy(constant->value, uniform->value, uniform->type->columns * uniform->type->rows * sizeof(GLuint));
+    }
+    return nconstants;
+}
+
+INTERNAL bool program_specialization_still_valid(const program_specialization_t* specialization,
+                                                 const struct optimize_shader_constant* constants, int nconstants) {
+    for(int i = 0; i < nconstants; i++) {
+        const tracked_uniform_t* uniform = NULL;
+        for(int j = 0; j < specialization->nuniforms && uniform == NULL; j++) {
+            if(strcmp(specialization->uniforms[j].name, constants[i].name) == 0) uniform = &specialization->uniforms[j];
+        }
+        if(uniform == NULL || !is_candidate(uniform)) return false;
+        if(memcmp(uniform->value, constants[i].value, uniform->type->columns * uniform->type->rows * sizeof(GLuint)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+INTERNAL void program_specialization_activate(program_specialization_t* specialization) {
+    specialization->pending = false;
+    specialization->active = true;
+    atomic_fetch_add_explicit(&stat_variants, 1, memory_order_relaxed);
+    for(int i = 0; i < specialization->nuniforms; i++) {
+        tracked_uniform_t* uniform = &specialization->uniforms[i];
+        // 除了折叠掉的常量，优化后不再使用的其他 uniform 也会消失，它们的值同样由包装层保存
+        uniform->absent = es3_functions.glGetUniformLocation(specialization->program, uniform->name) == -1;
+        uniform->constant = uniform->absent && uniform->requested;
+        if(uniform->constant) atomic_fetch_add_explicit(&stat_folded, 1, memory_order_relaxed);
+    }
+}
+
+INTERNAL void program_specialization_abandon(program_specialization_t* specialization, bool retry) {
+    specialization->pending = false;
+    if(!retry) specialization->exhausted = true;
+    for(int i = 0; i < specialization->nuniforms; i++) specialization->uniforms[i].requested = false;
+}
+
+INTERNAL const program_state_t* program_specialization_layout(const program_specialization_t* specialization) {
+    return specialization->layout;
+}
+
+// 折叠掉的常量被改写：换回通用版本，并把特化版本中缺少的 uniform 写回去。
+// 重新链接和写回都在绑定了该程序时进行，它不是当前程序时（glProgramUniform*）之后恢复绑定
+static void fall_back(program_specialization_t* specialization) {
+    specialization->active = false;
+    specialization->stable_uses = 0;
+    atomic_fetch_add_explicit(&stat_fallbacks, 1, memory_order_relaxed);
+    bool relinked = program_relink_generic(specialization->program);
+    if(!relinked) {
+        LTW_ERROR_PRINTF("LTW: failed to restore the generic version of program %u", specialization->program);
+        specialization->exhausted = true;
+    }
+    for(int i = 0; i < specialization->nuniforms; i++) {
+        tracked_uniform_t* uniform = &specialization->uniforms[i];
+        if(relinked && uniform->absent) write_uniform(uniform);
+        uniform->absent = false;
+        uniform->constant = false;
+        uniform->requested = false;
+    }
+    if(relinked && specialization->program != current_context->program) es3_functions.glUseProgram(current_context->program);
+}
+
+// 记录对 specialization 所属程序的一次写入，返回 false 表示不需要再交给驱动。
+// 数据按调用的形状（columns 列、每列 rows 个分量）给出，矩阵已转换为列主序。
+static bool track_uniform_write(program_specialization_t* specialization, GLint location, uniform_kind_t kind,
+                                GLint columns, GLint rows, GLsizei count, const void* data) {
+    if(location < 0 || location >= specialization->nslots || specialization->slots[location] < 0) return true;
+    tracked_uniform_t* uniform = &specialization->uniforms[specialization->slots[location]];
+    const uniform_type_t* type = uniform->type;
+    // 类型不匹配或对非数组写入多个元素时驱动会报错且不改变值
+    if(count != 1 || columns != type->columns || rows != type->rows) return true;
+    if(kind != type->kind && type->kind != KIND_BOOL) return true;
+
+    GLuint value[16];
+    GLint components = columns * rows;
+    if(type->kind == KIND_BOOL) {
+        for(GLint i = 0; i < components; i++) {
+            value[i] = kind == KIND_FLOAT ? ((const GLfloat*)data)[i] != 0.0f : ((const GLuint*)data)[i] != 0;
+        }
+    } else {
+        memcpy(value, data, components * sizeof(GLuint));
+    }
+    if(memcmp(uniform->value, value, components * sizeof(GLuint)) == 0) return !uniform->absent;
+    memcpy(uniform->value, value, components * sizeof(GLuint));
+    if(is_candidate(uniform)) {
+        uniform->changes++;
+        specialization->stable_uses = 0;
+    }
+    if(uniform->constant) {
+        // 新值连同其他缺少的 uniform 一起在通用版本中写回
+        fall_back(specialization);
+        return false;
+    }
+    return !uniform->absent;
+}
+
+// glProgramUniform* 写入的程序的跟踪状态
+static program_specialization_t* specialization_of(GLuint program) {
+    if(!enabled) return NULL;
+    if(program == current_context->program) return current_context->current_specialization;
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    return program_info != NULL ? program_info->specialization : NULL;
+}
+
+#define UNPAREN(...) __VA_ARGS__
+
+// glProgramUniform* 是 ES 3.1 的函数，ES 3.0 上和原来的存根一样什么也不做
+#define UNIFORM_WRITE_FUNCS(n, suffix, ctype, kind, params, ...) \
+void glUniform##n##suffix(GLint location, UNPAREN params) { \
+    if(!current_context) return; \
+    const ctype value[n] = { __VA_ARGS__ }; \
+    program_specialization_t* specialization = current_context->current_specialization; \
+    if(specialization != NULL && !track_uniform_write(specialization, location, kind, 1, n, 1, value)) return; \
+    es3_functions.glUniform##n##suffix(location, __VA_ARGS__); \
+} \
+void glUniform##n##suffix##v(GLint location, GLsizei count, const ctype* value) { \
+    if(!current_context) return; \
+    program_specialization_t* specialization = current_context->current_specialization; \
+    if(specialization != NULL && !track_uniform_write(specialization, location, kind, 1, n, count, value)) return; \
+    es3_functions.glUniform##n##suffix##v(location, count, value); \
+} \
+void glProgramUniform##n##suffix(GLuint program, GLint location, UNPAREN params) { \
+    if(!current_context || es3_functions.glProgramUniform##n##suffix == NULL) return; \
+    const ctype value[n] = { __VA_ARGS__ }; \
+    program_specialization_t* specialization = specialization_of(program); \
+    if(specialization != NULL && !track_uniform_write(specialization, location, kind, 1, n, 1, value)) return; \
+    es3_functions.glProgramUniform##n##suffix(program, location, __VA_ARGS__); \
+} \
+void glProgramUniform##n##suffix##v(GLuint program, GLint location, GLsizei count, const ctype* value) { \
+    if(!current_context || es3_functions.glProgramUniform##n##suffix##v == NULL) return; \
+    program_specialization_t* specialization = specialization_of(program); \
+    if(specialization != NULL && !track_uniform_write(specialization, location, kind, 1, n, count, value)) return; \
+    es3_functions.glProgramUniform##n##suffix##v(program, location, count, value); \
+}
+
+UNIFORM_WRITE_FUNCS(1, f, GLfloat, KIND_FLOAT, (GLfloat v0), v0)
+UNIFORM_WRITE_FUNCS(2, f, GLfloat, KIND_FLOAT, (GLfloat v0, GLfloat v1), v0, v1)
+UNIFORM_WRITE_FUNCS(3, f, GLfloat, KIND_FLOAT, (GLfloat v0, GLfloat v1, GLfloat v2), v0, v1, v2)
+UNIFORM_WRITE_FUNCS(4, f, GLfloat, KIND_FLOAT, (GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3), v0, v1, v2, v3)
+UNIFORM_WRITE_FUNCS(1, i, GLint, KIND_INT, (GLint v0), v0)
+UNIFORM_WRITE_FUNCS(2, i, GLint, KIND_INT, (GLint v0, GLint v1), v0, v1)
+UNIFORM_WRITE_FUNCS(3, i, GLint, KIND_INT, (GLint v0, GLint v1, GLint v2), v0, v1, v2)
+UNIFORM_WRITE_FUNCS(4, i, GLint, KIND_INT, (GLint v0, GLint v1, GLint v2, GLint v3), v0, v1, v2, v3)
+UNIFORM_WRITE_FUNCS(1, ui, GLuint, KIND_UINT, (GLuint v0), v0)
+UNIFORM_WRITE_FUNCS(2, ui, GLuint, KIND_UINT, (GLuint v0, GLuint v1), v0, v1)
+UNIFORM_WRITE_FUNCS(3, ui, GLuint, KIND_UINT, (GLuint v0, GLuint v1, GLuint v2), v0, v1, v2)
+UNIFORM_WRITE_FUNCS(4, ui, GLuint, KIND_UINT, (GLuint v0, GLuint v1, GLuint v2, GLuint v3), v0, v1, v2, v3)
+
+#undef UNIFORM_WRITE_FUNCS
+
+static bool track_matrix_write(program_specialization_t* specialization, GLint location, GLint columns, GLint rows,
+                               GLsizei count, GLboolean transpose, const GLfloat* value) {
+    if(count != 1 || !transpose) return track_uniform_write(specialization, location, KIND_FLOAT, columns, rows, count, value);
+    GLfloat column_major[16];
+    for(GLint c = 0; c < columns; c++) {
+        for(GLint r = 0; r < rows; r++) column_major[c * rows + r] = value[r * columns + c];
+    }
+    return track_uniform_write(specialization, location, KIND_FLOAT, columns, rows, count, column_major);
+}
+
+#define UNIFORM_MATRIX_FUNC(name, columns, rows) \
+void glUniformMatrix##name##fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { \
+    if(!current_context) return; \
+    program_specialization_t* specialization = current_context->current_specialization; \
+    if(specialization != NULL && \
+       !track_matrix_write(specialization, location, columns, rows, count, transpose, value)) return; \
+    es3_functions.glUniformMatrix##name##fv(location, count, transpose, value); \
+} \
+void glProgramUniformMatrix##name##fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, \
+                                      const GLfloat* value) { \
+    if(!current_context || es3_functions.glProgramUniformMatrix##name##fv == NULL) return; \
+    program_specialization_t* specialization = specialization_of(program); \
+    if(specialization != NULL && \
+       !track_matrix_write(specialization, location, columns, rows, count, transpose, value)) return; \
+    es3_functions.glProgramUniformMatrix##name##fv(program, location, count, transpose, value); \
+}
+
+UNIFORM_MATRIX_FUNC(2, 2, 2)
+UNIFORM_MATRIX_FUNC(3, 3, 3)
+UNIFORM_MATRIX_FUNC(4, 4, 4)
+UNIFORM_MATRIX_FUNC(2x3, 2, 3)
+UNIFORM_MATRIX_FUNC(2x4, 2, 4)
+UNIFORM_MATRIX_FUNC(3x2, 3, 2)
+UNIFORM_MATRIX_FUNC(3x4, 3, 4)
+UNIFORM_MATRIX_FUNC(4x2, 4, 2)
+UNIFORM_MATRIX_FUNC(4x3, 4, 3)
+
+#undef UNIFORM_MATRIX_FUNC
+#undef UNPAREN
+
+GLint glGetUniformLocation(GLuint program, const GLchar* name) {
+    if(!current_context) return -1;
+    GLint location = es3_functions.glGetUniformLocation(program, name);
+    if(location != -1 || !enabled) return location;
+    // 特化版本中缺少的 uniform 在驱动看来不存在，返回通用版本中的位置
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info == NULL || program_info->specialization == NULL) return -1;
+    const program_specialization_t* specialization = program_info->specialization;
+    for(int i = 0; i < specialization->nuniforms; i++) {
+        const tracked_uniform_t* uniform = &specialization->uniforms[i];
+        if(uniform->absent && strcmp(uniform->name, name) == 0) return uniform->location;
+    }
+    return -1;
+}
+
+INTERNAL void program_specialization_dump_stats(void) {
+    if(!enabled) return;
+    LTW_ERROR_PRINTF("LTW: uniform specialization: %u programs tracked, %u variants linked, %u uniforms folded, %u fallbacks",
+                     atomic_load(&stat_programs), atomic_load(&stat_variants), atomic_load(&stat_folded),
+                     atomic_load(&stat_fallbacks));
+}
@@ -0,0 +1,68 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_PROGRAM_SPECIALIZATION_H
+#define POJAVLAUNCHER_PROGRAM_SPECIALIZATION_H
+
+#include <stdbool.h>
+#include <GLES3/gl3.h>
+#include "program_state.h"
+#include "egl.h"
+#include "glsl_optimizer/src/code/c_wrapper.h"
+
+// uniform 特化（LTW_SPECIALIZE_UNIFORMS=1）：记录每个程序通过 glUniform* 写入的值，
+// 很少改变的 uniform 在程序被连续使用一段时间后编译成常量，生成特化版本在 glUseProgram 时换入。
+// 被折叠的 uniform 之后写入相同的值会被忽略；写入不同的值时换回通用版本，该 uniform 不再参与特化。
+// 每个程序最多生成 LTW_SPECIALIZE_VARIANTS 个（默认 4）特化版本。
+// glProgramUniform* 写入的值按程序同样跟踪。
+typedef struct program_specialization program_specialization_t;
+
+bool program_specialization_enabled(void);
+
+// 通用版本的着色器和片段输出绑定，换回通用版本时用它们重新编译链接。
+// 应用通常链接后就删除着色器，所以不能依赖 shader_map
+typedef struct {
+    int nstages;
+    GLenum types[MAX_ATTACHED_SHADERS];
+    GLchar* sources[MAX_ATTACHED_SHADERS];      // 共享的翻译结果（持有引用）
+    GLchar* colorbindings[MAX_DRAWBUFFERS];     // 链接时的颜色绑定（复制）
+} program_generic_t;
+
+// 程序链接成功后调用，记录可以特化的 uniform（非数组的标量、向量和矩阵，不在 uniform 块中）及其当前值
+program_specialization_t* program_specialization_create(GLuint program);
+
+void program_specialization_free(program_specialization_t* specialization);
+
+// 通用版本的着色器，由 shader_wrapper.c 在创建后填写，随 specialization 一起释放
+program_generic_t* program_specialization_generic(program_specialization_t* specialization);
+
+// glUseProgram 时调用；返回 true 表示候选 uniform 已经稳定，应该开始生成特化版本
+bool program_specialization_note_use(program_specialization_t* specialization);
+
+// 取出当前的候选 uniform 和值（malloc 分配，名字指向 specialization 内部），返回个数
+int program_specialization_constants(program_specialization_t* specialization,
+                                     struct optimize_shader_constant** constants);
+
+// 后台翻译期间 constants 中的值是否都没有改变
+bool program_specialization_still_valid(const program_specialization_t* specialization,
+                                        const struct optimize_shader_constant* constants, int nconstants);
+
+// 特化版本已经链接到程序上：驱动中不再存在的 uniform 之后由包装层保存它们的值
+void program_specialization_activate(program_specialization_t* specialization);
+
+// 特化版本没有换入。retry 为 false 表示特化不会带来变化，之后不再尝试
+void program_specialization_abandon(program_specialization_t* specialization, bool retry);
+
+// 通用版本链接时的 uniform 位置，换回通用版本后用来检查位置没有改变
+const program_state_t* program_specialization_layout(const program_specialization_t* specialization);
+
+// 在 eglDestroyContext 时输出统计
+void program_specialization_dump_stats(void);
+
+// 用记录的通用版本着色器重新链接程序，并恢复 uniform 状态（在 shader_wrapper.c 中实现）
+bool program_relink_generic(GLuint program);
+
+#endif //POJAVLAUNCHER_PROGRAM_SPECIALIZATION_H
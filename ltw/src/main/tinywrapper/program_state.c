@@ -0,0 +1,294 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "program_state.h"
+#include "proc.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+typedef enum {
+    VALUE_FLOAT,
+    VALUE_INT,
+    VALUE_UINT
+} value_kind_t;
+
+typedef struct {
+    GLchar* name;       // 数组去掉 "[0]" 后缀
+    GLenum type;
+    GLint size;
+    GLint components;
+    GLint* locations;   // 每个数组元素的位置
+    GLuint* values;     // size * components 个 32 位值，只记录位置时为 NULL
+} uniform_record_t;
+
+typedef struct {
+    GLchar* name;
+    GLint value;        // 属性位置或 uniform 块绑定点
+} named_value_t;
+
+struct program_state {
+    uniform_record_t* uniforms;
+    GLint nuniforms;
+    named_value_t* attribs;
+    GLint nattribs;
+    named_value_t* blocks;
+    GLint nblocks;
+};
+
+static void type_layout(GLenum type, GLint* components, value_kind_t* kind) {
+    *kind = VALUE_FLOAT;
+    switch(type) {
+        case GL_FLOAT: *components = 1; return;
+        case GL_FLOAT_VEC2: *components = 2; return;
+        case GL_FLOAT_VEC3: *components = 3; return;
+        case GL_FLOAT_VEC4: *components = 4; return;
+        case GL_FLOAT_MAT2: *components = 4; return;
+        case GL_FLOAT_MAT3: *components = 9; return;
+        case GL_FLOAT_MAT4: *components = 16; return;
+        case GL_FLOAT_MAT2x3: *components = 6; return;
+        case GL_FLOAT_MAT2x4: *components = 8; return;
+        case GL_FLOAT_MAT3x2: *components = 6; return;
+        case GL_FLOAT_MAT3x4: *components = 12; return;
+        case GL_FLOAT_MAT4x2: *components = 8; return;
+        case GL_FLOAT_MAT4x3: *components = 12; return;
+        default: break;
+    }
+    *kind = VALUE_UINT;
+    switch(type) {
+        case GL_UNSIGNED_INT: *components = 1; return;
+        case GL_UNSIGNED_INT_VEC2: *components = 2; return;
+        case GL_UNSIGNED_INT_VEC3: *components = 3; return;
+        case GL_UNSIGNED_INT_VEC4: *components = 4; return;
+        default: break;
+    }
+    *kind = VALUE_INT;
+    switch(type) {
+        case GL_INT_VEC2: case GL_BOOL_VEC2: *components = 2; return;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: *components = 3; return;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: *components = 4; return;
+        // int、bool 以及所有采样器/图像类型
+        default: *components = 1; return;
+    }
+}
+
+static void set_uniform(GLenum type, GLint location, const GLuint* value) {
+    const GLfloat* f = (const GLfloat*)value;
+    const GLint* i = (const GLint*)value;
+    switch(type) {
+        case GL_FLOAT: es3_functions.glUniform1fv(location, 1, f); return;
+        case GL_FLOAT_VEC2: es3_functions.glUniform2fv(location, 1, f); return;
+        case GL_FLOAT_VEC3: es3_functions.glUniform3fv(location, 1, f); return;
+        case GL_FLOAT_VEC4: es3_functions.glUniform4fv(location, 1, f); return;
+        // glGetUniformfv 按列主序返回，原样写回
+        case GL_FLOAT_MAT2: es3_functions.glUniformMatrix2fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3: es3_functions.glUniformMatrix3fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT4: es3_functions.glUniformMatrix4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT2x3: es3_functions.glUniformMatrix2x3fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT2x4: es3_functions.glUniformMatrix2x4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3x2: es3_functions.glUniformMatrix3x2fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT3x4: es3_functions.glUniformMatrix3x4fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT4x2: es3_functions.glUniformMatrix4x2fv(location, 1, GL_FALSE, f); return;
+        case GL_FLOAT_MAT4x3: es3_functions.glUniformMatrix4x3fv(location, 1, GL_FALSE, f); return;
+        case GL_UNSIGNED_INT: es3_functions.glUniform1uiv(location, 1, value); return;
+        case GL_UNSIGNED_INT_VEC2: es3_functions.glUniform2uiv(location, 1, value); return;
+        case GL_UNSIGNED_INT_VEC3: es3_functions.glUniform3uiv(location, 1, value); return;
+        case GL_UNSIGNED_INT_VEC4: es3_functions.glUniform4uiv(location, 1, value); return;
+        case GL_INT_VEC2: case GL_BOOL_VEC2: es3_functions.glUniform2iv(location, 1, i); return;
+        case GL_INT_VEC3: case GL_BOOL_VEC3: es3_functions.glUniform3iv(location, 1, i); return;
+        case GL_INT_VEC4: case GL_BOOL_VEC4: es3_functions.glUniform4iv(location, 1, i); return;
+        default: es3_functions.glUniform1iv(location, 1, i); return;
+    }
+}
+
+static void get_uniform(GLuint program, GLint location, value_kind_t kind, GLuint* value) {
+    switch(kind) {
+        case VALUE_FLOAT: es3_functions.glGetUniformfv(program, location, (GLfloat*)value); return;
+        case VALUE_UINT: es3_functions.glGetUniformuiv(program, location, value); return;
+        case VALUE_INT: es3_functions.glGetUniformiv(program, location, (GLint*)value); return;
+    }
+}
+
+static bool capture_uniform(GLuint program, uniform_record_t* record, GLchar* name, GLint size, GLenum type, bool with_values) {
+    // 数组的活动名以 "[0]" 结尾，去掉后才能拼出各个元素的名字
+    size_t name_length = strlen(name);
+    if(name_length > 3 && strcmp(name + name_length - 3, "[0]") == 0) name[name_length - 3] = 0;
+    GLint location = es3_functions.glGetUniformLocation(program, name);
+    // uniform 块成员没有位置，由块绑定负责
+    if(location == -1) return false;
+
+    value_kind_t kind;
+    record->type = type;
+    record->size = size > 0 ? size : 1;
+    type_layout(type, &record->components, &kind);
+    record->name = strdup(name);
+    record->locations = malloc(record->size * sizeof(GLint));
+    if(with_values) record->values = calloc((size_t)record->size * record->components, sizeof(GLuint));
+    if(record->name == NULL || record->locations == NULL || (with_values && record->values == NULL)) return false;
+
+    size_t element_name_size = strlen(name) + 16;
+    char element_name[element_name_size];
+    for(GLint i = 0; i < record->size; i++) {
+        if(i == 0) {
+            record->locations[i] = location;
+        } else {
+            snprintf(element_name, element_name_size, "%s[%d]", name, i);
+            record->locations[i] = es3_functions.glGetUniformLocation(program, element_name);
+        }
+        if(with_values && record->locations[i] != -1) {
+            get_uniform(program, record->locations[i], kind, &record->values[i * record->components]);
+        }
+    }
+    return true;
+}
+
+static void free_uniform(uniform_record_t* record) {
+    free(record->name);
+    free(record->locations);
+    free(record->values);
+    memset(record, 0, sizeof(uniform_record_t));
+}
+
+INTERNAL program_state_t* program_state_capture(GLuint program, bool with_values) {
+    program_state_t* state = calloc(1, sizeof(program_state_t));
+    if(state == NULL) return NULL;
+
+    GLint count = 0, max_length = 0;
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    if(count > 0) {
+        state->uniforms = calloc(count, sizeof(uniform_record_t));
+        if(state->uniforms == NULL) goto fail;
+        GLchar name[max_length + 1];
+        for(GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            name[0] = 0;
+            es3_functions.glGetActiveUniform(program, i, max_length + 1, NULL, &size, &type, name);
+            uniform_record_t* record = &state->uniforms[state->nuniforms];
+            if(capture_uniform(program, record, name, size, type, with_values)) state->nuniforms++;
+            else free_uniform(record);
+        }
+    }
+
+    count = 0; max_length = 0;
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+    if(count > 0) {
+        state->attribs = calloc(count, sizeof(named_value_t));
+        if(state->attribs == NULL) goto fail;
+        GLchar name[max_length + 1];
+        for(GLint i = 0; i < count; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            name[0] = 0;
+            es3_functions.glGetActiveAttrib(program, i, max_length + 1, NULL, &size, &type, name);
+            GLint location = es3_functions.glGetAttribLocation(program, name);
+            // 内建属性（gl_VertexID 等）没有位置
+            if(location == -1) continue;
+            named_value_t* attrib = &state->attribs[state->nattribs];
+            attrib->name = strdup(name);
+            attrib->value = location;
+            if(attrib->name != NULL) state->nattribs++;
+        }
+    }
+
+    count = 0; max_length = 0;
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    es3_functions.glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+    if(count > 0) {
+        state->blocks = calloc(count, sizeof(named_value_t));
+        if(state->blocks == NULL) goto fail;
+        GLchar name[max_length + 1];
+        for(GLint i = 0; i < count; i++) {
+            GLint binding = 0;
+            name[0] = 0;
+            es3_functions.glGetActiveUniformBlockName(program, i, max_length + 1, NULL, name);
+            es3_functions.glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+            named_value_t* block = &state->blocks[state->nblocks];
+            block->name = strdup(name);
+            block->value = binding;
+            if(block->name != NULL) state->nblocks++;
+        }
+    }
+    return state;
+
+    fail:
+    LTW_ERROR_PRINTF("LTW: failed to allocate state snapshot for program %u", program);
+    program_state_free(state);
+    return NULL;
+}
+
+INTERNAL void program_state_bind_attribs(const program_state_t* state, GLuint program) {
+    for(GLint i = 0; i < state->nattribs; i++) {
+        es3_functions.glBindAttribLocation(program, state->attribs[i].value, state->attribs[i].name);
+    }
+}
+
+static const uniform_record_t* find_uniform(const program_state_t* state, const char* name) {
+    for(GLint i = 0; i < state->nuniforms; i++) {
+        if(strcmp(state->uniforms[i].name, name) == 0) return &state->uniforms[i];
+    }
+    return NULL;
+}
+
+static const named_value_t* find_named(const named_value_t* values, GLint count, const char* name) {
+    for(GLint i = 0; i < count; i++) {
+        if(strcmp(values[i].name, name) == 0) return &values[i];
+    }
+    return NULL;
+}
+
+INTERNAL bool program_state_compatible(const program_state_t* original, const program_state_t* relinked) {
+    // 优化后可能少了未使用的 uniform 或缩短了数组，但应用已经拿到的位置必须仍然指向同一个变量
+    for(GLint i = 0; i < relinked->nuniforms; i++) {
+        const uniform_record_t* uniform = &relinked->uniforms[i];
+        const uniform_record_t* old_uniform = find_uniform(original, uniform->name);
+        if(old_uniform == NULL || old_uniform->type != uniform->type || uniform->size > old_uniform->size) return false;
+        for(GLint j = 0; j < uniform->size; j++) {
+            if(uniform->locations[j] != old_uniform->locations[j]) return false;
+        }
+    }
+    for(GLint i = 0; i < relinked->nattribs; i++) {
+        const named_value_t* old_attrib = find_named(original->attribs, original->nattribs, relinked->attribs[i].name);
+        if(old_attrib == NULL || old_attrib->value != relinked->attribs[i].value) return false;
+    }
+    for(GLint i = 0; i < relinked->nblocks; i++) {
+        if(find_named(original->blocks, original->nblocks, relinked->blocks[i].name) == NULL) return false;
+    }
+    return true;
+}
+
+INTERNAL void program_state_restore(const program_state_t* original, const program_state_t* relinked, GLuint program) {
+    for(GLint i = 0; i < relinked->nuniforms; i++) {
+        const uniform_record_t* uniform = &relinked->uniforms[i];
+        const uniform_record_t* old_uniform = find_uniform(original, uniform->name);
+        if(old_uniform == NULL || old_uniform->values == NULL) continue;
+        for(GLint j = 0; j < uniform->size; j++) {
+            if(uniform->locations[j] == -1) continue;
+            set_uniform(uniform->type, uniform->locations[j], &old_uniform->values[j * old_uniform->components]);
+        }
+    }
+    for(GLint i = 0; i < relinked->nblocks; i++) {
+        const named_value_t* old_block = find_named(original->blocks, original->nblocks, relinked->blocks[i].name);
+        if(old_block == NULL) continue;
+        GLuint index = es3_functions.glGetUniformBlockIndex(program, relinked->blocks[i].name);
+        if(index != GL_INVALID_INDEX) es3_functions.glUniformBlockBinding(program, index, old_block->value);
+    }
+}
+
+INTERNAL void program_state_free(program_state_t* state) {
+    if(state == NULL) return;
+    for(GLint i = 0; i < state->nuniforms; i++) free_uniform(&state->uniforms[i]);
+    for(GLint i = 0; i < state->nattribs; i++) free(state->attribs[i].name);
+    for(GLint i = 0; i < state->nblocks; i++) free(state->blocks[i].name);
+    free(state->uniforms);
+    free(state->attribs);
+    free(state->blocks);
+    free(state);
+}
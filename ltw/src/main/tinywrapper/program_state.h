@@ -0,0 +1,32 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_PROGRAM_STATE_H
+#define POJAVLAUNCHER_PROGRAM_STATE_H
+
+#include <stdbool.h>
+#include <GLES3/gl3.h>
+
+// 已链接程序中应用可见的状态：默认 uniform 块的位置和值、uniform 块绑定、顶点属性位置。
+// 重新链接同一个程序对象（分级编译换入优化版本）前后用它保证应用看到的状态不变。
+typedef struct program_state program_state_t;
+
+// with_values 为 false 时只记录位置，用于和重新链接后的程序比较
+program_state_t* program_state_capture(GLuint program, bool with_values);
+
+// 在链接前把属性绑定到记录的位置
+void program_state_bind_attribs(const program_state_t* state, GLuint program);
+
+// 重新链接后的状态与原状态兼容：没有新增的 uniform 或属性，保留下来的位置全部不变
+bool program_state_compatible(const program_state_t* original, const program_state_t* relinked);
+
+// 把 original 中记录的 uniform 值和 uniform 块绑定写回重新链接后的程序（其状态为 relinked），
+// program 必须是当前程序
+void program_state_restore(const program_state_t* original, const program_state_t* relinked, GLuint program);
+
+void program_state_free(program_state_t* state);
+
+#endif //POJAVLAUNCHER_PROGRAM_STATE_H
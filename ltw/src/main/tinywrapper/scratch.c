@@ -0,0 +1,103 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scratch.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+struct scratch_overflow {
+    struct scratch_overflow* next;
+    size_t size;
+    uint8_t data[];     // 头部两个字长，data 与 malloc 的结果同样对齐
+};
+
+static inline size_t align_size(size_t size) {
+    return (size + SCRATCH_ALIGNMENT - 1) & ~(size_t)(SCRATCH_ALIGNMENT - 1);
+}
+
+static void set_capacity(scratch_arena_t* arena, size_t capacity) {
+    free(arena->base);
+    arena->base = malloc(capacity);
+    arena->capacity = arena->base != NULL ? capacity : 0;
+}
+
+INTERNAL void scratch_init(scratch_arena_t* arena, size_t capacity) {
+    memset(arena, 0, sizeof(scratch_arena_t));
+    set_capacity(arena, align_size(capacity));
+}
+
+static void note_usage(scratch_arena_t* arena) {
+    size_t in_use = arena->used + arena->overflow_bytes;
+    if(in_use > arena->frame_peak) arena->frame_peak = in_use;
+}
+
+INTERNAL void* scratch_alloc(scratch_arena_t* arena, size_t size) {
+    if(size > SIZE_MAX - SCRATCH_ALIGNMENT - sizeof(scratch_overflow_t)) return NULL;
+    size = align_size(size);
+    if(size <= arena->capacity - arena->used) {
+        void* ptr = arena->base + arena->used;
+        arena->used += size;
+        note_usage(arena);
+        return ptr;
+    }
+    scratch_overflow_t* block = malloc(sizeof(scratch_overflow_t) + size);
+    if(block == NULL) return NULL;
+    block->size = size;
+    block->next = arena->overflow;
+    arena->overflow = block;
+    arena->overflow_bytes += size;
+    arena->frame_overflowed = true;
+    note_usage(arena);
+    return block->data;
+}
+
+INTERNAL scratch_mark_t scratch_mark(const scratch_arena_t* arena) {
+    return (scratch_mark_t){ arena->used, arena->overflow };
+}
+
+INTERNAL void scratch_release(scratch_arena_t* arena, scratch_mark_t mark) {
+    while(arena->overflow != mark.overflow && arena->overflow != NULL) {
+        scratch_overflow_t* next = arena->overflow->next;
+        arena->overflow_bytes -= arena->overflow->size;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+    arena->used = mark.used;
+}
+
+INTERNAL void scratch_reset(scratch_arena_t* arena) {
+    scratch_release(arena, (scratch_mark_t){ 0, NULL });
+    arena->frames++;
+    if(arena->frame_peak > arena->peak) {
+        arena->peak = arena->frame_peak;
+        LTW_DEBUG_PRINTF("LTW: new per-frame scratch peak: %zu bytes", arena->peak);
+    }
+    // 本帧溢出到了堆上：扩大到本帧峰值，下一帧同样的负载不再 malloc
+    if(arena->frame_overflowed) {
+        arena->overflow_frames++;
+        size_t capacity = align_size(arena->frame_peak + arena->frame_peak / 4);
+        if(capacity > SCRATCH_MAX_CAPACITY) capacity = SCRATCH_MAX_CAPACITY;
+        if(capacity > arena->capacity) set_capacity(arena, capacity);
+    }
+    arena->frame_peak = 0;
+    arena->frame_overflowed = false;
+}
+
+INTERNAL void scratch_report(const scratch_arena_t* arena) {
+    LTW_DEBUG_PRINTF("LTW: frame scratch: peak %zu bytes per frame, %zu bytes reserved, %u of %u frames overflowed to the heap",
+                     arena->frame_peak > arena->peak ? arena->frame_peak : arena->peak,
+                     arena->capacity, arena->overflow_frames, arena->frames);
+}
+
+INTERNAL void scratch_destroy(scratch_arena_t* arena) {
+    scratch_release(arena, (scratch_mark_t){ 0, NULL });
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SCRATCH_H
+#define POJAVLAUNCHER_SCRATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCRATCH_ALIGNMENT 8
+#define SCRATCH_INITIAL_CAPACITY (64 * 1024)
+#define SCRATCH_MAX_CAPACITY (4 * 1024 * 1024)
+
+typedef struct scratch_overflow scratch_overflow_t;
+
+// 每个上下文一个的线性（bump）分配器，给只在一次 GL 调用内使用的临时数据用。
+// 调用开始时 scratch_mark，结束时 scratch_release 归还；放不下的分配落到堆上，同样在 release 时释放。
+// eglSwapBuffers 时 scratch_reset：记录本帧峰值，有溢出时把缓冲区扩大到峰值（不超过 SCRATCH_MAX_CAPACITY）。
+// 宿主不经过包装器调用 eglSwapBuffers 时只是不扩容，mark/release 保证不会越用越多
+typedef struct {
+    uint8_t* base;
+    size_t capacity;
+    size_t used;                    // base 中已分配的字节数
+    size_t overflow_bytes;          // 当前在堆上的溢出字节数
+    scratch_overflow_t* overflow;   // 溢出块，后分配的在前
+    size_t frame_peak;              // 本帧同时使用的最大字节数（含溢出）
+    size_t peak;                    // 所有帧中 frame_peak 的最大值
+    unsigned frames, overflow_frames;
+    bool frame_overflowed;
+} scratch_arena_t;
+
+typedef struct {
+    size_t used;
+    scratch_overflow_t* overflow;
+} scratch_mark_t;
+
+void scratch_init(scratch_arena_t* arena, size_t capacity);
+// 返回按 SCRATCH_ALIGNMENT 对齐的内存，有效期到对应的 scratch_release（或 scratch_reset）；内存不足时返回 NULL
+void* scratch_alloc(scratch_arena_t* arena, size_t size);
+scratch_mark_t scratch_mark(const scratch_arena_t* arena);
+// 归还 mark 之后的所有分配，必须按后进先出的顺序
+void scratch_release(scratch_arena_t* arena, scratch_mark_t mark);
+// 帧边界：归还全部分配并统计
+void scratch_reset(scratch_arena_t* arena);
+// 调试版本输出每帧峰值（在 eglDestroyContext 时调用）
+void scratch_report(const scratch_arena_t* arena);
+void scratch_destroy(scratch_arena_t* arena);
+
+#endif //POJAVLAUNCHER_SCRATCH_H
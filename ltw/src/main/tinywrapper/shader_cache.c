@@ -0,0 +1,427 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shader_cache.h"
+#include "libraryinternal.h"
+#include "debug.h"
+#include "env.h"
+
+#define XXH_INLINE_ALL
+#include "glsl_optimizer/src/util/xxhash.h"
+#ifdef HAVE_COMPRESSION
+#include "glsl_optimizer/src/util/compress.h"
+#endif
+
+#define SHADER_CACHE_BUCKETS 512 // 2 的幂，约为条目上限的两倍
+#define SHADER_CACHE_STATS_INTERVAL 100
+#define SHADER_CACHE_HOT_ENTRIES 32      // 最近使用的条目始终保持解压
+#define SHADER_CACHE_COMPRESS_MIN 4096   // 更小的条目压缩不划算
+#define SHADER_CACHE_COMPRESS_PER_PUT 2  // 每次放入后最多在锁外压缩的冷条目数
+
+typedef struct {
+    atomic_uint refcount;
+    size_t length;
+    uint64_t hash;
+    char data[];
+} shared_source_t;
+
+typedef struct shader_cache_entry {
+    struct shader_cache_entry* hash_next;
+    struct shader_cache_entry* lru_prev;
+    struct shader_cache_entry* lru_next;
+    uint64_t hash;
+    uint32_t shader_type;
+    int source_version;
+    int target_version;
+    size_t source_length;
+    size_t translated_length;
+    char* source;       // 原始源码（共享字符串），用于命中时的完整比对，压缩后为 NULL
+    char* translated;   // 共享的翻译结果，压缩后为 NULL
+    // 冷条目：没有着色器再引用翻译结果时，原始源码和翻译结果各压成一段，依次存放
+    uint8_t* compressed;
+    size_t compressed_source_length;
+    size_t compressed_length;
+    bool compressing;   // 正在锁外压缩，此时被淘汰的条目由压缩线程释放
+    bool evicted;
+    bool incompressible;
+    size_t memory;
+} shader_cache_entry_t;
+
+typedef struct {
+    uint32_t shader_type;
+    int source_version;
+    int target_version;
+} shader_cache_key_header_t;
+
+static shader_cache_entry_t* buckets[SHADER_CACHE_BUCKETS];
+static shader_cache_entry_t* lru_head = NULL; // 最近使用
+static shader_cache_entry_t* lru_tail = NULL; // 最久未使用
+static shader_cache_stats_t stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+static bool print_stats = false;
+static bool compress_cold = false;
+
+static void config_init(void) {
+    print_stats = env_istrue("LTW_SHADER_CACHE_STATS");
+#ifdef HAVE_COMPRESSION
+    compress_cold = env_istrue_d("LTW_SHADER_CACHE_COMPRESS", true);
+#endif
+}
+
+static inline shared_source_t* shared_source_header(const char* source) {
+    return (shared_source_t*)(source - offsetof(shared_source_t, data));
+}
+
+INTERNAL char* shader_source_new(const char* data, size_t length) {
+    shared_source_t* shared = malloc(sizeof(shared_source_t) + length + 1);
+    if(shared == NULL) return NULL;
+    atomic_init(&shared->refcount, 1);
+    shared->length = length;
+    shared->hash = XXH64(data, length, 0);
+    memcpy(shared->data, data, length);
+    shared->data[length] = 0;
+    return shared->data;
+}
+
+INTERNAL size_t shader_source_header_size(void) {
+    return offsetof(shared_source_t, data);
+}
+
+INTERNAL char* shader_source_adopt(char* block, size_t length) {
+    if(block == NULL) return NULL;
+    shared_source_t* shared = (shared_source_t*)block;
+    atomic_init(&shared->refcount, 1);
+    shared->length = length;
+    shared->hash = XXH64(shared->data, length, 0);
+    return shared->data;
+}
+
+INTERNAL char* shader_source_acquire(char* source) {
+    if(source == NULL) return NULL;
+    atomic_fetch_add_explicit(&shared_source_header(source)->refcount, 1, memory_order_relaxed);
+    return source;
+}
+
+INTERNAL void shader_source_release(char* source) {
+    if(source == NULL) return;
+    shared_source_t* shared = shared_source_header(source);
+    if(atomic_fetch_sub_explicit(&shared->refcount, 1, memory_order_acq_rel) == 1) free(shared);
+}
+
+INTERNAL uint64_t shader_source_hash(const char* source) {
+    return shared_source_header(source)->hash;
+}
+
+// 哈希与片段的切分方式无关：拼接后的源码和原始片段得到相同的结果
+static uint64_t compute_hash(size_t count, const char* const* strings, const size_t* lengths,
+                             uint32_t shader_type, int source_version, int target_version) {
+    shader_cache_key_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.shader_type = shader_type;
+    header.source_version = source_version;
+    header.target_version = target_version;
+    XXH64_state_t state;
+    XXH64_reset(&state, 0);
+    XXH64_update(&state, &header, sizeof(header));
+    for(size_t i = 0; i < count; i++) XXH64_update(&state, strings[i], lengths[i]);
+    return XXH64_digest(&state);
+}
+
+static inline size_t entry_plain_memory(const shader_cache_entry_t* entry) {
+    return entry->source_length + 1 + entry->translated_length + 1;
+}
+
+static void entry_set_memory(shader_cache_entry_t* entry, size_t memory) {
+    stats.memory = stats.memory - entry->memory + memory;
+    entry->memory = memory;
+}
+
+#ifdef HAVE_COMPRESSION
+// 解压一段到新的共享字符串，失败时返回 NULL
+static char* inflate_source(const uint8_t* data, size_t data_length, size_t length) {
+    char* block = malloc(shader_source_header_size() + length + 1);
+    if(block == NULL) return NULL;
+    char* text = block + shader_source_header_size();
+    if(!util_compress_inflate(data, data_length, (uint8_t*)text, length)) {
+        free(block);
+        return NULL;
+    }
+    text[length] = 0;
+    return shader_source_adopt(block, length);
+}
+
+// 命中冷条目时在锁内解压回来，之后按热条目处理
+static bool entry_restore(shader_cache_entry_t* entry) {
+    char* source = inflate_source(entry->compressed, entry->compressed_source_length, entry->source_length);
+    char* translated = inflate_source(entry->compressed + entry->compressed_source_length,
+                                      entry->compressed_length - entry->compressed_source_length,
+                                      entry->translated_length);
+    if(source == NULL || translated == NULL) {
+        LTW_ERROR_PRINTF("LTW: failed to decompress a shader cache entry");
+        shader_source_release(source);
+        shader_source_release(translated);
+        return false;
+    }
+    free(entry->compressed);
+    entry->compressed = NULL;
+    entry->source = source;
+    entry->translated = translated;
+    stats.compressed_entries--;
+    entry_set_memory(entry, entry_plain_memory(entry));
+    return true;
+}
+#endif
+
+static inline bool entry_matches(shader_cache_entry_t* entry, uint64_t hash,
+                                 size_t count, const char* const* strings, const size_t* lengths, size_t total_length,
+                                 uint32_t shader_type, int source_version, int target_version) {
+    if(entry->hash != hash || entry->shader_type != shader_type ||
+       entry->source_version != source_version || entry->target_version != target_version ||
+       entry->source_length != total_length) return false;
+#ifdef HAVE_COMPRESSION
+    if(entry->compressed != NULL && !entry_restore(entry)) return false;
+#endif
+    size_t offset = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(memcmp(entry->source + offset, strings[i], lengths[i]) != 0) return false;
+        offset += lengths[i];
+    }
+    return true;
+}
+
+static void lru_unlink(shader_cache_entry_t* entry) {
+    if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else lru_head = entry->lru_next;
+    if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(shader_cache_entry_t* entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = lru_head;
+    if(lru_head) lru_head->lru_prev = entry;
+    lru_head = entry;
+    if(!lru_tail) lru_tail = entry;
+}
+
+static shader_cache_entry_t* find_entry(uint64_t hash, size_t count, const char* const* strings, const size_t* lengths,
+                                        size_t total_length, uint32_t shader_type, int source_version, int target_version) {
+    shader_cache_entry_t* entry = buckets[hash & (SHADER_CACHE_BUCKETS - 1)];
+    while(entry != NULL) {
+        if(entry_matches(entry, hash, count, strings, lengths, total_length,
+                         shader_type, source_version, target_version)) return entry;
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+static void evict_entry(shader_cache_entry_t* entry) {
+    shader_cache_entry_t** link = &buckets[entry->hash & (SHADER_CACHE_BUCKETS - 1)];
+    while(*link != entry) link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    lru_unlink(entry);
+    stats.entries--;
+    stats.memory -= entry->memory;
+    stats.evictions++;
+    if(entry->compressed != NULL) stats.compressed_entries--;
+    shader_source_release(entry->source);
+    shader_source_release(entry->translated);
+    free(entry->compressed);
+    entry->source = entry->translated = NULL;
+    entry->compressed = NULL;
+    if(entry->compressing) entry->evicted = true;
+    else free(entry);
+}
+
+static void maybe_print_stats(void) {
+    uint64_t lookups = stats.hits + stats.misses;
+    if(!print_stats || lookups % SHADER_CACHE_STATS_INTERVAL != 0) return;
+    LTW_ERROR_PRINTF("LTW: shader cache stats: hits=%llu, misses=%llu, hit_rate=%.2f%%, evictions=%llu, size=%zu/%d, compressed=%zu, memory=%.2fMB/%.2fMB",
+                     (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                     (double)stats.hits / (double)lookups * 100.0, (unsigned long long)stats.evictions,
+                     stats.entries, SHADER_CACHE_SIZE, stats.compressed_entries,
+                     stats.memory / (1024.0 * 1024.0), SHADER_CACHE_MAX_MEMORY / (1024.0 * 1024.0));
+}
+
+#ifdef HAVE_COMPRESSION
+static bool entry_is_hot(const shader_cache_entry_t* entry) {
+    const shader_cache_entry_t* hot = lru_head;
+    for(int i = 0; hot != NULL && i < SHADER_CACHE_HOT_ENTRIES; i++, hot = hot->lru_next) {
+        if(hot == entry) return true;
+    }
+    return false;
+}
+
+// 从最久未使用的一端找一个值得压缩的冷条目：翻译结果只剩缓存自己的引用，
+// 也就是没有着色器对象还在使用它，压缩后不会多出一份解压的副本
+static shader_cache_entry_t* find_cold_entry(void) {
+    if(stats.entries <= SHADER_CACHE_HOT_ENTRIES) return NULL;
+    size_t cold = stats.entries - SHADER_CACHE_HOT_ENTRIES;
+    for(shader_cache_entry_t* entry = lru_tail; entry != NULL && cold > 0; entry = entry->lru_prev, cold--) {
+        if(entry->compressed != NULL || entry->compressing || entry->incompressible) continue;
+        if(entry_plain_memory(entry) < SHADER_CACHE_COMPRESS_MIN) continue;
+        if(atomic_load_explicit(&shared_source_header(entry->translated)->refcount, memory_order_relaxed) != 1) continue;
+        return entry;
+    }
+    return NULL;
+}
+
+static uint8_t* compress_sources(const char* source, size_t source_length,
+                                 const char* translated, size_t translated_length,
+                                 size_t* out_source_length, size_t* out_length) {
+    size_t capacity = util_compress_max_compressed_len(source_length) +
+                      util_compress_max_compressed_len(translated_length);
+    uint8_t* data = malloc(capacity);
+    if(data == NULL) return NULL;
+    size_t first = util_compress_deflate((const uint8_t*)source, source_length, data, capacity);
+    size_t second = first == 0 ? 0 : util_compress_deflate((const uint8_t*)translated, translated_length,
+                                                           data + first, capacity - first);
+    if(second == 0 || first + second >= source_length + translated_length) {
+        free(data);
+        return NULL;
+    }
+    uint8_t* shrunk = realloc(data, first + second);
+    *out_source_length = first;
+    *out_length = first + second;
+    return shrunk != NULL ? shrunk : data;
+}
+
+// 调用时持有 cache_lock。压缩本身在锁外进行，返回时重新持有锁
+static void compress_cold_entries(void) {
+    for(int i = 0; i < SHADER_CACHE_COMPRESS_PER_PUT; i++) {
+        shader_cache_entry_t* entry = find_cold_entry();
+        if(entry == NULL) return;
+        entry->compressing = true;
+        char* source = shader_source_acquire(entry->source);
+        char* translated = shader_source_acquire(entry->translated);
+        size_t source_length = entry->source_length;
+        size_t translated_length = entry->translated_length;
+        pthread_mutex_unlock(&cache_lock);
+
+        size_t compressed_source_length = 0, compressed_length = 0;
+        uint8_t* compressed = compress_sources(source, source_length, translated, translated_length,
+                                               &compressed_source_length, &compressed_length);
+
+        pthread_mutex_lock(&cache_lock);
+        entry->compressing = false;
+        if(entry->evicted) {
+            free(compressed);
+            free(entry);
+        } else if(compressed != NULL && !entry_is_hot(entry) &&
+                  atomic_load_explicit(&shared_source_header(translated)->refcount, memory_order_relaxed) == 2) {
+            // 压缩期间条目没有被命中，可以换成压缩数据
+            shader_source_release(entry->source);
+            shader_source_release(entry->translated);
+            entry->source = entry->translated = NULL;
+            entry->compressed = compressed;
+            entry->compressed_source_length = compressed_source_length;
+            entry->compressed_length = compressed_length;
+            entry_set_memory(entry, compressed_length);
+            stats.compressed_entries++;
+        } else if(compressed != NULL) {
+            free(compressed);
+        } else {
+            entry->incompressible = true;
+        }
+        shader_source_release(source);
+        shader_source_release(translated);
+    }
+}
+#endif
+
+INTERNAL char* shader_cache_get(size_t count, const char* const* strings, const size_t* lengths,
+                                uint32_t shader_type, int source_version, int target_version) {
+    pthread_once(&config_once, config_init);
+    size_t total_length = 0;
+    for(size_t i = 0; i < count; i++) total_length += lengths[i];
+    uint64_t hash = compute_hash(count, strings, lengths, shader_type, source_version, target_version);
+    char* result = NULL;
+    pthread_mutex_lock(&cache_lock);
+    shader_cache_entry_t* entry = find_entry(hash, count, strings, lengths, total_length,
+                                             shader_type, source_version, target_version);
+    if(entry != NULL) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+        result = shader_source_acquire(entry->translated);
+        stats.hits++;
+    } else {
+        stats.misses++;
+    }
+    maybe_print_stats();
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+INTERNAL void shader_cache_put(const char* source, size_t length, uint32_t shader_type,
+                               int source_version, int target_version, char* translated) {
+    if(translated == NULL) return;
+    pthread_once(&config_once, config_init);
+    size_t translated_length = shared_source_header(translated)->length;
+    size_t memory = length + 1 + translated_length + 1;
+
+    // 检查单个着色器是否过大
+    if(memory > SHADER_CACHE_MAX_MEMORY / 2) {
+        LTW_DEBUG_PRINTF("LTW: shader source too large for cache: %zu bytes", memory);
+        return;
+    }
+
+    uint64_t hash = compute_hash(1, &source, &length, shader_type, source_version, target_version);
+    shader_cache_entry_t* entry = calloc(1, sizeof(shader_cache_entry_t));
+    if(entry == NULL) return;
+    entry->source = shader_source_new(source, length);
+    if(entry->source == NULL) {
+        free(entry);
+        return;
+    }
+    entry->hash = hash;
+    entry->shader_type = shader_type;
+    entry->source_version = source_version;
+    entry->target_version = target_version;
+    entry->source_length = length;
+    entry->translated_length = translated_length;
+    entry->memory = memory;
+
+    pthread_mutex_lock(&cache_lock);
+    shader_cache_entry_t* existing = find_entry(hash, 1, &source, &length, length,
+                                                shader_type, source_version, target_version);
+    if(existing != NULL) {
+        // 另一个线程已经放入了同一个着色器
+        pthread_mutex_unlock(&cache_lock);
+        shader_source_release(entry->source);
+        free(entry);
+        return;
+    }
+    entry->translated = shader_source_acquire(translated);
+    while(lru_tail != NULL && (stats.entries >= SHADER_CACHE_SIZE || stats.memory + memory > SHADER_CACHE_MAX_MEMORY)) {
+        evict_entry(lru_tail);
+    }
+    shader_cache_entry_t** bucket = &buckets[hash & (SHADER_CACHE_BUCKETS - 1)];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    lru_push_front(entry);
+    stats.entries++;
+    stats.memory += memory;
+    stats.insertions++;
+#ifdef HAVE_COMPRESSION
+    if(compress_cold) compress_cold_entries();
+#endif
+    pthread_mutex_unlock(&cache_lock);
+}
+
+INTERNAL void shader_cache_get_stats(shader_cache_stats_t* out_stats) {
+    pthread_mutex_lock(&cache_lock);
+    *out_stats = stats;
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,50 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SHADER_CACHE_H
+#define POJAVLAUNCHER_SHADER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 翻译结果的内存缓存：按 xxHash64 索引，命中时比对完整键（源码、类型、版本），O(1) LRU 淘汰。
+// 启用 HAVE_COMPRESSION 时，不再被着色器对象引用的冷条目会在放入新条目后压缩（LTW_SHADER_CACHE_COMPRESS=0 关闭），
+// 命中时再解压
+#define SHADER_CACHE_SIZE 256
+#define SHADER_CACHE_MAX_MEMORY (32 * 1024 * 1024) // 32MB 最大内存限制
+
+// 引用计数的翻译结果。缓存条目与所有使用它的着色器对象共享同一份内存，
+// 指针本身就是以 0 结尾的字符串，可以直接传给驱动
+char* shader_source_new(const char* data, size_t length);
+// 翻译器在 malloc 块的前 shader_source_header_size() 字节之后直接写出文本（见 optimize_shader_output），
+// adopt 就地写入头部，整块内存变成共享字符串而不再复制。block 为 NULL 时返回 NULL
+size_t shader_source_header_size(void);
+char* shader_source_adopt(char* block, size_t length);
+char* shader_source_acquire(char* source);
+void shader_source_release(char* source);
+// 创建时计算好的 XXH64，用于快速比较两份翻译结果
+uint64_t shader_source_hash(const char* source);
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    size_t entries;
+    size_t compressed_entries;
+    size_t memory;
+} shader_cache_stats_t;
+
+// 直接对各个片段做流式哈希和比对，不需要先拼接。glShaderSource 传入的是规范化后的源码（见 shader_normalize.h）。
+// 返回共享的翻译结果（调用者持有一个引用），未命中时返回 NULL
+char* shader_cache_get(size_t count, const char* const* strings, const size_t* lengths,
+                       uint32_t shader_type, int source_version, int target_version);
+// source 必须与查找时使用同样的规范化。translated 必须来自 shader_source_new，缓存会持有自己的引用
+void shader_cache_put(const char* source, size_t length, uint32_t shader_type,
+                      int source_version, int target_version, char* translated);
+void shader_cache_get_stats(shader_cache_stats_t* stats);
+
+#endif //POJAVLAUNCHER_SHADER_CACHE_H
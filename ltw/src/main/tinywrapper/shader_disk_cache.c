@@ -0,0 +1,215 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "shader_disk_cache.h"
+#include "shader_translation.h"
+#include "glsl_optimizer/src/util/mesa_cache_db.h"
+#include "glsl_optimizer/src/util/mesa-sha1.h"
+#include "glsl_optimizer/src/util/build_id.h"
+#include "libraryinternal.h"
+#include "debug.h"
+#include "env.h"
+
+#define SHADER_DISK_CACHE_DEFAULT_SIZE_MB 64
+
+struct shader_disk_cache {
+    struct mesa_cache_db db;
+    pthread_mutex_t lock;
+    char* path;
+};
+
+static pthread_once_t source_cache_once = PTHREAD_ONCE_INIT;
+static shader_disk_cache_t* source_cache = NULL;
+static uint8_t source_cache_base_key[SHADER_DISK_CACHE_KEY_SIZE];
+
+static bool mkdir_p(char* path) {
+    for(char* p = path + 1; *p; p++) {
+        if(*p != '/') continue;
+        *p = 0;
+        int result = mkdir(path, 0700);
+        *p = '/';
+        if(result != 0 && errno != EEXIST) return false;
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+// 缓存根目录：优先 LTW_SHADER_CACHE_DIR，否则 $HOME/.cache/ltw_turbo
+static char* get_cache_root(void) {
+    const char* dir = getenv("LTW_SHADER_CACHE_DIR");
+    if(dir != NULL && *dir != 0) return strdup(dir);
+    const char* home = getenv("HOME");
+    if(home == NULL || *home == 0) return NULL;
+    char* path = NULL;
+    if(asprintf(&path, "%s/.cache/ltw_turbo", home) == -1) return NULL;
+    return path;
+}
+
+static uint64_t get_cache_size_limit(void) {
+    const char* size_env = getenv("LTW_SHADER_CACHE_SIZE");
+    long size_mb = SHADER_DISK_CACHE_DEFAULT_SIZE_MB;
+    if(size_env != NULL) {
+        char* end = NULL;
+        long parsed = strtol(size_env, &end, 10);
+        if(end != size_env && parsed > 0) size_mb = parsed;
+    }
+    return (uint64_t)size_mb * 1024 * 1024;
+}
+
+// 对比目录下记录的版本键，不一致（或不存在）时清空缓存并写入新的版本键
+static void check_cache_version(const char* path, const uint8_t version[SHADER_DISK_CACHE_KEY_SIZE]) {
+    char version_hex[SHADER_DISK_CACHE_KEY_SIZE * 2 + 1];
+    char stored_hex[SHADER_DISK_CACHE_KEY_SIZE * 2 + 1] = {0};
+    _mesa_sha1_format(version_hex, version);
+
+    char* version_path = NULL;
+    if(asprintf(&version_path, "%s/version", path) == -1) return;
+
+    FILE* version_file = fopen(version_path, "r");
+    if(version_file != NULL) {
+        size_t read = fread(stored_hex, 1, sizeof(stored_hex) - 1, version_file);
+        stored_hex[read] = 0;
+        fclose(version_file);
+        if(strcmp(stored_hex, version_hex) == 0) {
+            free(version_path);
+            return;
+        }
+    }
+
+    LTW_DEBUG_PRINTF("LTW: shader disk cache at %s is stale, wiping", path);
+    mesa_db_wipe_path(path);
+    version_file = fopen(version_path, "w");
+    if(version_file != NULL) {
+        fputs(version_hex, version_file);
+        fclose(version_file);
+    }
+    free(version_path);
+}
+
+INTERNAL shader_disk_cache_t* shader_disk_cache_open(const char* name, const void* version_key, size_t version_key_size) {
+    if(!env_istrue_d("LTW_SHADER_DISK_CACHE", true)) return NULL;
+
+    char* root = get_cache_root();
+    if(root == NULL) {
+        LTW_DEBUG_PRINTF("LTW: no shader cache directory available, disk cache disabled");
+        return NULL;
+    }
+    char* path = NULL;
+    int result = asprintf(&path, "%s/%s", root, name);
+    free(root);
+    if(result == -1) return NULL;
+    if(!mkdir_p(path)) {
+        LTW_ERROR_PRINTF("LTW: failed to create shader cache directory %s: %s", path, strerror(errno));
+        free(path);
+        return NULL;
+    }
+
+    // 版本键包含本库的 build-id，重新编译 LTW 后旧缓存自动失效
+    uint8_t version[SHADER_DISK_CACHE_KEY_SIZE];
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    int cache_version = SHADER_DISK_CACHE_VERSION;
+    _mesa_sha1_update(&sha1_ctx, &cache_version, sizeof(cache_version));
+#ifdef HAVE_DL_ITERATE_PHDR
+    const struct build_id_note* note = build_id_find_nhdr_for_addr((const void*)shader_disk_cache_open);
+    if(note != NULL) _mesa_sha1_update(&sha1_ctx, build_id_data(note), build_id_length(note));
+#endif
+    if(version_key != NULL) _mesa_sha1_update(&sha1_ctx, version_key, version_key_size);
+    _mesa_sha1_final(&sha1_ctx, version);
+    check_cache_version(path, version);
+
+    shader_disk_cache_t* cache = calloc(1, sizeof(shader_disk_cache_t));
+    if(cache == NULL) {
+        free(path);
+        return NULL;
+    }
+    if(!mesa_cache_db_open(&cache->db, path)) {
+        LTW_ERROR_PRINTF("LTW: failed to open shader cache database in %s", path);
+        free(path);
+        free(cache);
+        return NULL;
+    }
+    mesa_cache_db_set_size_limit(&cache->db, get_cache_size_limit());
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->path = path;
+    LTW_DEBUG_PRINTF("LTW: shader disk cache opened at %s", path);
+    return cache;
+}
+
+INTERNAL void shader_disk_cache_close(shader_disk_cache_t* cache) {
+    if(cache == NULL) return;
+    mesa_cache_db_close(&cache->db);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->path);
+    free(cache);
+}
+
+INTERNAL void* shader_disk_cache_get(shader_disk_cache_t* cache, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], size_t* size) {
+    if(cache == NULL) return NULL;
+    pthread_mutex_lock(&cache->lock);
+    void* data = mesa_cache_db_read_entry(&cache->db, key, size);
+    pthread_mutex_unlock(&cache->lock);
+    return data;
+}
+
+INTERNAL bool shader_disk_cache_put(shader_disk_cache_t* cache, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], const void* data, size_t size) {
+    if(cache == NULL) return false;
+    pthread_mutex_lock(&cache->lock);
+    bool result = mesa_cache_db_entry_write(&cache->db, key, data, size);
+    pthread_mutex_unlock(&cache->lock);
+    return result;
+}
+
+static void source_cache_init(void) {
+    static const char magic[] = "LTW-Turbo translated shader source";
+    source_cache = shader_disk_cache_open("shaders", magic, sizeof(magic));
+    // 翻译选项不同的结果共存于同一个缓存，切换选项时不必清空
+    int output_flags = shader_translation_output_flags();
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    _mesa_sha1_update(&sha1_ctx, magic, sizeof(magic));
+    _mesa_sha1_update(&sha1_ctx, &output_flags, sizeof(output_flags));
+    _mesa_sha1_final(&sha1_ctx, source_cache_base_key);
+}
+
+INTERNAL void shader_disk_cache_source_key(size_t count, const char* const* strings, const size_t* lengths,
+                                           uint32_t shader_type, int source_version, int target_version,
+                                           uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    pthread_once(&source_cache_once, source_cache_init);
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    _mesa_sha1_update(&sha1_ctx, source_cache_base_key, sizeof(source_cache_base_key));
+    _mesa_sha1_update(&sha1_ctx, &shader_type, sizeof(shader_type));
+    _mesa_sha1_update(&sha1_ctx, &source_version, sizeof(source_version));
+    _mesa_sha1_update(&sha1_ctx, &target_version, sizeof(target_version));
+    for(size_t i = 0; i < count; i++) _mesa_sha1_update(&sha1_ctx, strings[i], lengths[i]);
+    _mesa_sha1_final(&sha1_ctx, key);
+}
+
+INTERNAL char* shader_disk_cache_get_source(const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    pthread_once(&source_cache_once, source_cache_init);
+    size_t size = 0;
+    char* source = shader_disk_cache_get(source_cache, key, &size);
+    if(source == NULL) return NULL;
+    // 条目必须是以 0 结尾的字符串，否则视为损坏
+    if(size == 0 || source[size - 1] != 0) {
+        LTW_ERROR_PRINTF("LTW: corrupted shader disk cache entry, ignoring");
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+INTERNAL void shader_disk_cache_put_source(const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], const char* translated_source) {
+    pthread_once(&source_cache_once, source_cache_init);
+    if(translated_source == NULL) return;
+    shader_disk_cache_put(source_cache, key, translated_source, strlen(translated_source) + 1);
+}
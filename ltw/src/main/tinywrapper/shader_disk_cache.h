@@ -0,0 +1,39 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SHADER_DISK_CACHE_H
+#define POJAVLAUNCHER_SHADER_DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 翻译器输出格式变化时必须递增，用于使旧的磁盘缓存失效
+#define SHADER_DISK_CACHE_VERSION 1
+#define SHADER_DISK_CACHE_KEY_SIZE 20
+
+typedef struct shader_disk_cache shader_disk_cache_t;
+
+// 打开（或创建）名为 name 的持久化缓存。
+// version_key 参与失效判断：与磁盘上记录的不一致时整个缓存会被清空。
+// 缓存被禁用或目录不可用时返回 NULL，所有其它函数都接受 NULL。
+shader_disk_cache_t* shader_disk_cache_open(const char* name, const void* version_key, size_t version_key_size);
+
+void shader_disk_cache_close(shader_disk_cache_t* cache);
+
+// 返回 malloc 分配的数据，调用者负责 free；未命中时返回 NULL
+void* shader_disk_cache_get(shader_disk_cache_t* cache, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], size_t* size);
+
+bool shader_disk_cache_put(shader_disk_cache_t* cache, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], const void* data, size_t size);
+
+// 翻译后着色器源码的缓存（glShaderSource 使用），键直接按源码片段流式计算
+void shader_disk_cache_source_key(size_t count, const char* const* strings, const size_t* lengths,
+                                  uint32_t shader_type, int source_version, int target_version,
+                                  uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]);
+char* shader_disk_cache_get_source(const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]);
+void shader_disk_cache_put_source(const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE], const char* translated_source);
+
+#endif //POJAVLAUNCHER_SHADER_DISK_CACHE_H
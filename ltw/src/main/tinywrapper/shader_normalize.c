@@ -0,0 +1,201 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shader_normalize.h"
+#include "libraryinternal.h"
+#include "env.h"
+
+static pthread_once_t normalize_once = PTHREAD_ONCE_INIT;
+static bool normalize_enabled = true;
+
+static void normalize_init(void) {
+    normalize_enabled = env_istrue_d("LTW_SHADER_CACHE_NORMALIZE", true);
+}
+
+static inline bool is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.';
+}
+
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// 这些字符两两相邻时可能组成另一个运算符（"+ +" 与 "++"、"/ /" 与注释），中间的空格不能去掉
+static inline bool is_operator_char(char c) {
+    return c != 0 && strchr("+-*/%<>=!&|^", c) != NULL;
+}
+
+static bool contains_token(const char* text, size_t length, const char* token) {
+    size_t token_length = strlen(token);
+    for(const char* p = text; (p = memchr(p, token[0], length - (p - text))) != NULL; p++) {
+        if((size_t)(text + length - p) < token_length) return false;
+        if(memcmp(p, token, token_length) == 0) return true;
+    }
+    return false;
+}
+
+static size_t skip_blanks(const char* text, size_t length, size_t i) {
+    while(i < length && (text[i] == ' ' || text[i] == '\t')) i++;
+    return i;
+}
+
+// "#line 行号 [源串号]" 只影响报错信息里的位置，返回到行尾（不含换行）的位置；
+// 其它写法（宏、注释、格式错误）原样保留，让翻译器照常报错，返回 0
+static size_t line_directive_end(const char* text, size_t length, size_t hash) {
+    size_t i = skip_blanks(text, length, hash + 1);
+    if(length - i < 4 || memcmp(text + i, "line", 4) != 0) return 0;
+    i += 4;
+    int numbers = 0;
+    for(;;) {
+        size_t start = i;
+        i = skip_blanks(text, length, i);
+        if(i >= length || text[i] == '\r' || text[i] == '\n') return numbers > 0 ? i : 0;
+        // 每个数字前都要有空白，最多两个
+        if(i == start || numbers == 2 || text[i] < '0' || text[i] > '9') return 0;
+        while(i < length && text[i] >= '0' && text[i] <= '9') i++;
+        numbers++;
+    }
+}
+
+static size_t normalize(const char* text, size_t length, char* out) {
+    // 行号可见时保留行结构，否则换行只是普通空白（预处理指令除外）
+    bool keep_lines = contains_token(text, length, "__LINE__") || contains_token(text, length, "__FILE__");
+    size_t n = 0;
+    bool line_start = true, in_directive = false, pending_space = false;
+    size_t comment_end = 0;     // 最近一个输出的跨行注释的结尾位置
+    size_t i = 0;
+    while(i < length) {
+        char c = text[i];
+        if(c == '\\' && (i + 1 < length && text[i + 1] == '\n')) {
+            // 续行先于其它处理，两边拼成同一行（甚至同一个记号）
+            if(keep_lines) {
+                out[n++] = '\\';
+                out[n++] = '\n';
+            }
+            i += 2;
+            continue;
+        }
+        if(c == '/' && i + 1 < length && text[i + 1] == '/') {
+            while(i < length && text[i] != '\n') i++;
+            pending_space = true;
+            continue;
+        }
+        if(c == '/' && i + 1 < length && text[i + 1] == '*') {
+            size_t start = i;
+            i += 2;
+            while(i + 1 < length && !(text[i] == '*' && text[i + 1] == '/')) i++;
+            bool terminated = i + 1 < length;
+            i = terminated ? i + 2 : length;
+            size_t newlines = 0;
+            if(keep_lines) {
+                for(size_t k = start; k < i; k++) newlines += text[k] == '\n';
+            }
+            if(newlines == 0) {
+                pending_space = true;
+                continue;
+            }
+            // 跨行注释影响之后的行号，换成只含这些换行的注释。
+            // 输出不能比输入长：除号和注释之间原本至少隔着一个字节（"//" 是行注释），刚输出的注释结尾则不需要空格；
+            // 没有结束的注释不补 "*/"
+            if(n > 0 && out[n - 1] == '/' && n != comment_end) out[n++] = ' ';
+            out[n++] = '/';
+            out[n++] = '*';
+            memset(out + n, '\n', newlines);
+            n += newlines;
+            if(terminated) {
+                out[n++] = '*';
+                out[n++] = '/';
+                comment_end = n;
+            }
+            pending_space = false;
+            continue;
+        }
+        if(c == '\n') {
+            if(in_directive || keep_lines) out[n++] = '\n';
+            else pending_space = true;
+            in_directive = false;
+            line_start = true;
+            i++;
+            continue;
+        }
+        if(is_blank(c)) {
+            pending_space = true;
+            i++;
+            continue;
+        }
+        if(c == '#' && line_start) {
+            // #version 之前的 #line 本身就是错误，保留下来
+            size_t end = keep_lines || n == 0 ? 0 : line_directive_end(text, length, i);
+            if(end != 0) {
+                i = end;
+                continue;
+            }
+            // 跨行注释之后的 # 仍在行首，不必再换行
+            if(n > 0 && out[n - 1] != '\n' && n != comment_end) out[n++] = '\n';
+            out[n++] = '#';
+            in_directive = true;
+            line_start = false;
+            pending_space = false;
+            i++;
+            continue;
+        }
+        if(pending_space && n > 0 && out[n - 1] != '\n') {
+            char last = out[n - 1];
+            bool needed = in_directive ? last != '#'
+                        : (is_word_char(last) && is_word_char(c)) || (is_operator_char(last) && is_operator_char(c));
+            if(needed) out[n++] = ' ';
+        }
+        out[n++] = c;
+        pending_space = false;
+        line_start = false;
+        i++;
+    }
+    out[n] = 0;
+    return n;
+}
+
+INTERNAL bool shader_normalize_enabled(void) {
+    pthread_once(&normalize_once, normalize_init);
+    return normalize_enabled;
+}
+
+INTERNAL size_t shader_normalize_source_into(size_t count, const char* const* strings, const size_t* lengths, char* out, char* joined) {
+    size_t length = 0;
+    for(size_t i = 0; i < count; i++) length += lengths[i];
+    const char* text = count == 1 ? strings[0] : joined;
+    if(count != 1) {
+        size_t offset = 0;
+        for(size_t i = 0; i < count; i++) {
+            memcpy(joined + offset, strings[i], lengths[i]);
+            offset += lengths[i];
+        }
+    }
+    return normalize(text, length, out);
+}
+
+INTERNAL char* shader_normalize_source(size_t count, const char* const* strings, const size_t* lengths, size_t* out_length) {
+    if(!shader_normalize_enabled()) return NULL;
+    size_t length = 0;
+    for(size_t i = 0; i < count; i++) length += lengths[i];
+    // 规范化不会让文本变长
+    char* out = malloc(length + 1);
+    if(out == NULL) return NULL;
+    char* joined = NULL;
+    if(count != 1) {
+        joined = malloc(length + 1);
+        if(joined == NULL) {
+            free(out);
+            return NULL;
+        }
+    }
+    *out_length = shader_normalize_source_into(count, strings, lengths, out, joined);
+    free(joined);
+    return out;
+}
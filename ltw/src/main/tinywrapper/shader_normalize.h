@@ -0,0 +1,25 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SHADER_NORMALIZE_H
+#define POJAVLAUNCHER_SHADER_NORMALIZE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 着色器缓存键的规范化文本：去掉注释和多余的空白，只差注释、缩进、换行风格或 #line 的源码得到同一个键。
+// 预处理指令保持各占一行，指令内的空白压缩成一个空格（函数式宏和对象式宏的区别仍然保留）。
+// 源码用到 __LINE__ 或 __FILE__ 时行号会影响结果，此时保留每个换行和 #line 指令。
+// 结果本身仍是等价的 GLSL，但只用于哈希和比对，不会交给翻译器。
+// 返回 malloc 分配、以 0 结尾的文本；LTW_SHADER_CACHE_NORMALIZE=0 或内存不足时返回 NULL，调用者改用原始片段
+char* shader_normalize_source(size_t count, const char* const* strings, const size_t* lengths, size_t* out_length);
+// LTW_SHADER_CACHE_NORMALIZE 是否启用
+bool shader_normalize_enabled(void);
+// 同 shader_normalize_source，但写入调用者提供的 out（至少片段总长度 + 1 字节）；
+// 多个片段时先拼接到 joined（大小同 out，只有一个片段时可以为 NULL）。不检查是否启用，返回结果长度
+size_t shader_normalize_source_into(size_t count, const char* const* strings, const size_t* lengths, char* out, char* joined);
+
+#endif //POJAVLAUNCHER_SHADER_NORMALIZE_H
@@ -0,0 +1,186 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shader_stats.h"
+#include "shader_cache.h"
+#include "glsl_optimizer/src/util/mesa-sha1.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+#define SHADER_STATS_BUCKETS 256
+
+typedef struct shader_stats_node {
+    struct shader_stats_node* next;
+    shader_stats_entry_t entry;
+} shader_stats_node_t;
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char* stats_path = NULL;
+static shader_stats_node_t* buckets[SHADER_STATS_BUCKETS];
+static size_t stats_count = 0;
+
+static void stats_init(void) {
+    const char* path = getenv("LTW_SHADER_STATS");
+    if(path != NULL && *path != 0) stats_path = path;
+}
+
+INTERNAL bool shader_stats_enabled(void) {
+    pthread_once(&stats_once, stats_init);
+    return stats_path != NULL;
+}
+
+static inline uint64_t phases_total(const struct optimize_shader_timings* t) {
+    return t->preprocess + t->parse + t->ast_to_hir + t->link + t->optimize + t->convert;
+}
+
+INTERNAL void shader_stats_record(const uint8_t source_key[SHADER_DISK_CACHE_KEY_SIZE], uint32_t shader_type,
+                                  size_t source_size, size_t output_size, bool failed,
+                                  const struct optimize_shader_timings* timings,
+                                  const struct optimize_shader_precision* precision) {
+    if(!shader_stats_enabled()) return;
+    // 源码键本身是 SHA-1，直接取前几个字节做桶索引
+    uint32_t bucket;
+    memcpy(&bucket, source_key, sizeof(bucket));
+    bucket %= SHADER_STATS_BUCKETS;
+
+    pthread_mutex_lock(&stats_lock);
+    shader_stats_node_t* node = buckets[bucket];
+    while(node != NULL && memcmp(node->entry.source_key, source_key, SHADER_DISK_CACHE_KEY_SIZE) != 0) {
+        node = node->next;
+    }
+    if(node == NULL) {
+        node = calloc(1, sizeof(shader_stats_node_t));
+        if(node == NULL) {
+            pthread_mutex_unlock(&stats_lock);
+            return;
+        }
+        memcpy(node->entry.source_key, source_key, SHADER_DISK_CACHE_KEY_SIZE);
+        node->entry.shader_type = shader_type;
+        node->next = buckets[bucket];
+        buckets[bucket] = node;
+        stats_count++;
+    }
+    shader_stats_entry_t* entry = &node->entry;
+    uint64_t total = phases_total(timings);
+    entry->source_size = source_size;
+    if(!failed) entry->output_size = output_size;
+    entry->translations++;
+    if(failed) entry->failures++;
+    entry->total_ns += total;
+    if(total > entry->max_ns) entry->max_ns = total;
+    entry->phases.preprocess += timings->preprocess;
+    entry->phases.parse += timings->parse;
+    entry->phases.ast_to_hir += timings->ast_to_hir;
+    entry->phases.link += timings->link;
+    entry->phases.optimize += timings->optimize;
+    entry->phases.convert += timings->convert;
+    if(!failed && precision != NULL) entry->precision = *precision;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static int compare_total_desc(const void* a, const void* b) {
+    const shader_stats_entry_t* ea = a;
+    const shader_stats_entry_t* eb = b;
+    if(ea->total_ns == eb->total_ns) return 0;
+    return ea->total_ns < eb->total_ns ? 1 : -1;
+}
+
+INTERNAL shader_stats_entry_t* shader_stats_snapshot(size_t* count) {
+    *count = 0;
+    pthread_mutex_lock(&stats_lock);
+    shader_stats_entry_t* entries = stats_count > 0 ? malloc(stats_count * sizeof(shader_stats_entry_t)) : NULL;
+    if(entries != NULL) {
+        for(int i = 0; i < SHADER_STATS_BUCKETS; i++) {
+            for(shader_stats_node_t* node = buckets[i]; node != NULL; node = node->next) {
+                entries[(*count)++] = node->entry;
+            }
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+    if(entries != NULL) qsort(entries, *count, sizeof(shader_stats_entry_t), compare_total_desc);
+    return entries;
+}
+
+static const char* shader_type_name(uint32_t type) {
+    switch(type) {
+        case GL_VERTEX_SHADER: return "vertex";
+        case GL_FRAGMENT_SHADER: return "fragment";
+        case GL_GEOMETRY_SHADER: return "geometry";
+        case GL_COMPUTE_SHADER: return "compute";
+        default: return "unknown";
+    }
+}
+
+static void write_csv(FILE* file, const shader_stats_entry_t* entries, size_t count) {
+    fputs("source_key,type,source_bytes,output_bytes,translations,failures,total_ns,max_ns,"
+          "preprocess_ns,parse_ns,ast_to_hir_ns,link_ns,optimize_ns,convert_ns,float_ops,mediump_ops\n", file);
+    for(size_t i = 0; i < count; i++) {
+        const shader_stats_entry_t* e = &entries[i];
+        char key_hex[SHADER_DISK_CACHE_KEY_SIZE * 2 + 1];
+        _mesa_sha1_format(key_hex, e->source_key);
+        fprintf(file, "%s,%s,%zu,%zu,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u\n",
+                key_hex, shader_type_name(e->shader_type), e->source_size, e->output_size,
+                e->translations, e->failures,
+                (unsigned long long)e->total_ns, (unsigned long long)e->max_ns,
+                (unsigned long long)e->phases.preprocess, (unsigned long long)e->phases.parse,
+                (unsigned long long)e->phases.ast_to_hir, (unsigned long long)e->phases.link,
+                (unsigned long long)e->phases.optimize, (unsigned long long)e->phases.convert,
+                e->precision.operations, e->precision.demoted_operations);
+    }
+}
+
+static void write_json(FILE* file, const shader_stats_entry_t* entries, size_t count) {
+    fputs("[\n", file);
+    for(size_t i = 0; i < count; i++) {
+        const shader_stats_entry_t* e = &entries[i];
+        char key_hex[SHADER_DISK_CACHE_KEY_SIZE * 2 + 1];
+        _mesa_sha1_format(key_hex, e->source_key);
+        fprintf(file, "  {\"source_key\": \"%s\", \"type\": \"%s\", \"source_bytes\": %zu, \"output_bytes\": %zu, "
+                      "\"translations\": %u, \"failures\": %u, \"total_ns\": %llu, \"max_ns\": %llu, "
+                      "\"phases_ns\": {\"preprocess\": %llu, \"parse\": %llu, \"ast_to_hir\": %llu, "
+                      "\"link\": %llu, \"optimize\": %llu, \"convert\": %llu}, "
+                      "\"float_ops\": %u, \"mediump_ops\": %u}%s\n",
+                key_hex, shader_type_name(e->shader_type), e->source_size, e->output_size,
+                e->translations, e->failures,
+                (unsigned long long)e->total_ns, (unsigned long long)e->max_ns,
+                (unsigned long long)e->phases.preprocess, (unsigned long long)e->phases.parse,
+                (unsigned long long)e->phases.ast_to_hir, (unsigned long long)e->phases.link,
+                (unsigned long long)e->phases.optimize, (unsigned long long)e->phases.convert,
+                e->precision.operations, e->precision.demoted_operations,
+                i + 1 < count ? "," : "");
+    }
+    fputs("]\n", file);
+}
+
+INTERNAL void shader_stats_dump(void) {
+    if(!shader_stats_enabled()) return;
+    size_t count = 0;
+    shader_stats_entry_t* entries = shader_stats_snapshot(&count);
+    FILE* file = fopen(stats_path, "w");
+    if(file == NULL) {
+        LTW_ERROR_PRINTF("LTW: failed to write shader stats to %s", stats_path);
+        free(entries);
+        return;
+    }
+    size_t path_length = strlen(stats_path);
+    if(path_length >= 5 && strcmp(stats_path + path_length - 5, ".json") == 0) write_json(file, entries, count);
+    else write_csv(file, entries, count);
+    fclose(file);
+    LTW_ERROR_PRINTF("LTW: wrote translation stats for %zu shaders to %s", count, stats_path);
+    free(entries);
+    // 内存缓存的命中情况与每个着色器的翻译耗时一起看
+    shader_cache_stats_t cache_stats;
+    shader_cache_get_stats(&cache_stats);
+    LTW_ERROR_PRINTF("LTW: shader cache: %llu hits, %llu misses, %llu insertions, %llu evictions, %zu entries (%zu compressed), %zu bytes",
+                     (unsigned long long)cache_stats.hits, (unsigned long long)cache_stats.misses,
+                     (unsigned long long)cache_stats.insertions, (unsigned long long)cache_stats.evictions,
+                     cache_stats.entries, cache_stats.compressed_entries, cache_stats.memory);
+}
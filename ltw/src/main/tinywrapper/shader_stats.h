@@ -0,0 +1,44 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SHADER_STATS_H
+#define POJAVLAUNCHER_SHADER_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "shader_disk_cache.h"
+#include "glsl_optimizer/src/code/c_wrapper.h"
+
+// 按着色器（源码键）汇总的翻译耗时，单位纳秒
+typedef struct {
+    uint8_t source_key[SHADER_DISK_CACHE_KEY_SIZE];
+    uint32_t shader_type;
+    size_t source_size;
+    size_t output_size;
+    uint32_t translations;
+    uint32_t failures;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    struct optimize_shader_timings phases; // 各阶段累计耗时
+    struct optimize_shader_precision precision; // 最近一次翻译降为 mediump 的情况（LTW_MEDIUMP）
+} shader_stats_entry_t;
+
+// 设置 LTW_SHADER_STATS=<文件路径> 后启用；以 .json 结尾写 JSON，否则写 CSV
+bool shader_stats_enabled(void);
+
+void shader_stats_record(const uint8_t source_key[SHADER_DISK_CACHE_KEY_SIZE], uint32_t shader_type,
+                         size_t source_size, size_t output_size, bool failed,
+                         const struct optimize_shader_timings* timings,
+                         const struct optimize_shader_precision* precision);
+
+// 返回按总耗时降序排列的快照（malloc 分配，调用者负责 free）
+shader_stats_entry_t* shader_stats_snapshot(size_t* count);
+
+// 把当前统计写入 LTW_SHADER_STATS 指定的文件（在销毁上下文时调用）
+void shader_stats_dump(void);
+
+#endif //POJAVLAUNCHER_SHADER_STATS_H
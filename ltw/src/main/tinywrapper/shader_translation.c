@@ -0,0 +1,280 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "shader_translation.h"
+#include "shader_cache.h"
+#include "shader_normalize.h"
+#include "shader_stats.h"
+#include "glsl_optimizer/src/util/u_queue.h"
+#include "glsl_optimizer/src/code/c_wrapper.h"
+#include "glsl_optimizer/src/util/mesa-sha1.h"
+#include "libraryinternal.h"
+#include "debug.h"
+#include "env.h"
+
+#define SHADER_TRANSLATION_MAX_THREADS 4
+#define SHADER_TRANSLATION_MAX_JOBS 64
+
+struct shader_translation {
+    struct util_queue_fence fence;
+    char* source;
+    char* result;
+    uint32_t shader_type;
+    int source_version;
+    int target_version;
+    int flags;
+    bool tier0;
+    uint8_t disk_key[SHADER_DISK_CACHE_KEY_SIZE];
+};
+
+static pthread_once_t output_flags_once = PTHREAD_ONCE_INIT;
+static int output_flags = 0;
+
+static void output_flags_init(void) {
+    // 把安全的浮点临时变量、片段输入和纹理结果降为 mediump，Mali/Adreno 上 ALU 和 varying 开销减半
+    if(env_istrue("LTW_MEDIUMP")) output_flags |= OPTIMIZE_SHADER_MEDIUMP;
+}
+
+INTERNAL int shader_translation_output_flags(void) {
+    pthread_once(&output_flags_once, output_flags_init);
+    return output_flags;
+}
+
+static pthread_once_t queue_once = PTHREAD_ONCE_INIT;
+static struct util_queue translation_queue;
+static bool queue_ready = false;
+
+static void queue_init(void) {
+    if(!env_istrue_d("LTW_ASYNC_SHADERS", true)) return;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    // 给渲染线程留一个核心
+    unsigned nthreads = ncpus > 1 ? (unsigned)(ncpus - 1) : 1;
+    if(nthreads > SHADER_TRANSLATION_MAX_THREADS) nthreads = SHADER_TRANSLATION_MAX_THREADS;
+    queue_ready = util_queue_init(&translation_queue, "ltwshdr", SHADER_TRANSLATION_MAX_JOBS, nthreads,
+                                  UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+    if(!queue_ready) LTW_ERROR_PRINTF("LTW: failed to start shader translation threads, translating synchronously");
+    else LTW_DEBUG_PRINTF("LTW: shader translation queue started with %u threads", nthreads);
+}
+
+static void translation_execute(void* job, void* gdata, int thread_index) {
+    shader_translation_t* translation = job;
+    // 翻译器在共享字符串的头部之后直接写出结果，整块内存交给 shader_source_adopt，不再复制
+    struct optimize_shader_output output = { shader_source_header_size(), 0 };
+    char* cached = shader_disk_cache_get_source(translation->disk_key);
+    if(cached != NULL) {
+        translation->result = shader_source_new(cached, strlen(cached));
+        free(cached);
+    } else if(translation->flags & SHADER_TRANSLATION_FAST) {
+        // 第 0 级结果不进缓存，也不计入统计（统计的是完整翻译的耗时）；保留原始源码供后台优化
+        char* translated = optimize_shader_ex(translation->source, translation->shader_type,
+                                              translation->source_version, translation->target_version,
+                                              OPTIMIZE_SHADER_FAST, NULL, NULL, &output);
+        translation->result = shader_source_adopt(translated, output.length);
+        translation->tier0 = true;
+        return;
+    } else {
+        struct optimize_shader_timings timings = {0};
+        struct optimize_shader_precision precision = {0};
+        char* translated = optimize_shader_ex(translation->source, translation->shader_type,
+                                              translation->source_version, translation->target_version,
+                                              shader_translation_output_flags(), &timings, &precision, &output);
+        translation->result = shader_source_adopt(translated, output.length);
+        shader_stats_record(translation->disk_key, translation->shader_type, strlen(translation->source),
+                            translated != NULL ? output.length : 0, translated == NULL, &timings, &precision);
+        shader_disk_cache_put_source(translation->disk_key, translation->result);
+    }
+    // 与 glShaderSource 查找时的键一致
+    size_t source_length = strlen(translation->source);
+    size_t key_length = 0;
+    char* key = shader_normalize_source(1, (const char* const*)&translation->source, &source_length, &key_length);
+    if(key != NULL) shader_cache_put(key, key_length, translation->shader_type,
+                                     translation->source_version, translation->target_version, translation->result);
+    else shader_cache_put(translation->source, source_length, translation->shader_type,
+                          translation->source_version, translation->target_version, translation->result);
+    free(key);
+    if(translation->flags & SHADER_TRANSLATION_KEEP_SOURCE) return;
+    free(translation->source);
+    translation->source = NULL;
+}
+
+INTERNAL shader_translation_t* shader_translation_start(char* source, uint32_t shader_type,
+                                                        int source_version, int target_version,
+                                                        const uint8_t disk_key[SHADER_DISK_CACHE_KEY_SIZE], int flags) {
+    pthread_once(&queue_once, queue_init);
+    shader_translation_t* translation = calloc(1, sizeof(shader_translation_t));
+    if(translation == NULL) {
+        free(source);
+        return NULL;
+    }
+    translation->source = source;
+    translation->shader_type = shader_type;
+    translation->source_version = source_version;
+    translation->target_version = target_version;
+    translation->flags = flags;
+    memcpy(translation->disk_key, disk_key, SHADER_DISK_CACHE_KEY_SIZE);
+    util_queue_fence_init(&translation->fence);
+    if(queue_ready) {
+        util_queue_add_job(&translation_queue, translation, &translation->fence, translation_execute, NULL, 0);
+    } else {
+        translation_execute(translation, NULL, 0);
+    }
+    return translation;
+}
+
+INTERNAL bool shader_translation_done(shader_translation_t* translation) {
+    if(translation == NULL || !queue_ready) return true;
+    return util_queue_fence_is_signalled(&translation->fence);
+}
+
+INTERNAL char* shader_translation_finish(shader_translation_t* translation, char** original_source, bool* tier0) {
+    if(original_source != NULL) *original_source = NULL;
+    if(tier0 != NULL) *tier0 = false;
+    if(translation == NULL) return NULL;
+    if(queue_ready) util_queue_fence_wait(&translation->fence);
+    util_queue_fence_destroy(&translation->fence);
+    char* result = translation->result;
+    if(result != NULL && original_source != NULL && translation->source != NULL) {
+        *original_source = translation->source;
+        if(tier0 != NULL) *tier0 = translation->tier0;
+    } else {
+        free(translation->source);
+    }
+    free(translation);
+    return result;
+}
+
+struct program_translation {
+    struct util_queue_fence fence;
+    char* sources[2];
+    char* results[2];
+    int source_version;
+    int target_version;
+    uint8_t keys[2][SHADER_DISK_CACHE_KEY_SIZE];
+    struct optimize_shader_constant* constants;
+    int nconstants;
+};
+
+// 裁剪后的结果取决于另一个阶段，磁盘缓存键由两个阶段的源码键共同决定
+static void program_stage_key(const program_translation_t* translation, int stage, uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    static const char tag[] = "cross-stage";
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    _mesa_sha1_update(&sha1_ctx, tag, sizeof(tag));
+    _mesa_sha1_update(&sha1_ctx, translation->keys, sizeof(translation->keys));
+    _mesa_sha1_update(&sha1_ctx, &stage, sizeof(stage));
+    for(int i = 0; i < translation->nconstants; i++) {
+        const struct optimize_shader_constant* constant = &translation->constants[i];
+        _mesa_sha1_update(&sha1_ctx, constant->name, strlen(constant->name) + 1);
+        _mesa_sha1_update(&sha1_ctx, &constant->type, sizeof(constant->type));
+        _mesa_sha1_update(&sha1_ctx, constant->value, sizeof(constant->value));
+    }
+    _mesa_sha1_final(&sha1_ctx, key);
+}
+
+static void program_translation_execute(void* job, void* gdata, int thread_index) {
+    program_translation_t* translation = job;
+    uint8_t keys[2][SHADER_DISK_CACHE_KEY_SIZE];
+    char* cached[2];
+    for(int i = 0; i < 2; i++) {
+        program_stage_key(translation, i, keys[i]);
+        cached[i] = shader_disk_cache_get_source(keys[i]);
+    }
+    if(cached[0] != NULL && cached[1] != NULL) {
+        for(int i = 0; i < 2; i++) {
+            translation->results[i] = shader_source_new(cached[i], strlen(cached[i]));
+            free(cached[i]);
+        }
+        return;
+    }
+    free(cached[0]);
+    free(cached[1]);
+    struct optimize_shader_output outputs[2] = {
+        { shader_source_header_size(), 0 },
+        { shader_source_header_size(), 0 },
+    };
+    char* translated[2];
+    unsigned pruned = 0, specialized = 0;
+    if(!optimize_program(translation->sources[0], translation->sources[1],
+                         translation->source_version, translation->target_version, shader_translation_output_flags(),
+                         translation->constants, translation->nconstants,
+                         &translated[0], &translated[1], outputs, &pruned, &specialized)) {
+        return;
+    }
+    LTW_DEBUG_PRINTF("LTW: cross-stage translation removed %u varyings, folded %u uniforms", pruned, specialized);
+    for(int i = 0; i < 2; i++) {
+        translation->results[i] = shader_source_adopt(translated[i], outputs[i].length);
+        shader_disk_cache_put_source(keys[i], translation->results[i]);
+    }
+}
+
+INTERNAL program_translation_t* program_translation_start(char* vertex_source, char* fragment_source,
+                                                          int source_version, int target_version,
+                                                          const uint8_t vertex_key[SHADER_DISK_CACHE_KEY_SIZE],
+                                                          const uint8_t fragment_key[SHADER_DISK_CACHE_KEY_SIZE],
+                                                          const struct optimize_shader_constant* constants, int nconstants) {
+    pthread_once(&queue_once, queue_init);
+    program_translation_t* translation = calloc(1, sizeof(program_translation_t));
+    if(translation != NULL && nconstants > 0) {
+        // 常量名由调用者持有，任务要在工作线程上使用，复制一份
+        translation->constants = malloc(nconstants * sizeof(struct optimize_shader_constant));
+        for(int i = 0; translation->constants != NULL && i < nconstants; i++) {
+            translation->constants[i] = constants[i];
+            translation->constants[i].name = strdup(constants[i].name);
+            if(translation->constants[i].name == NULL) break;
+            translation->nconstants++;
+        }
+        if(translation->nconstants != nconstants) {
+            for(int i = 0; i < translation->nconstants; i++) free((char*)translation->constants[i].name);
+            free(translation->constants);
+            free(translation);
+            translation = NULL;
+        }
+    }
+    if(translation == NULL) {
+        free(vertex_source);
+        free(fragment_source);
+        return NULL;
+    }
+    translation->sources[0] = vertex_source;
+    translation->sources[1] = fragment_source;
+    translation->source_version = source_version;
+    translation->target_version = target_version;
+    memcpy(translation->keys[0], vertex_key, SHADER_DISK_CACHE_KEY_SIZE);
+    memcpy(translation->keys[1], fragment_key, SHADER_DISK_CACHE_KEY_SIZE);
+    util_queue_fence_init(&translation->fence);
+    if(queue_ready) {
+        util_queue_add_job(&translation_queue, translation, &translation->fence, program_translation_execute, NULL, 0);
+    } else {
+        program_translation_execute(translation, NULL, 0);
+    }
+    return translation;
+}
+
+INTERNAL bool program_translation_done(program_translation_t* translation) {
+    if(translation == NULL || !queue_ready) return true;
+    return util_queue_fence_is_signalled(&translation->fence);
+}
+
+INTERNAL bool program_translation_finish(program_translation_t* translation, char** vertex_result, char** fragment_result) {
+    if(translation == NULL) return false;
+    if(queue_ready) util_queue_fence_wait(&translation->fence);
+    util_queue_fence_destroy(&translation->fence);
+    bool translated = translation->results[0] != NULL && translation->results[1] != NULL;
+    char** outputs[2] = { vertex_result, fragment_result };
+    for(int i = 0; i < 2; i++) {
+        free(translation->sources[i]);
+        if(translated && outputs[i] != NULL) *outputs[i] = translation->results[i];
+        else shader_source_release(translation->results[i]);
+    }
+    for(int i = 0; i < translation->nconstants; i++) free((char*)translation->constants[i].name);
+    free(translation->constants);
+    free(translation);
+    return translated;
+}
@@ -0,0 +1,57 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_SHADER_TRANSLATION_H
+#define POJAVLAUNCHER_SHADER_TRANSLATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdbool.h>
+#include "shader_disk_cache.h"
+#include "glsl_optimizer/src/code/c_wrapper.h"
+
+// 分级编译的第 0 级：磁盘缓存未命中时只做必要的降级，不运行优化，结果不写入任何缓存
+#define SHADER_TRANSLATION_FAST (1 << 0)
+// 完成后把原始源码交给调用者（跨阶段优化在链接时还要用到）
+#define SHADER_TRANSLATION_KEEP_SOURCE (1 << 1)
+
+typedef struct shader_translation shader_translation_t;
+
+// 影响翻译结果的全局选项（OPTIMIZE_SHADER_* 标志，如 LTW_MEDIUMP），参与磁盘缓存键
+int shader_translation_output_flags(void);
+
+// 在工作线程上开始翻译（查磁盘缓存 -> optimize_shader -> 写磁盘缓存），结果同时写入内存缓存。
+// source 的所有权转移给任务。工作线程不可用时同步执行。
+shader_translation_t* shader_translation_start(char* source, uint32_t shader_type,
+                                               int source_version, int target_version,
+                                               const uint8_t disk_key[SHADER_DISK_CACHE_KEY_SIZE], int flags);
+
+// 不阻塞地检查翻译是否已完成
+bool shader_translation_done(shader_translation_t* translation);
+
+// 等待翻译完成并释放任务，返回共享的翻译结果（见 shader_cache.h，失败时为 NULL）。
+// 结果是第 0 级翻译或设置了 SHADER_TRANSLATION_KEEP_SOURCE 时，原始源码的所有权通过 original_source
+// 交给调用者（传 NULL 则直接释放），否则置为 NULL。tier0 可为 NULL。
+char* shader_translation_finish(shader_translation_t* translation, char** original_source, bool* tier0);
+
+// 跨阶段优化：顶点/片段着色器一起翻译，片段着色器不读的 varying 连同计算它们的代码一起删除。
+// constants 中的 uniform 被替换成常量并折叠（uniform 特化，可为空）。
+// 结果按两个阶段的源码键和常量存入磁盘缓存。源码的所有权转移给任务，constants 会被复制。
+typedef struct program_translation program_translation_t;
+
+program_translation_t* program_translation_start(char* vertex_source, char* fragment_source,
+                                                 int source_version, int target_version,
+                                                 const uint8_t vertex_key[SHADER_DISK_CACHE_KEY_SIZE],
+                                                 const uint8_t fragment_key[SHADER_DISK_CACHE_KEY_SIZE],
+                                                 const struct optimize_shader_constant* constants, int nconstants);
+
+bool program_translation_done(program_translation_t* translation);
+
+// 等待完成并释放任务；成功时通过 vertex_result/fragment_result 返回共享的翻译结果
+bool program_translation_finish(program_translation_t* translation, char** vertex_result, char** fragment_result);
+
+#endif //POJAVLAUNCHER_SHADER_TRANSLATION_H
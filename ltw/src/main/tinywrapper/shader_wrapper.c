@@ -10,144 +10,21 @@
 #include <GLES3/gl3.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include "string_utils.h"
 #include "egl.h"
 #include "proc.h"
 #include "debug.h"
+#include "libraryinternal.h"
 #include "mempool.h"
-
-#define SHADER_CACHE_SIZE 256
-#define SHADER_CACHE_STATS 1
-#define SHADER_CACHE_MAX_MEMORY (32 * 1024 * 1024) // 32MB 最大内存限制
-
-// 获取高精度时间戳（跨平台兼容）
-static inline uint64_t get_timestamp() {
-#if defined(__GNUC__) || defined(__clang__)
-#if defined(__x86_64__) || defined(__i386__)
-    unsigned int lo, hi;
-    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
-    return ((uint64_t)hi << 32) | lo;
-#elif defined(__aarch64__)
-    uint64_t t;
-    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (t));
-    return t;
-#else
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-#endif
-#else
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-#endif
-}
-
-typedef struct {
-    size_t source_hash;
-    GLenum shader_type;
-    GLchar* optimized_source;
-    size_t source_size;  // 源代码大小，用于内存管理
-    uint32_t access_count;  // 访问计数，用于 LRU
-    uint64_t last_access;   // 最后访问时间
-} shader_cache_entry_t;
-
-static shader_cache_entry_t shader_cache[SHADER_CACHE_SIZE] = {0};
-static int shader_cache_count = 0;
-static uint64_t cache_hits = 0;
-static uint64_t cache_misses = 0;
-static size_t cache_total_memory = 0;  // 缓存总内存使用量
-
-static inline size_t hash_string(const char* str) {
-    size_t hash = 5381;
-    int c;
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash;
-}
-
-static GLchar* get_cached_shader(size_t hash, GLenum shader_type) {
-    for (int i = 0; i < shader_cache_count; i++) {
-        if (shader_cache[i].source_hash == hash && 
-            shader_cache[i].shader_type == shader_type) {
-            // 更新访问统计
-            shader_cache[i].access_count++;
-            shader_cache[i].last_access = get_timestamp();
-            #ifdef SHADER_CACHE_STATS
-            cache_hits++;
-            #endif
-            return shader_cache[i].optimized_source;
-        }
-    }
-    #ifdef SHADER_CACHE_STATS
-    cache_misses++;
-    #endif
-    return NULL;
-}
-
-static void cache_shader(size_t hash, GLenum shader_type, const GLchar* optimized_source) {
-    size_t source_size = strlen(optimized_source) + 1;
-
-    // 检查单个着色器是否过大
-    if (source_size > SHADER_CACHE_MAX_MEMORY / 2) {
-        LTW_DEBUG_PRINTF("LTW: shader source too large for cache: %zu bytes", source_size);
-        return;
-    }
-
-    if (shader_cache_count >= SHADER_CACHE_SIZE || cache_total_memory + source_size > SHADER_CACHE_MAX_MEMORY) {
-        // LRU 策略：替换访问次数最少且最久未使用的条目
-        int lru_index = 0;
-        uint32_t min_access = shader_cache[0].access_count;
-        uint64_t oldest_access = shader_cache[0].last_access;
-
-        for (int i = 1; i < shader_cache_count; i++) {
-            if (shader_cache[i].access_count < min_access ||
-                (shader_cache[i].access_count == min_access &&
-                 shader_cache[i].last_access < oldest_access)) {
-                min_access = shader_cache[i].access_count;
-                oldest_access = shader_cache[i].last_access;
-                lru_index = i;
-            }
-        }
-
-        // 释放被替换的条目
-        if (shader_cache[lru_index].optimized_source) {
-            cache_total_memory -= shader_cache[lru_index].source_size;
-            free(shader_cache[lru_index].optimized_source);
-        }
-
-        // 插入新条目
-        shader_cache[lru_index].source_hash = hash;
-        shader_cache[lru_index].shader_type = shader_type;
-        shader_cache[lru_index].optimized_source = strdup(optimized_source);
-        shader_cache[lru_index].source_size = source_size;
-        shader_cache[lru_index].access_count = 1;
-        shader_cache[lru_index].last_access = get_timestamp();
-        cache_total_memory += source_size;
-    } else {
-        // 缓存未满，直接添加
-        shader_cache[shader_cache_count].source_hash = hash;
-        shader_cache[shader_cache_count].shader_type = shader_type;
-        shader_cache[shader_cache_count].optimized_source = strdup(optimized_source);
-        shader_cache[shader_cache_count].source_size = source_size;
-        shader_cache[shader_cache_count].access_count = 1;
-        shader_cache[shader_cache_count].last_access = get_timestamp();
-        cache_total_memory += source_size;
-        shader_cache_count++;
-    }
-}
-
-#ifdef SHADER_CACHE_STATS
-static void print_cache_stats(void) {
-    if (cache_hits + cache_misses > 0) {
-        float hit_rate = (float)cache_hits / (cache_hits + cache_misses) * 100.0f;
-        LTW_DEBUG_PRINTF("Shader cache stats: hits=%llu, misses=%llu, hit_rate=%.2f%%, size=%d/%d, memory=%.2fMB/%.2fMB",
-                        cache_hits, cache_misses, hit_rate, shader_cache_count, SHADER_CACHE_SIZE,
-                        cache_total_memory / (1024.0f * 1024.0f), SHADER_CACHE_MAX_MEMORY / (1024.0f * 1024.0f));
-    }
-}
-#endif
+#include "shader_disk_cache.h"
+#include "shader_translation.h"
+#include "shader_cache.h"
+#include "shader_normalize.h"
+#include "program_state.h"
+#include "program_specialization.h"
+#include "glsl_optimizer/src/util/mesa-sha1.h"
+#include "env.h"
 
 GLuint glCreateProgram(void) {
     if(!current_context) return 0;
@@ -163,14 +40,21 @@ GLuint glCreateProgram(void) {
     return phys_program;
 }
 
+static void cancel_program_upgrade(program_info_t* program_info);
+static void reset_specialization(program_info_t* program_info);
+static void release_program_info(program_info_t* program_info);
+static void release_deleted_shader(GLuint shader);
+
 void glDeleteProgram(GLuint program) {
     if(!current_context) return;
     es3_functions.glDeleteProgram(program);
     program_info_t *old_programinfo = unordered_map_remove(current_context->program_map, (void*)program);
     if(old_programinfo == NULL) return;
-    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
-        const GLchar* binding = old_programinfo->colorbindings[i];
-        if(binding != NULL) free((void*)binding);
+    cancel_program_upgrade(old_programinfo);
+    reset_specialization(old_programinfo);
+    release_program_info(old_programinfo);
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(old_programinfo->shaders[i] != 0) release_deleted_shader(old_programinfo->shaders[i]);
     }
     mempool_free(current_context->program_info_pool, old_programinfo);
 }
@@ -181,10 +65,56 @@ void glAttachShader( 	GLuint program,
     es3_functions.glAttachShader(program, shader);
     program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
     shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)shader);
-    if(program_info == NULL || shader_info == NULL || shader_info->shader_type != GL_FRAGMENT_SHADER) return;
+    if(program_info == NULL || shader_info == NULL) return;
+    GLint free_slot = -1;
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == shader) {
+            free_slot = -1;
+            break;
+        }
+        if(program_info->shaders[i] == 0 && free_slot == -1) free_slot = i;
+    }
+    if(free_slot != -1) program_info->shaders[free_slot] = shader;
+    if(shader_info->shader_type != GL_FRAGMENT_SHADER) return;
     program_info->frag_shader = shader;
 }
 
+void glDetachShader(GLuint program, GLuint shader) {
+    if(!current_context) return;
+    es3_functions.glDetachShader(program, shader);
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info == NULL) return;
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == shader) program_info->shaders[i] = 0;
+    }
+    if(program_info->frag_shader == shader) program_info->frag_shader = 0;
+    release_deleted_shader(shader);
+}
+
+void glBindAttribLocation(GLuint program, GLuint index, const GLchar *name) {
+    if(!current_context) return;
+    es3_functions.glBindAttribLocation(program, index, name);
+    program_info_t *program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info == NULL) return;
+    if(index >= MAX_BOUND_ATTRIBS) {
+        program_info->binary_uncacheable = true;
+        return;
+    }
+    GLchar** pname = &program_info->attribbindings[index];
+    if(*pname != NULL) free(*pname);
+    if(asprintf(pname, "%s", name) == -1) {
+        *pname = NULL;
+        program_info->binary_uncacheable = true;
+    }
+}
+
+void glTransformFeedbackVaryings(GLuint program, GLsizei count, const GLchar *const*varyings, GLenum bufferMode) {
+    if(!current_context) return;
+    es3_functions.glTransformFeedbackVaryings(program, count, varyings, bufferMode);
+    program_info_t *program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info != NULL) program_info->binary_uncacheable = true;
+}
+
 void glBindFragDataLocation( 	GLuint program,
                                 GLuint colorNumber,
                                 const char * name) {
@@ -198,6 +128,198 @@ void glBindFragDataLocation( 	GLuint program,
     }
 }
 
+// 程序二进制缓存：键为所有附加着色器的翻译结果 + 片段输出/属性绑定，
+// 版本键包含 GL_VENDOR/GL_RENDERER/GL_VERSION，驱动更新后自动失效
+static pthread_once_t program_cache_once = PTHREAD_ONCE_INIT;
+static shader_disk_cache_t* program_cache = NULL;
+
+static void program_cache_init(void) {
+    if(!env_istrue_d("LTW_PROGRAM_BINARY_CACHE", true)) return;
+    GLint num_formats = 0;
+    es3_functions.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    if(num_formats <= 0) {
+        LTW_DEBUG_PRINTF("LTWShdrWp: driver has no program binary formats, program cache disabled");
+        return;
+    }
+    const char* vendor = (const char*)es3_functions.glGetString(GL_VENDOR);
+    const char* renderer = (const char*)es3_functions.glGetString(GL_RENDERER);
+    const char* version = (const char*)es3_functions.glGetString(GL_VERSION);
+    char* driver_key = NULL;
+    if(asprintf(&driver_key, "%s\n%s\n%s", vendor ? vendor : "", renderer ? renderer : "", version ? version : "") == -1) return;
+    program_cache = shader_disk_cache_open("programs", driver_key, strlen(driver_key));
+    free(driver_key);
+}
+
+static void shader_good_key(const shader_info_t* shader_info, uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    static const char tag[] = "compiled";
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    _mesa_sha1_update(&sha1_ctx, tag, sizeof(tag));
+    _mesa_sha1_update(&sha1_ctx, shader_info->source_key, sizeof(shader_info->source_key));
+    _mesa_sha1_final(&sha1_ctx, key);
+}
+
+// 该源码是否曾在本驱动上成功编译链接过，是则可以不编译直接报告 GL_COMPILE_STATUS
+static bool shader_known_good(const shader_info_t* shader_info) {
+    if(program_cache == NULL || !shader_info->has_source_key) return false;
+    uint8_t key[SHADER_DISK_CACHE_KEY_SIZE];
+    shader_good_key(shader_info, key);
+    size_t size = 0;
+    void* marker = shader_disk_cache_get(program_cache, key, &size);
+    if(marker == NULL) return false;
+    free(marker);
+    return true;
+}
+
+// 翻译失败时交给驱动的源码：编译一定失败，应用从 GL_COMPILE_STATUS 看到错误，而不是继续使用上一次的翻译
+static const GLchar* const failed_translation_source = "#version 300 es\n#error LTW failed to translate this shader\n";
+
+// 丢掉上一次的翻译，让驱动里的源码编译失败
+static void reject_source(GLuint shader, shader_info_t* shader_info) {
+    shader_source_release(shader_info->source);
+    shader_info->source = NULL;
+    free(shader_info->original_source);
+    shader_info->original_source = NULL;
+    shader_info->tier0 = false;
+    // 源码键描述的是新源码，而驱动里没有它的翻译：不能再用来读写程序二进制缓存
+    shader_info->has_source_key = false;
+    es3_functions.glShaderSource(shader, 1, &failed_translation_source, NULL);
+}
+
+// 取回工作线程的翻译结果并交给驱动
+static void join_translation(GLuint shader, shader_info_t* shader_info) {
+    if(shader_info == NULL || shader_info->pending_translation == NULL) return;
+    char* original_source = NULL;
+    bool tier0 = false;
+    GLchar* new_source = shader_translation_finish(shader_info->pending_translation, &original_source, &tier0);
+    shader_info->pending_translation = NULL;
+    if(new_source == NULL) {
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to translate shader %u", shader);
+        reject_source(shader, shader_info);
+        return;
+    }
+    shader_source_release(shader_info->source);
+    shader_info->source = new_source;
+    free(shader_info->original_source);
+    shader_info->original_source = original_source;
+    shader_info->tier0 = tier0;
+    es3_functions.glShaderSource(shader, 1, (const GLchar* const*)&shader_info->source, 0);
+}
+
+static void compile_if_pending(GLuint shader, shader_info_t* shader_info) {
+    join_translation(shader, shader_info);
+    if(shader_info == NULL || !shader_info->compile_pending) return;
+    shader_info->compile_pending = false;
+    es3_functions.glCompileShader(shader);
+}
+
+static bool compute_program_key(program_info_t* program_info, uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    if(program_cache == NULL || program_info->binary_uncacheable) return false;
+    struct mesa_sha1 sha1_ctx;
+    _mesa_sha1_init(&sha1_ctx);
+    int nshaders = 0;
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == 0) continue;
+        shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]);
+        if(shader_info == NULL || !shader_info->has_source_key) return false;
+        // 翻译结果由源码键唯一确定（磁盘缓存版本键包含本库的 build-id），无需等待翻译完成
+        _mesa_sha1_update(&sha1_ctx, shader_info->source_key, sizeof(shader_info->source_key));
+        nshaders++;
+    }
+    if(nshaders == 0) return false;
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        const char* binding = program_info->colorbindings[i];
+        if(binding == NULL) continue;
+        _mesa_sha1_update(&sha1_ctx, "c", 1);
+        _mesa_sha1_update(&sha1_ctx, &i, sizeof(i));
+        _mesa_sha1_update(&sha1_ctx, binding, strlen(binding) + 1);
+    }
+    for(GLuint i = 0; i < MAX_BOUND_ATTRIBS; i++) {
+        const char* binding = program_info->attribbindings[i];
+        if(binding == NULL) continue;
+        _mesa_sha1_update(&sha1_ctx, "a", 1);
+        _mesa_sha1_update(&sha1_ctx, &i, sizeof(i));
+        _mesa_sha1_update(&sha1_ctx, binding, strlen(binding) + 1);
+    }
+    _mesa_sha1_final(&sha1_ctx, key);
+    return true;
+}
+
+// 条目格式：GLenum binaryFormat + 驱动返回的二进制数据
+static bool load_program_binary(GLuint program, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    size_t size = 0;
+    uint8_t* entry = shader_disk_cache_get(program_cache, key, &size);
+    if(entry == NULL) return false;
+    if(size <= sizeof(GLenum)) {
+        free(entry);
+        return false;
+    }
+    GLenum format;
+    memcpy(&format, entry, sizeof(GLenum));
+    // 先取走应用之前留下的错误，下面只清除 glProgramBinary 自己产生的错误
+    GLenum app_error = es3_functions.glGetError();
+    if(app_error != GL_NO_ERROR && current_context->deferred_error == GL_NO_ERROR) current_context->deferred_error = app_error;
+    es3_functions.glProgramBinary(program, format, entry + sizeof(GLenum), (GLsizei)(size - sizeof(GLenum)));
+    free(entry);
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE) {
+        // 驱动拒绝了缓存的二进制（例如驱动已更新），清除它产生的错误后走正常链接
+        es3_functions.glGetError();
+        LTW_DEBUG_PRINTF("LTWShdrWp: driver rejected cached binary for program %u, relinking", program);
+        return false;
+    }
+    return true;
+}
+
+static void store_program_binary(GLuint program, program_info_t* program_info, const uint8_t key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE) return;
+    GLint binary_length = 0;
+    es3_functions.glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+    if(binary_length <= 0) return;
+    uint8_t* entry = malloc(sizeof(GLenum) + binary_length);
+    if(entry == NULL) return;
+    GLenum format = 0;
+    GLsizei written = 0;
+    es3_functions.glGetProgramBinary(program, binary_length, &written, &format, entry + sizeof(GLenum));
+    if(written > 0) {
+        memcpy(entry, &format, sizeof(GLenum));
+        shader_disk_cache_put(program_cache, key, entry, sizeof(GLenum) + written);
+    }
+    free(entry);
+
+    static const uint8_t marker = 1;
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == 0) continue;
+        shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]);
+        if(shader_info == NULL || !shader_info->has_source_key) continue;
+        uint8_t good_key[SHADER_DISK_CACHE_KEY_SIZE];
+        shader_good_key(shader_info, good_key);
+        shader_disk_cache_put(program_cache, good_key, &marker, sizeof(marker));
+    }
+}
+
+void glCompileShader(GLuint shader) {
+    if(!current_context) return;
+    pthread_once(&program_cache_once, program_cache_init);
+    shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)shader);
+    if(program_cache == NULL || shader_info == NULL || !shader_info->has_source_key) {
+        join_translation(shader, shader_info);
+        es3_functions.glCompileShader(shader);
+        return;
+    }
+    // 推迟到链接时（或应用查询编译结果时）再编译，翻译可以继续在工作线程上进行
+    shader_info->compile_pending = true;
+}
+
+void glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+    if(!current_context) return;
+    compile_if_pending(shader, unordered_map_get(current_context->shader_map, (void*)shader));
+    es3_functions.glGetShaderInfoLog(shader, bufSize, length, infoLog);
+}
+
 void glGetShaderiv(GLuint shader, GLenum pname, GLint* params) {
     if(!current_context) return;
     shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)shader);
@@ -207,81 +329,598 @@ void glGetShaderiv(GLuint shader, GLenum pname, GLint* params) {
         *params = GL_TRUE;
         return;
     }
+    if(shader_info != NULL && shader_info->compile_pending) {
+        if(pname == GL_SHADER_TYPE) {
+            *params = (GLint)shader_info->shader_type;
+            return;
+        }
+        if(pname == GL_COMPILE_STATUS && shader_known_good(shader_info)) {
+            *params = GL_TRUE;
+            return;
+        }
+    }
+    compile_if_pending(shader, shader_info);
     es3_functions.glGetShaderiv(shader, pname, params);
 }
 
-static void insert_fragout_pos(char* source, int* size, const char* name, GLuint pos) {
-    if (!source || !size || !name) {
-        LTW_ERROR_PRINTF("LTWShdrWp: Invalid parameters in insert_fragout_pos (NULL pointer)");
-        return;
-    }
-    char src_string[256] = { 0 };
-    char dst_string[256] = { 0 };
-    snprintf(src_string, sizeof(src_string), "/* LTW INSERT LOCATION %s LTW */", name);
-    snprintf(dst_string, sizeof(dst_string), "layout(location = %u) ", pos);
-    char* result = gl4es_inplace_replace_simple(source, size, src_string, dst_string);
-    if (!result) {
-        LTW_ERROR_PRINTF("LTWShdrWp: gl4es_inplace_replace_simple failed in insert_fragout_pos");
+static bool colorbindings_equal(GLchar* const* a, GLchar* const* b) {
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        if(a[i] == NULL || b[i] == NULL) {
+            if(a[i] != b[i]) return false;
+            continue;
+        }
+        if(strcmp(a[i], b[i]) != 0) return false;
     }
+    return true;
 }
 
-void glLinkProgram(GLuint program) {
-    if(!current_context) return;
-    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
-    if(program_info == NULL || program_info->frag_shader == 0) {
-        // Don't have any fragment shader to patch the locations in, fall through.
-        goto fallthrough;
+static void free_patched_frag(patched_frag_entry_t* entry, bool delete_shader) {
+    if(delete_shader && entry->shader != 0) es3_functions.glDeleteShader(entry->shader);
+    shader_source_release(entry->source);
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) free(entry->colorbindings[i]);
+    memset(entry, 0, sizeof(patched_frag_entry_t));
+}
+
+void free_patched_frag_cache(context_t* context, bool delete_shaders) {
+    for(int i = 0; i < PATCHED_FRAG_CACHE_SIZE; i++) {
+        free_patched_frag(&context->patched_frag_cache[i], delete_shaders);
     }
-    shader_info_t *shader = unordered_map_get(current_context->shader_map, (void*)program_info->frag_shader);
-    if(shader == NULL) {
-        LTW_ERROR_PRINTF("LTWShdrWp: failed to patch frag data location due to missing shader info");
-        goto fallthrough;
+    context->patched_frag_cache_index = 0;
+}
+
+static GLuint find_patched_frag(GLchar* source, uint64_t source_hash, program_info_t* program_info) {
+    for(int i = 0; i < PATCHED_FRAG_CACHE_SIZE; i++) {
+        patched_frag_entry_t* entry = &current_context->patched_frag_cache[i];
+        if(entry->shader == 0 || entry->source_hash != source_hash) continue;
+        if(entry->source != source && strcmp(entry->source, source) != 0) continue;
+        if(!colorbindings_equal(entry->colorbindings, program_info->colorbindings)) continue;
+        return entry->shader;
     }
-    int nsrc_size = (int)(strlen(shader->source) + 1);
-    char* new_source = (char*)malloc(nsrc_size);
-    memcpy(new_source, shader->source, nsrc_size);
-    bool changesMade = false;
+    return 0;
+}
+
+static void store_patched_frag(GLchar* source, uint64_t source_hash, program_info_t* program_info, GLuint shader) {
+    patched_frag_entry_t* entry = &current_context->patched_frag_cache[current_context->patched_frag_cache_index];
+    current_context->patched_frag_cache_index = (current_context->patched_frag_cache_index + 1) % PATCHED_FRAG_CACHE_SIZE;
+    // 被替换的着色器可能仍附加在已链接的程序上，删除不影响这些程序
+    free_patched_frag(entry, true);
+    entry->source_hash = source_hash;
+    entry->source = shader_source_acquire(source);
     for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
         const char* colorbind = program_info->colorbindings[i];
+        if(colorbind != NULL) entry->colorbindings[i] = strdup(colorbind);
+    }
+    entry->shader = shader;
+}
+
+// 按颜色绑定插入 layout(location)，没有绑定时返回 NULL
+// 所有绑定的插入标记在一次扫描中替换。结果只用来编译一次，分配在上下文的临时分配器里，
+// 由调用者在编译后 scratch_release
+static char* patch_fragouts(const GLchar* source, GLchar* const* colorbindings) {
+    char src_strings[MAX_DRAWBUFFERS][256];
+    char dst_strings[MAX_DRAWBUFFERS][32];
+    gl4es_replacement_t replacements[MAX_DRAWBUFFERS];
+    int count = 0;
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        const char* colorbind = colorbindings[i];
         if(colorbind == NULL) continue;
-        insert_fragout_pos(new_source, &nsrc_size, colorbind, i);
-        changesMade = true;
+        snprintf(src_strings[count], sizeof(src_strings[count]), "/* LTW INSERT LOCATION %s LTW */", colorbind);
+        snprintf(dst_strings[count], sizeof(dst_strings[count]), "layout(location = %u) ", i);
+        replacements[count].from = src_strings[count];
+        replacements[count].to = dst_strings[count];
+        count++;
     }
-    if(!changesMade) {
-        free(new_source);
-        goto fallthrough;
-    }else {
-        //printf("\n\n\nShader Result POST PATCH\n%s\n\n\n", new_source);
+    if(count == 0) return NULL;
+
+    // 替换文本总比插入标记短，结果不会比原文长
+    int capacity = (int)(strlen(source) + 1);
+    char* new_source = scratch_alloc(&current_context->scratch, capacity);
+    if(new_source == NULL) return NULL;
+    gl4es_replacer_t* replacer = gl4es_replacer_create(replacements, count);
+    int length = replacer != NULL ? gl4es_replacer_apply_into(replacer, source, new_source, capacity) : -1;
+    gl4es_replacer_destroy(replacer);
+    if(length < 0) {
+        LTW_ERROR_PRINTF("LTWShdrWp: gl4es_replacer_apply_into failed in patch_fragouts");
+        return NULL;
     }
-    const GLchar* const_source = (const GLchar*)new_source;
-    GLuint patched_shader = es3_functions.glCreateShader(GL_FRAGMENT_SHADER);
-    if(patched_shader == 0) {
-        free(new_source);
-        LTW_ERROR_PRINTF("LTWShdrWp: failed to initialize patched shader");
-        goto fallthrough;
+    return new_source;
+}
+
+// 直接交给驱动编译已翻译的源码，失败时打印日志并返回 0
+static GLuint compile_translated(GLenum type, const GLchar* source, const char* what) {
+    GLuint shader = es3_functions.glCreateShader(type);
+    if(shader == 0) {
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to initialize %s", what);
+        return 0;
     }
-    es3_functions.glShaderSource(patched_shader, 1, &const_source, NULL);
-    es3_functions.glCompileShader(patched_shader);
-    free(new_source);
+    es3_functions.glShaderSource(shader, 1, &source, NULL);
+    es3_functions.glCompileShader(shader);
     GLint compileStatus;
-    es3_functions.glGetShaderiv(patched_shader, GL_COMPILE_STATUS, &compileStatus);
+    es3_functions.glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
     if(compileStatus != GL_TRUE) {
         GLint logSize;
-        es3_functions.glGetShaderiv(patched_shader, GL_INFO_LOG_LENGTH, &logSize);
-        GLchar log[logSize];
-        es3_functions.glGetShaderInfoLog(patched_shader, logSize, NULL, log);
-        LTW_ERROR_PRINTF("LTWShdrWp: failed to compile patched fragment shader, using default. Log:\n\n%s\n\nShader content:\n\n%s\n\n", log, const_source);
+        es3_functions.glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
+        GLchar log[logSize > 0 ? logSize : 1];
+        log[0] = 0;
+        es3_functions.glGetShaderInfoLog(shader, logSize, NULL, log);
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to compile %s. Log:\n\n%s\n\nShader content:\n\n%s\n\n", what, log, source);
+        es3_functions.glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static GLuint compile_patched_frag(const GLchar* source, program_info_t* program_info) {
+    scratch_mark_t mark = scratch_mark(&current_context->scratch);
+    char* new_source = patch_fragouts(source, program_info->colorbindings);
+    GLuint patched_shader = 0;
+    if(new_source != NULL) patched_shader = compile_translated(GL_FRAGMENT_SHADER, new_source, "patched fragment shader, using default");
+    scratch_release(&current_context->scratch, mark);
+    return patched_shader;
+}
+
+static void link_program_with_fragouts(GLuint program, program_info_t* program_info) {
+    if(program_info == NULL || program_info->frag_shader == 0) {
+        // Don't have any fragment shader to patch the locations in, fall through.
         goto fallthrough;
     }
+    shader_info_t *shader = unordered_map_get(current_context->shader_map, (void*)program_info->frag_shader);
+    if(shader == NULL || shader->source == NULL) {
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to patch frag data location due to missing shader info");
+        goto fallthrough;
+    }
+    bool has_colorbindings = false;
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        if(program_info->colorbindings[i] != NULL) has_colorbindings = true;
+    }
+    if(!has_colorbindings) goto fallthrough;
+
+    // 同一片段着色器配同一组颜色绑定只编译一次
+    uint64_t source_hash = shader_source_hash(shader->source);
+    GLuint patched_shader = find_patched_frag(shader->source, source_hash, program_info);
+    if(patched_shader == 0) {
+        patched_shader = compile_patched_frag(shader->source, program_info);
+        if(patched_shader == 0) goto fallthrough;
+        store_patched_frag(shader->source, source_hash, program_info, patched_shader);
+    }
     es3_functions.glDetachShader(program, program_info->frag_shader);
     es3_functions.glAttachShader(program, patched_shader);
     es3_functions.glLinkProgram(program);
-    es3_functions.glDeleteShader(patched_shader);
+    // 链接结果不受分离影响；恢复应用附加的着色器，重新链接时才能再次替换
+    es3_functions.glDetachShader(program, patched_shader);
+    es3_functions.glAttachShader(program, program_info->frag_shader);
     return;
     fallthrough:
     es3_functions.glLinkProgram(program);
 }
 
+// 分级编译（LTW_TIERED_SHADERS=1）：glShaderSource 未命中缓存时只做第 0 级快速翻译，程序立即可以链接；
+// 链接后在工作线程上生成优化版本，下次 glUseProgram 时用它重新链接同一个程序对象，并恢复 uniform 状态。
+// 跨阶段优化（LTW_CROSS_STAGE=1）：顶点+片段程序链接后把两个阶段一起重新翻译，删除片段着色器不读的
+// varying 和只为它们服务的顶点代码，同样在 glUseProgram 时换入。
+// uniform 特化（LTW_SPECIALIZE_UNIFORMS=1）也是一次带常量的跨阶段翻译，见 program_specialization.h。
+static pthread_once_t upgrade_once = PTHREAD_ONCE_INIT;
+static bool tiered_enabled = false;
+static bool cross_stage_enabled = false;
+static bool keep_original_sources = false;
+
+static void upgrade_init(void) {
+    tiered_enabled = env_istrue("LTW_TIERED_SHADERS");
+    cross_stage_enabled = env_istrue("LTW_CROSS_STAGE");
+    keep_original_sources = cross_stage_enabled || program_specialization_enabled();
+}
+
+typedef struct {
+    GLenum type;
+    GLchar* tier0_source;               // 共享的第 0 级结果，换入失败时用来恢复
+    shader_translation_t* translation;  // 后台的优化翻译，着色器本来就是优化版本时为 NULL
+    GLchar* optimized;                  // 共享的优化结果
+} upgrade_stage_t;
+
+typedef struct program_upgrade {
+    upgrade_stage_t stages[MAX_ATTACHED_SHADERS];
+    int nstages;
+    program_translation_t* cross_stage;  // 跨阶段翻译，结果写入 stages[0]（顶点）和 stages[1]（片段）
+    struct optimize_shader_constant* constants; // uniform 特化：编译成常量的 uniform，否则为 NULL
+    int nconstants;
+    bool has_program_key;
+    uint8_t program_key[SHADER_DISK_CACHE_KEY_SIZE];
+} program_upgrade_t;
+
+static void free_program_upgrade(program_upgrade_t* upgrade) {
+    if(upgrade->cross_stage != NULL) program_translation_finish(upgrade->cross_stage, NULL, NULL);
+    for(int i = 0; i < upgrade->nstages; i++) {
+        upgrade_stage_t* stage = &upgrade->stages[i];
+        if(stage->translation != NULL) shader_source_release(shader_translation_finish(stage->translation, NULL, NULL));
+        shader_source_release(stage->tier0_source);
+        shader_source_release(stage->optimized);
+    }
+    free(upgrade->constants);
+    free(upgrade);
+}
+
+static void cancel_program_upgrade(program_info_t* program_info) {
+    if(program_info->upgrade == NULL) return;
+    free_program_upgrade(program_info->upgrade);
+    program_info->upgrade = NULL;
+    current_context->pending_program_upgrades--;
+}
+
+static void reset_specialization(program_info_t* program_info) {
+    if(program_info->specialization == NULL) return;
+    if(current_context->current_specialization == program_info->specialization) current_context->current_specialization = NULL;
+    program_specialization_free(program_info->specialization);
+    program_info->specialization = NULL;
+}
+
+// 只有一个顶点着色器和一个片段着色器、且两者的原始源码都在时才能做跨阶段翻译
+static bool start_cross_stage(program_info_t* program_info, program_upgrade_t* upgrade) {
+    shader_info_t* infos[2] = { NULL, NULL };
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == 0) continue;
+        shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]);
+        if(shader_info == NULL || shader_info->source == NULL || shader_info->original_source == NULL) return false;
+        int slot = shader_info->shader_type == GL_VERTEX_SHADER ? 0 : shader_info->shader_type == GL_FRAGMENT_SHADER ? 1 : -1;
+        if(slot < 0 || infos[slot] != NULL) return false;
+        infos[slot] = shader_info;
+    }
+    if(infos[0] == NULL || infos[1] == NULL) return false;
+    char* vertex_source = strdup(infos[0]->original_source);
+    char* fragment_source = strdup(infos[1]->original_source);
+    if(vertex_source == NULL || fragment_source == NULL) {
+        free(vertex_source);
+        free(fragment_source);
+        return false;
+    }
+    upgrade->cross_stage = program_translation_start(vertex_source, fragment_source, 460, current_context->shader_version,
+                                                     infos[0]->source_key, infos[1]->source_key,
+                                                     upgrade->constants, upgrade->nconstants);
+    if(upgrade->cross_stage == NULL) return false;
+    for(int i = 0; i < 2; i++) {
+        upgrade_stage_t* stage = &upgrade->stages[upgrade->nstages++];
+        stage->type = infos[i]->shader_type;
+        stage->tier0_source = shader_source_acquire(infos[i]->source);
+    }
+    return true;
+}
+
+// 为第 0 级着色器启动优化翻译，本来就是优化版本的着色器原样保留
+static bool start_tier_upgrade(program_info_t* program_info, program_upgrade_t* upgrade) {
+    bool has_tier0 = false;
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == 0) continue;
+        shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]);
+        if(shader_info == NULL || shader_info->source == NULL) return false;
+        upgrade_stage_t* stage = &upgrade->stages[upgrade->nstages++];
+        stage->type = shader_info->shader_type;
+        stage->tier0_source = shader_source_acquire(shader_info->source);
+        if(!shader_info->tier0) {
+            stage->optimized = shader_source_acquire(shader_info->source);
+            continue;
+        }
+        char* original = strdup(shader_info->original_source);
+        if(original == NULL) return false;
+        stage->translation = shader_translation_start(original, shader_info->shader_type,
+                                                      460, current_context->shader_version,
+                                                      shader_info->source_key, 0);
+        has_tier0 = true;
+    }
+    return has_tier0;
+}
+
+// 程序刚链接成功时启动后台翻译，结果在 program_upgrade_if_ready 中换入
+static bool start_program_upgrade(GLuint program, program_info_t* program_info, bool has_program_key,
+                                  const uint8_t program_key[SHADER_DISK_CACHE_KEY_SIZE]) {
+    // transform feedback 等链接状态无法在重新链接时还原，被捕获的 varying 也不能删除
+    if(!(tiered_enabled || cross_stage_enabled) || program_info->binary_uncacheable) return false;
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE) return false;
+
+    program_upgrade_t* upgrade = calloc(1, sizeof(program_upgrade_t));
+    if(upgrade == NULL) return false;
+    // 跨阶段翻译的结果是完整优化过的，第 0 级着色器也一并被替换
+    bool started = cross_stage_enabled && start_cross_stage(program_info, upgrade);
+    if(!started && tiered_enabled) started = start_tier_upgrade(program_info, upgrade);
+    if(!started) {
+        free_program_upgrade(upgrade);
+        return false;
+    }
+    upgrade->has_program_key = has_program_key;
+    if(has_program_key) memcpy(upgrade->program_key, program_key, SHADER_DISK_CACHE_KEY_SIZE);
+    program_info->upgrade = upgrade;
+    current_context->pending_program_upgrades++;
+    return true;
+}
+
+static bool compile_upgrade_stages(program_info_t* program_info, program_upgrade_t* upgrade, bool optimized,
+                                   GLuint shaders[MAX_ATTACHED_SHADERS]) {
+    for(int i = 0; i < upgrade->nstages; i++) {
+        const upgrade_stage_t* stage = &upgrade->stages[i];
+        const GLchar* source = optimized ? stage->optimized : stage->tier0_source;
+        scratch_mark_t mark = scratch_mark(&current_context->scratch);
+        char* patched = stage->type == GL_FRAGMENT_SHADER ? patch_fragouts(source, program_info->colorbindings) : NULL;
+        shaders[i] = compile_translated(stage->type, patched != NULL ? patched : source,
+                                        optimized ? "optimized shader" : "fast shader");
+        scratch_release(&current_context->scratch, mark);
+        if(shaders[i] != 0) continue;
+        for(int j = 0; j < i; j++) es3_functions.glDeleteShader(shaders[j]);
+        return false;
+    }
+    return true;
+}
+
+// 用临时着色器重新链接 program，之后恢复应用附加的着色器并删除临时着色器
+static bool relink_with_shaders(GLuint program, program_info_t* program_info, const GLuint* shaders, int nshaders,
+                                const program_state_t* state) {
+    GLuint attached[MAX_ATTACHED_SHADERS];
+    GLsizei nattached = 0;
+    es3_functions.glGetAttachedShaders(program, MAX_ATTACHED_SHADERS, &nattached, attached);
+    for(GLsizei i = 0; i < nattached; i++) es3_functions.glDetachShader(program, attached[i]);
+    for(int i = 0; i < nshaders; i++) es3_functions.glAttachShader(program, shaders[i]);
+    program_state_bind_attribs(state, program);
+    es3_functions.glLinkProgram(program);
+    for(int i = 0; i < nshaders; i++) {
+        es3_functions.glDetachShader(program, shaders[i]);
+        es3_functions.glDeleteShader(shaders[i]);
+    }
+    for(GLsizei i = 0; i < nattached; i++) {
+        if(es3_functions.glIsShader(attached[i])) {
+            es3_functions.glAttachShader(program, attached[i]);
+            continue;
+        }
+        // 应用已标记删除的着色器在分离时被驱动删除了
+        for(GLint j = 0; j < MAX_ATTACHED_SHADERS; j++) {
+            if(program_info->shaders[j] == attached[i]) program_info->shaders[j] = 0;
+        }
+        if(program_info->frag_shader == attached[i]) program_info->frag_shader = 0;
+    }
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    return link_status == GL_TRUE;
+}
+
+static bool swap_in_optimized(GLuint program, program_info_t* program_info, program_upgrade_t* upgrade) {
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE) return false;
+    GLuint shaders[MAX_ATTACHED_SHADERS];
+    // 编译失败时程序对象还没有被改动，保持第 0 级版本即可
+    if(!compile_upgrade_stages(program_info, upgrade, true, shaders)) return false;
+    program_state_t* original = program_state_capture(program, true);
+    if(original == NULL) {
+        for(int i = 0; i < upgrade->nstages; i++) es3_functions.glDeleteShader(shaders[i]);
+        return false;
+    }
+
+    program_state_t* relinked = NULL;
+    bool upgraded = relink_with_shaders(program, program_info, shaders, upgrade->nstages, original);
+    if(upgraded) {
+        relinked = program_state_capture(program, false);
+        upgraded = relinked != NULL && program_state_compatible(original, relinked);
+    }
+    if(!upgraded) {
+        // 应用可能已经缓存了 uniform 位置，位置变了就只能换回第 0 级版本
+        LTW_DEBUG_PRINTF("LTWShdrWp: optimized program %u changed its interface, keeping the fast translation", program);
+        program_state_free(relinked);
+        relinked = NULL;
+        if(compile_upgrade_stages(program_info, upgrade, false, shaders) &&
+           relink_with_shaders(program, program_info, shaders, upgrade->nstages, original)) {
+            relinked = program_state_capture(program, false);
+        }
+    }
+    if(relinked != NULL) {
+        es3_functions.glUseProgram(program);
+        program_state_restore(original, relinked, program);
+    } else {
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to relink program %u after an unsuccessful upgrade", program);
+    }
+    program_state_free(original);
+    program_state_free(relinked);
+    if(upgraded && upgrade->has_program_key) store_program_binary(program, program_info, upgrade->program_key);
+    return upgraded;
+}
+
+void program_upgrade_if_ready(GLuint program) {
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info == NULL || program_info->upgrade == NULL) return;
+    program_upgrade_t* upgrade = program_info->upgrade;
+    if(!program_translation_done(upgrade->cross_stage)) return;
+    for(int i = 0; i < upgrade->nstages; i++) {
+        if(!shader_translation_done(upgrade->stages[i].translation)) return;
+    }
+    program_info->upgrade = NULL;
+    current_context->pending_program_upgrades--;
+
+    bool translated = true;
+    if(upgrade->cross_stage != NULL) {
+        translated = program_translation_finish(upgrade->cross_stage, &upgrade->stages[0].optimized,
+                                                &upgrade->stages[1].optimized);
+        upgrade->cross_stage = NULL;
+    }
+    for(int i = 0; i < upgrade->nstages; i++) {
+        upgrade_stage_t* stage = &upgrade->stages[i];
+        if(stage->translation == NULL) continue;
+        stage->optimized = shader_translation_finish(stage->translation, NULL, NULL);
+        stage->translation = NULL;
+        if(stage->optimized == NULL) translated = false;
+    }
+    program_specialization_t* specialization = upgrade->constants != NULL ? program_info->specialization : NULL;
+    // 翻译期间应用改写了某个常量：结果已经过时，等值重新稳定后再试
+    if(specialization != NULL && translated &&
+       !program_specialization_still_valid(specialization, upgrade->constants, upgrade->nconstants)) {
+        program_specialization_abandon(specialization, true);
+        free_program_upgrade(upgrade);
+        return;
+    }
+    // 没有可删除的 varying 时跨阶段翻译和当前版本完全相同，不必重新链接
+    bool changed = false;
+    for(int i = 0; translated && i < upgrade->nstages; i++) {
+        if(strcmp(upgrade->stages[i].optimized, upgrade->stages[i].tier0_source) != 0) changed = true;
+    }
+    if(translated && !changed && upgrade->has_program_key) store_program_binary(program, program_info, upgrade->program_key);
+    bool upgraded = translated && changed && swap_in_optimized(program, program_info, upgrade);
+    if(upgraded) {
+        LTW_DEBUG_PRINTF("LTWShdrWp: program %u upgraded to %s shaders", program,
+                         specialization != NULL ? "specialized" : "optimized");
+    }
+    if(specialization != NULL) {
+        if(upgraded) program_specialization_activate(specialization);
+        else program_specialization_abandon(specialization, false);
+    }
+    free_program_upgrade(upgrade);
+}
+
+// 释放 program_info 持有的资源（调用者先处理上下文中对它的计数和引用）
+static void release_program_info(program_info_t* program_info) {
+    if(program_info->upgrade != NULL) free_program_upgrade(program_info->upgrade);
+    program_info->upgrade = NULL;
+    program_specialization_free(program_info->specialization);
+    program_info->specialization = NULL;
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        free(program_info->colorbindings[i]);
+        program_info->colorbindings[i] = NULL;
+    }
+    for(GLuint i = 0; i < MAX_BOUND_ATTRIBS; i++) {
+        free(program_info->attribbindings[i]);
+        program_info->attribbindings[i] = NULL;
+    }
+}
+
+// 在后台生成把稳定 uniform 编译成常量的特化版本。特化版本不写入程序二进制缓存：
+// 缓存键只描述通用版本
+static void start_specialization(program_info_t* program_info) {
+    program_specialization_t* specialization = program_info->specialization;
+    program_upgrade_t* upgrade = calloc(1, sizeof(program_upgrade_t));
+    if(upgrade != NULL) upgrade->nconstants = program_specialization_constants(specialization, &upgrade->constants);
+    if(upgrade == NULL || upgrade->nconstants == 0 || !start_cross_stage(program_info, upgrade)) {
+        if(upgrade != NULL) free_program_upgrade(upgrade);
+        program_specialization_abandon(specialization, false);
+        return;
+    }
+    program_info->upgrade = upgrade;
+    current_context->pending_program_upgrades++;
+}
+
+void program_specialization_bind(GLuint program) {
+    if(!keep_original_sources) {
+        current_context->current_specialization = NULL;
+        return;
+    }
+    program_info_t* program_info = program != 0 ? unordered_map_get(current_context->program_map, (void*)program) : NULL;
+    program_specialization_t* specialization = program_info != NULL ? program_info->specialization : NULL;
+    current_context->current_specialization = specialization;
+    // 等待中的分级/跨阶段升级先完成，特化在最终的通用版本上进行
+    if(specialization == NULL || program_info->upgrade != NULL) return;
+    if(program_specialization_note_use(specialization)) start_specialization(program_info);
+}
+
+INTERNAL bool program_relink_generic(GLuint program) {
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    if(program_info == NULL || program_info->specialization == NULL) return false;
+    // 应用可能已经删除了着色器，用特化开始跟踪时记录的通用版本
+    const program_generic_t* generic = program_specialization_generic(program_info->specialization);
+    GLuint shaders[MAX_ATTACHED_SHADERS];
+    int nshaders = 0;
+    for(int i = 0; i < generic->nstages; i++) {
+        scratch_mark_t mark = scratch_mark(&current_context->scratch);
+        char* patched = generic->types[i] == GL_FRAGMENT_SHADER ? patch_fragouts(generic->sources[i], generic->colorbindings) : NULL;
+        shaders[nshaders] = compile_translated(generic->types[i], patched != NULL ? patched : generic->sources[i],
+                                               "generic shader");
+        scratch_release(&current_context->scratch, mark);
+        if(shaders[nshaders] == 0) goto fail;
+        nshaders++;
+    }
+    program_state_t* original = program_state_capture(program, true);
+    if(original == NULL) goto fail;
+    program_state_t* relinked = NULL;
+    if(relink_with_shaders(program, program_info, shaders, nshaders, original)) relinked = program_state_capture(program, false);
+    bool compatible = relinked != NULL &&
+                      program_state_compatible(program_specialization_layout(program_info->specialization), relinked);
+    if(relinked != NULL) {
+        es3_functions.glUseProgram(program);
+        program_state_restore(original, relinked, program);
+    }
+    program_state_free(original);
+    program_state_free(relinked);
+    // 通用版本用的是链接时的翻译，分级/跨阶段优化需要重新进行（应用已删除着色器时无法进行）
+    if(compatible) {
+        uint8_t program_key[SHADER_DISK_CACHE_KEY_SIZE];
+        bool has_program_key = compute_program_key(program_info, program_key);
+        start_program_upgrade(program, program_info, has_program_key, program_key);
+    }
+    return compatible;
+
+    fail:
+    for(int i = 0; i < nshaders; i++) es3_functions.glDeleteShader(shaders[i]);
+    return false;
+}
+
+// 记录通用版本的着色器，之后换回通用版本时不再需要应用的着色器对象
+static bool keep_generic_stages(program_info_t* program_info, program_generic_t* generic) {
+    for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+        if(program_info->shaders[i] == 0) continue;
+        shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]);
+        // 命中程序二进制缓存时翻译可能还没有取回
+        join_translation(program_info->shaders[i], shader_info);
+        if(shader_info == NULL || shader_info->source == NULL) return false;
+        generic->types[generic->nstages] = shader_info->shader_type;
+        generic->sources[generic->nstages++] = shader_source_acquire(shader_info->source);
+    }
+    for(GLuint i = 0; i < MAX_DRAWBUFFERS; i++) {
+        if(program_info->colorbindings[i] == NULL) continue;
+        generic->colorbindings[i] = strdup(program_info->colorbindings[i]);
+        if(generic->colorbindings[i] == NULL) return false;
+    }
+    return generic->nstages > 0;
+}
+
+// 链接成功后重新开始跟踪 uniform 值
+static void attach_specialization(GLuint program, program_info_t* program_info) {
+    reset_specialization(program_info);
+    if(!keep_original_sources || program_info->binary_uncacheable) return;
+    GLint link_status = GL_FALSE;
+    es3_functions.glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if(link_status != GL_TRUE) return;
+    program_specialization_t* specialization = program_specialization_create(program);
+    if(specialization != NULL && !keep_generic_stages(program_info, program_specialization_generic(specialization))) {
+        // 没有通用版本就无法在常量改变时换回，不做特化
+        program_specialization_free(specialization);
+        specialization = NULL;
+    }
+    program_info->specialization = specialization;
+    if(current_context->program == program) current_context->current_specialization = program_info->specialization;
+}
+
+void glLinkProgram(GLuint program) {
+    if(!current_context) return;
+    pthread_once(&program_cache_once, program_cache_init);
+    pthread_once(&upgrade_once, upgrade_init);
+    program_info_t* program_info = unordered_map_get(current_context->program_map, (void*)program);
+    // 重新链接后之前等待的优化版本已经过时
+    if(program_info != NULL) cancel_program_upgrade(program_info);
+    uint8_t program_key[SHADER_DISK_CACHE_KEY_SIZE];
+    bool cacheable = program_info != NULL && compute_program_key(program_info, program_key);
+    if(cacheable && load_program_binary(program, program_key)) {
+        attach_specialization(program, program_info);
+        return;
+    }
+    if(program_info != NULL) {
+        for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+            if(program_info->shaders[i] == 0) continue;
+            compile_if_pending(program_info->shaders[i], unordered_map_get(current_context->shader_map, (void*)program_info->shaders[i]));
+        }
+    }
+    // 取回的翻译可能失败了，这时程序不能写入缓存
+    if(cacheable) cacheable = compute_program_key(program_info, program_key);
+    if(cacheable) es3_functions.glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    link_program_with_fragouts(program, program_info);
+    // 第 0 级的程序不存二进制，否则下次启动会一直命中未优化的版本；换入优化版本后再存
+    bool upgrading = program_info != NULL && start_program_upgrade(program, program_info, cacheable, program_key);
+    if(cacheable && !upgrading) store_program_binary(program, program_info, program_key);
+    if(program_info != NULL) attach_specialization(program, program_info);
+}
+
 GLuint glCreateShader(GLenum shaderType) {
     if(!current_context) return 0;
     GLuint phys_shader = es3_functions.glCreateShader(shaderType);
@@ -297,13 +936,51 @@ GLuint glCreateShader(GLenum shaderType) {
     return phys_shader;
 }
 
+// 释放 shader_info 持有的资源，未取回的翻译等它完成后丢弃
+static void release_shader_info(shader_info_t* shader_info) {
+    if(shader_info->pending_translation != NULL) {
+        shader_source_release(shader_translation_finish(shader_info->pending_translation, NULL, NULL));
+        shader_info->pending_translation = NULL;
+    }
+    shader_source_release(shader_info->source);
+    shader_info->source = NULL;
+    free(shader_info->original_source);
+    shader_info->original_source = NULL;
+}
+
+// 着色器是否还附加在某个程序上
+static bool shader_attached(GLuint shader) {
+    unordered_map_iterator iterator;
+    if(!unordered_map_iterator_alloc_local(current_context->program_map, &iterator)) return true;
+    void* key;
+    void* value;
+    while(unordered_map_iterator_next(&iterator, &key, &value)) {
+        const program_info_t* program_info = value;
+        for(GLint i = 0; i < MAX_ATTACHED_SHADERS; i++) {
+            if(program_info->shaders[i] == shader) return true;
+        }
+    }
+    return false;
+}
+
+// 已删除的着色器不再附加在任何程序上时，驱动也删除了它，这时才释放跟踪状态
+static void release_deleted_shader(GLuint shader) {
+    shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)shader);
+    if(shader_info == NULL || !shader_info->delete_pending || shader_attached(shader)) return;
+    unordered_map_remove(current_context->shader_map, (void*)shader);
+    release_shader_info(shader_info);
+    mempool_free(current_context->shader_info_pool, shader_info);
+}
+
 void glDeleteShader(GLuint shader) {
     if(!current_context) return;
     es3_functions.glDeleteShader(shader);
-    shader_info_t * old_shaderinfo = unordered_map_remove(current_context->shader_map, (void*)shader);
-    if(old_shaderinfo == NULL) return;
-    if(old_shaderinfo->source != NULL) free((void*)old_shaderinfo->source);
-    mempool_free(current_context->shader_info_pool, old_shaderinfo);
+    shader_info_t* shader_info = unordered_map_get(current_context->shader_map, (void*)shader);
+    if(shader_info == NULL) return;
+    // 附加在程序上的着色器由驱动保留到分离为止，程序还可以重新链接：推迟的编译和翻译都要留着，
+    // 到 glDetachShader 或 glDeleteProgram 时再释放。常见的链接后删除的顺序仍然可以跳过编译
+    shader_info->delete_pending = true;
+    release_deleted_shader(shader);
 }
 
 void glShaderSource(GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length) {
@@ -314,51 +991,95 @@ void glShaderSource(GLuint shader, GLsizei count, const GLchar *const*string, co
         es3_functions.glShaderSource(shader, count, string, length);
         return;
     }
+    // 被推迟的编译必须使用旧的源码，未取回的翻译也要先完成
+    compile_if_pending(shader, shader_info);
 
+    // 每个片段只计算一次长度，命中时直接对片段做哈希，不拼接也不复制。
+    // 长度数组和规范化的键只在本次调用内使用，放在上下文的临时分配器里
+    scratch_arena_t* scratch = &current_context->scratch;
+    scratch_mark_t mark = scratch_mark(scratch);
+    size_t stack_lengths[16];
+    size_t* heap_lengths = NULL;
+    size_t* fragment_lengths = count > 16 ? scratch_alloc(scratch, count * sizeof(size_t)) : stack_lengths;
+    if(fragment_lengths == NULL) fragment_lengths = heap_lengths = malloc(count * sizeof(size_t));
+    if(fragment_lengths == NULL) {
+        LTW_ERROR_PRINTF("LTWShdrWp: failed to allocate fragment lengths for shader %u", shader);
+        scratch_release(scratch, mark);
+        reject_source(shader, shader_info);
+        return;
+    }
     size_t target_length = 0;
-#define SRC_LEN(x) length != NULL ? length[x] : strlen(string[x])
-    for(GLsizei i = 0; i < count; i++) target_length += SRC_LEN(i);
-    GLchar* target_string = malloc((target_length + 1) * sizeof(GLchar));
-    size_t offset = 0;
     for(GLsizei i = 0; i < count; i++) {
-        memcpy(&target_string[offset], string[i], SRC_LEN(i));
-        offset += SRC_LEN(i);
+        fragment_lengths[i] = (length != NULL && length[i] >= 0) ? (size_t)length[i] : strlen(string[i]);
+        target_length += fragment_lengths[i];
     }
-    target_string[target_length] = 0;
-
-#undef SRC_LEN
 
-    size_t source_hash = hash_string(target_string);
-    GLchar* cached_source = get_cached_shader(source_hash, shader_info->shader_type);
-
-    if (cached_source != NULL) {
-        if(shader_info->source != NULL) free((void*)shader_info->source);
-        char* new_source = strdup(cached_source);
-        if(!new_source) {
-            LTW_ERROR_PRINTF("LTWShdrWp: failed to duplicate cached shader source");
-            free(target_string);
-            return;
+    // 两级缓存的键都用规范化后的源码：只差注释、空白或 #line 的着色器共用同一份翻译
+    size_t key_length = 0;
+    char* key = NULL;
+    if(shader_normalize_enabled()) {
+        key = scratch_alloc(scratch, target_length + 1);
+        char* joined = count != 1 ? scratch_alloc(scratch, target_length + 1) : NULL;
+        if(key != NULL && (count == 1 || joined != NULL)) {
+            key_length = shader_normalize_source_into(count, string, fragment_lengths, key, joined);
+        } else {
+            key = NULL;
         }
-        shader_info->source = new_source;
-        es3_functions.glShaderSource(shader, 1, &shader_info->source, 0);
-        free(target_string);
-
-        #ifdef SHADER_CACHE_STATS
-        // 每100次编译后打印统计信息
-        static int compile_count = 0;
-        if (++compile_count % 100 == 0) {
-            print_cache_stats();
+    }
+    size_t key_count = key != NULL ? 1 : (size_t)count;
+    const char* const* key_strings = key != NULL ? (const char* const*)&key : string;
+    const size_t* key_lengths = key != NULL ? &key_length : fragment_lengths;
+    shader_disk_cache_source_key(key_count, key_strings, key_lengths, shader_info->shader_type,
+                                 460, current_context->shader_version, shader_info->source_key);
+    shader_info->has_source_key = true;
+    GLchar* cached_source = shader_cache_get(key_count, key_strings, key_lengths, shader_info->shader_type,
+                                             460, current_context->shader_version);
+    pthread_once(&upgrade_once, upgrade_init);
+
+    // 翻译器需要连续的源码，只有未命中（或跨阶段优化、uniform 特化要保留原始源码）时才拼接。
+    // 拼接结果交给工作线程或保留为原始源码，活得比本次调用久，所以仍在堆上分配
+    GLchar* target_string = NULL;
+    if(cached_source == NULL || keep_original_sources) {
+        target_string = malloc((target_length + 1) * sizeof(GLchar));
+        size_t offset = 0;
+        for(GLsizei i = 0; i < count; i++) {
+            memcpy(&target_string[offset], string[i], fragment_lengths[i]);
+            offset += fragment_lengths[i];
         }
-        #endif
+        target_string[target_length] = 0;
+    }
+    scratch_release(scratch, mark);
+    free(heap_lengths);
 
+    if (cached_source != NULL) {
+        shader_source_release(shader_info->source);
+        shader_info->source = cached_source;
+        free(shader_info->original_source);
+        shader_info->original_source = target_string;
+        shader_info->tier0 = false;
+        es3_functions.glShaderSource(shader, 1, (const GLchar* const*)&shader_info->source, 0);
         return;
     }
 
-    GLchar* new_source = optimize_shader(target_string, shader_info->shader_type, 460, current_context->shader_version);
-    cache_shader(source_hash, shader_info->shader_type, new_source);
-    //printf("\n\n\nShader Result\n%s\n\n\n", new_source);
-    if(shader_info->source != NULL) free((void*)shader_info->source);
-    shader_info->source = new_source;
-    es3_functions.glShaderSource(shader, 1, &shader_info->source, 0);
-    free(target_string);
+    // 内存缓存未命中：在工作线程上查磁盘缓存/翻译，直到编译、查询或链接时才取回结果
+    int flags = (tiered_enabled ? SHADER_TRANSLATION_FAST : 0) | (keep_original_sources ? SHADER_TRANSLATION_KEEP_SOURCE : 0);
+    shader_info->pending_translation = shader_translation_start(target_string, shader_info->shader_type,
+                                                                460, current_context->shader_version,
+                                                                shader_info->source_key, flags);
+}
+
+// 上下文销毁时释放着色器和程序信息持有的资源：共享的翻译结果（它们同时占住缓存条目）、原始源码、
+// 工作线程上的翻译任务、后台升级和特化状态。驱动对象随上下文一起销毁，这里不调用 GL
+void free_shader_objects(context_t* context) {
+    unordered_map_iterator iterator;
+    void* key;
+    void* value;
+    if(unordered_map_iterator_alloc_local(context->shader_map, &iterator)) {
+        while(unordered_map_iterator_next(&iterator, &key, &value)) release_shader_info(value);
+    }
+    if(unordered_map_iterator_alloc_local(context->program_map, &iterator)) {
+        while(unordered_map_iterator_next(&iterator, &key, &value)) release_program_info(value);
+    }
+    context->pending_program_upgrades = 0;
+    context->current_specialization = NULL;
 }
@@ -0,0 +1,197 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "state_shadow.h"
+#include "egl.h"
+#include "main.h"
+#include "env.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+static pthread_once_t check_once = PTHREAD_ONCE_INIT;
+static bool check_enabled = false;
+
+static void check_init(void) {
+    check_enabled = env_istrue("LTW_CHECK_STATE_SHADOW");
+    if(check_enabled) LTW_ERROR_PRINTF("LTW will cross-check its binding state shadow against the driver.");
+}
+
+// 交叉检查：向驱动查询同一个值，不一致时报告并以驱动为准
+static GLint check_integer(GLenum pname, GLint shadow_value) {
+    pthread_once(&check_once, check_init);
+    if(!check_enabled) return shadow_value;
+    GLint actual = 0;
+    es3_functions.glGetIntegerv(pname, &actual);
+    if(actual != shadow_value) {
+        LTW_ERROR_PRINTF("LTW: state shadow mismatch for 0x%x: shadow %d, driver %d", pname, shadow_value, actual);
+    }
+    return actual;
+}
+
+INTERNAL int get_texture_target_index(GLenum target) {
+    switch (target) {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_3D: return 1;
+        case GL_TEXTURE_2D_ARRAY: return 2;
+        case GL_TEXTURE_CUBE_MAP:
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+        case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+        case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z: return 3;
+        case GL_TEXTURE_CUBE_MAP_ARRAY: return 4;
+        case GL_TEXTURE_2D_MULTISAMPLE: return 5;
+        case GL_TEXTURE_2D_MULTISAMPLE_ARRAY: return 6;
+        case GL_TEXTURE_BUFFER: return 7;
+        default: return -1;
+    }
+}
+
+INTERNAL GLuint shadow_get_texture(GLenum target) {
+    GLenum getter = get_textarget_query_param(target);
+    if(getter == 0) return 0;
+    int index = get_texture_target_index(target);
+    if(index == -1 || current_context->active_texture >= MAX_TMUS) {
+        GLint texture = 0;
+        current_context->fast_gl.glGetIntegerv(getter, &texture);
+        return texture;
+    }
+    return check_integer(getter, (GLint)current_context->bound_textures[current_context->active_texture][index]);
+}
+
+INTERNAL GLuint shadow_get_element_buffer(void) {
+    return check_integer(GL_ELEMENT_ARRAY_BUFFER_BINDING, (GLint)current_context->element_buffer);
+}
+
+static bool get_bound_buffer(GLenum target, GLuint* buffer) {
+    if(target == GL_ELEMENT_ARRAY_BUFFER) {
+        *buffer = current_context->element_buffer;
+        return true;
+    }
+    int buffer_index = get_buffer_index(target);
+    if(buffer_index == -1) return false;
+    *buffer = current_context->bound_buffers[buffer_index];
+    return true;
+}
+
+// 缓冲区的存储在共享组内共享，大小记录在共享组里（别的上下文重新指定时同样更新）。
+// buffer_sizes 里存的是大小 + 1，这样大小为 0 的缓冲区也能和"未知"区分开
+static uintptr_t get_stored_size(GLuint buffer) {
+    share_group_t* share_group = current_context->share_group;
+    pthread_mutex_lock(&share_group->lock);
+    uintptr_t stored = (uintptr_t)unordered_map_get(share_group->buffer_sizes, (void*)buffer);
+    pthread_mutex_unlock(&share_group->lock);
+    return stored;
+}
+
+static void set_stored_size(GLuint buffer, uintptr_t stored) {
+    share_group_t* share_group = current_context->share_group;
+    pthread_mutex_lock(&share_group->lock);
+    if(stored != 0) unordered_map_put(share_group->buffer_sizes, (void*)buffer, (void*)stored);
+    else unordered_map_remove(share_group->buffer_sizes, (void*)buffer);
+    pthread_mutex_unlock(&share_group->lock);
+}
+
+INTERNAL GLint shadow_get_buffer_size(GLenum target) {
+    GLuint buffer;
+    uintptr_t stored = 0;
+    if(get_bound_buffer(target, &buffer) && buffer != 0) stored = get_stored_size(buffer);
+    pthread_once(&check_once, check_init);
+    if(stored == 0 || check_enabled) {
+        GLint actual = 0;
+        es3_functions.glGetBufferParameteriv(target, GL_BUFFER_SIZE, &actual);
+        if(stored != 0 && (GLint)(stored - 1) != actual) {
+            LTW_ERROR_PRINTF("LTW: state shadow mismatch for the size of buffer %u: shadow %ld, driver %d",
+                             buffer, (long)(stored - 1), actual);
+        }
+        return actual;
+    }
+    return (GLint)(stored - 1);
+}
+
+INTERNAL void shadow_set_element_buffer(GLuint buffer) {
+    current_context->element_buffer = buffer;
+    // 元素缓冲区绑定属于 VAO，切换 VAO 时从这里取回
+    if(buffer != 0) unordered_map_put(current_context->vao_element_buffers, (void*)current_context->vertex_array, (void*)buffer);
+    else unordered_map_remove(current_context->vao_element_buffers, (void*)current_context->vertex_array);
+}
+
+INTERNAL void shadow_set_buffer_size(GLenum target, GLsizeiptr size) {
+    GLuint buffer;
+    if(!get_bound_buffer(target, &buffer) || buffer == 0) return;
+    if(size < 0) return;
+    set_stored_size(buffer, (uintptr_t)size + 1);
+}
+
+INTERNAL void shadow_delete_textures(GLsizei n, const GLuint* textures) {
+    // 删除的纹理在当前上下文的所有纹理单元上都会解绑
+    for(GLsizei i = 0; i < n; i++) {
+        if(textures[i] == 0) continue;
+        for(int unit = 0; unit < MAX_TMUS; unit++) {
+            for(int target = 0; target < MAX_TEXTARGETS; target++) {
+                if(current_context->bound_textures[unit][target] == textures[i]) current_context->bound_textures[unit][target] = 0;
+            }
+        }
+    }
+}
+
+void glActiveTexture(GLenum texture) {
+    if(!current_context) return;
+    es3_functions.glActiveTexture(texture);
+    current_context->active_texture = texture - GL_TEXTURE0;
+}
+
+void glBindTexture(GLenum target, GLuint texture) {
+    if(!current_context) return;
+    current_context->fast_gl.glBindTexture(target, texture);
+    int index = get_texture_target_index(target);
+    if(index == -1 || current_context->active_texture >= MAX_TMUS) return;
+    current_context->bound_textures[current_context->active_texture][index] = texture;
+}
+
+void glBindVertexArray(GLuint array) {
+    if(!current_context) return;
+    es3_functions.glBindVertexArray(array);
+    current_context->vertex_array = array;
+    current_context->element_buffer = (GLuint)(uintptr_t)unordered_map_get(current_context->vao_element_buffers, (void*)array);
+}
+
+void glDeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    if(!current_context || !arrays) return;
+    es3_functions.glDeleteVertexArrays(n, arrays);
+    for(GLsizei i = 0; i < n; i++) {
+        // 默认 VAO 不能删除
+        if(arrays[i] == 0) continue;
+        unordered_map_remove(current_context->vao_element_buffers, (void*)arrays[i]);
+        // 删除当前 VAO 时绑定回到默认 VAO
+        if(arrays[i] == current_context->vertex_array) glBindVertexArray(0);
+    }
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    if(!current_context) return;
+    current_context->fast_gl.glBufferData(target, size, data, usage);
+    shadow_set_buffer_size(target, size);
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint* buffers) {
+    if(!current_context || !buffers) return;
+    es3_functions.glDeleteBuffers(n, buffers);
+    // 删除的缓冲区在当前上下文的绑定点（包括当前 VAO 的元素缓冲区）上都会解绑
+    for(GLsizei i = 0; i < n; i++) {
+        GLuint buffer = buffers[i];
+        if(buffer == 0) continue;
+        set_stored_size(buffer, 0);
+        for(int j = 0; j < MAX_BOUND_BUFFERS; j++) {
+            if(current_context->bound_buffers[j] == buffer) current_context->bound_buffers[j] = 0;
+        }
+        if(current_context->element_buffer == buffer) shadow_set_element_buffer(0);
+    }
+}
@@ -0,0 +1,33 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_STATE_SHADOW_H
+#define POJAVLAUNCHER_STATE_SHADOW_H
+
+#include <stdbool.h>
+#include "proc.h"
+
+// 绑定状态的影子副本：包装器内部要知道当前绑定时直接读 context_t，不再 glGet（很多驱动上 glGet 是同步调用）。
+// 跟踪当前纹理单元、每个单元各目标上的纹理、VAO 及其元素缓冲区，以及用 glBufferData/glBufferStorage 指定过的缓冲区大小。
+// 缓冲区大小属于共享对象，记录在上下文的共享组里，其余都是上下文自己的状态。
+// 影子不知道的情况（超出 MAX_TMUS 的纹理单元、不跟踪的目标、没有经过包装层指定大小的缓冲区）仍然向驱动查询。
+// LTW_CHECK_STATE_SHADOW=1 时每次读取都同时向驱动查询，不一致时打印并使用驱动的值
+
+// 纹理目标在 bound_textures 中的下标，立方体贴图的各个面都算 GL_TEXTURE_CUBE_MAP；不跟踪的目标返回 -1
+int get_texture_target_index(GLenum target);
+// 当前纹理单元上 target 绑定的纹理
+GLuint shadow_get_texture(GLenum target);
+// 当前 VAO 的元素缓冲区
+GLuint shadow_get_element_buffer(void);
+// 绑定到 target 的缓冲区的大小
+GLint shadow_get_buffer_size(GLenum target);
+
+// 以下由绑定类函数调用，更新影子
+void shadow_set_element_buffer(GLuint buffer);
+void shadow_set_buffer_size(GLenum target, GLsizeiptr size);
+void shadow_delete_textures(GLsizei n, const GLuint* textures);
+
+#endif //POJAVLAUNCHER_STATE_SHADOW_H
@@ -0,0 +1,138 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "stream_ring.h"
+#include "libraryinternal.h"
+#include "debug.h"
+
+#define STREAM_RING_WAIT_NS 1000000000ull
+
+// 大小取区段数的整数倍，每个字节都落在某个区段里
+static inline GLsizeiptr round_size(GLsizeiptr size) {
+    GLsizeiptr unit = STREAM_RING_SEGMENTS * 64;
+    return (size + unit - 1) / unit * unit;
+}
+
+static inline GLsizeiptr segment_size(const stream_ring_t* ring) {
+    return ring->size / STREAM_RING_SEGMENTS;
+}
+
+// 单次分配最多占 STREAM_RING_SEGMENTS - 1 段，大多数回绕不必等待刚离开的区段
+static inline GLsizeiptr max_allocation(const stream_ring_t* ring) {
+    return ring->size - segment_size(ring);
+}
+
+static void create_storage(stream_ring_t* ring) {
+    es3_functions.glGenBuffers(1, &ring->buffer);
+    es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    if(ring->persistent && es3_functions.glBufferStorageEXT != NULL) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+        es3_functions.glBufferStorageEXT(GL_COPY_WRITE_BUFFER, ring->size, NULL, flags);
+        ring->mapping = es3_functions.glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, ring->size, flags);
+        if(ring->mapping != NULL) return;
+        LTW_ERROR_PRINTF("LTW: failed to map the streaming buffer persistently (%x), falling back to glBufferSubData",
+                         es3_functions.glGetError());
+        // 不可变存储不能再用 glBufferData，换一个缓冲区
+        es3_functions.glDeleteBuffers(1, &ring->buffer);
+        es3_functions.glGenBuffers(1, &ring->buffer);
+        es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+        ring->persistent = false;
+    }
+    es3_functions.glBufferData(GL_COPY_WRITE_BUFFER, ring->size, NULL, GL_STREAM_DRAW);
+}
+
+static void release_storage(stream_ring_t* ring) {
+    // 缓冲区在 GPU 用完之前由驱动保留，删除时不需要等待
+    for(int i = 0; i < STREAM_RING_SEGMENTS; i++) {
+        if(ring->fences[i] != NULL) es3_functions.glDeleteSync(ring->fences[i]);
+        ring->fences[i] = NULL;
+    }
+    if(ring->mapping != NULL) {
+        es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+        es3_functions.glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        ring->mapping = NULL;
+    }
+    if(ring->buffer != 0) es3_functions.glDeleteBuffers(1, &ring->buffer);
+    ring->buffer = 0;
+    ring->head = 0;
+    ring->open_segment = 0;
+}
+
+INTERNAL bool stream_ring_init(stream_ring_t* ring, GLsizeiptr size, GLsizeiptr max_size, bool persistent) {
+    memset(ring, 0, sizeof(stream_ring_t));
+    ring->size = round_size(size);
+    ring->max_size = round_size(max_size);
+    ring->persistent = persistent;
+    create_storage(ring);
+    return ring->buffer != 0;
+}
+
+INTERNAL void stream_ring_destroy(stream_ring_t* ring) {
+    release_storage(ring);
+}
+
+static bool grow(stream_ring_t* ring, GLsizeiptr needed) {
+    GLsizeiptr size = ring->size * 2;
+    GLsizeiptr min_size = needed + needed / (STREAM_RING_SEGMENTS - 1) + STREAM_RING_SEGMENTS;
+    if(size < min_size) size = min_size;
+    size = round_size(size);
+    if(size > ring->max_size) size = ring->max_size;
+    if(size < min_size) return false;
+    LTW_DEBUG_PRINTF("LTW: growing streaming buffer from %ld to %ld bytes", (long)ring->size, (long)size);
+    release_storage(ring);
+    ring->size = size;
+    create_storage(ring);
+    return true;
+}
+
+static void wait_segment(stream_ring_t* ring, int segment) {
+    GLsync fence = ring->fences[segment];
+    if(fence == NULL) return;
+    GLenum result;
+    do {
+        result = es3_functions.glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_RING_WAIT_NS);
+    } while(result == GL_TIMEOUT_EXPIRED);
+    if(result == GL_WAIT_FAILED) LTW_ERROR_PRINTF("LTW: waiting for a streaming buffer fence failed");
+    es3_functions.glDeleteSync(fence);
+    ring->fences[segment] = NULL;
+}
+
+INTERNAL GLintptr stream_ring_alloc(stream_ring_t* ring, GLsizeiptr size, GLsizeiptr alignment) {
+    if(size <= 0) return -1;
+    if(size > max_allocation(ring) && !grow(ring, size)) {
+        LTW_ERROR_PRINTF("LTW: streaming buffer allocation too large: %ld bytes", (long)size);
+        return -1;
+    }
+    es3_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+    GLsizeiptr segment = segment_size(ring);
+    GLintptr offset = (ring->head + alignment - 1) / alignment * alignment;
+    bool wrapped = offset + size > ring->size;
+    if(wrapped) offset = 0;
+    int current = ring->head > 0 ? (int)((ring->head - 1) / segment) : -1;
+    int first = (int)(offset / segment);
+    int last = (int)((offset + size - 1) / segment);
+    // 之前的分配都已提交，新分配之前的区段不会再写入，插入 fence（回绕时是所有写过的区段）。
+    // 跨区段的分配要等画完才能给它开头的区段插 fence，所以记录最早一个还没有 fence 的区段
+    int fence_end = wrapped ? current : first - 1;
+    for(int s = ring->open_segment; s <= fence_end; s++) {
+        if(ring->fences[s] != NULL) es3_functions.glDeleteSync(ring->fences[s]);
+        ring->fences[s] = es3_functions.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    // 进入本圈还没写过的区段前，等待上一圈留下的 fence。回绕后可能回到当前区段的开头，同样要等
+    for(int s = first; s <= last; s++) {
+        if(s != current || wrapped) wait_segment(ring, s);
+    }
+    ring->open_segment = first;
+    ring->head = offset + size;
+    return offset;
+}
+
+INTERNAL void stream_ring_write(stream_ring_t* ring, GLintptr offset, const void* data, GLsizeiptr size) {
+    if(ring->mapping != NULL) memcpy(ring->mapping + offset, data, size);
+    else es3_functions.glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
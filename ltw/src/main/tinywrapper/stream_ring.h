@@ -0,0 +1,41 @@
+/**
+ * Created by: artDev
+ * Copyright (c) 2025 artDev, SerpentSpirale, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef POJAVLAUNCHER_STREAM_RING_H
+#define POJAVLAUNCHER_STREAM_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "proc.h"
+
+// 区段数：整个环分成几段，每段写完后插入一个 fence，再次写入前等待它
+#define STREAM_RING_SEGMENTS 4
+
+// 每次绘制都要上传的临时数据（索引、间接绘制命令）用的流式环形缓冲区。
+// 支持 EXT_buffer_storage 时持久映射（coherent），客户端数据直接 memcpy 进映射；
+// 否则用 glBufferSubData 写入。写入位置只会落在 GPU 已经用完的区段上，不会覆盖正在读取的数据，
+// 也不需要重新指定整个缓冲区。
+typedef struct {
+    GLuint buffer;
+    GLsizeiptr size;
+    GLsizeiptr max_size;
+    GLintptr head;          // 下一次分配的起点
+    int open_segment;       // 最早一个写过但还没有 fence 的区段
+    uint8_t* mapping;       // 持久映射的地址，回退路径下为 NULL
+    bool persistent;        // 初始化时是否请求持久映射（扩容时沿用）
+    GLsync fences[STREAM_RING_SEGMENTS];
+} stream_ring_t;
+
+// 以下函数都会把环的缓冲区绑定到 GL_COPY_WRITE_BUFFER 上，由调用者恢复原来的绑定
+bool stream_ring_init(stream_ring_t* ring, GLsizeiptr size, GLsizeiptr max_size, bool persistent);
+// 分配 size 字节，起点按 alignment 对齐，返回缓冲区内的偏移；需要时等待 fence 或扩容（不超过 max_size），失败返回 -1
+GLintptr stream_ring_alloc(stream_ring_t* ring, GLsizeiptr size, GLsizeiptr alignment);
+// 把客户端数据写到 stream_ring_alloc 返回的范围内
+void stream_ring_write(stream_ring_t* ring, GLintptr offset, const void* data, GLsizeiptr size);
+// 删除缓冲区和 fence（上下文仍然有效时调用）
+void stream_ring_destroy(stream_ring_t* ring);
+
+#endif //POJAVLAUNCHER_STREAM_RING_H
@@ -11,34 +11,10 @@ const char* AllSeparators = " \t\n\r.,;()[]{}-<>+*/%&\\\"'^$=!:?";
 
 char* gl4es_resize_if_needed(char* pBuffer, int *size, int addsize);
 
+// 保留给旧调用者，缓冲区可能被换成新的
 char* gl4es_inplace_replace(char* pBuffer, int* size, const char* S, const char* D)
 {
-    if (!pBuffer || !S || !D) {
-        fprintf(stderr, "LTW: Invalid parameters in gl4es_inplace_replace (NULL pointer)\n");
-        return pBuffer;
-    }
-    int lS = strlen(S), lD = strlen(D);
-    pBuffer = gl4es_resize_if_needed(pBuffer, size, (lD-lS)*gl4es_count_string(pBuffer, S));
-    if (!pBuffer) {
-        fprintf(stderr, "LTW: gl4es_resize_if_needed failed in gl4es_inplace_replace\n");
-        return NULL;
-    }
-    char* p = pBuffer;
-    while((p = strstr(p, S)))
-    {
-        // found an occurrence of S
-        // check if good to replace, strchr also found '\0' :)
-        if(strchr(AllSeparators, p[lS])!=NULL && (p==pBuffer || strchr(AllSeparators, p[-1])!=NULL)) {
-            // move out rest of string
-            memmove(p+lD, p+lS, strlen(p)-lS+1);
-            // replace
-            memcpy(p, D, strlen(D));
-            // next
-            p+=lD;
-        } else p+=lS;
-    }
-
-    return pBuffer;
+    return gl4es_replace(pBuffer, size, S, D);
 }
 
 
@@ -65,8 +41,8 @@ char * InplaceReplaceByIndex(char* pBuffer, int* size, const int startIndex, con
         return NULL;
     }
     //SHUT_LOGD("BEFORE MOVING: \n%s", pBuffer);
-    // Move the end of the string
-    memmove(pBuffer + startIndex + strlen(replacement) , pBuffer + endIndex + 1, strlen(pBuffer) - endIndex + 1);
+    // Move the end of the string, up to and including its terminator
+    memmove(pBuffer + startIndex + strlen(replacement) , pBuffer + endIndex + 1, strlen(pBuffer) - endIndex);
     //SHUT_LOGD("AFTER MOVING 1: \n%s", pBuffer);
 
     // Insert the replacement
@@ -210,8 +186,9 @@ char* gl4es_resize_if_needed(char* pBuffer, int *size, int addsize) {
     int current_size = *size;
     int str_len = (int)strlen(pBuffer);
     
-    // 检查 addsize 是否会导致溢出
-    if (addsize < 0 || str_len < 0) {
+    // 替换后变短时（addsize 为负）不需要扩容
+    if (addsize < 0) addsize = 0;
+    if (str_len < 0) {
         fprintf(stderr, "LTW: Invalid size parameters in gl4es_resize_if_needed\n");
         return NULL;
     }
@@ -370,28 +347,303 @@ int gl4es_countstring_simple(char* pBuffer, const char* S)
 
 char* gl4es_inplace_replace_simple(char* pBuffer, int* size, const char* S, const char* D)
 {
-    if (!pBuffer || !S || !D) {
-        fprintf(stderr, "LTW: Invalid parameters in gl4es_inplace_replace_simple (NULL pointer)\n");
+    return gl4es_replace_simple(pBuffer, size, S, D);
+}
+
+typedef struct {
+    char* data;
+    int length;
+    int capacity;
+} gl4es_strbuf_t;
+
+static int gl4es_strbuf_append(gl4es_strbuf_t* buf, const char* S, int length)
+{
+    if (buf->length + length + 1 > buf->capacity) {
+        int capacity = buf->capacity + (buf->capacity >> 1);
+        if (capacity < buf->length + length + 1) capacity = buf->length + length + 1;
+        char* data = (char*)realloc(buf->data, capacity);
+        if (!data) {
+            fprintf(stderr, "LTW: Failed to grow replacement buffer (requested %d bytes)\n", capacity);
+            return 0;
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->length, S, length);
+    buf->length += length;
+    return 1;
+}
+
+// 把 pBuffer 换成拼好的结果，失败时丢弃结果
+static char* gl4es_strbuf_finish(gl4es_strbuf_t* buf, int ok, char* pBuffer, int* size)
+{
+    if (!ok) {
+        free(buf->data);
+        return NULL;
+    }
+    buf->data[buf->length] = '\0';
+    free(pBuffer);
+    *size = buf->capacity;
+    return buf->data;
+}
+
+static char* gl4es_replace_impl(char* pBuffer, int* size, const char* S, const char* D, int separators, const char* caller)
+{
+    if (!pBuffer || !size || !S || !D) {
+        fprintf(stderr, "LTW: Invalid parameters in %s (NULL pointer)\n", caller);
         return pBuffer;
     }
     int lS = strlen(S), lD = strlen(D);
-    pBuffer = gl4es_resize_if_needed(pBuffer, size, (lD-lS)*gl4es_countstring_simple(pBuffer, S));
-    if (!pBuffer) {
-        fprintf(stderr, "LTW: gl4es_resize_if_needed failed in gl4es_inplace_replace_simple\n");
+    if (lS == 0) return pBuffer;
+    const char* p = strstr(pBuffer, S);
+    if (!p) return pBuffer;
+
+    int length = strlen(pBuffer);
+    gl4es_strbuf_t buf = { NULL, 0, 0 };
+    int ok = gl4es_strbuf_append(&buf, "", 0);
+    const char* copied = pBuffer;
+    for (; ok && p; p = strstr(p, S)) {
+        if (separators) {
+            // 前一个字符看已经写出的结果，和原来逐次原地替换的行为一致，strchr 也能找到 '\0' :)
+            char before = p != copied ? p[-1] : buf.length ? buf.data[buf.length - 1] : '\0';
+            if (strchr(AllSeparators, p[lS]) == NULL || strchr(AllSeparators, before) == NULL) {
+                p += lS;
+                continue;
+            }
+        }
+        ok = gl4es_strbuf_append(&buf, copied, p - copied) && gl4es_strbuf_append(&buf, D, lD);
+        p += lS;
+        copied = p;
+    }
+    if (ok) ok = gl4es_strbuf_append(&buf, copied, pBuffer + length - copied);
+    return gl4es_strbuf_finish(&buf, ok, pBuffer, size);
+}
+
+char* gl4es_replace(char* pBuffer, int* size, const char* S, const char* D)
+{
+    return gl4es_replace_impl(pBuffer, size, S, D, 1, "gl4es_replace");
+}
+
+char* gl4es_replace_simple(char* pBuffer, int* size, const char* S, const char* D)
+{
+    return gl4es_replace_impl(pBuffer, size, S, D, 0, "gl4es_replace_simple");
+}
+
+typedef struct {
+    int child;      // 第一个子节点
+    int sibling;
+    int fail;
+    int dict;       // fail 链上下一个模式结尾的节点，-1 表示没有
+    int pattern;    // 在此结束的模式，-1 表示没有
+    unsigned char c;
+} gl4es_ac_node_t;
+
+struct gl4es_replacer_s {
+    gl4es_ac_node_t* nodes;
+    int node_count;
+    int root_next[256]; // 根节点的转移查表，其余节点走子节点链表
+    const gl4es_replacement_t* pairs;
+    int* lengths;
+    int count;
+};
+
+static int gl4es_ac_child(const gl4es_replacer_t* replacer, int node, unsigned char c)
+{
+    if (node == 0) return replacer->root_next[c];
+    for (int n = replacer->nodes[node].child; n != -1; n = replacer->nodes[n].sibling)
+        if (replacer->nodes[n].c == c) return n;
+    return -1;
+}
+
+gl4es_replacer_t* gl4es_replacer_create(const gl4es_replacement_t* pairs, int count)
+{
+    if (!pairs || count < 0) {
+        fprintf(stderr, "LTW: Invalid parameters in gl4es_replacer_create\n");
         return NULL;
     }
-    char* p = pBuffer;
-    while((p = strstr(p, S)))
-    {
-        // found an occurrence of S
-        // move out rest of string
-        memmove(p+lD, p+lS, strlen(p)-lS+1);
-        // replace
-        memcpy(p, D, strlen(D));
-        // next
-        p+=lD;
+    int max_nodes = 1;
+    for (int i = 0; i < count; i++) {
+        if (!pairs[i].from || !pairs[i].to) {
+            fprintf(stderr, "LTW: Invalid parameters in gl4es_replacer_create (NULL pointer)\n");
+            return NULL;
+        }
+        max_nodes += strlen(pairs[i].from);
+    }
+    gl4es_replacer_t* replacer = (gl4es_replacer_t*)calloc(1, sizeof(gl4es_replacer_t));
+    int* queue = (int*)malloc(max_nodes * sizeof(int));
+    if (replacer) {
+        replacer->nodes = (gl4es_ac_node_t*)malloc(max_nodes * sizeof(gl4es_ac_node_t));
+        replacer->lengths = (int*)malloc((count ? count : 1) * sizeof(int));
+    }
+    if (!replacer || !queue || !replacer->nodes || !replacer->lengths) {
+        fprintf(stderr, "LTW: Failed to allocate replacer in gl4es_replacer_create\n");
+        free(queue);
+        gl4es_replacer_destroy(replacer);
+        return NULL;
+    }
+    replacer->pairs = pairs;
+    replacer->count = count;
+    memset(replacer->root_next, -1, sizeof(replacer->root_next));
+    replacer->nodes[0] = (gl4es_ac_node_t){ -1, -1, 0, -1, -1, 0 };
+    replacer->node_count = 1;
+
+    // 1. 模式字典树，重复的模式以第一个为准
+    for (int i = 0; i < count; i++) {
+        const unsigned char* from = (const unsigned char*)pairs[i].from;
+        replacer->lengths[i] = strlen(pairs[i].from);
+        if (replacer->lengths[i] == 0) continue;
+        int node = 0;
+        for (; *from; from++) {
+            int next = gl4es_ac_child(replacer, node, *from);
+            if (next == -1) {
+                next = replacer->node_count++;
+                replacer->nodes[next] = (gl4es_ac_node_t){ -1, replacer->nodes[node].child, 0, -1, -1, *from };
+                replacer->nodes[node].child = next;
+                if (node == 0) replacer->root_next[*from] = next;
+            }
+            node = next;
+        }
+        if (replacer->nodes[node].pattern == -1) replacer->nodes[node].pattern = i;
     }
 
-    return pBuffer;
+    // 2. 按层求 fail 和 dict
+    int head = 0, tail = 0;
+    for (int n = replacer->nodes[0].child; n != -1; n = replacer->nodes[n].sibling) queue[tail++] = n;
+    while (head < tail) {
+        int node = queue[head++];
+        for (int n = replacer->nodes[node].child; n != -1; n = replacer->nodes[n].sibling) {
+            int fail = replacer->nodes[node].fail;
+            int next;
+            while ((next = gl4es_ac_child(replacer, fail, replacer->nodes[n].c)) == -1 && fail != 0)
+                fail = replacer->nodes[fail].fail;
+            replacer->nodes[n].fail = next != -1 ? next : 0;
+            int f = replacer->nodes[n].fail;
+            replacer->nodes[n].dict = replacer->nodes[f].pattern != -1 ? f : replacer->nodes[f].dict;
+            queue[tail++] = n;
+        }
+    }
+    free(queue);
+    return replacer;
+}
+
+void gl4es_replacer_destroy(gl4es_replacer_t* replacer)
+{
+    if (!replacer) return;
+    free(replacer->nodes);
+    free(replacer->lengths);
+    free(replacer);
+}
+
+// 扫一遍原文，记下每个起点上最长的匹配；没有匹配时返回 NULL 且 *failed 为 0
+static int* gl4es_replacer_match(const gl4es_replacer_t* replacer, const char* pBuffer, int length, int* failed)
+{
+    int* longest = NULL;
+    int state = 0;
+    *failed = 0;
+    for (int i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)pBuffer[i];
+        int next;
+        while ((next = gl4es_ac_child(replacer, state, c)) == -1 && state != 0)
+            state = replacer->nodes[state].fail;
+        state = next != -1 ? next : 0;
+        int node = replacer->nodes[state].pattern != -1 ? state : replacer->nodes[state].dict;
+        for (; node != -1; node = replacer->nodes[node].dict) {
+            int pattern = replacer->nodes[node].pattern;
+            int start = i - replacer->lengths[pattern] + 1;
+            if (!longest) {
+                longest = (int*)malloc(length * sizeof(int));
+                if (!longest) {
+                    fprintf(stderr, "LTW: Failed to allocate match table in gl4es_replacer_apply\n");
+                    *failed = 1;
+                    return NULL;
+                }
+                memset(longest, -1, length * sizeof(int));
+            }
+            int known = longest[start];
+            if (known == -1 || replacer->lengths[pattern] > replacer->lengths[known]
+                || (replacer->lengths[pattern] == replacer->lengths[known] && pattern < known))
+                longest[start] = pattern;
+        }
+    }
+    return longest;
+}
+
+char* gl4es_replacer_apply(const gl4es_replacer_t* replacer, char* pBuffer, int* size)
+{
+    if (!replacer || !pBuffer || !size) {
+        fprintf(stderr, "LTW: Invalid parameters in gl4es_replacer_apply (NULL pointer)\n");
+        return pBuffer;
+    }
+    // 1. 每个起点上最长的匹配（第一次命中时才分配）
+    int length = strlen(pBuffer);
+    int failed;
+    int* longest = gl4es_replacer_match(replacer, pBuffer, length, &failed);
+    if (failed) return NULL;
+    if (!longest) return pBuffer;
+
+    // 2. 从左到右写出结果，匹配之间不重叠
+    gl4es_strbuf_t buf = { NULL, 0, 0 };
+    int ok = gl4es_strbuf_append(&buf, "", 0);
+    int copied = 0;
+    for (int i = 0; ok && i < length;) {
+        int pattern = longest[i];
+        if (pattern == -1) {
+            i++;
+            continue;
+        }
+        const char* to = replacer->pairs[pattern].to;
+        ok = gl4es_strbuf_append(&buf, pBuffer + copied, i - copied) && gl4es_strbuf_append(&buf, to, strlen(to));
+        i += replacer->lengths[pattern];
+        copied = i;
+    }
+    if (ok) ok = gl4es_strbuf_append(&buf, pBuffer + copied, length - copied);
+    free(longest);
+    return gl4es_strbuf_finish(&buf, ok, pBuffer, size);
+}
+
+int gl4es_replacer_apply_into(const gl4es_replacer_t* replacer, const char* source, char* out, int capacity)
+{
+    if (!replacer || !source || !out || capacity <= 0) {
+        fprintf(stderr, "LTW: Invalid parameters in gl4es_replacer_apply_into\n");
+        return -1;
+    }
+    int length = strlen(source);
+    int failed;
+    int* longest = gl4es_replacer_match(replacer, source, length, &failed);
+    if (failed) return -1;
+    // 写出 [copied, i) 的原文和匹配的替换文本，匹配之间不重叠
+    int n = 0, copied = 0;
+    for (int i = 0; i <= length;) {
+        int pattern = longest && i < length ? longest[i] : -1;
+        if (pattern == -1 && i < length) {
+            i++;
+            continue;
+        }
+        const char* to = pattern != -1 ? replacer->pairs[pattern].to : "";
+        int to_length = strlen(to);
+        if ((i - copied) + to_length >= capacity - n) {
+            free(longest);
+            return -1;
+        }
+        memcpy(out + n, source + copied, i - copied);
+        n += i - copied;
+        memcpy(out + n, to, to_length);
+        n += to_length;
+        if (pattern == -1) break;
+        i += replacer->lengths[pattern];
+        copied = i;
+    }
+    out[n] = '\0';
+    free(longest);
+    return n;
+}
+
+char* gl4es_replace_batch(char* pBuffer, int* size, const gl4es_replacement_t* pairs, int count)
+{
+    gl4es_replacer_t* replacer = gl4es_replacer_create(pairs, count);
+    if (!replacer) return NULL;
+    char* result = gl4es_replacer_apply(replacer, pBuffer, size);
+    gl4es_replacer_destroy(replacer);
+    return result;
 }
 #pragma GCC visibility pop(hidden)
\ No newline at end of file
@@ -34,5 +34,25 @@ const char* gl4es_get_next_str(char* pBuffer); // get a (static) copy of next st
 int gl4es_countstring_simple(char* pBuffer, const char* S);
 char* gl4es_inplace_replace_simple(char* pBuffer, int* size, const char* S, const char* D);
 
+// 单次前向扫描的替换：结果写入新缓冲区并释放 pBuffer，*size 为新缓冲区大小
+// 没有匹配时原样返回 pBuffer，内存不足时返回 NULL（pBuffer 不变）
+char* gl4es_replace(char* pBuffer, int* size, const char* S, const char* D); // S 前后须为分隔符
+char* gl4es_replace_simple(char* pBuffer, int* size, const char* S, const char* D);
+
+typedef struct {
+    const char* from;
+    const char* to;
+} gl4es_replacement_t;
+
+// 批量替换（Aho–Corasick）：所有模式在原文上同时匹配，从左到右，同一位置取最长的模式，
+// 替换进去的文本不会再被匹配。同一组模式多次使用时先 create 一次
+typedef struct gl4es_replacer_s gl4es_replacer_t;
+gl4es_replacer_t* gl4es_replacer_create(const gl4es_replacement_t* pairs, int count); // 字符串不会被复制
+char* gl4es_replacer_apply(const gl4es_replacer_t* replacer, char* pBuffer, int* size);
+// 结果写入调用者提供的 out（capacity 字节，含结尾的 0），source 不变；返回结果长度，放不下或内存不足时返回 -1
+int gl4es_replacer_apply_into(const gl4es_replacer_t* replacer, const char* source, char* out, int capacity);
+void gl4es_replacer_destroy(gl4es_replacer_t* replacer);
+char* gl4es_replace_batch(char* pBuffer, int* size, const gl4es_replacement_t* pairs, int count);
+
 
 #endif // _GL4ES_STRING_UTILS_H_
@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "egl.h"
 #include "mempool.h"
+#include "state_shadow.h"
 #include "debug.h"
 #include <string.h>
 #include "libraryinternal.h"
@@ -31,10 +32,7 @@ static void swizzle_process_endianness(GLenum* swizzle) {
 }
 
 static texture_swizzle_track_t* get_swizzle_track(GLenum target) {
-    GLint texture;
-    GLenum getter = get_textarget_query_param(target);
-    if(getter == 0) return NULL;
-    current_context->fast_gl.glGetIntegerv(getter, &texture);
+    GLuint texture = shadow_get_texture(target);
     if(texture == 0) return NULL;
     texture_swizzle_track_t* track = unordered_map_get(current_context->texture_swztrack_map, (void*)texture);
     if(track == NULL) {
@@ -75,10 +73,8 @@ static void apply_swizzles(GLenum target, texture_swizzle_track_t* track) {
         track->has_pending_update = GL_TRUE;
 
         // 获取纹理ID并添加到待更新列表
-        GLint texture;
-        GLenum getter = get_textarget_query_param(target);
-        if(getter != 0) {
-            current_context->fast_gl.glGetIntegerv(getter, &texture);
+        GLuint texture = shadow_get_texture(target);
+        {
             if(texture != 0 && current_context->pending_swizzle_count < 64) {
                 // 检查是否已经在列表中
                 bool already_pending = false;
@@ -167,6 +163,7 @@ INTERNAL void swizzle_end_batch_update(void) {
     if(!current_context || !current_context->swizzle_batch_mode) return;
 
     // 应用所有待处理的更新
+    bool rebound = false;
     for(int i = 0; i < current_context->pending_swizzle_count; i++) {
         GLuint texture = current_context->pending_swizzle_textures[i];
         texture_swizzle_track_t* track = unordered_map_get(current_context->texture_swztrack_map, (void*)texture);
@@ -179,6 +176,7 @@ INTERNAL void swizzle_end_batch_update(void) {
             // 应用更新
             memcpy(track->applied_swizzle, track->pending_swizzle, 4 * sizeof(GLenum));
             current_context->fast_gl.glBindTexture(target, texture);
+            rebound = true;
             current_context->fast_gl.glTexParameteri(target, GL_TEXTURE_SWIZZLE_R, track->pending_swizzle[0]);
             current_context->fast_gl.glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, track->pending_swizzle[1]);
             current_context->fast_gl.glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, track->pending_swizzle[2]);
@@ -187,6 +185,9 @@ INTERNAL void swizzle_end_batch_update(void) {
         }
     }
 
+    // 恢复应用绑定的纹理
+    if(rebound) current_context->fast_gl.glBindTexture(GL_TEXTURE_2D, shadow_get_texture(GL_TEXTURE_2D));
+
     // 退出批量更新模式
     current_context->swizzle_batch_mode = false;
     current_context->pending_swizzle_count = 0;
@@ -4,10 +4,12 @@
  * For use under LGPL-3.0
  */
 #include <math.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include "shaderconv.h"
+#include "shadertokens.h"
 #include "../string_utils.h"
 
 int NO_OPERATOR_VALUE = 9999;
@@ -22,7 +24,61 @@ void VerbosePrint(char * source, char * stage) {
 #endif
 }
 
+/** Wrappers for the functions that take integer arguments, everything being a float after the int to float coercion */
+static const char texelFetchWrapper[] = "\nvec4 vgpu_texelFetch(sampler2D sampler, vec2 P, float lod){return texelFetch(sampler, ivec2(P), int(lod));}\n"
+                                        "vec4 vgpu_texelFetch(sampler3D sampler, vec3 P, float lod){return texelFetch(sampler, ivec3(P), int(lod));}\n"
+                                        "vec4 vgpu_texelFetch(sampler2DArray sampler, vec3 P, float lod){return texelFetch(sampler, ivec3(P), int(lod));}\n"
+                                        "#ifdef GL_EXT_texture_buffer\n"
+                                        "vec4 vgpu_texelFetch(samplerBuffer sampler, float P){return texelFetch(sampler, int(P));}\n"
+                                        "#endif\n"
+                                        "#ifdef GL_OES_texture_storage_multisample_2d_array\n"
+                                        "vec4 vgpu_texelFetch(sampler2DMS sampler, vec2 P, float _sample){return texelFetch(sampler, ivec2(P), int(_sample));}\n"
+                                        "vec4 vgpu_texelFetch(sampler2DMSArray sampler, vec3 P, float _sample){return texelFetch(sampler, ivec3(P), int(_sample));}\n"
+                                        "#endif\n";
+
+static const char textureSizeWrapper[] = "\nvec2 vgpu_textureSize(sampler2D sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
+                                         "vec3 vgpu_textureSize(sampler3D sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
+                                         "vec2 vgpu_textureSize(samplerCube sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
+                                         "vec2 vgpu_textureSize(sampler2DShadow sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
+                                         "vec2 vgpu_textureSize(samplerCubeShadow sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
+                                         "#ifdef GL_EXT_texture_cube_map_array\n"
+                                         "vec3 vgpu_textureSize(samplerCubeArray sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
+                                         "vec3 vgpu_textureSize(samplerCubeArrayShadow sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
+                                         "#endif\n"
+                                         "vec3 vgpu_textureSize(sampler2DArray sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
+                                         "vec3 vgpu_textureSize(sampler2DArrayShadow sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
+                                         "#ifdef GL_EXT_texture_buffer\n"
+                                         "float vgpu_textureSize(samplerBuffer sampler){return float(textureSize(sampler));}\n"
+                                         "#endif\n"
+                                         "#ifdef GL_OES_texture_storage_multisample_2d_array\n"
+                                         "vec2 vgpu_textureSize(sampler2DMS sampler){return vec2(textureSize(sampler));}\n"
+                                         "vec3 vgpu_textureSize(sampler2DMSArray sampler){return vec3(textureSize(sampler));}\n"
+                                         "#endif\n";
+
+static const char textureOffsetWrapper[] = "\nvec4 vgpu_textureOffset(sampler2D tex, vec2 P, vec2 offset, float bias){ivec2 Size = textureSize(tex, 0);return texture(tex, P+offset/vec2(float(Size.x), float(Size.y)), bias);}\n"
+                                           "vec4 vgpu_textureOffset(sampler2D tex, vec2 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
+                                           "vec4 vgpu_textureOffset(sampler3D tex, vec3 P, vec3 offset, float bias){ivec3 Size = textureSize(tex, 0);return texture(tex, P+offset/vec3(float(Size.x), float(Size.y), float(Size.z)), bias);}\n"
+                                           "vec4 vgpu_textureOffset(sampler3D tex, vec3 P, vec3 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
+                                           "float vgpu_textureOffset(sampler2DShadow tex, vec3 P, vec2 offset, float bias){ivec2 Size = textureSize(tex, 0);return texture(tex, P+vec3(offset.x, offset.y, 0)/vec3(float(Size.x), float(Size.y), 1.0), bias);}\n"
+                                           "float vgpu_textureOffset(sampler2DShadow tex, vec3 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
+                                           "vec4 vgpu_textureOffset(sampler2DArray tex, vec3 P, vec2 offset, float bias){ivec3 Size = textureSize(tex, 0);return texture(tex, P+vec3(offset.x, offset.y, 0)/vec3(float(Size.x), float(Size.y), float(Size.z)), bias);}\n"
+                                           "vec4 vgpu_textureOffset(sampler2DArray tex, vec3 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n";
+
+static const char shadow2DWrapper[] = "\nvec4 vgpu_shadow2D(sampler2DShadow shadow, vec3 coord){return vec4(texture(shadow, coord), 0.0, 0.0, 0.0);}\n"
+                                      "vec4 vgpu_shadow2D(sampler2DShadow shadow, vec3 coord, float bias){return vec4(texture(shadow, coord, bias), 0.0, 0.0, 0.0);}\n";
+
+const VgpuFunctionWrapper vgpuFunctionWrappers[] = {
+    { "texelFetch", "vgpu_texelFetch", texelFetchWrapper },
+    { "textureSize", "vgpu_textureSize", textureSizeWrapper },
+    { "textureOffset", "vgpu_textureOffset", textureOffsetWrapper },
+    { "shadow2D", "vgpu_shadow2D", shadow2DWrapper },
+};
+const int vgpuFunctionWrapperCount = sizeof(vgpuFunctionWrappers) / sizeof(vgpuFunctionWrappers[0]);
+
 /** Convert the shader through multiple steps
+ * Everything that only looks at single tokens (renames, int to float coercion, array index casts)
+ * is done in one pass by RewriteShaderTokens, then the passes rewriting whole expressions run.
+ * The pass sequence it replaced lives in glsl_optimizer/bench/shaderconv_reference.c.
  * @param source The start of the shader as a string
  * @param second_pass Whether gl4es tries to solve a linking error
  */
@@ -34,89 +90,87 @@ char * ConvertShaderVgpu(char* source, int is_vertex, int second_pass){
 
     // Get the shader source
     int sourceLength = strlen(source) + 1;
-    // For now, skip stuff
-
-
-    // Remove 'const' storage qualifier
-    //printf("REMOVING CONST qualifiers");
-    //source = RemoveConstInsideBlocks(source, &sourceLength);
-    //source = ReplaceVariableName(source, &sourceLength, "const", " ");
-
-
-
-
-    // Avoid keyword clash with gl4es #define blocks
-    //printf("REPLACING KEYWORDS");
-    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define texture2D texture\n", "");
-    source = ReplaceVariableName(source, &sourceLength, "sample", "vgpu_Sample");
-    source = ReplaceVariableName(source, &sourceLength, "texture", "vgpu_texture");
-
-    source = ReplaceFunctionName(source, &sourceLength, "texture2D", "texture");
-    source = ReplaceFunctionName(source, &sourceLength, "texture3D", "texture");
-    source = ReplaceFunctionName(source, &sourceLength, "texture2DLod", "textureLod");
 
+    // Avoid keyword clash with gl4es #define blocks, and drop the dubious ones
+    const char * removedStrings[] = {
+        "#define texture2D texture\n",
+        "#define texture texture2D\n",
+        "#define attribute in\n",
+        "#define varying out\n",
+    };
 
-
-    //printf("REMOVING \" CHARS ");
-    // " not really supported here
-    source = gl4es_inplace_replace_simple(source, &sourceLength, "\"", "");
-    VerbosePrint(source, "Function renames");
-
-    // For now let's hope no extensions are used
-    // TODO deal with extensions but properly
-    //printf("REMOVING EXTENSIONS");
-    //source = RemoveUnsupportedExtensions(source);
+    // Order matters: the first identifier rule matching a token wins
+    TokenRewrite rewrites[] = {
+        { TOKEN_REWRITE_VARIABLE, "sample", "vgpu_Sample" },
+        { TOKEN_REWRITE_VARIABLE, "texture", "vgpu_texture" },
+        { TOKEN_REWRITE_FUNCTION, "texture2D", "texture" },
+        { TOKEN_REWRITE_FUNCTION, "texture3D", "texture" },
+        { TOKEN_REWRITE_FUNCTION, "texture2DLod", "textureLod" },
+
+        // Hey we don't want to deal with implicit type stuff
+        { TOKEN_REWRITE_VARIABLE, "int", "float" },
+        { TOKEN_REWRITE_FUNCTION, "int", "float" },
+        { TOKEN_REWRITE_VARIABLE, "uint", "float" },
+        { TOKEN_REWRITE_FUNCTION, "uint", "float" },
+
+        // Since everything is a float, we need to overload WAY TOO MANY functions
+        { TOKEN_REWRITE_FUNCTION, "texelFetch", "vgpu_texelFetch" },
+        { TOKEN_REWRITE_FUNCTION, "textureSize", "vgpu_textureSize" },
+        { TOKEN_REWRITE_FUNCTION, "textureOffset", "vgpu_textureOffset" },
+        { TOKEN_REWRITE_FUNCTION, "shadow2D", "vgpu_shadow2D" },
+
+        { TOKEN_REWRITE_VARIABLE, "attribute", is_vertex ? "in" : "attribute" },
+        { TOKEN_REWRITE_VARIABLE, "varying", is_vertex ? "out" : "in" },
+
+        { TOKEN_REWRITE_SUBSTRING, "ivec", "vec" },
+        { TOKEN_REWRITE_SUBSTRING, "uvec", "vec" },
+        { TOKEN_REWRITE_SUBSTRING, "isampleBuffer", "sampleBuffer" },
+        { TOKEN_REWRITE_SUBSTRING, "usampleBuffer", "sampleBuffer" },
+        { TOKEN_REWRITE_SUBSTRING, "isampler", "sampler" },
+        { TOKEN_REWRITE_SUBSTRING, "usampler", "sampler" },
+        { TOKEN_REWRITE_SUBSTRING, "gl_VertexID", "float(gl_VertexID)" },
+        { TOKEN_REWRITE_SUBSTRING, "gl_InstanceID", "float(gl_InstanceID)" },
+    };
+    TokenRewriter rewriter = {
+        .rewrites = rewrites,
+        .rewriteCount = sizeof(rewrites) / sizeof(rewrites[0]),
+        .removedStrings = removedStrings,
+        .removedStringCount = sizeof(removedStrings) / sizeof(removedStrings[0]),
+        .removeQuotes = 1, // " not really supported here
+        .coerceIntLiterals = 1,
+        .castArrayIndices = 1, // Avoid any weird type trying to be an index for an array
+    };
+    source = RewriteShaderTokens(source, &sourceLength, &rewriter);
+    VerbosePrint(source, "Tokens rewritten");
+
+    // Add the wrappers of the functions that got replaced
+    for (int i = 0; i < vgpuFunctionWrapperCount; ++i) {
+        int used = 0;
+        for (int r = 0; r < rewriter.rewriteCount; ++r) {
+            if (strcmp(rewrites[r].replacement, vgpuFunctionWrappers[i].wrapperName) == 0) used += rewrites[r].count;
+        }
+        if (!used) continue;
+        int insertPoint = FindPositionAfterDirectives(source);
+        source = InplaceInsertByIndex(source, &sourceLength, insertPoint + 1, vgpuFunctionWrappers[i].wrapper);
+    }
+    VerbosePrint(source, "Wrapped ivec function renames");
 
     // OpenGL natively supports non const global initializers, not OPENGL ES except if we add an extension
-    //printf("ADDING EXTENSIONS\n");
     source = InsertExtensions(source, &sourceLength);
     VerbosePrint(source, "Extensions inserted");
 
-    //printf("REPLACING mod OPERATORS");
     // No support for % operator, so we replace it
     source = ReplaceModOperator(source, &sourceLength);
     VerbosePrint(source, "Modulo operator replaced");
 
-    //printf("COERCING INT TO FLOATS");
-    // Hey we don't want to deal with implicit type stuff
-    source = CoerceIntToFloat(source, &sourceLength);
-    VerbosePrint(source, "Int coerced to float");
-
-    //printf("FIXING ARRAY ACCESS");
-    // Avoid any weird type trying to be an index for an array
-    source = ForceIntegerArrayAccess(source, &sourceLength);
-    VerbosePrint(source, "Array access cast to integers");
-
-    //printf("WRAPPING FUNCTION");
-    // Since everything is a float, we need to overload WAY TOO MANY functions
-    source = WrapIvecFunctions(source, &sourceLength);
-    VerbosePrint(source, "Wrapped ivec function renames");
-
-    //printf("REMOVING DUBIOUS DEFINES");
-    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define texture texture2D\n", "");
-    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define attribute in\n", "");
-    source = gl4es_inplace_replace_simple(source, &sourceLength, "#define varying out\n", "");
-
-    if (is_vertex){
-        source = ReplaceVariableName(source, &sourceLength, "attribute", "in");
-        source = ReplaceVariableName(source, &sourceLength, "varying", "out");
-    }else{
-        source = ReplaceVariableName(source, &sourceLength, "varying", "in");
-    }
-
-    VerbosePrint(source, "Basic renames - PART 2");
-
     // Draw buffers aren't dealt the same on OPEN GL|ES
     if(!is_vertex && doesShaderVersionContainsES(source) ){
-        //printf("REPLACING FRAG DATA");
         source = ReplaceGLFragData(source, &sourceLength);
-        //printf("REPLACING FRAG COLOR");
         source = ReplaceGLFragColor(source, &sourceLength);
 
         VerbosePrint(source, "GL_FRAG renames");
     }
 
-    //printf("FUCKING UP PRECISION");
     source = ReplacePrecisionQualifiers(source, &sourceLength, is_vertex);
 
     source = ProcessSwitchCases(source, &sourceLength);
@@ -197,7 +251,14 @@ char* FindAndCorrect(char* source, int* length, int mode) {
     size_t          string_offset;
     size_t          offset = 0;
     unsigned char   rewind = 0;
+    const char*     keyword = mode == MODE_SWITCH ? "switch" : "case";
     while(1) {
+        // The template only matches where the keyword starts, maybe after some whitespace: jump there
+        char* next = strstr(scan_source, keyword);
+        if(next == NULL) break;
+        while(next > scan_source && isspace((unsigned char) next[-1])) next--;
+        scan_source = next;
+
         int scan_result = sscanf(scan_source, template, &string_offset, &template_string);
         if(scan_result == 0) {
             scan_source++;
@@ -205,7 +266,9 @@ char* FindAndCorrect(char* source, int* length, int mode) {
         }else if(scan_result == EOF) {
             break;
         }
-        offset = string_offset + (strstr(scan_source, mode == MODE_SWITCH ? "{" : mode == MODE_CASE ? ":" : 0) - scan_source); // find it by hand cause sscanf has trouble with two %n operators
+        char* delimiter = strstr(scan_source, mode == MODE_SWITCH ? "{" : ":");
+        if(delimiter == NULL) break; // keyword inside a comment or an identifier, nothing left to fix
+        offset = string_offset + (delimiter - scan_source); // find it by hand cause sscanf has trouble with two %n operators
         string_offset += (scan_source - source); // convert it from relative to scan to relative to base
         if(mode == MODE_SWITCH && !strstr(template_string, "int(") ) { // already cast to int, skip
             size_t insert_end_offset = string_offset + strlen(template_string);
@@ -241,7 +304,9 @@ char* FindAndCorrect(char* source, int* length, int mode) {
         if(rewind) {
             scan_source = source; // since inplace replacement operations are destructive, the scan will be rewound after doing them
             rewind = 0;
-        }else scan_source += offset;
+        }else if(offset < strlen(scan_source)) {
+            scan_source += offset;
+        }else break;
     }
     return source;
 }
@@ -502,18 +567,25 @@ char * InsertExtensions(char *source, int *sourceLength){
     int insertPoint = FindPositionAfterDirectives(source);
     //printf("INSERT POINT: %i\n", insertPoint);
 
-    source = InsertExtension(source, sourceLength, insertPoint+1, "GL_EXT_shader_non_constant_global_initializers");
-    source = InsertExtension(source, sourceLength, insertPoint+1, "GL_EXT_texture_cube_map_array");
-    source = InsertExtension(source, sourceLength, insertPoint+1, "GL_EXT_texture_buffer");
-    source = InsertExtension(source, sourceLength, insertPoint+1, "GL_OES_texture_storage_multisample_2d_array");
-    return source;
+    // Same order as inserting them one by one at the same point, all in one go
+    const char * extensions[] = {
+        "GL_OES_texture_storage_multisample_2d_array",
+        "GL_EXT_texture_buffer",
+        "GL_EXT_texture_cube_map_array",
+        "GL_EXT_shader_non_constant_global_initializers",
+    };
+    char block[512] = "";
+    for (int i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        int used = strlen(block);
+        snprintf(block + used, sizeof(block) - used, "#ifdef %s \n#extension %s : enable\n#endif\n", extensions[i], extensions[i]);
+    }
+    return InplaceInsertByIndex(source, sourceLength, insertPoint+1, block);
 }
 
 char * InsertExtension(char * source, int * sourceLength, const int insertPoint, const char * extension){
-    // First, insert the model, then the extension
-    source = InplaceInsertByIndex(source, sourceLength, insertPoint, "#ifdef __EXT__ \n#extension __EXT__ : enable\n#endif\n");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "__EXT__", extension);
-    return source;
+    char block[256];
+    snprintf(block, sizeof(block), "#ifdef %s \n#extension %s : enable\n#endif\n", extension, extension);
+    return InplaceInsertByIndex(source, sourceLength, insertPoint, block);
 }
 
 int doesShaderVersionContainsES(const char * source){
@@ -521,71 +593,6 @@ int doesShaderVersionContainsES(const char * source){
     return version >= 300 &&  version <= 320;
 }
 
-char * WrapIvecFunctions(char * source, int * sourceLength){
-    source = WrapFunction(source, sourceLength, "texelFetch", "vgpu_texelFetch", "\nvec4 vgpu_texelFetch(sampler2D sampler, vec2 P, float lod){return texelFetch(sampler, ivec2(P), int(lod));}\n"
-                                                                                 "vec4 vgpu_texelFetch(sampler3D sampler, vec3 P, float lod){return texelFetch(sampler, ivec3(P), int(lod));}\n"
-                                                                                 "vec4 vgpu_texelFetch(sampler2DArray sampler, vec3 P, float lod){return texelFetch(sampler, ivec3(P), int(lod));}\n"
-                                                                                 "#ifdef GL_EXT_texture_buffer\n"
-                                                                                 "vec4 vgpu_texelFetch(samplerBuffer sampler, float P){return texelFetch(sampler, int(P));}\n"
-                                                                                 "#endif\n"
-                                                                                 "#ifdef GL_OES_texture_storage_multisample_2d_array\n"
-                                                                                 "vec4 vgpu_texelFetch(sampler2DMS sampler, vec2 P, float _sample){return texelFetch(sampler, ivec2(P), int(_sample));}\n"
-                                                                                 "vec4 vgpu_texelFetch(sampler2DMSArray sampler, vec3 P, float _sample){return texelFetch(sampler, ivec3(P), int(_sample));}\n"
-                                                                                 "#endif\n");
-
-    source = WrapFunction(source, sourceLength, "textureSize", "vgpu_textureSize", "\nvec2 vgpu_textureSize(sampler2D sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec3 vgpu_textureSize(sampler3D sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec2 vgpu_textureSize(samplerCube sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec2 vgpu_textureSize(sampler2DShadow sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec2 vgpu_textureSize(samplerCubeShadow sampler, float lod){return vec2(textureSize(sampler, int(lod)));}\n"
-                                                                                   "#ifdef GL_EXT_texture_cube_map_array\n"
-                                                                                   "vec3 vgpu_textureSize(samplerCubeArray sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec3 vgpu_textureSize(samplerCubeArrayShadow sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
-                                                                                   "#endif\n"
-                                                                                   "vec3 vgpu_textureSize(sampler2DArray sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
-                                                                                   "vec3 vgpu_textureSize(sampler2DArrayShadow sampler, float lod){return vec3(textureSize(sampler, int(lod)));}\n"
-                                                                                   "#ifdef GL_EXT_texture_buffer\n"
-                                                                                   "float vgpu_textureSize(samplerBuffer sampler){return float(textureSize(sampler));}\n"
-                                                                                   "#endif\n"
-                                                                                   "#ifdef GL_OES_texture_storage_multisample_2d_array\n"
-                                                                                   "vec2 vgpu_textureSize(sampler2DMS sampler){return vec2(textureSize(sampler));}\n"
-                                                                                   "vec3 vgpu_textureSize(sampler2DMSArray sampler){return vec3(textureSize(sampler));}\n"
-                                                                                   "#endif\n");
-
-    source = WrapFunction(source, sourceLength, "textureOffset", "vgpu_textureOffset", "\nvec4 vgpu_textureOffset(sampler2D tex, vec2 P, vec2 offset, float bias){ivec2 Size = textureSize(tex, 0);return texture(tex, P+offset/vec2(float(Size.x), float(Size.y)), bias);}\n"
-                                                                                       "vec4 vgpu_textureOffset(sampler2D tex, vec2 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
-                                                                                       "vec4 vgpu_textureOffset(sampler3D tex, vec3 P, vec3 offset, float bias){ivec3 Size = textureSize(tex, 0);return texture(tex, P+offset/vec3(float(Size.x), float(Size.y), float(Size.z)), bias);}\n"
-                                                                                       "vec4 vgpu_textureOffset(sampler3D tex, vec3 P, vec3 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
-                                                                                       "float vgpu_textureOffset(sampler2DShadow tex, vec3 P, vec2 offset, float bias){ivec2 Size = textureSize(tex, 0);return texture(tex, P+vec3(offset.x, offset.y, 0)/vec3(float(Size.x), float(Size.y), 1.0), bias);}\n"
-                                                                                       "float vgpu_textureOffset(sampler2DShadow tex, vec3 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n"
-                                                                                       "vec4 vgpu_textureOffset(sampler2DArray tex, vec3 P, vec2 offset, float bias){ivec3 Size = textureSize(tex, 0);return texture(tex, P+vec3(offset.x, offset.y, 0)/vec3(float(Size.x), float(Size.y), float(Size.z)), bias);}\n"
-                                                                                       "vec4 vgpu_textureOffset(sampler2DArray tex, vec3 P, vec2 offset){return vgpu_textureOffset(tex, P, offset, 0.0);}\n");
-
-    source = WrapFunction(source, sourceLength, "shadow2D", "vgpu_shadow2D", "\nvec4 vgpu_shadow2D(sampler2DShadow shadow, vec3 coord){return vec4(texture(shadow, coord), 0.0, 0.0, 0.0);}\n"
-                                                                             "vec4 vgpu_shadow2D(sampler2DShadow shadow, vec3 coord, float bias){return vec4(texture(shadow, coord, bias), 0.0, 0.0, 0.0);}\n");
-    return source;
-}
-
-/**
- * Replace a function and its calls by a wrapper version, only if needed
- * @param source The shader code as a string
- * @param functionName The function to be replaced
- * @param wrapperFunctionName The replacing function name
- * @param function The wrapper function itself
- * @return The shader as a string, maybe in a different memory location
- */
-char * WrapFunction(char * source, int * sourceLength, char * functionName, char * wrapperFunctionName, char * wrapperFunction){
-    int originalSize = strlen(source);
-    source = ReplaceFunctionName(source, sourceLength, functionName, wrapperFunctionName);
-    // If some calls got replaced, add the wrapper
-    if(originalSize != strlen(source)){
-        int insertPoint = FindPositionAfterDirectives(source);
-        source = InplaceInsertByIndex(source, sourceLength, insertPoint + 1, wrapperFunction);
-    }
-
-    return source;
-}
-
 /**
  * Replace the % operator with a mathematical equivalent (x - y * floor(x/y))
  * @param source The shader as a string
@@ -596,18 +603,19 @@ char * ReplaceModOperator(char * source, int * sourceLength){
     int startIndex, endIndex = 0;
     int * startPtr = &startIndex, *endPtr = &endIndex;
 
-    for(int i=0;i<*sourceLength; ++i){
+    for(int i=0; source[i] != '\0'; ++i){
         if(source[i] != '%') continue;
         // A mod operator is found !
         char * leftOperand = GetOperandFromOperator(source, i, 0, startPtr);
         char * rightOperand = GetOperandFromOperator(source,  i, 1, endPtr);
 
         // Generate a model string to be inserted
+        // Both operands at once, so a "y" in the left operand isn't replaced again
         char * replacementString = malloc(strlen(modelString) + 1);
         strcpy(replacementString, modelString);
-        int replacementSize = strlen(replacementString);
-        replacementString = gl4es_inplace_replace(replacementString, &replacementSize, "x", leftOperand);
-        replacementString = gl4es_inplace_replace(replacementString, &replacementSize, "y", rightOperand);
+        int replacementSize = strlen(replacementString) + 1;
+        gl4es_replacement_t operands[] = { { "x", leftOperand }, { "y", rightOperand } };
+        replacementString = gl4es_replace_batch(replacementString, &replacementSize, operands, 2);
 
         // Insert the new string
         source = InplaceReplaceByIndex(source, sourceLength, startIndex, endIndex, replacementString);
@@ -631,7 +639,7 @@ char * WrapBitShiftOperators(char * source, int *sourceLength) {
     int startIndex, endIndex = 0;
     int * startPtr = &startIndex, *endPtr = &endIndex;
 
-    for(int i=0;i<*sourceLength-2; ++i){
+    for(int i=0; source[i] != '\0'; ++i){
         if((source[i] == '<' && source[i+1] == '<') || (source[i] == '>' && source[i+1] == '>')){
             // A bit shift operator is found
             char * leftOperand = GetOperandFromOperatorValueOverride(source, i, 0, startPtr, GetOperatorValue('<', '<'));
@@ -655,7 +663,7 @@ char * WrapBitwiseOrAnd(char * source, int *sourceLength) {
     int startIndex, endIndex = 0;
     int * startPtr = &startIndex, *endPtr = &endIndex;
 
-    for(int i=0;i<*sourceLength-2; ++i){
+    for(int i=0; source[i] != '\0'; ++i){
         if((source[i] == '|' && !(source[i+1] == '|' || source[i-1] == '|'))
         || (source[i] == '&' && !(source[i+1] == '&' || source[i-1] == '&')
         || (source[i] == '^' && !(source[i+1] == '^' || source[i-1] == '^'))) ){
@@ -677,91 +685,6 @@ char * WrapBitwiseOrAnd(char * source, int *sourceLength) {
     return source;
 }
 
-/**
- * Change all (u)ints to floats.
- * This is a hack to avoid dealing with implicit conversions on common operators
- * @param source The shader as a string
- * @return The shader as a string, maybe in a new memory location
- * @see ForceIntegerArrayAccess
- */
-char * CoerceIntToFloat(char * source, int * sourceLength){
-    // Let's go the "freestyle way"
-
-    // Step 1 is to translate keywords
-    // Attempt and loop unrolling -> worked well, time to fix my shit I guess
-    source = ReplaceVariableName(source, sourceLength, "int", "float");
-    source = WrapFunction(source, sourceLength, "int", "float", "\n ");
-    source = ReplaceVariableName(source, sourceLength, "uint", "float");
-    source = WrapFunction(source, sourceLength, "uint", "float", "\n ");
-
-    // TODO Yes I could just do the same as above but I'm lazy at times
-    source = gl4es_inplace_replace_simple(source, sourceLength, "ivec", "vec");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "uvec", "vec");
-
-    source = gl4es_inplace_replace_simple(source, sourceLength, "isampleBuffer", "sampleBuffer");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "usampleBuffer", "sampleBuffer");
-
-    source = gl4es_inplace_replace_simple(source, sourceLength, "isampler", "sampler");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "usampler", "sampler");
-
-
-    // Step 3 is slower.
-    // We need to parse hardcoded values like 1 and turn it into 1.(0)
-    for(int i=0; i<*sourceLength; ++i){
-
-        // Avoid version/line directives
-        if(source[i] == '#' && (source[i + 1] == 'v' || source[i + 1] == 'l') ){
-            // Look for the next line
-            while (source[i] != '\n' && source[i] != '\0'){
-                i++;
-            }
-        }
-
-        if(!isDigit(source[i])){ continue; }
-        // So there is a few situations that we have to distinguish:
-        // functionName1 (      ----- meaning there is SOMETHING on its left side that is related to the number
-        // function(1,          ----- there is something, and it ISN'T related to the number
-        // float test=3;        ----- something on both sides, not related to the number.
-        // float test=X.2       ----- There is a dot, so it is part of a float already
-        // float test = 0.00000 ----- I have to backtrack to find the dot
-        // float test = 4u      ----- I delete the u, then branch back to normal int handling
-
-        if(source[i-1] == '.' || source[i+1] == '.') continue;// Number part of a float
-        if(isValidFunctionName(source[i - 1])) continue; // Char attached to something related
-        if(isDigit(source[i+1])) continue; // End of number not reached
-        if(isDigit(source[i-1])){
-            // Backtrack to check if the number is floating point
-            int shouldBeCoerced = 0;
-            for(int j=1; 1; ++j){
-                if(isDigit(source[i-j])) continue;
-                if(isValidFunctionName(source[i-j])) break; // Function or variable name, don't coerce
-                if(source[i-j] == '.' || ((source[i-j] == '+' || source[i-j] == '-') && (source[i-j-1] == 'e'|| source[i-j-1] == 'E') )) break; // No coercion, float or scientific notation already
-                // Nothing found, should be coerced then
-                shouldBeCoerced = 1;
-                break;
-            }
-
-            if(!shouldBeCoerced) continue;
-        }
-
-        // Check if we have the scientific notation
-        if(((source[i-1] == '+' || source[i-1] == '-') && (source[i-2] == 'e'|| source[i-2] == 'E'))) continue;
-
-
-        // Remove the potential uint literal marking
-        if(source[i+1] == 'u') source[i+1] = ' ';
-
-        // Now we know there is nothing related to the digit, turn it into a float
-        source = InplaceInsertByIndex(source, sourceLength, i+1, ".0");
-    }
-
-    // TODO Hacks for special built in values and typecasts ?
-    source = gl4es_inplace_replace_simple(source, sourceLength, "gl_VertexID", "float(gl_VertexID)");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "gl_InstanceID", "float(gl_InstanceID)");
-
-    return source;
-}
-
 /**
  * Wrap functions return statement if they have an int typecast
  * @param source The shader as a string
@@ -791,46 +714,6 @@ char * FixReturnTypes(char * source, int * sourceLength) {
     return source;
 }
 
-/** Force all array accesses to use integers by adding an explicit typecast
- * @param source The shader as a string
- * @return The shader as a string, maybe at a new memory location */
-char * ForceIntegerArrayAccess(char* source, int * sourceLength){
-    char * markerStart = "$";
-    char * markerEnd = "`";
-
-    // Step 1, we need to mark all [] that are empty and must not be changed
-    int leftCharIndex = 0;
-    for(int i=0; i< *sourceLength; ++i){
-        if(source[i] == '['){
-            leftCharIndex = i;
-            continue;
-        }
-        // If a start has been found
-        if(leftCharIndex){
-            if(source[i] == ' ' || source[i] == '\n'){
-                continue;
-            }
-            // We find the other side and mark both ends
-            if(source[i] == ']'){
-                source[leftCharIndex] = *markerStart;
-                source[i] = *markerEnd;
-            }
-        }
-        //Something else is there, abort the marking phase for this one
-        leftCharIndex = 0;
-    }
-
-    // Step 2, replace the array accesses with a forced typecast version
-    source = gl4es_inplace_replace_simple(source, sourceLength, "]", ")]");
-    source = gl4es_inplace_replace_simple(source, sourceLength, "[", "[int(");
-
-    // Step 3, restore all marked empty []
-    source = gl4es_inplace_replace_simple(source, sourceLength, markerStart, "[");
-    source = gl4es_inplace_replace_simple(source, sourceLength, markerEnd, "]");
-
-    return source;
-}
-
 
 /**
  * Turn layout (location=<float>) into layout (location=<int>)
@@ -1128,7 +1011,7 @@ char * ReplaceGLFragData(char * source, int * sourceLength){
         int insertPoint = FindPositionAfterDirectives(source);
 
         // And place them into the shader
-        source = gl4es_inplace_replace_simple(source, sourceLength, &needle[0], &replacement[0]);
+        source = gl4es_replace_simple(source, sourceLength, &needle[0], &replacement[0]);
         source = InplaceInsertByIndex(source, sourceLength, insertPoint + 1, &replacementLine[0]);
     }
     return source;
@@ -1141,7 +1024,7 @@ char * ReplaceGLFragData(char * source, int * sourceLength){
  */
 char * ReplaceGLFragColor(char * source, int * sourceLength){
     if(strstr(source, "gl_FragColor")){
-        source = gl4es_inplace_replace_simple(source, sourceLength, "gl_FragColor", "vgpu_FragColor");
+        source = gl4es_replace_simple(source, sourceLength, "gl_FragColor", "vgpu_FragColor");
         int insertPoint = FindPositionAfterDirectives(source);
         source = InplaceInsertByIndex(source, sourceLength, insertPoint + 1, "out mediump vec4 vgpu_FragColor;\n");
     }
@@ -1173,37 +1056,11 @@ char * RemoveUnsupportedExtensions(char * source){
  * @return The shader as a string, maybe in a different memory location
  */
 char * ReplaceVariableName(char * source, int * sourceLength, char * initialName, char* newName) {
-
-    char * toReplace = malloc(strlen(initialName) + 3);
-    char * replacement = malloc(strlen(newName) + 3);
-    char * charBefore = "{}([];+-*/~!%<>,&| \n\t";
-    char * charAfter = ")[];+-*/%<>;,|&. \n\t";
-
-    // Prepare the fixed part of the strings
-    strcpy(toReplace+1, initialName);
-    toReplace[strlen(initialName)+2] = '\0';
-
-    strcpy(replacement+1, newName);
-    replacement[strlen(newName)+2] = '\0';
-
-    for (int i = 0; i < strlen(charBefore); ++i) {
-        for (int j = 0; j < strlen(charAfter); ++j) {
-            // Prepare the string to replace
-            toReplace[0] = charBefore[i];
-            toReplace[strlen(initialName)+1] = charAfter[j];
-
-            // Prepare the replacement string
-            replacement[0] = charBefore[i];
-            replacement[strlen(newName)+1] = charAfter[j];
-
-            source = gl4es_inplace_replace_simple(source, sourceLength, toReplace, replacement);
-        }
-    }
-
-    free(toReplace);
-    free(replacement);
-
-    return source;
+    // One pass with the separators on both sides, instead of one replacement per separator pair
+    TokenRewrite rewrite = { TOKEN_REWRITE_VARIABLE, initialName, newName };
+    TokenRewriter rewriter = { .rewrites = &rewrite, .rewriteCount = 1 };
+    if (strstr(source, initialName) == NULL) return source;
+    return RewriteShaderTokens(source, sourceLength, &rewriter);
 }
 
 /**
@@ -1238,39 +1095,6 @@ int IsVariableNamePresent(const char * source, const int * sourceLength, const c
     return 0;
 }
 
-/**
- * Replace a function definition and calls to the function to another name
- * @param source The shader as a string
- * @param sourceLength The shader length
- * @param initialName The name be to changed
- * @param finalName The name to use instead
- * @return The shader as a string, maybe in a different memory location
- */
-char * ReplaceFunctionName(char * source, int * sourceLength, char * initialName, char * finalName){
-    for(unsigned long currentPosition = 0; 1; currentPosition += strlen(initialName)){
-        unsigned long newPosition = strstrPos(source + currentPosition, initialName);
-        if(newPosition == 0) // No more calls
-            break;
-
-        // Check if that is indeed a function call on the right side
-        if (source[GetNextTokenPosition(source, currentPosition + newPosition + strlen(initialName), '(', " \n\t")] != '('){
-            currentPosition += newPosition;
-            continue; // Skip to the next potential call
-        }
-
-        // Check the naming on the left side
-        if (isValidFunctionName(source[currentPosition + newPosition - 1])){
-            currentPosition += newPosition;
-            continue; // Skip to the next potential call
-        }
-
-        // This is a valid function call/definition, replace it
-        source = InplaceReplaceByIndex(source, sourceLength, currentPosition + newPosition, currentPosition + newPosition + strlen(initialName) - 1, finalName);
-        currentPosition += newPosition;
-    }
-    return source;
-}
-
 /**
  * Remove all "uniform" keywords from uniform variables with a default initializer.
  * The default "uniform" initializer is not part of the GLSL ES specification.
@@ -1513,7 +1337,8 @@ char * SimplifyConstIntTypecasts(char * source, int * sourceLength) {
  * @return The shader as a string, probably not in a different memory location
  */
 char * SimplifyRedundantIntTypecasts(char * source, int * sourceLength) {
-    for(int i=0; i < strlen(source) - 4; ++i){
+    int length = strlen(source);
+    for(int i=0; i < length - 4; ++i){
         if(source[i] != 'i' || source[i+1] != 'n' || source[i+2] != 't' || source[i+3] != '(') continue;
         // Get the next parentheses opening
         const int secondParenthesesIndex = GetNextTokenPosition(source, i+3, '(', " int");
@@ -1530,6 +1355,7 @@ char * SimplifyRedundantIntTypecasts(char * source, int * sourceLength) {
         // Redundant parentheses found, remove them
         source = InplaceReplaceByIndex(source, sourceLength, fourthParenthesesIndex, fourthParenthesesIndex, "");
         source = InplaceReplaceByIndex(source, sourceLength, i, i+3, "");
+        length = strlen(source);
         i--;
     }
 
@@ -1543,7 +1369,8 @@ char * SimplifyRedundantIntTypecasts(char * source, int * sourceLength) {
  * @param sourceLength The length of the shader
  */
 char * SimplifyRedundantParentheses(char * source, int * sourceLength){
-    for(int i=0; i < strlen(source); ++i){
+    int length = strlen(source);
+    for(int i=0; i < length; ++i){
         if(source[i] != '(') continue;
         // Get the next parentheses opening
         const int secondParenthesesIndex = GetNextTokenPosition(source, i, '(', " ");
@@ -1560,6 +1387,7 @@ char * SimplifyRedundantParentheses(char * source, int * sourceLength){
         // Redundant parentheses found, remove them
         source = InplaceReplaceByIndex(source, sourceLength, fourthParenthesesIndex, fourthParenthesesIndex, "");
         source = InplaceReplaceByIndex(source, sourceLength, i, i, "");
+        length = strlen(source);
         i--;
     }
 
@@ -1611,9 +1439,10 @@ int GetClosingTokenPositionTokenOverride(const char * source, int initialTokenPo
     }
 
     // Step 2: Go through the string to find what we want
-    for(int i=initialTokenPosition+1; i<strlen(source); ++i){
+    const int closingTokenCount = strlen(closingTokens);
+    for(int i=initialTokenPosition+1; source[i] != '\0'; ++i){
         // Loop though all the available closing tokens first, since opening/closing tokens can be identical
-        for(int j=0; j<strlen(closingTokens); ++j){
+        for(int j=0; j<closingTokenCount; ++j){
             if (source[i] == closingTokens[j]){
                 return i;
             }
@@ -1640,17 +1469,20 @@ int GetClosingTokenPositionTokenOverride(const char * source, int initialTokenPo
  * @return
  */
 int GetNextTokenPosition(const char * source, int initialPosition, const char token, const char * acceptedChars){
-    int inverseTripping = strlen(acceptedChars) > 0 && acceptedChars[0] == '\\';
+    int acceptedCount = strlen(acceptedChars);
+    int inverseTripping = acceptedCount > 0 && acceptedChars[0] == '\\';
+    if (source[initialPosition] == '\0') return initialPosition;
 
-    for(int i=initialPosition+1; i< strlen(source); ++i){
+    // Stop at the terminator rather than measuring the whole source for every call
+    for(int i=initialPosition+1; source[i] != '\0'; ++i){
         if (source[i] == token){
             return i;
         }
 
         // Tripping check
-        if(strlen(acceptedChars) > 0){
+        if(acceptedCount > 0){
             int acceptedCharFound = 0;
-            for(int j=0; j< strlen(acceptedChars); ++j){
+            for(int j=0; j< acceptedCount; ++j){
                 if (source[i] == acceptedChars[j]) {
                     if(inverseTripping)  // Tripped, break out.
                         return initialPosition;
@@ -9,21 +9,25 @@
 
 char * ConvertShaderVgpu(char* source, int is_vertex, int second_pass);
 
+/** Overloads taking float arguments, added for the functions renamed to their vgpu_ wrapper */
+typedef struct {
+    const char * functionName;
+    const char * wrapperName;
+    const char * wrapper;
+} VgpuFunctionWrapper;
+extern const VgpuFunctionWrapper vgpuFunctionWrappers[];
+extern const int vgpuFunctionWrapperCount;
+
 char * GLSLHeader(char* source);
 char * RemoveConstInsideBlocks(char* source, int * sourceLength);
-char * ForceIntegerArrayAccess(char* source, int * sourceLength);
-char * CoerceIntToFloat(char * source, int * sourceLength);
 char * ReplaceModOperator(char * source, int * sourceLength);
 char * WrapBitShiftOperators(char * source, int *sourceLength);
 char * WrapBitwiseOrAnd(char * source, int *sourceLength);
-char * WrapIvecFunctions(char * source, int * sourceLength);
-char * WrapFunction(char * source, int * sourceLength, char * functionName, char * wrapperFunctionName, char * wrapperFunction);
 int FindPositionAfterDirectives(char * source);
 int FindPositionAfterVersion(const char * source);
 char * ReplaceGLFragData(char * source, int * sourceLength);
 char * ReplaceGLFragColor(char * source, int * sourceLength);
 char * ReplaceVariableName(char * source, int * sourceLength, char * initialName, char* newName);
-char * ReplaceFunctionName(char * source, int * sourceLength, char * initialName, char * finalName);
 char * RemoveUnsupportedExtensions(char * source);
 int doesShaderVersionContainsES(const char * source);
 char *ReplacePrecisionQualifiers(char *source, int *sourceLength, int isVertex);
@@ -0,0 +1,211 @@
+/**
+ * Created by: SerpentSpirale
+ * Copyright (c) 2025 SerpentSpirale, artDev, CADIndie.
+ * For use under LGPL-3.0
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "shadertokens.h"
+#include "../string_utils.h"
+
+// Same separators as ReplaceVariableName
+static const char * variableBefore = "{}([];+-*/~!%<>,&| \n\t";
+static const char * variableAfter = ")[];+-*/%<>;,|&. \n\t";
+
+typedef struct {
+    char * data;
+    int length;
+    int capacity;
+} OutputBuffer;
+
+static int Reserve(OutputBuffer * output, int extra) {
+    if (output->length + extra + 1 <= output->capacity) return 1;
+    int capacity = output->capacity * 2;
+    if (capacity < output->length + extra + 1) capacity = output->length + extra + 1;
+    char * data = realloc(output->data, capacity);
+    if (data == NULL) return 0;
+    output->data = data;
+    output->capacity = capacity;
+    return 1;
+}
+
+static int Emit(OutputBuffer * output, const char * text, int length) {
+    if (!Reserve(output, length)) return 0;
+    memcpy(output->data + output->length, text, length);
+    output->length += length;
+    return 1;
+}
+
+static int IsIdentifierChar(char value) {
+    return isValidFunctionName(value) || isDigit(value);
+}
+
+/**
+ * Check whether the identifier is used in the context the rule asks for
+ * @param source The shader as a string
+ * @param start The first char of the identifier
+ * @param end The char right after the identifier
+ */
+static int RuleApplies(const TokenRewrite * rule, const char * source, int start, int end) {
+    switch (rule->kind) {
+        case TOKEN_REWRITE_VARIABLE:
+            return start > 0 && strchr(variableBefore, source[start - 1]) != NULL
+                && source[end] != '\0' && strchr(variableAfter, source[end]) != NULL;
+        case TOKEN_REWRITE_FUNCTION:
+            while (source[end] == ' ' || source[end] == '\t' || source[end] == '\n' || source[end] == '\r') ++end;
+            return source[end] == '(';
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Emit an identifier, with the substring rules applied left to right
+ * @return 0 if the output could not grow
+ */
+static int EmitIdentifier(OutputBuffer * output, TokenRewriter * rewriter, const char * identifier, int length) {
+    int copied = 0;
+    for (int i = 0; i < length;) {
+        TokenRewrite * match = NULL;
+        for (int r = 0; r < rewriter->rewriteCount && match == NULL; ++r) {
+            TokenRewrite * rule = &rewriter->rewrites[r];
+            if (rule->kind != TOKEN_REWRITE_SUBSTRING) continue;
+            int nameLength = (int)strlen(rule->name);
+            if (nameLength <= length - i && memcmp(identifier + i, rule->name, nameLength) == 0) match = rule;
+        }
+        if (match == NULL) {
+            ++i;
+            continue;
+        }
+        if (!Emit(output, identifier + copied, i - copied)) return 0;
+        if (!Emit(output, match->replacement, (int)strlen(match->replacement))) return 0;
+        match->count++;
+        i += (int)strlen(match->name);
+        copied = i;
+    }
+    return Emit(output, identifier + copied, length - copied);
+}
+
+/**
+ * Length of the removed string starting at the position, 0 if there is none
+ */
+static int RemovedStringAt(const TokenRewriter * rewriter, const char * text) {
+    for (int r = 0; r < rewriter->removedStringCount; ++r) {
+        const char * removed = rewriter->removedStrings[r];
+        if (removed[0] != text[0]) continue;
+        int removedLength = (int)strlen(removed);
+        if (strncmp(text, removed, removedLength) == 0) return removedLength;
+    }
+    return 0;
+}
+
+char * RewriteShaderTokens(char * source, int * sourceLength, TokenRewriter * rewriter) {
+    int length = (int)strlen(source);
+    OutputBuffer output = { malloc(length + length / 4 + 64), 0, length + length / 4 + 64 };
+    if (output.data == NULL) {
+        fprintf(stderr, "LTW: Failed to allocate the output of RewriteShaderTokens\n");
+        return source;
+    }
+
+    int ok = 1;
+    for (int i = 0; ok && i < length;) {
+        char c = source[i];
+
+        int removed = RemovedStringAt(rewriter, source + i);
+        if (removed) {
+            i += removed;
+            continue;
+        }
+
+        if (c == '"' && rewriter->removeQuotes) {
+            ++i;
+            continue;
+        }
+
+        // Numbers in #version and #line are left alone
+        if (c == '#' && rewriter->coerceIntLiterals && (source[i + 1] == 'v' || source[i + 1] == 'l')) {
+            int end = i;
+            while (end < length && source[end] != '\n') ++end;
+            ok = Emit(&output, source + i, end - i);
+            i = end;
+            continue;
+        }
+
+        if (isValidFunctionName(c)) {
+            int end = i + 1;
+            while (IsIdentifierChar(source[end])) ++end;
+            TokenRewrite * match = NULL;
+            for (int r = 0; r < rewriter->rewriteCount && match == NULL; ++r) {
+                TokenRewrite * rule = &rewriter->rewrites[r];
+                if (rule->kind == TOKEN_REWRITE_SUBSTRING) continue;
+                if (strncmp(source + i, rule->name, end - i) != 0 || rule->name[end - i] != '\0') continue;
+                if (RuleApplies(rule, source, i, end)) match = rule;
+            }
+            if (match != NULL) {
+                match->count++;
+                ok = EmitIdentifier(&output, rewriter, match->replacement, (int)strlen(match->replacement));
+            } else {
+                ok = EmitIdentifier(&output, rewriter, source + i, end - i);
+            }
+            i = end;
+            continue;
+        }
+
+        if (isDigit(c)) {
+            // Whole number, including fractions, exponents and suffixes
+            int end = i + 1;
+            int integer = 1;
+            while (IsIdentifierChar(source[end]) || source[end] == '.'
+                   || ((source[end] == '+' || source[end] == '-') && (source[end - 1] == 'e' || source[end - 1] == 'E'))) {
+                if (!isDigit(source[end]) && !(source[end] == 'u' && !IsIdentifierChar(source[end + 1]))) integer = 0;
+                ++end;
+            }
+            if (rewriter->coerceIntLiterals && integer && (i == 0 || source[i - 1] != '.')) {
+                int digits = source[end - 1] == 'u' ? end - 1 - i : end - i;
+                ok = Emit(&output, source + i, digits) && Emit(&output, ".0", 2);
+            } else {
+                ok = Emit(&output, source + i, end - i);
+            }
+            i = end;
+            continue;
+        }
+
+        if (c == '[' && rewriter->castArrayIndices) {
+            int end = i + 1;
+            while (source[end] == ' ' || source[end] == '\n') ++end;
+            if (source[end] == ']') {
+                ok = Emit(&output, source + i, end + 1 - i);
+                i = end + 1;
+            } else {
+                ok = Emit(&output, "[int(", 5);
+                ++i;
+            }
+            continue;
+        }
+        if (c == ']' && rewriter->castArrayIndices) {
+            ok = Emit(&output, ")]", 2);
+            ++i;
+            continue;
+        }
+
+        // Everything else is copied as is, up to the next char a rule may care about
+        int end = i + 1;
+        while (end < length && !isValidFunctionName(source[end]) && !isDigit(source[end])
+               && source[end] != '"' && source[end] != '#' && source[end] != '[' && source[end] != ']'
+               && (rewriter->removedStringCount == 0 || RemovedStringAt(rewriter, source + end) == 0)) ++end;
+        ok = Emit(&output, source + i, end - i);
+        i = end;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "LTW: Failed to grow the output of RewriteShaderTokens\n");
+        free(output.data);
+        return source;
+    }
+    output.data[output.length] = '\0';
+    free(source);
+    // Only the text is reported, passes that scan up to *sourceLength stay within it
+    *sourceLength = output.length + 1;
+    return output.data;
+}
@@ -0,0 +1,42 @@
+/**
+ * Created by: SerpentSpirale
+ * Copyright (c) 2025 SerpentSpirale, artDev, CADIndie.
+ * For use under LGPL-3.0
+ */
+
+#ifndef UNTITLED_SHADERTOKENS_H
+#define UNTITLED_SHADERTOKENS_H
+
+typedef enum {
+    TOKEN_REWRITE_VARIABLE,   // Whole identifier between the ReplaceVariableName separators
+    TOKEN_REWRITE_FUNCTION,   // Whole identifier followed by '(', calls and definitions
+    TOKEN_REWRITE_SUBSTRING,  // Any part of an identifier, like "ivec" in "ivec3"
+} TokenRewriteKind;
+
+typedef struct {
+    TokenRewriteKind kind;
+    const char * name;
+    const char * replacement;
+    int count;                // Replacements made, filled in by RewriteShaderTokens
+} TokenRewrite;
+
+typedef struct {
+    TokenRewrite * rewrites;  // Identifier rules, the first matching one wins
+    int rewriteCount;
+    const char * const * removedStrings; // Removed verbatim wherever they appear
+    int removedStringCount;
+    int removeQuotes;         // Drop '"' characters
+    int coerceIntLiterals;    // 1 -> 1.0 and 1u -> 1.0, outside of #version and #line
+    int castArrayIndices;     // a[i] -> a[int(i)], empty [] are left alone
+} TokenRewriter;
+
+/**
+ * Apply all the rules of the rewriter in a single pass over the shader
+ * Every rule looks at the original source only, output is never scanned again
+ * @param source The shader as a string, freed
+ * @param sourceLength Receives the allocated length of the result
+ * @return The rewritten shader, in a different memory location
+ */
+char * RewriteShaderTokens(char * source, int * sourceLength, TokenRewriter * rewriter);
+
+#endif //UNTITLED_SHADERTOKENS_H